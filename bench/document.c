@@ -0,0 +1,258 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "lines.h"
+#include "document.h"
+
+
+
+/**
+ * The number of lines in the benchmarked document, unless given on the command line
+ */
+#define  BENCH_LINES  2000000
+
+/**
+ * The number of each operation that is timed, unless given on the command line
+ */
+#define  BENCH_OPERATIONS  1000
+
+
+
+/**
+ * The lines as a single flat array, as frames stored them before documents
+ */
+typedef struct flat
+{
+  /**
+   * The lines
+   */
+  line_buffer_t* line_buffers;
+  
+  /**
+   * The number of lines
+   */
+  pos_t count;
+  
+  /**
+   * The number of lines that fit in `line_buffers`
+   */
+  pos_t allocated;
+  
+} flat_t;
+
+
+
+/**
+ * The state of the pseudorandom generator that picks the rows
+ */
+static uint_least32_t seed = 1;
+
+/**
+ * Sum of the lengths of the lines that have been jumped to,
+ * printed so that the lookups cannot be optimised away
+ */
+static pos_t checksum = 0;
+
+
+
+/**
+ * Get the current time in seconds
+ * 
+ * @return  The time on a monotonic clock
+ */
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)(ts.tv_sec) + (double)(ts.tv_nsec) / (double)1000000000;
+}
+
+
+/**
+ * Pick a random row
+ * 
+ * @param   count  The number of rows to pick from
+ * @return         The row
+ */
+static pos_t random_row(pos_t count)
+{
+  seed = seed * 1103515245 + 12345;
+  return (pos_t)((((size_t)seed >> 1) * 4099) % (size_t)count);
+}
+
+
+/**
+ * Create a line that is a view of ASCII text, as lines that have not been edited are
+ * 
+ * @param  lbuf  Output parameter for the line
+ * @param  text  The text of the line
+ */
+static void make_line(line_buffer_t* lbuf, const char* text)
+{
+  memset(lbuf, 0, sizeof(line_buffer_t));
+  lbuf->raw = text;
+  lbuf->raw_size = strlen(text);
+  lbuf->used = (pos_t)(lbuf->raw_size);
+}
+
+
+/**
+ * Insert a line into a flat array
+ * 
+ * @param  flat  The array
+ * @param  row   The index the line shall have
+ * @param  lbuf  The line
+ */
+static void flat_insert(flat_t* flat, pos_t row, const line_buffer_t* lbuf)
+{
+  if (flat->count == flat->allocated)
+    {
+      flat->allocated = flat->allocated ? flat->allocated << 1 : 64;
+      flat->line_buffers = realloc(flat->line_buffers, (size_t)(flat->allocated) * sizeof(line_buffer_t));
+    }
+  memmove(flat->line_buffers + row + 1, flat->line_buffers + row,
+	  (size_t)(flat->count - row) * sizeof(line_buffer_t));
+  *(flat->line_buffers + row) = *lbuf;
+  flat->count++;
+}
+
+
+/**
+ * Remove a line from a flat array
+ * 
+ * @param  flat  The array
+ * @param  row   The index of the line
+ */
+static void flat_remove(flat_t* flat, pos_t row)
+{
+  free_line(flat->line_buffers + row);
+  flat->count--;
+  memmove(flat->line_buffers + row, flat->line_buffers + row + 1,
+	  (size_t)(flat->count - row) * sizeof(line_buffer_t));
+}
+
+
+/**
+ * Report the time an operation took
+ * 
+ * @param  name        The name of the operation
+ * @param  operations  The number of times it was performed
+ * @param  document    The number of seconds it took on the document
+ * @param  flat        The number of seconds it took on the flat array
+ */
+static void report(const char* name, long operations, double document, double flat)
+{
+  printf("%-8s %10.3f µs %12.3f µs %9.1fx\n", name,
+	 document * (double)1000000 / (double)operations, flat * (double)1000000 / (double)operations, flat / document);
+}
+
+
+/**
+ * Benchmark editing a document with millions of lines against editing a flat array
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The command line arguments, optionally the number of
+ *                lines and the number of each operation that is timed
+ * @return        Exit value, 0 on success
+ */
+int main(int argc, char** argv)
+{
+  pos_t lines = argc > 1 ? (pos_t)atol(*(argv + 1)) : BENCH_LINES;
+  long operations = argc > 2 ? atol(*(argv + 2)) : BENCH_OPERATIONS;
+  const char* text = "  return document_line(&(frame->document), row);";
+  const char* inserted = "  /* An inserted line */";
+  document_t doc;
+  flat_t flat;
+  line_buffer_t lbuf;
+  double start, document_time, flat_time;
+  pos_t i;
+  long j;
+  
+  if ((lines <= 0) || (operations <= 0))
+    {
+      fprintf(stderr, "Usage: %s [LINES [OPERATIONS]]\n", *argv);
+      return 1;
+    }
+  
+  document_create(&doc);
+  flat.line_buffers = NULL;
+  flat.count = flat.allocated = 0;
+  
+  start = now();
+  for (i = 0; i < lines; i++)
+    make_line(&lbuf, text), document_append(&doc, &lbuf);
+  document_time = now() - start;
+  start = now();
+  for (i = 0; i < lines; i++)
+    make_line(&lbuf, text), flat_insert(&flat, i, &lbuf);
+  flat_time = now() - start;
+  
+  printf("%li lines, %li of each operation\n", (long)lines, operations);
+  printf("%-8s %13s %15s %10s\n", "", "document", "flat array", "speedup");
+  report("append", (long)lines, document_time, flat_time);
+  
+  /* Both get the same rows */
+  seed = 1, start = now();
+  for (j = 0; j < operations; j++)
+    make_line(&lbuf, inserted), document_insert(&doc, random_row(document_lines(&doc) + 1), &lbuf);
+  document_time = now() - start;
+  seed = 1, start = now();
+  for (j = 0; j < operations; j++)
+    make_line(&lbuf, inserted), flat_insert(&flat, random_row(flat.count + 1), &lbuf);
+  flat_time = now() - start;
+  report("insert", operations, document_time, flat_time);
+  
+  seed = 2, start = now();
+  for (j = 0; j < operations; j++)
+    document_remove(&doc, random_row(document_lines(&doc)));
+  document_time = now() - start;
+  seed = 2, start = now();
+  for (j = 0; j < operations; j++)
+    flat_remove(&flat, random_row(flat.count));
+  flat_time = now() - start;
+  report("delete", operations, document_time, flat_time);
+  
+  seed = 3, start = now();
+  for (j = 0; j < operations; j++)
+    checksum += document_line(&doc, random_row(document_lines(&doc)))->used;
+  document_time = now() - start;
+  seed = 3, start = now();
+  for (j = 0; j < operations; j++)
+    checksum -= (flat.line_buffers + random_row(flat.count))->used;
+  flat_time = now() - start;
+  report("jump", operations, document_time, flat_time);
+  
+  if (checksum || (document_lines(&doc) != flat.count))
+    {
+      fprintf(stderr, "The document and the flat array differ\n");
+      return 1;
+    }
+  
+  document_free(&doc);
+  for (i = 0; i < flat.count; i++)
+    free_line(flat.line_buffers + i);
+  free(flat.line_buffers);
+  return 0;
+}
+
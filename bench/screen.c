@@ -0,0 +1,172 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "types.h"
+#include "screen.h"
+#include "glyph.h"
+
+
+
+/**
+ * The number of rows on the benchmarked screen
+ */
+#define  BENCH_ROWS  60
+
+/**
+ * The number of columns on the benchmarked screen
+ */
+#define  BENCH_COLS  200
+
+/**
+ * The number of frames rendered in each pass, unless given on the command line
+ */
+#define  BENCH_FRAMES  2000
+
+
+
+/**
+ * The text the frames are drawn from, a mix of highlighted source,
+ * non-ASCII, double-width and combining characters
+ */
+static const char_t sample[] =
+  {
+    'i', 'n', 't', ' ', 'm', 'a', 'i', 'n', '(', 'v', 'o', 'i', 'd', ')', ' ', '{', ' ',
+    'r', 'e', 't', 'u', 'r', 'n', ' ', '"', 'h', 0xE9, 'l', 'l', 'o', '"', ';', ' ',
+    '/', '*', ' ', 0x65E5, 0x672C, 0x8A9E, ' ', 'e', 0x0301, ' ', '*', '/', ' ', '}', ' ',
+    '#', 'd', 'e', 'f', 'i', 'n', 'e', ' ', 'X', ' ', '4', '2', ' ', ' ', ' ', ' '
+  };
+
+/**
+ * The attributes of the characters in `sample`
+ */
+static int sample_attr[sizeof(sample) / sizeof(*sample)];
+
+
+
+/**
+ * Get the current time in seconds
+ * 
+ * @return  The time on a monotonic clock
+ */
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)(ts.tv_sec) + (double)(ts.tv_nsec) / (double)1000000000;
+}
+
+
+/**
+ * Draw a frame of text
+ * 
+ * @param  shift  How many characters the text is shifted, frames with
+ *                different shifts differ in almost every cell
+ */
+static void draw(pos_t shift)
+{
+  pos_t n = (pos_t)(sizeof(sample) / sizeof(*sample));
+  
+  screen_clear();
+  for (pos_t row = 0; row < BENCH_ROWS - 2; row++)
+    {
+      pos_t i = (shift + row * 7) % n;
+      for (pos_t col = 0; col < BENCH_COLS; i = (i + 1) % n)
+	col += screen_put(row, col, *(sample + i), *(sample_attr + i));
+    }
+  
+  /* The mode line and the minibuffer */
+  screen_fill(BENCH_ROWS - 2, 0, BENCH_COLS, ATTR_REVERSE);
+  screen_print(BENCH_ROWS - 2, 1, "-UU-:----F1  bench.c  \033[1mAll\033[0m (1,0)", ATTR_REVERSE);
+  screen_print(BENCH_ROWS - 1, 0, "Rendering frames", 0);
+}
+
+
+/**
+ * Render frames and report how many were rendered per second
+ * 
+ * @param  name    The name of the pass
+ * @param  frames  The number of frames to render
+ * @param  step    How much the text is shifted between frames, 0 to redraw the same frame
+ * @param  out     Where the report is written
+ */
+static void pass(const char* name, long frames, pos_t step, FILE* out)
+{
+  double start, elapsed;
+  
+  draw(0);
+  screen_flush(0, 0);
+  
+  start = now();
+  for (long i = 1; i <= frames; i++)
+    {
+      draw((pos_t)i * step);
+      screen_flush(BENCH_ROWS - 1, 16);
+    }
+  elapsed = now() - start;
+  
+  fprintf(out, "%-10s %ld frames of %ix%i in %.3f s: %.1f FPS, %.1f µs per frame\n",
+	  name, frames, BENCH_COLS, BENCH_ROWS, elapsed,
+	  (double)frames / elapsed, elapsed * (double)1000000 / (double)frames);
+}
+
+
+/**
+ * Benchmark rendering full frames to /dev/null
+ * 
+ * @param   argc  The number of elements in `argv`
+ * @param   argv  The command line arguments, optionally the number of frames in each pass
+ * @return        Exit value, 0 on success
+ */
+int main(int argc, char** argv)
+{
+  long frames = argc > 1 ? atol(*(argv + 1)) : BENCH_FRAMES;
+  int null = open("/dev/null", O_WRONLY);
+  int report = dup(STDOUT_FILENO);
+  FILE* out;
+  
+  if ((frames <= 0) || (null < 0) || (report < 0) || ((out = fdopen(report, "w")) == NULL))
+    {
+      fprintf(stderr, "Usage: %s [FRAMES]\n", *argv);
+      return 1;
+    }
+  
+  /* Highlight the sample like the C mode would */
+  for (size_t i = 0; i < sizeof(sample) / sizeof(*sample); i++)
+    *(sample_attr + i) = i < 3 ? ATTR_FG(2) : i < 24 ? 0 : i < 31 ? ATTR_FG(1) :
+			 i < 33 ? 0 : i < 47 ? ATTR_FG(4) : ATTR_FG(5) | ATTR_BOLD;
+  
+  /* The screen writes to standard output */
+  dup2(null, STDOUT_FILENO);
+  close(null);
+  
+  screen_create(BENCH_ROWS, BENCH_COLS);
+  pass("changed", frames, 1, out);
+  pass("unchanged", frames, 0, out);
+  screen_free();
+  glyph_free();
+  
+  fclose(out);
+  return 0;
+}
+
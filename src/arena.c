@@ -0,0 +1,143 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "arena.h"
+
+
+
+/**
+ * Create an empty arena
+ * 
+ * @param  arena  The arena
+ */
+void arena_create(arena_t* arena)
+{
+  arena->blocks = NULL;
+}
+
+
+/**
+ * Allocate memory in an arena
+ * 
+ * @param   arena  The arena
+ * @param   size   The number of bytes to allocate
+ * @return         The allocated memory, suitably aligned for any type
+ */
+void* arena_alloc(arena_t* arena, size_t size)
+{
+  arena_block_t* block = arena->blocks;
+  
+  /* Keep all allocations aligned */
+  size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+  
+  if ((block == NULL) || (block->size - block->used < size))
+    {
+      /* Large allocations get a block of their own, behind the block being filled */
+      size_t block_size = size > ARENA_BLOCK / 4 ? size : ARENA_BLOCK;
+      block = malloc(sizeof(arena_block_t) + block_size);
+      block->size = block_size;
+      block->used = 0;
+      if ((block_size != ARENA_BLOCK) && arena->blocks)
+	{
+	  block->next = arena->blocks->next;
+	  arena->blocks->next = block;
+	}
+      else
+	{
+	  block->next = arena->blocks;
+	  arena->blocks = block;
+	}
+    }
+  
+  block->used += size;
+  return (char*)(block->data) + block->used - size;
+}
+
+
+/**
+ * Release all memory in an arena
+ * 
+ * @param  arena  The arena
+ */
+void arena_free(arena_t* arena)
+{
+  arena_block_t* block = arena->blocks;
+  while (block)
+    {
+      arena_block_t* next = block->next;
+      free(block);
+      block = next;
+    }
+  arena->blocks = NULL;
+}
+
+
+/**
+ * Create an empty slab
+ * 
+ * @param  slab  The slab
+ * @param  size  The size of each object
+ */
+void slab_create(slab_t* slab, size_t size)
+{
+  arena_create(&(slab->arena));
+  slab->free_list = NULL;
+  slab->size = size < sizeof(void*) ? sizeof(void*) : size;
+}
+
+
+/**
+ * Allocate an object in a slab
+ * 
+ * @param   slab  The slab
+ * @return        The allocated object
+ */
+void* slab_alloc(slab_t* slab)
+{
+  void* object = slab->free_list;
+  if (object == NULL)
+    return arena_alloc(&(slab->arena), slab->size);
+  slab->free_list = *(void**)object;
+  return object;
+}
+
+
+/**
+ * Return an object to a slab so that it can be reused
+ * 
+ * @param  slab    The slab
+ * @param  object  The object
+ */
+void slab_release(slab_t* slab, void* object)
+{
+  *(void**)object = slab->free_list;
+  slab->free_list = object;
+}
+
+
+/**
+ * Release all objects in a slab
+ * 
+ * @param  slab  The slab
+ */
+void slab_free(slab_t* slab)
+{
+  arena_free(&(slab->arena));
+  slab->free_list = NULL;
+}
+
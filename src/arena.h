@@ -0,0 +1,160 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "types.h"
+
+
+/**
+ * The size of the blocks an arena allocates its memory in
+ */
+#ifndef ARENA_BLOCK
+#define ARENA_BLOCK  (64 << 10)
+#endif
+
+
+
+/**
+ * A block of memory in an arena
+ */
+typedef struct arena_block
+{
+  /**
+   * The next block in the arena, `NULL` if none
+   */
+  struct arena_block* next;
+  
+  /**
+   * The number of bytes in `data`
+   */
+  size_t size;
+  
+  /**
+   * The number of allocated bytes in `data`
+   */
+  size_t used;
+  
+  /**
+   * The memory of the block
+   */
+  max_align_t data[];
+  
+} arena_block_t;
+
+
+/**
+ * Allocator from which memory is never released
+ * individually, but all at once when it is freed
+ */
+typedef struct arena
+{
+  /**
+   * The blocks of the arena, the first block is the one being filled
+   */
+  arena_block_t* blocks;
+  
+} arena_t;
+
+
+/**
+ * Allocator of equally sized objects, backed by an arena
+ */
+typedef struct slab
+{
+  /**
+   * The arena the objects are allocated in
+   */
+  arena_t arena;
+  
+  /**
+   * Released objects, linked through their first bytes, `NULL` if none
+   */
+  void* free_list;
+  
+  /**
+   * The size of each object
+   */
+  size_t size;
+  
+} slab_t;
+
+
+
+/**
+ * Create an empty arena
+ * 
+ * @param  arena  The arena
+ */
+void arena_create(arena_t* arena);
+
+/**
+ * Allocate memory in an arena
+ * 
+ * @param   arena  The arena
+ * @param   size   The number of bytes to allocate
+ * @return         The allocated memory, suitably aligned for any type
+ */
+void* arena_alloc(arena_t* arena, size_t size) __attribute__((malloc));
+
+/**
+ * Release all memory in an arena
+ * 
+ * @param  arena  The arena
+ */
+void arena_free(arena_t* arena);
+
+/**
+ * Create an empty slab
+ * 
+ * @param  slab  The slab
+ * @param  size  The size of each object
+ */
+void slab_create(slab_t* slab, size_t size);
+
+/**
+ * Allocate an object in a slab
+ * 
+ * @param   slab  The slab
+ * @return        The allocated object
+ */
+void* slab_alloc(slab_t* slab) __attribute__((malloc));
+
+/**
+ * Return an object to a slab so that it can be reused
+ * 
+ * @param  slab    The slab
+ * @param  object  The object
+ */
+void slab_release(slab_t* slab, void* object);
+
+/**
+ * Release all objects in a slab
+ * 
+ * @param  slab  The slab
+ */
+void slab_free(slab_t* slab);
+
+
+#endif
+
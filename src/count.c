@@ -0,0 +1,352 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "count.h"
+
+
+
+/**
+ * Protects the state of the threads that count occurrences
+ */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signals that a step of a count has been started
+ */
+static pthread_cond_t step_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Signals that the threads are done with the step of a count
+ */
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Whether the threads that count occurrences have been started
+ */
+static int pool_started = 0;
+
+/**
+ * The number of threads that count occurrences, besides the calling thread
+ */
+static size_t workers = 0;
+
+/**
+ * The number of steps that have been started, a thread takes part in a step when this changes
+ */
+static unsigned long steps = 0;
+
+/**
+ * The number of threads that are not done with the current step
+ */
+static size_t busy = 0;
+
+/**
+ * The count of the current step
+ */
+static count_t* step_count;
+
+/**
+ * The pattern of the current step
+ */
+static const search_pattern_t* step_pattern;
+
+/**
+ * The document of the current step
+ */
+static const document_t* step_doc;
+
+
+
+/**
+ * Count the occurrences in the parts of the current step until
+ * they have all been taken, by this thread or by another thread
+ * 
+ * @param  count    The count
+ * @param  pattern  The pattern
+ * @param  doc      The document
+ */
+static void count_parts(count_t* count, const search_pattern_t* pattern, const document_t* doc)
+{
+  count_part_t* part;
+  size_t i;
+  
+  while ((i = __atomic_fetch_add(&(count->next), 1, __ATOMIC_RELAXED)) < count->limit)
+    {
+      part = count->parts + i;
+      if (part->run)
+	part->count = search_count_run(pattern, part->run, part->end);
+      else
+	part->count = search_count_rows(pattern, doc, part->first, part->stop);
+    }
+}
+
+
+/**
+ * Take part in the steps of counts, forever
+ * 
+ * @param   arg  Not used
+ * @return       Never returns
+ */
+static void* count_steps(void* arg)
+{
+  unsigned long seen = 0;
+  
+  (void) arg;
+  pthread_mutex_lock(&pool_mutex);
+  for (;;)
+    {
+      while (steps == seen)
+	pthread_cond_wait(&step_cond, &pool_mutex);
+      seen = steps;
+      pthread_mutex_unlock(&pool_mutex);
+      
+      count_parts(step_count, step_pattern, step_doc);
+      
+      pthread_mutex_lock(&pool_mutex);
+      if (--busy == 0)
+	pthread_cond_signal(&done_cond);
+    }
+  
+  return NULL;
+}
+
+
+/**
+ * Start one thread per processor, the calling thread is one of them
+ */
+static void start_pool(void)
+{
+  pthread_t thread;
+  long cpus;
+  size_t n;
+  
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  n = cpus > 1 ? (size_t)cpus : 1;
+  n = n < COUNT_THREADS ? n : COUNT_THREADS;
+  
+  pthread_mutex_lock(&pool_mutex);
+  for (; workers + 1 < n; workers++)
+    {
+      if (pthread_create(&thread, NULL, count_steps, NULL))
+	break;
+      pthread_detach(thread);
+    }
+  pthread_mutex_unlock(&pool_mutex);
+  pool_started = 1;
+}
+
+
+/**
+ * Add a part to a count
+ * 
+ * @param  count      The count
+ * @param  allocated  The number of parts that fit in the count, updated if the parts are reallocated
+ * @param  part       The part
+ */
+static void add_part(count_t* count, size_t* allocated, count_part_t part)
+{
+  if (count->n == *allocated)
+    count->parts = realloc(count->parts, (*allocated <<= 1) * sizeof(count_part_t));
+  part.count = 0;
+  *(count->parts + count->n++) = part;
+}
+
+
+
+/**
+ * Start counting the occurrences of a pattern in a document
+ * 
+ * @param  count    Output parameter for the count
+ * @param  pattern  The pattern, must not be empty
+ * @param  doc      The document
+ * @param  clean    The number of lines at the beginning of the document that are well-formed views
+ *                  into the file, back to back, see `clean_lines`
+ */
+void count_start(count_t* count, const search_pattern_t* pattern, const document_t* doc, pos_t clean)
+{
+  pos_t lines = document_lines(doc), r;
+  size_t allocated = 16;
+  line_buffer_t* lbuf;
+  count_part_t part;
+  const char* end;
+  const char* cut;
+  
+  count->chars = malloc((size_t)(pattern->length) * sizeof(char_t));
+  memcpy(count->chars, pattern->chars, (size_t)(pattern->length) * sizeof(char_t));
+  count->length = pattern->length;
+  count->regexp = pattern->regexp != NULL;
+  count->parts = malloc(allocated * sizeof(count_part_t));
+  count->n = count->next = count->limit = count->total = 0;
+  count->clean = 0;
+  
+  /* Lines that have not been edited are split into blocks of bytes at line feeds, without being looked at */
+  if (clean > 0)
+    {
+      part.run = document_line(doc, 0)->raw;
+      lbuf = document_line(doc, clean - 1);
+      end = lbuf->raw ? lbuf->raw + lbuf->raw_size : NULL;
+      if (part.run && end)
+	{
+	  count->clean = clean;
+	  part.first = part.stop = 0;
+	  for (; part.run < end; part.run = part.end + 1)
+	    {
+	      cut = (size_t)(end - part.run) > COUNT_BLOCK ? part.run + COUNT_BLOCK : end;
+	      part.end = cut < end ? memchr(cut, '\n', (size_t)(end - cut)) : NULL;
+	      part.end = part.end ? part.end : end;
+	      add_part(count, &allocated, part);
+	    }
+	}
+    }
+  
+  /* The rest of the lines are split into ranges of lines */
+  part.run = part.end = NULL;
+  for (r = count->clean; r < lines; r = part.stop)
+    {
+      part.first = r;
+      part.stop = lines - r > COUNT_LINES ? r + COUNT_LINES : lines;
+      add_part(count, &allocated, part);
+    }
+}
+
+
+/**
+ * Release the resources of a count
+ * 
+ * @param  count  The count
+ */
+void count_free(count_t* count)
+{
+  free(count->chars);
+  free(count->parts);
+  count->chars = NULL;
+  count->parts = NULL;
+  count->n = count->next = count->limit = 0;
+}
+
+
+/**
+ * Count a few parts of the document, on one thread per processor
+ * 
+ * @param   count    The count
+ * @param   pattern  The pattern, as when the count was started
+ * @param   doc      The document, unchanged since the count was started
+ * @return           Whether the count is complete
+ */
+int count_step(count_t* count, const search_pattern_t* pattern, const document_t* doc)
+{
+  size_t first = count->next, i, n;
+  
+  if (count_done(count))
+    return 1;
+  if (!pool_started)
+    start_pool();
+  
+  /* The threads are done with the document when the step is, so it may be edited between steps */
+  n = (workers + 1) * COUNT_SLICE;
+  count->limit = count->n - first > n ? first + n : count->n;
+  if (workers)
+    {
+      pthread_mutex_lock(&pool_mutex);
+      step_count = count;
+      step_pattern = pattern;
+      step_doc = doc;
+      busy = workers;
+      steps++;
+      pthread_cond_broadcast(&step_cond);
+      pthread_mutex_unlock(&pool_mutex);
+    }
+  count_parts(count, pattern, doc);
+  if (workers)
+    {
+      pthread_mutex_lock(&pool_mutex);
+      while (busy)
+	pthread_cond_wait(&done_cond, &pool_mutex);
+      pthread_mutex_unlock(&pool_mutex);
+    }
+  
+  /* Every thread overshoots the last part by one when it takes its last part */
+  count->next = count->limit;
+  for (i = first; i < count->limit; i++)
+    count->total += (count->parts + i)->count;
+  return count_done(count);
+}
+
+
+/**
+ * Check whether a count is complete
+ * 
+ * @param   count  The count
+ * @return         Whether the count is complete
+ */
+int count_done(const count_t* count)
+{
+  return count->parts && (count->next == count->n);
+}
+
+
+/**
+ * Get how much of a count is complete
+ * 
+ * @param   count  The count
+ * @return         The percentage of the parts that have been counted
+ */
+int count_progress(const count_t* count)
+{
+  return count->n ? (int)(count->next * 100 / count->n) : 100;
+}
+
+
+/**
+ * Get the number of occurrences that start before a position, in a complete count
+ * 
+ * @param   count    The count
+ * @param   pattern  The pattern, as when the count was started
+ * @param   doc      The document, unchanged since the count was started
+ * @param   row      The line of the position
+ * @param   column   The column of the position
+ * @return           The number of occurrences that start before the position
+ */
+size_t count_before(const count_t* count, const search_pattern_t* pattern, const document_t* doc,
+		    pos_t row, pos_t column)
+{
+  line_buffer_t* lbuf = document_line(doc, row);
+  const count_part_t* part = count->parts;
+  const count_part_t* parts_end = count->parts + count->n;
+  size_t before = 0;
+  
+  if (row < count->clean)
+    {
+      /* The line is in a block of bytes, which ends at a line feed or at the end of the blocks */
+      for (; (part != parts_end) && part->run && (part->end < lbuf->raw); part++)
+	before += part->count;
+      if ((part == parts_end) || (part->run == NULL))
+	return before;
+      if (part->run < lbuf->raw)
+	before += search_count_run(pattern, part->run, lbuf->raw - 1);
+      return before + search_count_line(pattern, lbuf, column);
+    }
+  
+  for (; (part != parts_end) && (part->run || (part->stop <= row)); part++)
+    before += part->count;
+  if (part == parts_end)
+    return before;
+  before += search_count_rows(pattern, doc, part->first, row);
+  return before + search_count_line(pattern, lbuf, column);
+}
+
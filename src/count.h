@@ -0,0 +1,215 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __COUNT_H__
+#define __COUNT_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "utf8.h"
+#include "lines.h"
+#include "document.h"
+#include "search.h"
+
+
+
+/**
+ * The maximum number of threads to count occurrences with, including the calling thread
+ */
+#ifndef COUNT_THREADS
+#define COUNT_THREADS  64
+#endif
+
+/**
+ * The number of bytes of unedited lines in each part of a count
+ */
+#ifndef COUNT_BLOCK
+#define COUNT_BLOCK  (1 << 20)
+#endif
+
+/**
+ * The number of edited lines in each part of a count
+ */
+#ifndef COUNT_LINES
+#define COUNT_LINES  (1 << 12)
+#endif
+
+/**
+ * The number of parts each thread counts in a step of a count
+ */
+#ifndef COUNT_SLICE
+#define COUNT_SLICE  16
+#endif
+
+
+
+/**
+ * A part of a document that is counted on its own, parts never split lines
+ */
+typedef struct count_part
+{
+  /**
+   * The content of the first line if the part is unedited lines
+   * that are back to back in the file, otherwise `NULL`
+   */
+  const char* run;
+  
+  /**
+   * The end of the content of the last line if `run` is not `NULL`
+   */
+  const char* end;
+  
+  /**
+   * The first line of the part if `run` is `NULL`
+   */
+  pos_t first;
+  
+  /**
+   * The line after the last line of the part if `run` is `NULL`
+   */
+  pos_t stop;
+  
+  /**
+   * The number of occurrences in the part, once it has been counted
+   */
+  size_t count;
+  
+} count_part_t;
+
+
+/**
+ * A count of the occurrences of a pattern in a document, the document must not
+ * be modified until the count has been released, but may be modified between steps
+ * if the count is released and started over afterwards
+ */
+typedef struct count
+{
+  /**
+   * The characters of the pattern that is counted
+   */
+  char_t* chars;
+  
+  /**
+   * The number of characters in `chars`
+   */
+  pos_t length;
+  
+  /**
+   * Whether the pattern that is counted is a regular expression
+   */
+  int regexp;
+  
+  /**
+   * The number of lines at the beginning of the document that are counted as one byte range
+   */
+  pos_t clean;
+  
+  /**
+   * The parts of the document, in order
+   */
+  count_part_t* parts;
+  
+  /**
+   * The number of elements in `parts`
+   */
+  size_t n;
+  
+  /**
+   * The number of parts that have been counted, or are being counted
+   */
+  size_t next;
+  
+  /**
+   * The number of parts that will have been counted when the current step is done
+   */
+  size_t limit;
+  
+  /**
+   * The number of occurrences in the parts that have been counted
+   */
+  size_t total;
+  
+} count_t;
+
+
+
+/**
+ * Start counting the occurrences of a pattern in a document
+ * 
+ * @param  count    Output parameter for the count
+ * @param  pattern  The pattern, must not be empty
+ * @param  doc      The document
+ * @param  clean    The number of lines at the beginning of the document that are well-formed views
+ *                  into the file, back to back, see `clean_lines`
+ */
+void count_start(count_t* count, const search_pattern_t* pattern, const document_t* doc, pos_t clean);
+
+/**
+ * Release the resources of a count
+ * 
+ * @param  count  The count
+ */
+void count_free(count_t* count);
+
+/**
+ * Count a few parts of the document, on one thread per processor
+ * 
+ * @param   count    The count
+ * @param   pattern  The pattern, as when the count was started
+ * @param   doc      The document, unchanged since the count was started
+ * @return           Whether the count is complete
+ */
+int count_step(count_t* count, const search_pattern_t* pattern, const document_t* doc);
+
+/**
+ * Check whether a count is complete
+ * 
+ * @param   count  The count
+ * @return         Whether the count is complete
+ */
+int count_done(const count_t* count) __attribute__((pure));
+
+/**
+ * Get how much of a count is complete
+ * 
+ * @param   count  The count
+ * @return         The percentage of the parts that have been counted
+ */
+int count_progress(const count_t* count) __attribute__((pure));
+
+/**
+ * Get the number of occurrences that start before a position, in a complete count
+ * 
+ * @param   count    The count
+ * @param   pattern  The pattern, as when the count was started
+ * @param   doc      The document, unchanged since the count was started
+ * @param   row      The line of the position
+ * @param   column   The column of the position
+ * @return           The number of occurrences that start before the position
+ */
+size_t count_before(const count_t* count, const search_pattern_t* pattern, const document_t* doc,
+		    pos_t row, pos_t column);
+
+
+#endif
+
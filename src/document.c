@@ -0,0 +1,802 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "document.h"
+
+
+/**
+ * Held while a block is indexed, lines can be looked up on multiple threads
+ */
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/**
+ * Get the number of lines in a subtree
+ * 
+ * @param   node  The subtree, may be `NULL`
+ * @return        The number of lines in the subtree
+ */
+static pos_t lines_of(const document_node_t* node)
+{
+  return node ? node->lines : 0;
+}
+
+
+/**
+ * Get the number of characters, excluding line breaks, in a subtree
+ * 
+ * @param   node  The subtree, may be `NULL`
+ * @return        The number of characters in the subtree
+ */
+static pos_t chars_of(const document_node_t* node)
+{
+  return node ? node->chars : 0;
+}
+
+
+/**
+ * Recalculate the aggregated counts of a node from its children
+ * 
+ * @param  node  The node
+ */
+static void update(document_node_t* node)
+{
+  node->lines = lines_of(node->left) + node->count + lines_of(node->right);
+  node->chars = chars_of(node->left) + node->count_chars + chars_of(node->right);
+}
+
+
+/**
+ * Create an empty chunk
+ * 
+ * @param   doc    The document the chunk will belong to
+ * @param   block  Whether the chunk shall be a block, whose lines are allocated separately
+ * @return         The chunk
+ */
+static document_node_t* create_node(document_t* doc, int block)
+{
+  document_node_t* node = slab_alloc(block ? &(doc->blocks) : &(doc->nodes));
+  
+  /* xorshift32 */
+  doc->seed ^= doc->seed << 13;
+  doc->seed ^= doc->seed >> 17;
+  doc->seed ^= doc->seed << 5;
+  
+  node->left = NULL;
+  node->right = NULL;
+  node->priority = doc->seed;
+  node->lines = 0;
+  node->chars = 0;
+  node->count = 0;
+  node->count_chars = 0;
+  node->line_buffers = block ? NULL : (line_buffer_t*)(void*)(node + 1);
+  node->raw = NULL;
+  node->raw_size = 0;
+  node->malformed = -1;
+  node->used = doc->epoch;
+  return node;
+}
+
+
+/**
+ * Get the lines in a chunk, indexing them if it is a block that has not been indexed
+ * 
+ * @param   doc   The document
+ * @param   node  The chunk
+ * @return        The lines in the chunk
+ */
+static line_buffer_t* chunk_lines(const document_t* doc, document_node_t* node)
+{
+  line_buffer_t* lbufs = __atomic_load_n(&(node->line_buffers), __ATOMIC_ACQUIRE);
+  const char* start = node->raw;
+  const char* end = node->raw + node->raw_size;
+  size_t n;
+  
+  /* Remember that the block is in use, so that it is kept when the document is trimmed */
+  if (node->raw && (__atomic_load_n(&(node->used), __ATOMIC_RELAXED) != doc->epoch))
+    __atomic_store_n(&(node->used), doc->epoch, __ATOMIC_RELAXED);
+  if (lbufs)
+    return lbufs;
+  
+  pthread_mutex_lock(&index_mutex);
+  if ((lbufs = node->line_buffers) == NULL)
+    {
+      lbufs = malloc((size_t)(node->count) * sizeof(line_buffer_t));
+      for (pos_t i = 0; i < node->count; i++)
+	{
+	  /* Stay within the block even if it has fewer lines than it claims */
+	  n = view_line(lbufs + i, start, end);
+	  start += start + n < end ? n + 1 : n;
+	}
+      __atomic_store_n(&(node->line_buffers), lbufs, __ATOMIC_RELEASE);
+    }
+  pthread_mutex_unlock(&index_mutex);
+  return lbufs;
+}
+
+
+/**
+ * Release the lines, that are not in the arena, in a chunk and, recursively, its subtrees
+ * 
+ * @param  node  The chunk, may be `NULL`
+ */
+static void free_lines(document_node_t* node)
+{
+  if (node == NULL)
+    return;
+  free_lines(node->left);
+  free_lines(node->right);
+  if (node->line_buffers == NULL)
+    return;
+  for (pos_t i = 0; i < node->count; i++)
+    if ((node->line_buffers + i)->line && !((node->line_buffers + i)->flags & LINE_ARENA))
+      free_line(node->line_buffers + i);
+  if (node->raw)
+    free(node->line_buffers);
+}
+
+
+/**
+ * Split a subtree in two
+ * 
+ * @param  node   The subtree, may be `NULL`
+ * @param  row    The number of lines to put in `left`, must be at a chunk boundary
+ * @param  left   Output parameter for the subtree with the first `row` lines
+ * @param  right  Output parameter for the subtree with the remaining lines
+ */
+static void split(document_node_t* node, pos_t row, document_node_t** left, document_node_t** right)
+{
+  if (node == NULL)
+    *left = *right = NULL;
+  else if (row <= lines_of(node->left))
+    {
+      split(node->left, row, left, &(node->left));
+      update(*right = node);
+    }
+  else
+    {
+      split(node->right, row - lines_of(node->left) - node->count, &(node->right), right);
+      update(*left = node);
+    }
+}
+
+
+/**
+ * Insert a chunk into a subtree
+ * 
+ * @param  link  The link to the subtree
+ * @param  row   The index, in the subtree, the first line in the chunk shall have,
+ *               must be at a chunk boundary
+ * @param  new   The chunk
+ */
+static void insert_node(document_node_t** link, pos_t row, document_node_t* new)
+{
+  document_node_t* node = *link;
+  if (node == NULL)
+    *link = new;
+  else if (new->priority > node->priority)
+    {
+      split(node, row, &(new->left), &(new->right));
+      *link = new;
+    }
+  else if (row <= lines_of(node->left))
+    insert_node(&(node->left), row, new);
+  else
+    insert_node(&(node->right), row - lines_of(node->left) - node->count, new);
+  update(*link);
+}
+
+
+/**
+ * Join two subtrees
+ * 
+ * @param   left   The subtree with the first lines, may be `NULL`
+ * @param   right  The subtree with the last lines, may be `NULL`
+ * @return         The joined subtree
+ */
+static document_node_t* merge(document_node_t* left, document_node_t* right)
+{
+  if ((left == NULL) || (right == NULL))
+    return left ? left : right;
+  if (left->priority > right->priority)
+    {
+      left->right = merge(left->right, right);
+      update(left);
+      return left;
+    }
+  else
+    {
+      right->left = merge(left, right->left);
+      update(right);
+      return right;
+    }
+}
+
+
+/**
+ * Find the chunk that contains a line and update the
+ * aggregated counts of all nodes on the way there
+ * 
+ * The end of the document is considered to be in the last chunk
+ * 
+ * @param   doc     The document, must not be empty
+ * @param   row     The index of the line
+ * @param   local   Output parameter for the index of the line in the chunk
+ * @param   dlines  The number of lines to add to every node on the way
+ * @param   dchars  The number of characters to add to every node on the way
+ * @return          The chunk
+ */
+static document_node_t* locate(const document_t* doc, pos_t row, pos_t* local, pos_t dlines, pos_t dchars)
+{
+  document_node_t* node = doc->root;
+  for (;;)
+    {
+      pos_t left = lines_of(node->left);
+      /* Lookups do not write to the nodes, so that lines can be read on multiple threads */
+      if (dlines || dchars)
+	{
+	  node->lines += dlines;
+	  node->chars += dchars;
+	}
+      if (row < left)
+	node = node->left;
+      else if (((row -= left) < node->count) || ((row == node->count) && (node->right == NULL)))
+	{
+	  *local = row;
+	  return node;
+	}
+      else
+	{
+	  row -= node->count;
+	  node = node->right;
+	}
+    }
+}
+
+
+/**
+ * Split a full chunk in two halves
+ * 
+ * @param  doc   The document
+ * @param  row   The index of the first line in the chunk
+ * @param  node  The chunk
+ */
+static void split_chunk(document_t* doc, pos_t row, document_node_t* node)
+{
+  document_node_t* new = create_node(doc, 0);
+  pos_t keep = node->count / 2, local, i;
+  
+  /* Move the second half to the new chunk */
+  new->count = node->count - keep;
+  for (i = 0; i < new->count; i++)
+    new->count_chars += (node->line_buffers + keep + i)->used;
+  memcpy(new->line_buffers, node->line_buffers + keep, (size_t)(new->count) * sizeof(line_buffer_t));
+  update(new);
+  
+  /* Remove the second half from the old chunk */
+  locate(doc, row, &local, -(new->count), -(new->count_chars));
+  node->count = keep;
+  node->count_chars -= new->count_chars;
+  
+  /* Put the new chunk directly after the old chunk */
+  insert_node(&(doc->root), row + keep, new);
+}
+
+
+/**
+ * Spread the lines of a block over ordinary chunks, so that lines can be inserted and removed
+ * 
+ * @param  doc   The document
+ * @param  row   The index of the first line in the block
+ * @param  node  The block
+ */
+static void unpack_block(document_t* doc, pos_t row, document_node_t* node)
+{
+  line_buffer_t* lbufs = chunk_lines(doc, node);
+  document_node_t* left;
+  document_node_t* right;
+  document_node_t* new;
+  pos_t i, j, n;
+  
+  /* Take out the block, it is alone in the middle part */
+  split(doc->root, row, &left, &right);
+  split(right, node->count, &new, &right);
+  
+  /* Fill chunks as if the lines had been appended, leaving room for insertions */
+  for (i = 0; i < node->count; i += n)
+    {
+      n = node->count - i < DOCUMENT_FILL ? node->count - i : DOCUMENT_FILL;
+      new = create_node(doc, 0);
+      new->count = n;
+      for (j = 0; j < n; j++)
+	new->count_chars += (lbufs + i + j)->used;
+      memcpy(new->line_buffers, lbufs + i, (size_t)n * sizeof(line_buffer_t));
+      update(new);
+      left = merge(left, new);
+    }
+  doc->root = merge(left, right);
+  
+  free(lbufs);
+  slab_release(&(doc->blocks), node);
+}
+
+
+/**
+ * Get the number of bytes used by the lines of a block
+ * 
+ * @param   node  The block, its lines must have been indexed
+ * @return        The number of bytes, zero if any of its lines has been edited
+ */
+__attribute__((pure))
+static size_t block_bytes(const document_node_t* node)
+{
+  size_t bytes = (size_t)(node->count) * sizeof(line_buffer_t);
+  const line_buffer_t* lbuf;
+  
+  for (pos_t i = 0; i < node->count; i++)
+    {
+      if ((lbuf = node->line_buffers + i)->line)
+	return 0;
+      if (lbuf->columns)
+	bytes += sizeof(line_columns_t) + (size_t)(lbuf->columns->allocated) * sizeof(pos_t);
+      if (lbuf->checkpoints)
+	bytes += sizeof(line_checkpoints_t) + (size_t)(lbuf->checkpoints->allocated) * sizeof(line_checkpoint_t);
+    }
+  return bytes;
+}
+
+
+/**
+ * Find the blocks in a subtree whose lines have been indexed but not edited
+ * 
+ * @param  node       The subtree, may be `NULL`
+ * @param  blocks     The found blocks, will be updated
+ * @param  count      The number of elements in `*blocks`, will be updated
+ * @param  allocated  The number of elements that fit in `*blocks`, will be updated
+ * @param  size       The number of bytes used by the lines of the found blocks, will be updated
+ */
+static void find_blocks(document_node_t* node, document_node_t*** blocks, size_t* count,
+			size_t* allocated, size_t* size)
+{
+  size_t bytes;
+  
+  if (node == NULL)
+    return;
+  find_blocks(node->left, blocks, count, allocated, size);
+  find_blocks(node->right, blocks, count, allocated, size);
+  if ((node->raw == NULL) || (node->line_buffers == NULL) || ((bytes = block_bytes(node)) == 0))
+    return;
+  
+  if (*count == *allocated)
+    *blocks = realloc(*blocks, (*allocated = *allocated ? *allocated << 1 : 64) * sizeof(document_node_t*));
+  *(*blocks + (*count)++) = node;
+  *size += bytes;
+}
+
+
+/**
+ * Compare when two blocks were last used, for `qsort`
+ * 
+ * @param   a  One of the blocks
+ * @param   b  The other block
+ * @return     Negative if `a` was used before `b`, positive if after, otherwise zero
+ */
+__attribute__((pure))
+static int compare_used(const void* a, const void* b)
+{
+  size_t used_a = (*(document_node_t* const*)a)->used;
+  size_t used_b = (*(document_node_t* const*)b)->used;
+  return used_a < used_b ? -1 : used_a > used_b;
+}
+
+
+/**
+ * Release the lines of a block whose lines have not been edited
+ * 
+ * @param  node  The block
+ */
+static void release_block(document_node_t* node)
+{
+  line_buffer_t* first = node->line_buffers;
+  line_buffer_t* last = node->line_buffers + node->count - 1;
+  
+  /* The lines may have been moved, and have become well-formed, if the file has been saved in place */
+  node->raw = first->raw;
+  node->raw_size = (size_t)(last->raw + last->raw_size - first->raw);
+  node->malformed = -1;
+  for (pos_t i = 0; i < node->count; i++)
+    {
+      if (((first + i)->flags & LINE_MALFORMED) && (node->malformed < 0))
+	node->malformed = i;
+      free_line(first + i);
+    }
+  
+  free(node->line_buffers);
+  node->line_buffers = NULL;
+}
+
+
+/**
+ * Remove a chunk with one line from a subtree and release it
+ * 
+ * @param  doc   The document
+ * @param  link  The link to the subtree
+ * @param  row   The index, in the subtree, of the line in the chunk
+ */
+static void remove_node(document_t* doc, document_node_t** link, pos_t row)
+{
+  document_node_t* node = *link;
+  pos_t left = lines_of(node->left);
+  if (row < left)
+    remove_node(doc, &(node->left), row);
+  else if (row - left >= node->count)
+    remove_node(doc, &(node->right), row - left - node->count);
+  else
+    {
+      *link = merge(node->left, node->right);
+      free_line(node->line_buffers);
+      slab_release(&(doc->nodes), node);
+      return;
+    }
+  update(node);
+}
+
+
+
+/**
+ * Create an empty document
+ * 
+ * @param  doc  The document
+ */
+void document_create(document_t* doc)
+{
+  doc->root = NULL;
+  doc->seed = 2463534242U;
+  doc->epoch = 0;
+  slab_create(&(doc->nodes), sizeof(document_node_t) + DOCUMENT_CHUNK * sizeof(line_buffer_t));
+  slab_create(&(doc->blocks), sizeof(document_node_t));
+  arena_create(&(doc->arena));
+}
+
+
+/**
+ * Release all resources of a document, including its lines
+ * 
+ * @param  doc  The document
+ */
+void document_free(document_t* doc)
+{
+  free_lines(doc->root);
+  slab_free(&(doc->nodes));
+  slab_free(&(doc->blocks));
+  arena_free(&(doc->arena));
+  doc->root = NULL;
+}
+
+
+/**
+ * Get the number of lines in a document
+ * 
+ * @param   doc  The document
+ * @return       The number of lines in the document
+ */
+pos_t document_lines(const document_t* doc)
+{
+  return lines_of(doc->root);
+}
+
+
+/**
+ * Get the number of characters, including line breaks, in a document
+ * 
+ * @param   doc  The document
+ * @return       The number of characters in the document
+ */
+pos_t document_chars(const document_t* doc)
+{
+  /* There is one line break less than there are lines */
+  return doc->root ? doc->root->chars + doc->root->lines - 1 : 0;
+}
+
+
+/**
+ * Get a line in a document
+ * 
+ * @param   doc  The document
+ * @param   row  The index of the line, must be a line in the document
+ * @return       The line, valid until lines are inserted or removed
+ */
+line_buffer_t* document_line(const document_t* doc, pos_t row)
+{
+  pos_t local;
+  document_node_t* node = locate(doc, row, &local, 0, 0);
+  return chunk_lines(doc, node) + local;
+}
+
+
+/**
+ * Get a run of consecutive lines in a document
+ * 
+ * @param   doc    The document
+ * @param   row    The index of the first line, must be a line in the document
+ * @param   count  Output parameter for the number of lines in the run, at least 1
+ * @return         The first line in the run, valid until lines are inserted or removed
+ */
+line_buffer_t* document_span(const document_t* doc, pos_t row, pos_t* count)
+{
+  pos_t local;
+  document_node_t* node = locate(doc, row, &local, 0, 0);
+  *count = node->count - local;
+  return chunk_lines(doc, node) + local;
+}
+
+
+/**
+ * Get the chunk that contains a line in a document, without indexing it if it is a block
+ * 
+ * @param   doc    The document
+ * @param   row    The index of the line, must be a line in the document
+ * @param   local  Output parameter for the index of the line in the chunk
+ * @return         The chunk, valid until lines are inserted or removed
+ */
+document_node_t* document_chunk(const document_t* doc, pos_t row, pos_t* local)
+{
+  return locate(doc, row, local, 0, 0);
+}
+
+
+/**
+ * Append a block of unedited lines, that are indexed when they are first looked up,
+ * to the end of a document
+ * 
+ * @param  doc        The document
+ * @param  raw        The content of the lines, back to back as they are in the file
+ * @param  raw_size   The number of bytes in `raw`, excluding the line break after the last line
+ * @param  lines      The number of lines in the block
+ * @param  chars      The number of characters, excluding line breaks, in the block
+ * @param  malformed  The index in the block of its first line that is not well-formed UTF-8, -1 if none
+ */
+void document_append_block(document_t* doc, const char* raw, size_t raw_size, pos_t lines,
+			   pos_t chars, pos_t malformed)
+{
+  document_node_t* node = create_node(doc, 1);
+  node->raw = raw;
+  node->raw_size = raw_size;
+  node->malformed = malformed;
+  node->count = lines;
+  node->count_chars = chars;
+  update(node);
+  insert_node(&(doc->root), document_lines(doc), node);
+}
+
+
+/**
+ * Release the lines of the blocks in a document that have been used least recently,
+ * until the lines of its blocks use at most a number of bytes, or every block that
+ * remains has been used since the document was last trimmed, blocks with edited lines
+ * are kept and not counted
+ * 
+ * @param  doc     The document
+ * @param  budget  The number of bytes
+ */
+void document_trim(document_t* doc, size_t budget)
+{
+  document_node_t** blocks = NULL;
+  size_t count = 0, allocated = 0, size = 0, i;
+  
+  find_blocks(doc->root, &blocks, &count, &allocated, &size);
+  if (size > budget)
+    {
+      qsort(blocks, count, sizeof(document_node_t*), compare_used);
+      for (i = 0; (i < count) && (size > budget) && ((*(blocks + i))->used != doc->epoch); i++)
+	{
+	  size -= block_bytes(*(blocks + i));
+	  release_block(*(blocks + i));
+	}
+    }
+  free(blocks);
+  doc->epoch++;
+}
+
+
+/**
+ * Insert a line into a document
+ * 
+ * @param   doc   The document
+ * @param   row   The index the line shall have, at most the number of lines in the document
+ * @param   lbuf  The line, the document takes over its resources
+ * @return        The line in the document, valid until lines are inserted or removed
+ */
+line_buffer_t* document_insert(document_t* doc, pos_t row, const line_buffer_t* lbuf)
+{
+  document_node_t* node;
+  pos_t local;
+  
+  if (doc->root == NULL)
+    doc->root = create_node(doc, 0);
+  
+  /* Make room in the chunk that shall hold the line */
+  node = locate(doc, row, &local, 0, 0);
+  if (node->raw)
+    {
+      unpack_block(doc, row - local, node);
+      node = locate(doc, row, &local, 0, 0);
+    }
+  if (node->count == DOCUMENT_CHUNK)
+    split_chunk(doc, row - local, node);
+  
+  /* Insert the line */
+  node = locate(doc, row, &local, 1, lbuf->used);
+  memmove(node->line_buffers + local + 1, node->line_buffers + local,
+	  (size_t)(node->count - local) * sizeof(line_buffer_t));
+  *(node->line_buffers + local) = *lbuf;
+  node->count++;
+  node->count_chars += lbuf->used;
+  return node->line_buffers + local;
+}
+
+
+/**
+ * Append a line to the end of a document
+ * 
+ * @param   doc   The document
+ * @param   lbuf  The line, the document takes over its resources
+ * @return        The line in the document, valid until lines are inserted or removed
+ */
+line_buffer_t* document_append(document_t* doc, const line_buffer_t* lbuf)
+{
+  pos_t row = document_lines(doc), local;
+  
+  /* Start a new chunk when the last chunk has been filled, leaving room for insertions */
+  if ((doc->root == NULL) || (locate(doc, row, &local, 0, 0)->count >= DOCUMENT_FILL))
+    insert_node(&(doc->root), row, create_node(doc, 0));
+  
+  return document_insert(doc, row, lbuf);
+}
+
+
+/**
+ * Remove a line from a document and release its resources
+ * 
+ * @param  doc  The document
+ * @param  row  The index of the line
+ */
+void document_remove(document_t* doc, pos_t row)
+{
+  pos_t local;
+  document_node_t* node = locate(doc, row, &local, 0, 0);
+  line_buffer_t* lbuf;
+  
+  if (node->raw)
+    {
+      unpack_block(doc, row - local, node);
+      node = locate(doc, row, &local, 0, 0);
+    }
+  lbuf = node->line_buffers + local;
+  
+  /* Release the chunk instead if this is its only line */
+  if (node->count == 1)
+    {
+      remove_node(doc, &(doc->root), row);
+      return;
+    }
+  
+  locate(doc, row, &local, -1, -(lbuf->used));
+  node->count--;
+  node->count_chars -= lbuf->used;
+  free_line(lbuf);
+  memmove(lbuf, lbuf + 1, (size_t)(node->count - local) * sizeof(line_buffer_t));
+}
+
+
+/**
+ * Inform a document that the number of characters in one of its lines has changed
+ * 
+ * @param  doc    The document
+ * @param  row    The index of the line
+ * @param  delta  The number of characters added to the line, negative if characters were removed
+ */
+void document_resize(document_t* doc, pos_t row, pos_t delta)
+{
+  pos_t local;
+  locate(doc, row, &local, 0, delta)->count_chars += delta;
+}
+
+
+/**
+ * Get the character offset of the beginning of a line in a document
+ * 
+ * @param   doc  The document
+ * @param   row  The index of the line, at most the number of lines in the document
+ * @return       The number of characters, including line breaks, before the line
+ */
+pos_t document_offset(const document_t* doc, pos_t row)
+{
+  document_node_t* node = doc->root;
+  pos_t offset = row;
+  
+  while (node)
+    {
+      pos_t left = lines_of(node->left);
+      if (row < left)
+	{
+	  node = node->left;
+	  continue;
+	}
+      offset += chars_of(node->left);
+      row -= left;
+      if (row < node->count)
+	{
+	  for (pos_t i = 0; i < row; i++)
+	    offset += (chunk_lines(doc, node) + i)->used;
+	  break;
+	}
+      offset += node->count_chars;
+      row -= node->count;
+      node = node->right;
+    }
+  
+  return offset;
+}
+
+
+/**
+ * Find the line and column of a character offset in a document
+ * 
+ * @param   doc     The document
+ * @param   offset  The number of characters, including line breaks, before the position
+ * @param   column  Output parameter for the column in the line
+ * @return          The index of the line, -1 if the offset is beyond the end of the document
+ */
+pos_t document_locate(const document_t* doc, pos_t offset, pos_t* column)
+{
+  document_node_t* node = doc->root;
+  pos_t row = 0;
+  
+  while (node)
+    {
+      /* Each line is followed by a line break, except the last line of the document */
+      pos_t left = chars_of(node->left) + lines_of(node->left);
+      if (offset < left)
+	{
+	  node = node->left;
+	  continue;
+	}
+      offset -= left;
+      row += lines_of(node->left);
+      if (offset < node->count_chars + node->count)
+	{
+	  for (pos_t i = 0;; i++, row++)
+	    {
+	      pos_t used = (chunk_lines(doc, node) + i)->used;
+	      if (offset <= used)
+		break;
+	      offset -= used + 1;
+	    }
+	  *column = offset;
+	  return row;
+	}
+      offset -= node->count_chars + node->count;
+      row += node->count;
+      node = node->right;
+    }
+  
+  return -1;
+}
+
@@ -0,0 +1,319 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __DOCUMENT_H__
+#define __DOCUMENT_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "lines.h"
+#include "arena.h"
+
+
+/**
+ * The maximum number of lines in a chunk of a document
+ */
+#ifndef DOCUMENT_CHUNK
+#define DOCUMENT_CHUNK  64
+#endif
+
+/**
+ * The number of lines put in each chunk when lines are appended,
+ * the rest of the chunk is left for lines that are inserted later
+ */
+#ifndef DOCUMENT_FILL
+#define DOCUMENT_FILL  48
+#endif
+
+
+
+/**
+ * A chunk of lines in a document, and the root of
+ * the subtree of chunks that surrounds it
+ * 
+ * A chunk can also be a block of unedited lines whose
+ * places in the file are known, but that are not kept
+ * in memory. Its lines are indexed when one of them is
+ * looked up, and released again when the document is
+ * trimmed unless they have been edited. A block is
+ * spread over ordinary chunks when lines are inserted
+ * into it or removed from it.
+ */
+typedef struct document_node
+{
+  /**
+   * The subtree of chunks that precede this chunk, `NULL` if none
+   */
+  struct document_node* left;
+  
+  /**
+   * The subtree of chunks that succeed this chunk, `NULL` if none
+   */
+  struct document_node* right;
+  
+  /**
+   * The heap priority of the chunk, a node never has higher priority than its parent
+   */
+  uint_least32_t priority;
+  
+  /**
+   * The number of lines in the subtree
+   */
+  pos_t lines;
+  
+  /**
+   * The number of characters, excluding line breaks, in the subtree
+   */
+  pos_t chars;
+  
+  /**
+   * The number of lines in the chunk
+   */
+  pos_t count;
+  
+  /**
+   * The number of characters, excluding line breaks, in the chunk
+   */
+  pos_t count_chars;
+  
+  /**
+   * The lines in the chunk, with room for `DOCUMENT_CHUNK` lines,
+   * allocated directly after the node; for a block, its `count`
+   * lines, `NULL` until they have been indexed
+   */
+  line_buffer_t* line_buffers;
+  
+  /**
+   * The content of the lines of a block, back to back as they are in the file,
+   * until they have been indexed, `NULL` if the chunk is not a block
+   */
+  const char* raw;
+  
+  /**
+   * The number of bytes in `raw`, excluding the line break after the last line
+   */
+  size_t raw_size;
+  
+  /**
+   * The index in a block of its first line that is not well-formed UTF-8, -1 if none
+   */
+  pos_t malformed;
+  
+  /**
+   * The `epoch` of the document when the lines of a block were last looked up
+   */
+  size_t used;
+  
+} document_node_t;
+
+
+/**
+ * A document, a sequence of lines indexed both by
+ * line and by character, stored as a treap of chunks
+ */
+typedef struct document
+{
+  /**
+   * The root of the treap, `NULL` if the document is empty
+   */
+  document_node_t* root;
+  
+  /**
+   * The state of the pseudorandom generator used for priorities
+   */
+  uint_least32_t seed;
+  
+  /**
+   * The number of times the document has been trimmed, see `document_trim`
+   */
+  size_t epoch;
+  
+  /**
+   * The allocator for the chunks
+   */
+  slab_t nodes;
+  
+  /**
+   * The allocator for the blocks
+   */
+  slab_t blocks;
+  
+  /**
+   * The allocator for the content of the lines, lines that grow out
+   * of their space in the arena are moved out to the heap
+   */
+  arena_t arena;
+  
+} document_t;
+
+
+
+/**
+ * Create an empty document
+ * 
+ * @param  doc  The document
+ */
+void document_create(document_t* doc);
+
+/**
+ * Release all resources of a document, including its lines
+ * 
+ * Everything allocated in the document's arena and slab
+ * is released in bulk, only lines that have been moved
+ * out of the arena are released individually
+ * 
+ * @param  doc  The document
+ */
+void document_free(document_t* doc);
+
+/**
+ * Get the number of lines in a document
+ * 
+ * @param   doc  The document
+ * @return       The number of lines in the document
+ */
+pos_t document_lines(const document_t* doc) __attribute__((pure));
+
+/**
+ * Get the number of characters, including line breaks, in a document
+ * 
+ * @param   doc  The document
+ * @return       The number of characters in the document
+ */
+pos_t document_chars(const document_t* doc) __attribute__((pure));
+
+/**
+ * Get a line in a document
+ * 
+ * @param   doc  The document
+ * @param   row  The index of the line, must be a line in the document
+ * @return       The line, valid until lines are inserted or removed
+ */
+line_buffer_t* document_line(const document_t* doc, pos_t row);
+
+/**
+ * Get a run of consecutive lines in a document
+ * 
+ * @param   doc    The document
+ * @param   row    The index of the first line, must be a line in the document
+ * @param   count  Output parameter for the number of lines in the run, at least 1
+ * @return         The first line in the run, valid until lines are inserted or removed
+ */
+line_buffer_t* document_span(const document_t* doc, pos_t row, pos_t* count);
+
+/**
+ * Get the chunk that contains a line in a document, without indexing it if it is a block
+ * 
+ * @param   doc    The document
+ * @param   row    The index of the line, must be a line in the document
+ * @param   local  Output parameter for the index of the line in the chunk
+ * @return         The chunk, valid until lines are inserted or removed
+ */
+document_node_t* document_chunk(const document_t* doc, pos_t row, pos_t* local);
+
+/**
+ * Append a block of unedited lines, that are indexed when they are first looked up,
+ * to the end of a document
+ * 
+ * @param  doc        The document
+ * @param  raw        The content of the lines, back to back as they are in the file
+ * @param  raw_size   The number of bytes in `raw`, excluding the line break after the last line
+ * @param  lines      The number of lines in the block
+ * @param  chars      The number of characters, excluding line breaks, in the block
+ * @param  malformed  The index in the block of its first line that is not well-formed UTF-8, -1 if none
+ */
+void document_append_block(document_t* doc, const char* raw, size_t raw_size, pos_t lines,
+			   pos_t chars, pos_t malformed);
+
+/**
+ * Release the lines of the blocks in a document that have been used least recently,
+ * until the lines of its blocks use at most a number of bytes, or every block that
+ * remains has been used since the document was last trimmed, blocks with edited lines
+ * are kept and not counted
+ * 
+ * Lines obtained from the document before it is trimmed must not be used afterwards
+ * 
+ * @param  doc     The document
+ * @param  budget  The number of bytes
+ */
+void document_trim(document_t* doc, size_t budget);
+
+/**
+ * Insert a line into a document
+ * 
+ * @param   doc   The document
+ * @param   row   The index the line shall have, at most the number of lines in the document
+ * @param   lbuf  The line, the document takes over its resources
+ * @return        The line in the document, valid until lines are inserted or removed
+ */
+line_buffer_t* document_insert(document_t* doc, pos_t row, const line_buffer_t* lbuf);
+
+/**
+ * Append a line to the end of a document
+ * 
+ * @param   doc   The document
+ * @param   lbuf  The line, the document takes over its resources
+ * @return        The line in the document, valid until lines are inserted or removed
+ */
+line_buffer_t* document_append(document_t* doc, const line_buffer_t* lbuf);
+
+/**
+ * Remove a line from a document and release its resources
+ * 
+ * @param  doc  The document
+ * @param  row  The index of the line
+ */
+void document_remove(document_t* doc, pos_t row);
+
+/**
+ * Inform a document that the number of characters in one of its lines has changed
+ * 
+ * @param  doc    The document
+ * @param  row    The index of the line
+ * @param  delta  The number of characters added to the line, negative if characters were removed
+ */
+void document_resize(document_t* doc, pos_t row, pos_t delta);
+
+/**
+ * Get the character offset of the beginning of a line in a document
+ * 
+ * The lines of the block that contains the line are indexed if they have not been
+ * 
+ * @param   doc  The document
+ * @param   row  The index of the line, at most the number of lines in the document
+ * @return       The number of characters, including line breaks, before the line
+ */
+pos_t document_offset(const document_t* doc, pos_t row);
+
+/**
+ * Find the line and column of a character offset in a document
+ * 
+ * @param   doc     The document
+ * @param   offset  The number of characters, including line breaks, before the position
+ * @param   column  Output parameter for the column in the line
+ * @return          The index of the line, -1 if the offset is beyond the end of the document
+ */
+pos_t document_locate(const document_t* doc, pos_t offset, pos_t* column);
+
+
+#endif
+
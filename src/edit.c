@@ -0,0 +1,424 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "edit.h"
+
+
+/**
+ * The currently active frame
+ */
+extern frame_t* cur_frame;
+
+/**
+ * Whether the user has asked for the editor to exit
+ */
+bool_t quit_requested = 0;
+
+
+
+/**
+ * Get the line of the point in the current frame
+ * 
+ * @return  The line of the point
+ */
+static line_buffer_t* point_line(void)
+{
+  return document_line(&(cur_frame->document), cur_frame->row);
+}
+
+
+/**
+ * Get the column of the point in the current frame, limited to the length of its line
+ * 
+ * @return  The column of the point
+ */
+static pos_t point_column(void)
+{
+  pos_t used = point_line()->used;
+  return cur_frame->column < used ? cur_frame->column : used;
+}
+
+
+/**
+ * Join a line with the line after it
+ * 
+ * @param  row  The index of the first line
+ */
+static void join_lines(pos_t row)
+{
+  document_t* doc = &(cur_frame->document);
+  line_buffer_t* next = document_line(doc, row + 1);
+  pos_t n = next->used;
+  char_t* text = malloc((size_t)(n ? n : 1) * sizeof(char_t));
+  
+  read_line(next, 0, n, text);
+  document_remove(doc, row + 1);
+  
+  line_buffer_t* lbuf = document_line(doc, row);
+  line_insert(lbuf, &(doc->arena), lbuf->used, text, n);
+  document_resize(doc, row, n);
+  lines_changed(row, -1);
+  mark_modified(row);
+  free(text);
+}
+
+
+
+/**
+ * Move the point in the current frame
+ * 
+ * @param  row     The line to move the point to, must be a line in the frame
+ * @param  column  The column to move the point to
+ */
+void set_point(pos_t row, pos_t column)
+{
+  /* The line the point leaves does not need its gap anymore */
+  if (row != cur_frame->row)
+    compact_line(point_line());
+  cur_frame->row = row;
+  cur_frame->column = column;
+}
+
+
+/**
+ * Move the point one character forward, to the next line if at the end of the line
+ */
+void move_forward(void)
+{
+  pos_t column = point_column();
+  if (column < point_line()->used)
+    set_point(cur_frame->row, column + 1);
+  else if (cur_frame->row + 1 < document_lines(&(cur_frame->document)))
+    set_point(cur_frame->row + 1, 0);
+}
+
+
+/**
+ * Move the point one character backward, to the previous line if at the beginning of the line
+ */
+void move_backward(void)
+{
+  pos_t column = point_column();
+  if (column > 0)
+    set_point(cur_frame->row, column - 1);
+  else if (cur_frame->row > 0)
+    {
+      set_point(cur_frame->row - 1, 0);
+      cur_frame->column = point_line()->used;
+    }
+}
+
+
+/**
+ * Move the point to the next line
+ */
+void move_down(void)
+{
+  if (cur_frame->row + 1 < document_lines(&(cur_frame->document)))
+    set_point(cur_frame->row + 1, cur_frame->column);
+}
+
+
+/**
+ * Move the point to the previous line
+ */
+void move_up(void)
+{
+  if (cur_frame->row > 0)
+    set_point(cur_frame->row - 1, cur_frame->column);
+}
+
+
+/**
+ * Move the point to the beginning of the line
+ */
+void move_home(void)
+{
+  cur_frame->column = 0;
+}
+
+
+/**
+ * Move the point to the end of the line
+ */
+void move_end(void)
+{
+  cur_frame->column = point_line()->used;
+}
+
+
+/**
+ * Insert text, without line breaks, at the point and move the point past it
+ * 
+ * @param  text  The characters to insert
+ * @param  n     The number of characters to insert
+ */
+void insert_text(const char_t* text, pos_t n)
+{
+  pos_t column = point_column();
+  line_insert(point_line(), &(cur_frame->document.arena), column, text, n);
+  document_resize(&(cur_frame->document), cur_frame->row, n);
+  lines_changed(cur_frame->row, 0);
+  undo_insert(&(cur_frame->undo), cur_frame->row, column, text, n);
+  cur_frame->column = column + n;
+  mark_modified(cur_frame->row);
+}
+
+
+/**
+ * Insert text at the point and move the point past it
+ * 
+ * @param  text  The characters to insert, with `\n` for line breaks
+ * @param  n     The number of characters to insert
+ */
+void insert_region(const char_t* text, pos_t n)
+{
+  pos_t start = 0, i;
+  
+  for (i = 0; i < n; i++)
+    if (*(text + i) == '\n')
+      {
+	if (i > start)
+	  insert_text(text + start, i - start);
+	break_line(1);
+	start = i + 1;
+      }
+  if (n > start)
+    insert_text(text + start, n - start);
+}
+
+
+/**
+ * Delete text after the point
+ * 
+ * @param  n  The number of characters to delete, line breaks included
+ */
+void delete_region(pos_t n)
+{
+  document_t* doc = &(cur_frame->document);
+  pos_t row = cur_frame->row, column = point_column(), k, text_size = 0;
+  char_t* text = NULL;
+  line_buffer_t* lbuf;
+  
+  if (n <= 0)
+    return;
+  
+  for (;;)
+    {
+      /* Delete the rest of the line, or the part of it that is deleted */
+      lbuf = document_line(doc, row);
+      k = lbuf->used - column < n ? lbuf->used - column : n;
+      if (k > 0)
+	{
+	  if (text_size < k)
+	    text = realloc(text, (size_t)(text_size = k) * sizeof(char_t));
+	  read_line(lbuf, column, k, text);
+	  line_delete(lbuf, &(doc->arena), column, k);
+	  document_resize(doc, row, -k);
+	  lines_changed(row, 0);
+	  undo_delete(&(cur_frame->undo), row, column, text, k, 0);
+	  n -= k;
+	}
+      if ((n == 0) || (row + 1 >= document_lines(doc)))
+	break;
+      
+      /* Lines that are deleted completely, with the line break before them, are removed rather than joined */
+      lbuf = document_line(doc, row + 1);
+      k = lbuf->used + 1;
+      if (k > n)
+	k = 1;
+      if (text_size < k)
+	text = realloc(text, (size_t)(text_size = k) * sizeof(char_t));
+      *text = '\n';
+      if (k > 1)
+	{
+	  read_line(lbuf, 0, k - 1, text + 1);
+	  document_remove(doc, row + 1);
+	  lines_changed(row, -1);
+	}
+      else
+	join_lines(row);
+      undo_delete(&(cur_frame->undo), row, column, text, k, 0);
+      n -= k;
+    }
+  
+  cur_frame->column = column;
+  mark_modified(row);
+  free(text);
+}
+
+
+/**
+ * Break the line at the point
+ * 
+ * @param  move  Whether the point shall be moved to the new line
+ */
+void break_line(int move)
+{
+  document_t* doc = &(cur_frame->document);
+  pos_t column = point_column();
+  line_buffer_t* lbuf = point_line();
+  line_buffer_t tail;
+  char_t line_break = '\n';
+  
+  split_line(lbuf, &(doc->arena), column, &tail);
+  document_resize(doc, cur_frame->row, -(tail.used));
+  document_insert(doc, cur_frame->row + 1, &tail);
+  lines_changed(cur_frame->row, 1);
+  undo_insert(&(cur_frame->undo), cur_frame->row, column, &line_break, 1);
+  mark_modified(cur_frame->row);
+  
+  if (move)
+    set_point(cur_frame->row + 1, 0);
+  else
+    cur_frame->column = column;
+}
+
+
+/**
+ * Remove the character before the point, joining
+ * the line with the previous line if at its beginning
+ */
+void erase_char(void)
+{
+  pos_t column = point_column();
+  char_t c;
+  if (column > 0)
+    {
+      c = line_char(point_line(), column - 1);
+      line_delete(point_line(), &(cur_frame->document.arena), column - 1, 1);
+      document_resize(&(cur_frame->document), cur_frame->row, -1);
+      lines_changed(cur_frame->row, 0);
+      undo_delete(&(cur_frame->undo), cur_frame->row, column - 1, &c, 1, 1);
+      cur_frame->column = column - 1;
+      mark_modified(cur_frame->row);
+    }
+  else if (cur_frame->row > 0)
+    {
+      cur_frame->row--;
+      column = point_line()->used;
+      join_lines(cur_frame->row);
+      c = '\n';
+      undo_delete(&(cur_frame->undo), cur_frame->row, column, &c, 1, 1);
+      cur_frame->column = column;
+    }
+}
+
+
+/**
+ * Remove the character at the point, joining the line
+ * with the next line if at its end
+ */
+void delete_char(void)
+{
+  pos_t column = point_column();
+  char_t c;
+  if (column < point_line()->used)
+    {
+      c = line_char(point_line(), column);
+      line_delete(point_line(), &(cur_frame->document.arena), column, 1);
+      document_resize(&(cur_frame->document), cur_frame->row, -1);
+      lines_changed(cur_frame->row, 0);
+      undo_delete(&(cur_frame->undo), cur_frame->row, column, &c, 1, 0);
+      cur_frame->column = column;
+      mark_modified(cur_frame->row);
+    }
+  else if (cur_frame->row + 1 < document_lines(&(cur_frame->document)))
+    {
+      join_lines(cur_frame->row);
+      c = '\n';
+      undo_delete(&(cur_frame->undo), cur_frame->row, column, &c, 1, 0);
+      cur_frame->column = column;
+    }
+}
+
+
+/**
+ * Break the line at the point and move the point to the new line
+ */
+void new_line(void)
+{
+  break_line(1);
+}
+
+
+/**
+ * Break the line at the point without moving the point
+ */
+void open_line(void)
+{
+  break_line(0);
+}
+
+
+/**
+ * Insert a horizontal tab at the point
+ */
+void insert_tab(void)
+{
+  char_t c = '\t';
+  insert_text(&c, 1);
+}
+
+
+/**
+ * Revert the next edit in the current sequence of undos
+ */
+void undo(void)
+{
+  undo_log_t* log = &(cur_frame->undo);
+  undo_edit_t edit;
+  
+  if (undo_pop(log, &edit) == 0)
+    {
+      alert(strdup("No further undo information"));
+      return;
+    }
+  
+  set_point(edit.row, edit.column);
+  if (edit.type == UNDO_INSERT)
+    delete_region(edit.length);
+  else
+    {
+      insert_region(edit.text, edit.length);
+      /* Text that was deleted after the point is put back after the point */
+      if (edit.type == UNDO_DELETE)
+	set_point(edit.row, edit.column);
+    }
+  undo_boundary(log);
+  free(edit.text);
+}
+
+
+/**
+ * End the current sequence of undos, so that the next undo redoes
+ */
+void switch_undo_direction(void)
+{
+  undo_switch(&(cur_frame->undo));
+}
+
+
+/**
+ * Ask for the editor to exit once the current key has been processed
+ */
+void quit_editor(void)
+{
+  quit_requested = 1;
+}
+
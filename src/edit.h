@@ -0,0 +1,140 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __EDIT_H__
+#define __EDIT_H__
+
+
+#include "frames.h"
+#include "types.h"
+
+
+
+/**
+ * Move the point in the current frame
+ * 
+ * @param  row     The line to move the point to, must be a line in the frame
+ * @param  column  The column to move the point to
+ */
+void set_point(pos_t row, pos_t column);
+
+/**
+ * Move the point one character forward, to the next line if at the end of the line
+ */
+void move_forward(void);
+
+/**
+ * Move the point one character backward, to the previous line if at the beginning of the line
+ */
+void move_backward(void);
+
+/**
+ * Move the point to the next line
+ */
+void move_down(void);
+
+/**
+ * Move the point to the previous line
+ */
+void move_up(void);
+
+/**
+ * Move the point to the beginning of the line
+ */
+void move_home(void);
+
+/**
+ * Move the point to the end of the line
+ */
+void move_end(void);
+
+/**
+ * Insert text, without line breaks, at the point and move the point past it
+ * 
+ * @param  text  The characters to insert
+ * @param  n     The number of characters to insert
+ */
+void insert_text(const char_t* text, pos_t n);
+
+/**
+ * Break the line at the point
+ * 
+ * @param  move  Whether the point shall be moved to the new line
+ */
+void break_line(int move);
+
+/**
+ * Insert text at the point and move the point past it
+ * 
+ * @param  text  The characters to insert, with `\n` for line breaks
+ * @param  n     The number of characters to insert
+ */
+void insert_region(const char_t* text, pos_t n);
+
+/**
+ * Delete text after the point
+ * 
+ * @param  n  The number of characters to delete, line breaks included
+ */
+void delete_region(pos_t n);
+
+/**
+ * Remove the character before the point, joining
+ * the line with the previous line if at its beginning
+ */
+void erase_char(void);
+
+/**
+ * Remove the character at the point, joining the line
+ * with the next line if at its end
+ */
+void delete_char(void);
+
+/**
+ * Break the line at the point and move the point to the new line
+ */
+void new_line(void);
+
+/**
+ * Break the line at the point without moving the point
+ */
+void open_line(void);
+
+/**
+ * Insert a horizontal tab at the point
+ */
+void insert_tab(void);
+
+/**
+ * Revert the next edit in the current sequence of undos
+ */
+void undo(void);
+
+/**
+ * End the current sequence of undos, so that the next undo redoes
+ */
+void switch_undo_direction(void);
+
+/**
+ * Ask for the editor to exit once the current key has been processed
+ */
+void quit_editor(void);
+
+
+#endif
+
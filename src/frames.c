@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "frames.h"
+#include "save.h"
+#include "recover.h"
 
 
 /**
@@ -25,7 +27,7 @@
 static pos_t open_frames = 0;
 
 /**
- * The number of frames that fits in `frames`
+ * The number of frames that fits in the blocks of `frames`
  */
 static pos_t prepared_frames = 0;
 
@@ -35,37 +37,204 @@ static pos_t prepared_frames = 0;
 static pos_t current_frame = -1;
 
 /**
- * The opened frames
+ * The opened frames, in blocks of `FRAME_BLOCK` frames
  */
-static frame_t* frames = NULL;
+static frame_t** frames = NULL;
+
+/**
+ * Hash table from files to the indices of the frames holding them, -1 for empty slots
+ */
+static pos_t* frame_table = NULL;
+
+/**
+ * The number of slots in `frame_table`, zero or a power of two
+ */
+static size_t frame_table_size = 0;
 
 /**
  * The currently active frame
  */
 frame_t* cur_frame = NULL;
 
+/**
+ * Buffer for the characters of lines that are being highlighted
+ */
+static char_t* lex_buffer = NULL;
 
+/**
+ * Buffer for the classes of the characters in `lex_buffer`
+ */
+static int_least8_t* lex_classes = NULL;
 
 /**
- * Prepare the frame buffer to hold one more frame
+ * Buffer for the lexer states where lexing can be resumed in `lex_buffer`
+ */
+static int_least16_t* lex_marks = NULL;
+
+/**
+ * The number of characters that fits in `lex_buffer`, `lex_classes` and `lex_marks`
+ */
+static pos_t lex_buffer_size = 0;
+
+/**
+ * The size of the pages of memory, set when `SIGBUS` starts to be handled
+ */
+static size_t page_size = 0;
+
+/**
+ * Whether a page of a mapped file has been read after the end of the file
+ * since `notice_truncated` last looked for the truncated files
+ */
+static volatile sig_atomic_t truncated = 0;
+
+
+
+/**
+ * Get an opened frame
+ * 
+ * @param   index  The index of the frame
+ * @return         The frame
+ */
+__attribute__((pure))
+static frame_t* frame_at(pos_t index)
+{
+  return *(frames + index / FRAME_BLOCK) + index % FRAME_BLOCK;
+}
+
+
+/**
+ * Prepare the frame buffer to hold one more frame, frames that are already held are not moved
  */
 void prepare_frame_buffer(void)
 {
-  if (frames == NULL)
-  {
-    /* Prepare to hold 4 frames initially */
-    frames = malloc((size_t)(prepared_frames = 4) * sizeof(frame_t));
-  }
-  else if (open_frames == prepared_frames)
+  if (open_frames == prepared_frames)
   {
-    /* When full, prepare to hold twice as much */
-    frames = realloc(frames, (size_t)(prepared_frames <<= 1) * sizeof(frame_t));
-    /* Revalidate the value of `cur_frame` as it would have been incorrect if `realloc` moves `frames` */
-    cur_frame = frames + current_frame;
+    /* When full, add another block, the list of blocks grows by doubling */
+    pos_t blocks = prepared_frames / FRAME_BLOCK;
+    if ((blocks & (blocks - 1)) == 0)
+      frames = realloc(frames, (size_t)(blocks ? blocks << 1 : 1) * sizeof(frame_t*));
+    *(frames + blocks) = malloc(FRAME_BLOCK * sizeof(frame_t));
+    prepared_frames += FRAME_BLOCK;
   }
 }
 
 
+/**
+ * Hash the identity of a file
+ * 
+ * @param   device  The device the file is stored on
+ * @param   inode   The inode of the file, zero if the file does not exist
+ * @param   path    The path of the file, only used if `inode` is zero
+ * @return          The hash
+ */
+__attribute__((pure))
+static size_t file_hash(dev_t device, ino_t inode, const char* path)
+{
+  uint_least64_t hash = 14695981039346656037ULL;
+  if (inode)
+    {
+      hash = (hash ^ (uint_least64_t)device) * 1099511628211ULL;
+      hash = (hash ^ (uint_least64_t)inode) * 1099511628211ULL;
+    }
+  else
+    while (*path)
+      hash = (hash ^ (unsigned char)*path++) * 1099511628211ULL;
+  return (size_t)(hash ^ (hash >> 32));
+}
+
+
+/**
+ * Find the frame holding a file
+ * 
+ * @param   device  The device the file is stored on
+ * @param   inode   The inode of the file, zero if the file does not exist
+ * @param   path    The path of the file, only used if `inode` is zero
+ * @return  >=0     The index of the frame
+ * @return  -1      No frame contains the file
+ */
+__attribute__((pure))
+static pos_t lookup_frame(dev_t device, ino_t inode, const char* path)
+{
+  size_t i, mask = frame_table_size - 1;
+  frame_t* frame;
+  pos_t index;
+  
+  if (frame_table_size == 0)
+    return -1;
+  
+  /* Files that do not exist yet can only be identified by their paths */
+  for (i = file_hash(device, inode, path) & mask; (index = *(frame_table + i)) >= 0; i = (i + 1) & mask)
+    {
+      frame = frame_at(index);
+      if (inode ? ((frame->inode == inode) && (frame->device == device))
+		: ((frame->inode == 0) && !strcmp(frame->file, path)))
+	return index;
+    }
+  return -1;
+}
+
+
+/**
+ * Add the file of an opened frame to the hash table of files
+ * 
+ * @param  index  The index of the frame
+ */
+static void register_frame(pos_t index)
+{
+  size_t i, size, mask;
+  frame_t* frame;
+  pos_t j;
+  
+  /* Keep the table at most half full, the frames are rehashed when it grows */
+  if ((size_t)open_frames * 2 > frame_table_size)
+    {
+      size = frame_table_size ? frame_table_size << 1 : 16;
+      free(frame_table);
+      frame_table = malloc(size * sizeof(pos_t));
+      frame_table_size = size;
+      for (i = 0; i < size; i++)
+	*(frame_table + i) = -1;
+      for (j = 0; j < open_frames; j++)
+	if ((j != index) && frame_at(j)->file)
+	  register_frame(j);
+    }
+  
+  frame = frame_at(index);
+  mask = frame_table_size - 1;
+  for (i = file_hash(frame->device, frame->inode, frame->file) & mask; *(frame_table + i) >= 0; i = (i + 1) & mask)
+    ;
+  *(frame_table + i) = index;
+}
+
+
+/**
+ * Remove the file of an opened frame from the hash table of files
+ * 
+ * @param  index  The index of the frame
+ */
+static void unregister_frame(pos_t index)
+{
+  size_t i, j, home, mask = frame_table_size - 1;
+  frame_t* frame = frame_at(index);
+  
+  for (i = file_hash(frame->device, frame->inode, frame->file) & mask; *(frame_table + i) != index; i = (i + 1) & mask)
+    ;
+  
+  /* Move back the entries after it that would not be found past the hole */
+  for (j = (i + 1) & mask; *(frame_table + j) >= 0; j = (j + 1) & mask)
+    {
+      frame = frame_at(*(frame_table + j));
+      home = file_hash(frame->device, frame->inode, frame->file) & mask;
+      if (((j - home) & mask) >= ((j - i) & mask))
+	{
+	  *(frame_table + i) = *(frame_table + j);
+	  i = j;
+	}
+    }
+  *(frame_table + i) = -1;
+}
+
+
 /**
  * Create an empty document that is not yet associated with a file
  */
@@ -76,7 +245,7 @@ void create_scratch(void)
   
   /* Create new frame */
   current_frame = open_frames++;
-  cur_frame = frames + current_frame;
+  cur_frame = frame_at(current_frame);
   
   /* Initialise frame */
   cur_frame->row = 0;
@@ -87,24 +256,304 @@ void create_scratch(void)
   cur_frame->first_column = 0;
   cur_frame->flags = 0;
   cur_frame->file = NULL;
+  cur_frame->device = 0;
+  cur_frame->inode = 0;
   cur_frame->alert = NULL;
-  cur_frame->line_count = 1;
-  cur_frame->line_buffers = malloc(sizeof(line_buffer_t));
+  cur_frame->content = NULL;
+  cur_frame->content_size = 0;
+  cur_frame->content_reserved = 0;
+  cur_frame->loaded = 0;
+  cur_frame->line_index.entries = NULL;
+  cur_frame->modified_row = -1;
+  cur_frame->modified_offset = 0;
+  cur_frame->malformed_row = -1;
+  cur_frame->pending_row = -1;
+  cur_frame->pending_column = -1;
+  cur_frame->language = find_language(NULL);
+  cur_frame->lexed = cur_frame->lexed_max = cur_frame->dirty_end = 0;
+  undo_create(&(cur_frame->undo));
+  document_create(&(cur_frame->document));
   
   /* Create one empty line */
-  cur_frame->line_buffers->used = 0;
-  cur_frame->line_buffers->allocated = 16;
-  cur_frame->line_buffers->line = malloc(16 * sizeof(char_t));
+  line_buffer_t lbuf;
+  lbuf.used = 0;
+  lbuf.line = NULL;
+  lbuf.width = 0;
+  lbuf.raw = NULL;
+  lbuf.raw_size = 0;
+  lbuf.columns = NULL;
+  lbuf.checkpoints = NULL;
+  lbuf.highlight = HIGHLIGHT_UNKNOWN;
+  lbuf.flags = 0;
+  materialise_line(&lbuf, &(cur_frame->document.arena));
+  document_append(&(cur_frame->document), &lbuf);
 }
 
 
 /**
- * Opens a new file
+ * Makes a jump in a frame
+ * 
+ * @param  frame  The frame
+ * @param  row    The line to jump to, negative to keep the current
+ * @param  col    The column to jump to, negative to keep the current
+ */
+static void jump_frame(frame_t* frame, pos_t row, pos_t col)
+{
+  if (row >= 0)
+    {
+      if (row >= document_lines(&(frame->document)))
+	row = document_lines(&(frame->document)) - 1;
+      if (row != frame->row)
+	compact_line(document_line(&(frame->document), frame->row));
+      frame->row = row;
+    }
+  if (col >= 0)
+    frame->column = col;
+}
+
+
+/**
+ * Read the content of a file that cannot be memory-mapped
+ * 
+ * @param   fd          File descriptor for the file
+ * @param   size        The reported size of the file, will be updated to the number of read bytes
+ * @param   block_size  The optimal reading block size
+ * @return              The content of the file, `NULL` on error
+ */
+static char* read_content(int fd, size_t* size, size_t block_size)
+{
+  size_t reported_size = *size;
+  char* buffer = malloc(reported_size * sizeof(char));
+  ssize_t got;
+  
+  for (*size = 0;;)
+    {
+      size_t read_block = reported_size - *size;
+      read_block = block_size < read_block ? block_size : read_block;
+      if (read_block == 0)
+	break;
+      if ((got = read(fd, buffer + *size, read_block)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  free(buffer);
+	  return NULL;
+	}
+      if (got == 0)
+	/* End of file */
+	break;
+      *size += (size_t)got;
+    }
+  
+  return buffer;
+}
+
+
+/**
+ * Release the content of a file
+ * 
+ * @param  content  The content of the file, may be `NULL`
+ * @param  size     The number of bytes in `content`, or reserved for it if it is memory-mapped
+ * @param  mapped   Whether `content` is memory-mapped
+ */
+static void release_content(char* content, size_t size, int_least8_t mapped)
+{
+  if (content == NULL)
+    return;
+  if (mapped)
+    munmap(content, size);
+  else
+    free(content);
+}
+
+
+/**
+ * Fill a page of a mapped file, that has been truncated to before the page,
+ * with zeroes rather than dying, the frame is found by `notice_truncated`
+ * 
+ * @param  signo    The signal, `SIGBUS`
+ * @param  info     Where the page was read
+ * @param  context  Not used
+ */
+static void fill_truncated(int signo, siginfo_t* info, void* context)
+{
+  char* page = (char*)((uintptr_t)(info->si_addr) / page_size * page_size);
+  (void) context;
+  
+  /* Anything but reading past the end of a file is a bug, that must still kill the process */
+  if ((info->si_code != BUS_ADRERR) ||
+      (mmap(page, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED))
+    signal(signo, SIG_DFL);
+  else
+    truncated = 1;
+}
+
+
+/**
+ * Start handling `SIGBUS`, which is raised when a mapped file is read after its end,
+ * as another process can truncate the file while it is open
+ */
+static void handle_truncation(void)
+{
+  struct sigaction action;
+  
+  if (__atomic_exchange_n(&page_size, (size_t)sysconf(_SC_PAGESIZE), __ATOMIC_RELAXED))
+    return;
+  memset(&action, 0, sizeof(struct sigaction));
+  action.sa_sigaction = fill_truncated;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&(action.sa_mask));
+  sigaction(SIGBUS, &action, NULL);
+}
+
+
+/**
+ * Append a block of lines, that are not kept in memory while they are not used, to a frame
+ * 
+ * @param  frame      The frame
+ * @param  raw        The content of the first line
+ * @param  end        The end of the content of the last line
+ * @param  lines      The number of lines
+ * @param  chars      The number of characters, excluding line breaks, in the lines
+ * @param  malformed  The index of the first of the lines that is not well-formed UTF-8, -1 if none
+ */
+static void append_block(frame_t* frame, const char* raw, const char* end, pos_t lines, pos_t chars, pos_t malformed)
+{
+  if ((malformed >= 0) && (frame->malformed_row < 0))
+    frame->malformed_row = document_lines(&(frame->document)) + malformed;
+  document_append_block(&(frame->document), raw, (size_t)(end - raw), lines, chars, malformed);
+}
+
+
+/**
+ * Index more of the content of a frame that is being loaded
+ * 
+ * @param  frame      The frame
+ * @param  budget     The number of bytes to index, whole lines are always indexed
+ * @param  min_lines  The minimum number of lines to index, unless the end of the content is reached
+ */
+static void index_content(frame_t* frame, size_t budget, pos_t min_lines)
+{
+  char* start = frame->content ? frame->content + frame->loaded : NULL;
+  char* content_end = frame->content + frame->content_size;
+  size_t limit = frame->loaded + budget;
+  int windowed = frame->content_size >= WINDOW_MIN_SIZE;
+  const char* block = start;
+  const char* block_end = start;
+  pos_t block_lines = 0, block_chars = 0, block_malformed = -1;
+  
+  /* Populate lines, they are views into the content of the file until they are edited */
+  while (frame->flags & FLAG_LOADING)
+    {
+      line_buffer_t lbuf;
+      view_line(&lbuf, start, content_end);
+      if (windowed)
+	{
+	  /* Large files are populated with blocks, the lines are indexed again when they are used */
+	  if ((lbuf.flags & LINE_MALFORMED) && (block_malformed < 0))
+	    block_malformed = block_lines;
+	  block_chars += lbuf.used;
+	  block_end = start + lbuf.raw_size;
+	  if (++block_lines == LINE_INDEX_STRIDE)
+	    {
+	      append_block(frame, block, block_end, block_lines, block_chars, block_malformed);
+	      block = block_end + 1;
+	      block_lines = block_chars = 0;
+	      block_malformed = -1;
+	    }
+	}
+      else
+	{
+	  document_append(&(frame->document), &lbuf);
+	  if ((lbuf.flags & LINE_MALFORMED) && (frame->malformed_row < 0))
+	    frame->malformed_row = document_lines(&(frame->document)) - 1;
+	}
+      line_index_add(&(frame->line_index), (size_t)(start - frame->content), lbuf.used, lbuf.flags & LINE_MALFORMED);
+      min_lines--;
+      if (start + lbuf.raw_size == content_end)
+	{
+	  frame->loaded = frame->content_size;
+	  frame->flags &= (int_least8_t)~FLAG_LOADING;
+	  /* The next time the file is opened, it does not have to be read to find its lines */
+	  if (frame->flags & FLAG_REPLACED)
+	    line_index_free(&(frame->line_index));
+	  else
+	    line_index_finish(&(frame->line_index), frame->content_size);
+	}
+      else
+	{
+	  /* Jump over the \n at the end of the line so the following lines does not appear to be empty */
+	  start += lbuf.raw_size + 1;
+	  frame->loaded = (size_t)(start - frame->content);
+	  if ((frame->loaded >= limit) && (min_lines <= 0))
+	    break;
+	}
+    }
+  if (block_lines)
+    append_block(frame, block, block_end, block_lines, block_chars, block_malformed);
+  
+  /* Make the jump to a line that was not indexed when it was requested, once the line is available */
+  if ((frame->pending_row >= 0) &&
+      ((frame->pending_row < document_lines(&(frame->document))) || !(frame->flags & FLAG_LOADING)))
+    {
+      jump_frame(frame, frame->pending_row, frame->pending_column);
+      frame->pending_row = -1;
+    }
+}
+
+
+/**
+ * Populate the lines of a frame from the line index of its file, without reading the file,
+ * the lines are indexed, block by block, when they are first looked up
+ * 
+ * @param  frame  The frame, its line index must have been loaded
+ */
+static void index_blocks(frame_t* frame)
+{
+  line_index_t* index = &(frame->line_index);
+  line_index_entry_t* entry = index->entries;
+  pos_t lines = (pos_t)(index->header.lines), row, count;
+  
+  for (row = 0; row < lines; row += count, entry++)
+    {
+      count = lines - row < LINE_INDEX_STRIDE ? lines - row : LINE_INDEX_STRIDE;
+      append_block(frame, frame->content + entry->offset, frame->content + (entry + 1)->offset - 1, count,
+		   (pos_t)((entry + 1)->chars - entry->chars), (pos_t)(entry->malformed));
+    }
+  
+  frame->loaded = frame->content_size;
+  line_index_free(index);
+}
+
+
+/**
+ * Free the resources of a frame
+ * 
+ * @param  frame  The frame
+ */
+static void release_frame(frame_t* frame)
+{
+  if (frame->file)
+    free(frame->file);
+  if (frame->alert)
+    free(frame->alert);
+  document_free(&(frame->document));
+  undo_free(&(frame->undo));
+  line_index_free(&(frame->line_index));
+  release_content(frame->content, (frame->flags & FLAG_MAPPED) ? frame->content_reserved : frame->content_size,
+		  (frame->flags & FLAG_MAPPED) != 0);
+}
+
+
+/**
+ * Read a file into a frame without adding the frame to the opened frames,
+ * this does not touch any shared state and can be done from any thread,
+ * interrupted saves of the file must have been finished with `recover_save`
  * 
  * @param   filename      The filename of the file to open
- * @return  0             The file was successfully opened
- * @return  <0            The file is already opened in the frame whose index is bitwise negation of the returned integer
- * @return  >0            Failed to open the file, the returned integer is an error code.
+ * @param   frame         Output parameter for the frame
+ * @return  0             The file was successfully read
+ * @return  >0            Failed to read the file, the returned integer is an error code.
  * 
  * @throws  EACCES        Search permission is denied for one of the directories in the path prefix of the path
  * @throws  EFAULT        Bad address
@@ -117,13 +566,8 @@ void create_scratch(void)
  * @throws  256           The file is not a regular file
  * @throws  257           Failed to read file
  */
-long open_file(char* filename)
+static long read_file(const char* filename, frame_t* frame)
 {
-  /* Return the ~index of the frame holding the file if it already exists */
-  pos_t found = find_file(filename);
-  if (found >= 0)
-    return ~found;
-  
   /* Verify that the file is a regular file or does not exist but can be created */
   int file_exists = 1;
   struct stat file_stats;
@@ -154,60 +598,59 @@ long open_file(char* filename)
   else if (S_ISREG(file_stats.st_mode) == 0)
     return 256;
   
-  /* Get the optimal reading block size */
-  size_t block_size = file_exists ? (size_t)(file_stats.st_blksize) : 0;
-  /* Get the size of the file */
-  size_t size = 0;
-  size_t reported_size = (size_t)(file_stats.st_size);
-  /* Buffer for the content file */
-  int8_t* buffer = file_exists ? malloc(reported_size * sizeof(int8_t)) : NULL;
-  
-  /* Read file */
-  size_t got;
-  FILE* file = file_exists ? fopen(filename, "r") : NULL;
+  /* Load the content of the file */
+  char* content = NULL;
+  size_t size = 0, reserved = 0;
+  int_least8_t mapped = 0;
   if (file_exists)
     {
-      for (;;)
+      int fd = open(filename, O_RDONLY);
+      if (fd < 0)
+	return 257;
+      if (fstat(fd, &file_stats))
 	{
-	  size_t read_block = reported_size - size;
-	  read_block = block_size < read_block ? block_size : read_block;
-	  if (read_block == 0)
-	    break;
-	  if ((got = fread(buffer + size, 1, read_block, file)) != read_block)
+	  close(fd);
+	  return 257;
+	}
+      if ((size = (size_t)(file_stats.st_size)))
+	{
+	  /* Map the file into memory, so that it does not need to be copied, with room after
+	   * it so that it can grow if it is saved in place; the mapping is shared so that the
+	   * saved bytes are what the mapping shows */
+	  handle_truncation();
+	  reserved = size + CONTENT_RESERVE;
+	  content = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	  if (content == MAP_FAILED)
+	    content = mmap(NULL, reserved = size, PROT_READ, MAP_SHARED, fd, 0);
+	  else if (mmap(content, size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+	    {
+	      munmap(content, reserved);
+	      content = MAP_FAILED;
+	    }
+	  if (content != MAP_FAILED)
+	    mapped = 1;
+	  else if ((content = read_content(fd, &size, (size_t)(file_stats.st_blksize))) == NULL)
 	    {
-	      if (feof(file))
-		{
-		  /* End of file */
-		  size += got;
-		  clearerr(file);
-		  break;
-		}
 	      /* Failed to read the file */
-	      free(buffer);
-	      clearerr(file);
-	      fclose(file);
+	      close(fd);
 	      return 257;
 	    }
-	  else
-	    size += got;
 	}
-      fclose(file);
+      close(fd);
     }
   
-  /* Count the number of lines */
-  pos_t lines = 1;
-  if (buffer)
-    for (size_t i = 0; i < size; i++)
-      if (*(buffer + i) == '\n')
-	lines++;
-  
   /* Copy filename so it later can be freed as well as get the real path */
   char* _filename = 0;
-  if (buffer)
+  if (file_exists)
     {
       _filename = malloc(PATH_MAX * sizeof(char));
       if (realpath(filename, _filename) == NULL)
-	return errno;
+	{
+	  int error = errno;
+	  free(_filename);
+	  release_content(content, mapped ? reserved : size, mapped);
+	  return error;
+	}
     }
   else
     {
@@ -220,96 +663,251 @@ long open_file(char* filename)
 	*(_filename + i) = *(filename + i);
     }
   
-  /* Ensure that another frame can be held */
-  prepare_frame_buffer();
+  /* Initialise the frame */
+  frame->row = 0;
+  frame->column = 0;
+  frame->mark_row = 0;
+  frame->mark_column = 0;
+  frame->first_row = 0;
+  frame->first_column = 0;
+  frame->flags = mapped ? FLAG_MAPPED : 0;
+  if (has_journal(_filename))
+    frame->flags |= FLAG_RECOVERABLE;
+  frame->file = _filename;
+  frame->device = file_exists ? file_stats.st_dev : 0;
+  frame->inode = file_exists ? file_stats.st_ino : 0;
+  frame->alert = NULL;
+  frame->content = content;
+  frame->content_size = size;
+  frame->content_reserved = reserved;
+  frame->loaded = 0;
+  frame->modified_row = -1;
+  frame->modified_offset = 0;
+  frame->malformed_row = -1;
+  frame->pending_row = -1;
+  frame->pending_column = -1;
+  frame->language = find_language(_filename);
+  frame->lexed = frame->lexed_max = frame->dirty_end = 0;
+  undo_create(&(frame->undo));
+  document_create(&(frame->document));
   
-  /* Create new frame */
-  current_frame = open_frames++;
-  cur_frame = frames + current_frame;
-  cur_frame->row = 0;
-  cur_frame->column = 0;
-  cur_frame->mark_row = 0;
-  cur_frame->mark_column = 0;
-  cur_frame->first_row = 0;
-  cur_frame->first_column = 0;
-  cur_frame->flags = 0;
-  cur_frame->file = _filename;
-  cur_frame->alert = NULL;
-  cur_frame->line_count = lines;
-  cur_frame->line_buffers = malloc((size_t)lines * sizeof(line_buffer_t));
-  for (upos_t i = 0; i < (upos_t)lines; i++)
+  /* A file whose lines are in the cache does not have to be read, otherwise index the
+   * beginning of the file now, and the rest while waiting for input */
+  if (content && line_index_load(&(frame->line_index), &file_stats))
+    index_blocks(frame);
+  else
     {
-      line_buffer_t* lbuf = cur_frame->line_buffers + i;
-      lbuf->used = 0;
-      lbuf->allocated = 4;
-      lbuf->line = malloc(4 * sizeof(char_t));
+      if (content)
+	line_index_start(&(frame->line_index), &file_stats);
+      else
+	frame->line_index.entries = NULL;
+      frame->flags |= FLAG_LOADING;
+      index_content(frame, LOAD_STEP, LOAD_FIRST_LINES);
     }
   
-  if (buffer)
-    {
-      /* Populate lines */
-      size_t bufptr = 0;
-      for (upos_t i = 0; i < (upos_t)lines; i++)
-	{
-	  /* Get the span of the line */
-	  size_t start = bufptr;
-	  pos_t chars = 0;
-	  while (bufptr < size)
-	    if (*(buffer + bufptr) == '\n')
-	      break;
-	    else
-	      if ((*(buffer + bufptr++) & 0xC0) != 0x80)
-		chars++;
-	  pos_t linesize = (pos_t)(bufptr - start);
-	  bufptr = start;
-	  
-	  /* Create line buffer and fill it with metadata */
-	  line_buffer_t* lbuf = cur_frame->line_buffers + i;
-	  lbuf->used = chars;
-	  if (lbuf->allocated < lbuf->used)
-	    {
-	      lbuf->allocated = lbuf->used;
-	      lbuf->line = realloc(lbuf->line, (size_t)(lbuf->allocated) * sizeof(char_t));
-	    }
-	  
-	  /* Fill the line with the data */
-	  for (pos_t j = 0, k = -1; j < linesize; j++)
-	    {
-	      int8_t c = *(buffer + bufptr++);
-	      if ((c & 0xC0) != 0x80)
-		{
-		  int8_t n = 0;
-		  while (c & 0x80)
-		    {
-		      n++;
-		      c = (int8_t)(c << 1);
-		    }
-		  *(lbuf->line + ++k) = c >> n;
-		}
-	      else
-		{
-		  if (k < 0)
-		    k = 0;
-		  *(lbuf->line + k) <<= 6;
-		  *(lbuf->line + k) |= c & 0x3F;
-		}
-	    }
-	  
-	  /* Jump over the \n at the end of the line so the following lines does not appear to be empty */
-	  bufptr++;
-	}
-      free(buffer);
-    }
-  else
+  return 0;
+}
+
+
+
+
+/**
+ * Add a frame that has been read with `read_file` to the opened frames and make it the current frame
+ * 
+ * @param   frame  The frame, it is released if its file is already opened
+ * @return  0      The frame was added
+ * @return  <0     The file is already opened in the frame whose index is bitwise negation of the returned integer
+ */
+static long add_frame(frame_t* frame)
+{
+  /* Return the ~index of the frame holding the file if it already exists */
+  pos_t found = frame->file ? lookup_frame(frame->device, frame->inode, frame->file) : -1;
+  if (found >= 0)
     {
-      /* No file was actually opened, an empty document has been created, keep it */
+      release_frame(frame);
+      return ~found;
     }
   
+  /* Ensure that another frame can be held */
+  prepare_frame_buffer();
+  
+  /* Create new frame */
+  current_frame = open_frames++;
+  cur_frame = frame_at(current_frame);
+  *cur_frame = *frame;
+  if (cur_frame->file)
+    register_frame(current_frame);
+  
   /* Report that a new frame as been created */
   return 0;
 }
 
 
+/**
+ * Opens a new file
+ * 
+ * @param   filename      The filename of the file to open
+ * @return  0             The file was successfully opened
+ * @return  <0            The file is already opened in the frame whose index is bitwise negation of the returned integer
+ * @return  >0            Failed to open the file, the returned integer is an error code.
+ * 
+ * @throws  EACCES        Search permission is denied for one of the directories in the path prefix of the path
+ * @throws  EFAULT        Bad address
+ * @throws  ELOOP         Too many symbolic links encountered while traversing the path.
+ * @throws  ENAMETOOLONG  The path is too long
+ * @throws  ENOENT        A component of the path does not exist, or the path is an empty string
+ * @throws  ENOMEM        Out of memory (i.e., kernel memory)
+ * @throws  ENOTDIR       A component of the path prefix of path is not a directory
+ * @throws  EOVERFLOW     The file size, inode number, or number of block is too large for the system
+ * @throws  256           The file is not a regular file
+ * @throws  257           Failed to read file
+ */
+long open_file(char* filename)
+{
+  frame_t frame;
+  long error;
+  
+  /* Return the ~index of the frame holding the file if it already exists */
+  pos_t found = find_file(filename);
+  if (found >= 0)
+    return ~found;
+  
+  /* Finish saving the file if the editor died while it was saved in place */
+  recover_save(filename);
+  if ((error = read_file(filename, &frame)))
+    return error;
+  return add_frame(&frame);
+}
+
+
+/**
+ * Read files on one of the threads of `open_files`
+ * 
+ * @param   data  The `file_batch_t` describing the files
+ * @return        `NULL`
+ */
+static void* read_files(void* data)
+{
+  file_batch_t* batch = data;
+  size_t i;
+  
+  while ((i = __atomic_fetch_add(&(batch->next), 1, __ATOMIC_RELAXED)) < batch->count)
+    *(batch->errors + i) = read_file(*(batch->filenames + i), batch->frames + i);
+  return NULL;
+}
+
+
+/**
+ * Read files in parallel, the files are not added to the opened frames
+ * until `add_file` is called, so they can be added in any order
+ * 
+ * @param   filenames  The filenames of the files to open
+ * @param   count      The number of elements in `filenames`
+ * @return             The files, `NULL` on error, free with `free` after
+ *                     every file has been passed to `add_file`
+ */
+file_batch_t* open_files(char* const* filenames, size_t count)
+{
+  file_batch_t* batch;
+  pthread_t* threads;
+  size_t i, n;
+  long cpus;
+  
+  batch = malloc(sizeof(file_batch_t) + count * (sizeof(frame_t) + sizeof(long)));
+  if (batch == NULL)
+    return NULL;
+  batch->filenames = filenames;
+  batch->count = count;
+  batch->next = 0;
+  batch->frames = (frame_t*)(batch + 1);
+  batch->errors = (long*)(batch->frames + count);
+  
+  /* Finish saving the files if the editor died while they were saved in place,
+     this replays and removes journals, so it cannot be done by the threads,
+     which may be given the same file twice */
+  for (i = 0; i < count; i++)
+    recover_save(*(filenames + i));
+  
+  /* Use one thread per processor, but no more threads than files, the calling thread is one of them */
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  n = cpus > 1 ? (size_t)cpus : 1;
+  n = n < count ? n : count;
+  n = n < OPEN_THREADS ? n : OPEN_THREADS;
+  threads = n > 1 ? malloc((n - 1) * sizeof(pthread_t)) : NULL;
+  if (threads == NULL)
+    n = 1;
+  for (i = 1; i < n; i++)
+    if (pthread_create(threads + i - 1, NULL, read_files, batch))
+      break;
+  n = i;
+  read_files(batch);
+  for (i = 1; i < n; i++)
+    pthread_join(*(threads + i - 1), NULL);
+  free(threads);
+  
+  return batch;
+}
+
+
+/**
+ * Add a file read by `open_files` to the opened frames and make it the current frame
+ * 
+ * @param   batch  The files returned by `open_files`
+ * @param   index  The index of the file in the filename list passed to `open_files`
+ * @return         See the return values and errors of `open_file`
+ */
+long add_file(file_batch_t* batch, size_t index)
+{
+  if (*(batch->errors + index))
+    return *(batch->errors + index);
+  return add_frame(batch->frames + index);
+}
+
+
+/**
+ * Get an opened frame
+ * 
+ * @param   index  The index of the frame
+ * @return         The frame, `NULL` if there is no frame with the index
+ */
+frame_t* get_frame(pos_t index)
+{
+  return (0 <= index) && (index < open_frames) ? frame_at(index) : NULL;
+}
+
+
+/**
+ * Change the file of a frame, after the frame has been written to it
+ * 
+ * @param  frame     The frame
+ * @param  filename  The real path of the file, the frame takes over the allocation
+ * @param  device    The device the file is stored on
+ * @param  inode     The inode of the file
+ */
+void set_frame_file(frame_t* frame, char* filename, dev_t device, ino_t inode)
+{
+  pos_t index = frame->file ? lookup_frame(frame->device, frame->inode, frame->file) : -1;
+  
+  if (index < 0)
+    for (index = 0; frame_at(index) != frame; index++)
+      ;
+  else
+    unregister_frame(index);
+  
+  if (frame->file != filename)
+    {
+      free(frame->file);
+      /* Highlight again from the top, the new name may belong to another language */
+      frame->language = find_language(filename);
+      frame->lexed = frame->lexed_max = frame->dirty_end = 0;
+    }
+  frame->file = filename;
+  frame->device = device;
+  frame->inode = inode;
+  register_frame(index);
+}
+
+
 /**
  * Find the frame that contains a specific file
  * 
@@ -319,26 +917,12 @@ long open_file(char* filename)
  */
 pos_t find_file(char* filename)
 {
-  char* f;
-  char* ff;
-  for (pos_t i = 0; i < open_frames; i++)
-    if ((ff = (frames + i)->file))
-      {
-	/* Check of the frames file matches the wanted file */
-	f = filename;
-	while ((*ff && *f) && (*ff == *f))
-	  {
-	    ff++;
-	    f++;
-	  }
-	
-	/* Report index of frame if it was match */
-	if ((*ff | *f) == 0)
-	  return (pos_t)i;
-      }
+  struct stat file_stats;
   
-  /* No frame contains the file */
-  return -1;
+  /* A file that exists is identified by its inode, even if it has multiple paths */
+  if (stat(filename, &file_stats) == 0)
+    return lookup_frame(file_stats.st_dev, file_stats.st_ino, NULL);
+  return lookup_frame(0, 0, filename);
 }
 
 
@@ -363,41 +947,405 @@ void alert(char* message)
  */
 void apply_jump(pos_t row, pos_t col)
 {
-  if (row >= 0)
+  if ((cur_frame->flags & FLAG_LOADING) && (row >= document_lines(&(cur_frame->document))))
     {
-      if (row >= cur_frame->line_count)
-	row = cur_frame->line_count - 1;
-      cur_frame->row = row;
+      /* The line has not been indexed yet, jump when it has */
+      cur_frame->pending_row = row;
+      cur_frame->pending_column = col;
     }
-  if (col >= 0)
-    cur_frame->column = col;
+  else
+    jump_frame(cur_frame, row, col);
 }
 
 
 /**
- * Free all frame resources
+ * Release the lines of the files that have not been used recently, so that their memory use
+ * stays within `WINDOW_BUDGET`, no lines obtained from the frames may be in use
  */
-void free_frames(void)
+void trim_frames(void)
+{
+  for (pos_t i = 0; i < open_frames; i++)
+    document_trim(&(frame_at(i)->document), WINDOW_BUDGET);
+}
+
+
+/**
+ * Find the files that have been truncated while they were mapped into memory, their
+ * frames no longer show their content, and tell the user
+ * 
+ * @return  Whether any file was found
+ */
+int notice_truncated(void)
 {
-  pos_t i, j, n;
-  char* buf;
+  struct stat attr;
+  frame_t* frame;
+  size_t start;
+  char* message;
+  size_t n;
+  int found = 0;
   
-#define _p_(object)  ((long)(void*)(object))
+  if (!truncated)
+    return 0;
+  truncated = 0;
   
-  for (i = 0; i < open_frames; i++)
+  for (pos_t i = 0; i < open_frames; i++)
     {
-      if ((buf = (frames + i)->file))
-	free(buf);
+      frame = frame_at(i);
+      if (!(frame->flags & FLAG_MAPPED) || (frame->flags & FLAG_REPLACED) || (frame->file == NULL) ||
+	  stat(frame->file, &attr) || (attr.st_dev != frame->device) || (attr.st_ino != frame->inode) ||
+	  ((size_t)(attr.st_size) >= frame->content_size))
+	continue;
       
-      if ((buf = (frames + i)->alert))
-	free(buf);
+      /* The rest of the file reads as zeroes, rather than a page at a time through `fill_truncated` */
+      start = ((size_t)(attr.st_size) + page_size - 1) / page_size * page_size;
+      if (start < frame->content_size)
+	mmap(frame->content + start, frame->content_size - start, PROT_READ,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
       
-      n = (frames + i)->line_count;
-      for (j = 0; j < n; j++)
-	free((frames + i)->line_buffers[j].line);
-      free((frames + i)->line_buffers);
+      /* The frame can only be saved by replacing the file, from what it shows */
+      frame->flags |= FLAG_REPLACED;
+      n = strlen(frame->file) + 64;
+      message = malloc(n * sizeof(char));
+      snprintf(message, n, "\033[31m%s was truncated on disk, its end reads as zeroes\033[m", frame->file);
+      if (frame->alert)
+	free(frame->alert);
+      frame->alert = message;
+      found = 1;
     }
+  return found;
+}
+
+
+/**
+ * Continue loading the files that are being loaded
+ * 
+ * @param   budget  The number of bytes to index in each file
+ * @return          Whether any file is still being loaded
+ */
+int load_files(size_t budget)
+{
+  int loading = 0;
+  for (pos_t i = 0; i < open_frames; i++)
+    if (frame_at(i)->flags & FLAG_LOADING)
+      {
+	index_content(frame_at(i), budget, 0);
+	loading |= (frame_at(i)->flags & FLAG_LOADING) != 0;
+      }
+  return loading;
+}
+
+
+/**
+ * Record that lines in the current frame have changed, so that they are highlighted again
+ * 
+ * @param  row       The first changed line
+ * @param  inserted  The number of lines inserted after `row`, negative if lines after it were removed
+ */
+void lines_changed(pos_t row, pos_t inserted)
+{
+  pos_t end = row + 1 + (inserted > 0 ? inserted : 0);
+  
+  /* Lines after the change have moved */
+  if (cur_frame->lexed_max > row + 1)
+    {
+      cur_frame->lexed_max += inserted;
+      cur_frame->lexed_max = cur_frame->lexed_max > row + 1 ? cur_frame->lexed_max : row + 1;
+    }
+  if (cur_frame->dirty_end > row + 1)
+    {
+      cur_frame->dirty_end += inserted;
+      cur_frame->dirty_end = cur_frame->dirty_end > row + 1 ? cur_frame->dirty_end : row + 1;
+    }
+  
+  if (cur_frame->lexed > row)
+    cur_frame->lexed = row;
+  if (cur_frame->dirty_end < end)
+    cur_frame->dirty_end = end;
+}
+
+
+/**
+ * Record that a line in the current frame has been edited, so that it is saved
+ * 
+ * @param  row  The edited line
+ */
+void mark_modified(pos_t row)
+{
+  line_buffer_t* lbuf;
+  size_t offset = 0;
+  
+  cur_frame->flags |= FLAG_MODIFIED;
+  if ((cur_frame->modified_row >= 0) && (cur_frame->modified_row <= row))
+    return;
+  
+  /* The line before it has not been edited, so the line begins where it began in the file */
+  if (row > 0)
+    {
+      lbuf = document_line(&(cur_frame->document), row - 1);
+      if (lbuf->raw && cur_frame->content)
+	offset = (size_t)(lbuf->raw - cur_frame->content) + lbuf->raw_size + 1;
+      offset = offset < cur_frame->content_size ? offset : cur_frame->content_size;
+    }
+  cur_frame->modified_row = row;
+  cur_frame->modified_offset = offset;
+}
+
+
+/**
+ * Get the number of lines at the beginning of a frame that are unedited views into `content`,
+ * back to back as they are in the file, and that are well-formed UTF-8
+ * 
+ * @param   frame  The frame
+ * @return         The number of lines
+ */
+pos_t clean_lines(const frame_t* frame)
+{
+  pos_t clean = document_lines(&(frame->document));
+  if ((frame->modified_row >= 0) && (frame->modified_row < clean))
+    clean = frame->modified_row;
+  if ((frame->malformed_row >= 0) && (frame->malformed_row < clean))
+    clean = frame->malformed_row;
+  return frame->content ? clean : 0;
+}
+
+
+/**
+ * Make sure that `lex_buffer`, `lex_classes` and `lex_marks` fit a number of characters
+ * 
+ * @param  n  The number of characters
+ */
+static void lex_reserve(pos_t n)
+{
+  if (lex_buffer_size < n)
+    {
+      lex_buffer_size = n;
+      lex_buffer = realloc(lex_buffer, (size_t)lex_buffer_size * sizeof(char_t));
+      lex_classes = realloc(lex_classes, (size_t)lex_buffer_size * sizeof(int_least8_t));
+      lex_marks = realloc(lex_marks, (size_t)lex_buffer_size * sizeof(int_least16_t));
+    }
+}
+
+
+/**
+ * Lex characters of a long line into `lex_buffer` and `lex_classes` from one of its checkpoints,
+ * and if it is the last checkpoint, add the checkpoints after it that are passed
+ * 
+ * @param   lex   The lexer
+ * @param   lbuf  The line, its checkpoints are for `lex`
+ * @param   low   The index of the checkpoint
+ * @param   stop  The character after the last character to lex
+ * @return        The lexer state after the characters
+ */
+static int_least16_t lex_checkpoint(lexer_t* lex, line_buffer_t* lbuf, pos_t low, pos_t stop)
+{
+  line_checkpoints_t* checkpoints = lbuf->checkpoints;
+  line_checkpoint_t* checkpoint = checkpoints->checkpoint + low;
+  pos_t start = checkpoint->index, at = start, i, k, n;
+  size_t offset = checkpoint->offset;
+  int_least16_t state;
+  
+  /* A view is decoded from the checkpoint rather than from the beginning of the line */
+  lex_reserve(stop - start);
+  if (lbuf->line)
+    n = read_line(lbuf, start, stop - start, lex_buffer);
+  else
+    n = utf8_decode(lbuf->raw + offset, lbuf->raw_size - offset, 0, stop - start, lex_buffer);
+  for (i = 0; i < n; i++)
+    *(lex_marks + i) = HIGHLIGHT_UNKNOWN;
+  state = lex(lex_buffer, n, checkpoint->state, lex_classes, lex_marks);
+  
+  /* Add the checkpoints after the last one, the states marked just before the
+   * end of the characters that were read depend on the characters after them */
+  if (low + 1 == checkpoints->valid)
+    {
+      stop = stop == lbuf->used ? stop : stop - LEX_LOOKAHEAD;
+      k = checkpoints->valid;
+      i = k * LEXER_SAMPLE > start ? k * LEXER_SAMPLE : start + 1;
+      for (; i < stop; i++)
+	if (*(lex_marks + i - start) != HIGHLIGHT_UNKNOWN)
+	  {
+	    if (k == checkpoints->allocated)
+	      {
+		checkpoints->allocated <<= 1;
+		checkpoints = realloc(checkpoints, sizeof(line_checkpoints_t) +
+				      (size_t)(checkpoints->allocated) * sizeof(line_checkpoint_t));
+		lbuf->checkpoints = checkpoints;
+	      }
+	    if (lbuf->line == NULL)
+	      offset += utf8_offset(lbuf->raw + offset, lbuf->raw_size - offset, i - at);
+	    checkpoint = checkpoints->checkpoint + k++;
+	    checkpoint->index = at = i;
+	    checkpoint->offset = offset;
+	    checkpoint->state = *(lex_marks + i - start);
+	    i = k * LEXER_SAMPLE > i ? k * LEXER_SAMPLE - 1 : i;
+	  }
+      checkpoints->valid = k;
+    }
+  return state;
+}
+
+
+/**
+ * Lex a line into `lex_buffer` and `lex_classes`, from the last checkpoint before the
+ * characters that are needed, and keep the checkpoints that are passed in long lines
+ * 
+ * @param   frame  The frame
+ * @param   lbuf   The line
+ * @param   state  The lexer state at the beginning of the line
+ * @param   first  The first character that is needed
+ * @param   end    The character after the last character that is needed, at most `lbuf->used`
+ * @param   start  Output parameter for the index of the character at the beginning of `lex_buffer`
+ * @return         The lexer state at the end of the line, if `end` is `lbuf->used`
+ */
+static int_least16_t lex_line(const frame_t* frame, line_buffer_t* lbuf, int_least16_t state,
+			      pos_t first, pos_t end, pos_t* start)
+{
+  lexer_t* lex = frame->language->lex;
+  line_checkpoints_t* checkpoints = lbuf->checkpoints;
+  pos_t stop = lbuf->used - end > LEX_LOOKAHEAD ? end + LEX_LOOKAHEAD : lbuf->used, low, high, valid, at;
+  
+  /* Short lines are lexed whole */
+  *start = 0;
+  if (lbuf->used < LEXER_SAMPLE)
+    {
+      lex_reserve(stop);
+      return lex(lex_buffer, read_line(lbuf, 0, stop, lex_buffer), state, lex_classes, NULL);
+    }
+  
+  /* Checkpoints are only kept for one lexer state at the beginning of the line */
+  if (checkpoints == NULL)
+    {
+      checkpoints = malloc(sizeof(line_checkpoints_t) + 16 * sizeof(line_checkpoint_t));
+      checkpoints->allocated = 16;
+      checkpoints->lexer = NULL;
+      lbuf->checkpoints = checkpoints;
+    }
+  if ((checkpoints->lexer != lex) || (checkpoints->start != state))
+    {
+      checkpoints->lexer = lex;
+      checkpoints->start = state;
+      checkpoints->valid = 1;
+      checkpoints->checkpoint->index = 0;
+      checkpoints->checkpoint->offset = 0;
+      checkpoints->checkpoint->state = state;
+    }
+  
+  /* Resume at the last checkpoint at or before the first character, the characters
+   * after the last checkpoint before it are lexed a window at a time, so that only
+   * the checkpoints, and not the whole line, are kept while they are passed */
+  for (;;)
+    {
+      checkpoints = lbuf->checkpoints;
+      for (low = 0, high = checkpoints->valid; high - low > 1;)
+	if ((checkpoints->checkpoint + (low + high) / 2)->index <= first)
+	  low = (low + high) / 2;
+	else
+	  high = (low + high) / 2;
+      at = (checkpoints->checkpoint + low)->index;
+      if ((low + 1 < checkpoints->valid) || (first - at < LEXER_WINDOW))
+	break;
+      valid = checkpoints->valid;
+      high = at + LEXER_WINDOW + LEX_LOOKAHEAD;
+      lex_checkpoint(lex, lbuf, low, high < lbuf->used ? high : lbuf->used);
+      /* Without anywhere to resume in the window, the rest is lexed at once */
+      if (lbuf->checkpoints->valid == valid)
+	break;
+    }
+  
+  *start = at;
+  return lex_checkpoint(lex, lbuf, low, stop);
+}
+
+
+/**
+ * Get the lexer state at the beginning of a line, highlighting the lines before it as needed
+ * 
+ * @param   frame  The frame
+ * @param   row    The line
+ * @return         The lexer state
+ */
+int_least16_t line_state(frame_t* frame, pos_t row)
+{
+  document_t* doc = &(frame->document);
+  pos_t start;
+  
+  /* Lines far before the line are not highlighted, neither are lines that were passed over that way */
+  if ((row - frame->lexed > LEX_HORIZON) ||
+      (row && (row <= frame->lexed) && (document_line(doc, row - 1)->highlight == HIGHLIGHT_UNKNOWN)))
+    frame->lexed = frame->lexed_max = row > LEX_HORIZON ? row - LEX_HORIZON : 0;
+  
+  while (frame->lexed < row)
+    {
+      pos_t i = frame->lexed;
+      line_buffer_t* lbuf = document_line(doc, i);
+      int_least16_t state = i ? document_line(doc, i - 1)->highlight : 0;
+      
+      /* The lines before may have been passed over */
+      if (state == HIGHLIGHT_UNKNOWN)
+	state = 0;
+      
+      /* Only the end of the line after its last checkpoint is lexed */
+      state = lex_line(frame, lbuf, state, lbuf->used, lbuf->used, &start);
+      
+      /* When a line ends in the same state as before, the lines after it are unaffected by the changes */
+      if ((state == lbuf->highlight) && (i + 1 >= frame->dirty_end))
+	frame->lexed = frame->lexed_max > i + 1 ? frame->lexed_max : i + 1;
+      else
+	frame->lexed = i + 1;
+      lbuf->highlight = state;
+      if (frame->lexed_max < frame->lexed)
+	frame->lexed_max = frame->lexed;
+    }
+  
+  return row ? document_line(doc, row - 1)->highlight : 0;
+}
+
+
+/**
+ * Highlight the characters of a line that are shown, highlighting the lines before it as needed
+ * 
+ * @param   frame    The frame
+ * @param   row      The line
+ * @param   first    The first character that is shown
+ * @param   end      The character after the last character that is shown
+ * @param   text     Output parameter for the characters from `first`, valid until the next call
+ * @param   classes  Output parameter for the `HIGHLIGHT_*` class of each character in `text`
+ * @return           The number of characters in `text`, fewer than asked for if the line ends before
+ */
+pos_t highlight_line(frame_t* frame, pos_t row, pos_t first, pos_t end,
+		     const char_t** text, const int_least8_t** classes)
+{
+  int_least16_t state = line_state(frame, row);
+  line_buffer_t* lbuf = document_line(&(frame->document), row);
+  pos_t start;
+  
+  end = end < lbuf->used ? end : lbuf->used;
+  first = first < end ? first : end;
+  lex_line(frame, lbuf, state, first, end, &start);
+  *text = lex_buffer + (first - start);
+  *classes = lex_classes + (first - start);
+  return end - first;
+}
+
+
+/**
+ * Free all frame resources
+ */
+void free_frames(void)
+{
+  pos_t i;
+  
+#define _p_(object)  ((long)(void*)(object))
+  
+  for (i = 0; i < open_frames; i++)
+    release_frame(frame_at(i));
+  for (i = 0; i < prepared_frames / FRAME_BLOCK; i++)
+    free(*(frames + i));
   free(frames);
+  free(frame_table);
+  free(lex_buffer);
+  free(lex_classes);
+  free(lex_marks);
 
 #undef _p_
 }
@@ -23,11 +23,21 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <limits.h>
 #include <errno.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "types.h"
+#include "lines.h"
+#include "document.h"
+#include "highlight.h"
+#include "undo.h"
+#include "lineindex.h"
 
 
 
@@ -46,29 +56,88 @@
  */
 #define  FLAG_MARK_ACTIVE  4
 
+/**
+ * The content of the file is memory-mapped rather than read into the heap
+ */
+#define  FLAG_MAPPED  8
 
+/**
+ * The content of the file has not been completely indexed yet
+ */
+#define  FLAG_LOADING  16
 
 /**
- * Frame line buffer information structure
+ * The file has been replaced since it was read, so `content` is no longer its content
  */
-typedef struct line_buffer
-{
-  /**
-   * The number of used characters in the line
-   */
-  pos_t used;
-  
-  /**
-   * The number of allocated characters for the line
-   */
-  pos_t allocated;
-  
-  /**
-   * The content of the line
-   */
-  char_t* line;
-  
-} line_buffer_t;
+#define  FLAG_REPLACED  32
+
+/**
+ * A journal of unsaved edits to the file was found when it was opened
+ */
+#define  FLAG_RECOVERABLE  64
+
+
+
+/**
+ * The number of bytes to index in each step while a file is being loaded
+ */
+#ifndef LOAD_STEP
+#define LOAD_STEP  (1 << 20)
+#endif
+
+/**
+ * The number of lines to index before a newly opened file is displayed
+ */
+#ifndef LOAD_FIRST_LINES
+#define LOAD_FIRST_LINES  256
+#endif
+
+/**
+ * The number of bytes a file must have to be loaded in windowed mode, in which its lines are
+ * indexed in blocks whose lines are only kept in memory while they are used, or edited
+ */
+#ifndef WINDOW_MIN_SIZE
+#define WINDOW_MIN_SIZE  (16 << 20)
+#endif
+
+/**
+ * The number of bytes the unedited lines of the blocks of a file may use at a time
+ */
+#ifndef WINDOW_BUDGET
+#define WINDOW_BUDGET  (16 << 20)
+#endif
+
+/**
+ * The number of lines before a line that are highlighted to find the lexer state at
+ * its beginning, when the lines before them have not been highlighted, the first
+ * of these lines is assumed to begin in the initial state
+ */
+#ifndef LEX_HORIZON
+#define LEX_HORIZON  4096
+#endif
+
+/**
+ * The number of frames allocated at a time, frames never move once allocated
+ */
+#ifndef FRAME_BLOCK
+#define FRAME_BLOCK  64
+#endif
+
+/**
+ * The maximum number of threads to read files with when multiple files are opened at once
+ */
+#ifndef OPEN_THREADS
+#define OPEN_THREADS  64
+#endif
+
+/**
+ * The number of bytes of address space reserved after a memory-mapped file,
+ * so that it can grow in place when it is saved without being moved
+ */
+#ifndef CONTENT_RESERVE
+#define CONTENT_RESERVE  ((size_t)1 << 30)
+#endif
+
 
 
 /**
@@ -116,27 +185,144 @@ typedef struct frame
    */
   char* file;
   
+  /**
+   * The device the file is stored on, not used if `inode` is zero
+   */
+  dev_t device;
+  
+  /**
+   * The inode of the file, zero if the file does not exist or there is no file
+   */
+  ino_t inode;
+  
   /**
    * The alert of the frame, `NULL` if none
    */
   char* alert;
   
   /**
-   * The number of lines in the frame
+   * The lines in the frame
+   */
+  document_t document;
+  
+  /**
+   * The content of the file, that unedited lines are views into, `NULL` if none
+   */
+  char* content;
+  
+  /**
+   * The number of bytes in `content`
+   */
+  size_t content_size;
+  
+  /**
+   * The number of bytes of address space reserved for `content` if it is memory-mapped
    */
-  pos_t line_count;
+  size_t content_reserved;
   
   /**
-   * The line buffes in the frame
+   * The number of bytes in `content` that have been indexed into lines
    */
-  line_buffer_t* line_buffers;
+  size_t loaded;
+  
+  /**
+   * The line index of the file, that is built while the file is
+   * being loaded, and cached once it has been loaded completely
+   */
+  line_index_t line_index;
+  
+  /**
+   * The first line that has been edited since the file was read or saved, -1 if none,
+   * the lines before it are unedited views into `content` at their place in the file
+   */
+  pos_t modified_row;
+  
+  /**
+   * The offset in the file of the first byte that may have been modified,
+   * that is, of the beginning of `modified_row`, if the file is `content`
+   */
+  size_t modified_offset;
+  
+  /**
+   * The first line that was not well-formed UTF-8 when it was read, -1 if none
+   */
+  pos_t malformed_row;
+  
+  /**
+   * The line of a jump that waits for the line to be indexed, -1 if none
+   */
+  pos_t pending_row;
+  
+  /**
+   * The column of the jump that waits for its line to be indexed
+   */
+  pos_t pending_column;
+  
+  /**
+   * The language the file is highlighted as
+   */
+  const language_t* language;
+  
+  /**
+   * The number of lines from the top whose highlighting state is up to date
+   */
+  pos_t lexed;
+  
+  /**
+   * The number of lines from the top that have been highlighted at some time,
+   * those after `dirty_end` are up to date if the line before them is
+   */
+  pos_t lexed_max;
+  
+  /**
+   * The line after the last line that has changed since it was highlighted
+   */
+  pos_t dirty_end;
+  
+  /**
+   * The edits that have been made in the frame
+   */
+  undo_log_t undo;
   
 } frame_t;
 
 
+/**
+ * Files that are read in parallel by `open_files`
+ */
+typedef struct file_batch
+{
+  /**
+   * The filenames of the files
+   */
+  char* const* filenames;
+  
+  /**
+   * The number of files
+   */
+  size_t count;
+  
+  /**
+   * The index of the next file to read
+   */
+  size_t next;
+  
+  /**
+   * The frames the files were read into
+   */
+  frame_t* frames;
+  
+  /**
+   * For each file, 0 if it was read and otherwise the error code as returned by `open_file`
+   */
+  long* errors;
+  
+} file_batch_t;
+
+
 
 /**
- * Prepare the frame buffer to hold one more frame
+ * Prepare the frame buffer to hold one more frame, frames that are already held are not moved
  */
 void prepare_frame_buffer(void);
 
@@ -166,6 +352,26 @@ void create_scratch(void);
  */
 long open_file(char* filename);
 
+/**
+ * Read files in parallel, the files are not added to the opened frames
+ * until `add_file` is called, so they can be added in any order
+ * 
+ * @param   filenames  The filenames of the files to open
+ * @param   count      The number of elements in `filenames`
+ * @return             The files, `NULL` on error, free with `free` after
+ *                     every file has been passed to `add_file`
+ */
+file_batch_t* open_files(char* const* filenames, size_t count);
+
+/**
+ * Add a file read by `open_files` to the opened frames and make it the current frame
+ * 
+ * @param   batch  The files returned by `open_files`
+ * @param   index  The index of the file in the filename list passed to `open_files`
+ * @return         See the return values and errors of `open_file`
+ */
+long add_file(file_batch_t* batch, size_t index);
+
 /**
  * Find the frame that contains a specific file
  * 
@@ -173,7 +379,25 @@ long open_file(char* filename);
  * @return  >=0       The index of the frame
  * @return  -1        No frame contains the file
  */
-pos_t find_file(char* filename) __attribute__((pure));
+pos_t find_file(char* filename);
+
+/**
+ * Get an opened frame
+ * 
+ * @param   index  The index of the frame
+ * @return         The frame, `NULL` if there is no frame with the index
+ */
+frame_t* get_frame(pos_t index) __attribute__((pure));
+
+/**
+ * Change the file of a frame, after the frame has been written to it
+ * 
+ * @param  frame     The frame
+ * @param  filename  The real path of the file, the frame takes over the allocation
+ * @param  device    The device the file is stored on
+ * @param  inode     The inode of the file
+ */
+void set_frame_file(frame_t* frame, char* filename, dev_t device, ino_t inode);
 
 /**
  * Adds an alert to the current frame
@@ -190,6 +414,75 @@ void alert(char* message);
  */
 void apply_jump(pos_t row, pos_t col);
 
+/**
+ * Release the lines of the files that have not been used recently, so that their memory use
+ * stays within `WINDOW_BUDGET`, no lines obtained from the frames may be in use
+ */
+void trim_frames(void);
+
+/**
+ * Find the files that have been truncated while they were mapped into memory, their
+ * frames no longer show their content, and tell the user
+ * 
+ * @return  Whether any file was found
+ */
+int notice_truncated(void);
+
+/**
+ * Continue loading the files that are being loaded
+ * 
+ * @param   budget  The number of bytes to index in each file
+ * @return          Whether any file is still being loaded
+ */
+int load_files(size_t budget);
+
+/**
+ * Record that lines in the current frame have changed, so that they are highlighted again
+ * 
+ * @param  row       The first changed line
+ * @param  inserted  The number of lines inserted after `row`, negative if lines after it were removed
+ */
+void lines_changed(pos_t row, pos_t inserted);
+
+/**
+ * Record that a line in the current frame has been edited, so that it is saved
+ * 
+ * @param  row  The edited line
+ */
+void mark_modified(pos_t row);
+
+/**
+ * Get the number of lines at the beginning of a frame that are unedited views into `content`,
+ * back to back as they are in the file, and that are well-formed UTF-8
+ * 
+ * @param   frame  The frame
+ * @return         The number of lines
+ */
+pos_t clean_lines(const frame_t* frame) __attribute__((pure));
+
+/**
+ * Get the lexer state at the beginning of a line, highlighting the lines before it as needed
+ * 
+ * @param   frame  The frame
+ * @param   row    The line
+ * @return         The lexer state
+ */
+int_least16_t line_state(frame_t* frame, pos_t row);
+
+/**
+ * Highlight the characters of a line that are shown, highlighting the lines before it as needed
+ * 
+ * @param   frame    The frame
+ * @param   row      The line
+ * @param   first    The first character that is shown
+ * @param   end      The character after the last character that is shown
+ * @param   text     Output parameter for the characters from `first`, valid until the next call
+ * @param   classes  Output parameter for the `HIGHLIGHT_*` class of each character in `text`
+ * @return           The number of characters in `text`, fewer than asked for if the line ends before
+ */
+pos_t highlight_line(frame_t* frame, pos_t row, pos_t first, pos_t end,
+		     const char_t** text, const int_least8_t** classes);
+
 /**
  * Free all frame resources
  */
@@ -0,0 +1,129 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __GLYPH_H__
+#define __GLYPH_H__
+
+
+#include <stdlib.h>
+
+#include "types.h"
+
+
+
+/**
+ * The number of characters outside the Basic Multilingual Plane whose glyphs are cached
+ */
+#ifndef GLYPH_CACHE
+#define GLYPH_CACHE  64
+#endif
+
+
+
+/**
+ * An ordinary character
+ */
+#define  GLYPH_PLAIN  0
+
+/**
+ * A control character, drawn as the character in the position 64 positions above it
+ */
+#define  GLYPH_CONTROL  1
+
+/**
+ * A value that is not a character
+ */
+#define  GLYPH_INVALID  2
+
+/**
+ * A horizontal tab
+ */
+#define  GLYPH_TAB  3
+
+/**
+ * U+2010 hyphen
+ */
+#define  GLYPH_HYPHEN  4
+
+/**
+ * U+2011 non-breaking hyphen
+ */
+#define  GLYPH_NB_HYPHEN  5
+
+/**
+ * U+00A0 no-break space
+ */
+#define  GLYPH_NBSP  6
+
+/**
+ * U+00AD soft hyphen
+ */
+#define  GLYPH_SOFT_HYPHEN  7
+
+
+
+/**
+ * How a character is drawn
+ */
+typedef struct glyph
+{
+  /**
+   * The character as UTF-8, NUL-terminated
+   */
+  char utf8[7];
+  
+  /**
+   * The number of bytes in `utf8`
+   */
+  int_least8_t length;
+  
+  /**
+   * The number of columns the character occupies, 0 for combining characters
+   */
+  int_least8_t width;
+  
+  /**
+   * How the character is highlighted, one of the `GLYPH_*` values
+   */
+  int_least8_t class;
+  
+  /**
+   * The character drawn in place of the character
+   */
+  char_t shown;
+  
+} glyph_t;
+
+
+
+/**
+ * Look up how a character is drawn
+ * 
+ * @param   c  The character
+ * @return     The glyph of the character, valid until `glyph_free` is called
+ */
+const glyph_t* glyph_get(char_t c);
+
+/**
+ * Free the cached glyphs
+ */
+void glyph_free(void);
+
+
+#endif
+
@@ -0,0 +1,339 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "highlight.h"
+
+
+/**
+ * Lexer mode: ordinary text
+ */
+#define  MODE_NORMAL  0
+
+/**
+ * Lexer mode: in a block comment
+ */
+#define  MODE_BLOCK_COMMENT  1
+
+/**
+ * Lexer mode: in a double-quoted string
+ */
+#define  MODE_DOUBLE_QUOTED  2
+
+/**
+ * Lexer mode: in a single-quoted string
+ */
+#define  MODE_SINGLE_QUOTED  3
+
+/**
+ * Lexer mode: in a here-document, the rest of the state is a hash of its delimiter,
+ * in the other modes, a hash there is of a here-document that starts on the next line
+ */
+#define  MODE_HEREDOC  4
+
+/**
+ * Lexer mode: in a comment that ends at the end of the line, only used within lines
+ */
+#define  MODE_LINE_COMMENT  5
+
+/**
+ * The bits of a lexer state that hold the mode
+ */
+#define  MODE_MASK  7
+
+/**
+ * Lexer flag, only used within lines: the character before cannot be followed by a shell comment
+ */
+#define  MODE_AFTER_WORD  8
+
+
+/**
+ * Set the class of a range of characters
+ */
+#define  CLASSIFY(START, END, CLASS)				\
+  do								\
+    if (classes)						\
+      for (pos_t k_ = (START), e_ = (END); k_ < e_; k_++)	\
+	*(classes + k_) = (CLASS);				\
+  while (0)
+
+/**
+ * Mark that lexing can be resumed at a character
+ */
+#define  MARK(AT, STATE)			\
+  do						\
+    if (marks)					\
+      *(marks + (AT)) = (int_least16_t)(STATE);	\
+  while (0)
+
+
+
+/**
+ * Hash a here-document delimiter into the bits of a lexer state that are not used by the mode,
+ * a line that is not the delimiter but has the same hash ends the here-document too
+ * 
+ * @param   text  The delimiter
+ * @param   n     The number of characters in `text`
+ * @return        The hash, shifted into place, never zero
+ */
+__attribute__((pure))
+static int_least16_t delimiter_hash(const char_t* text, pos_t n)
+{
+  uint_least32_t hash = 2166136261U;
+  while (n--)
+    hash = (hash ^ (uint_least32_t)*text++) * 16777619U;
+  return (int_least16_t)((hash % 0x07FF + 1) << 4);
+}
+
+
+/**
+ * Lex a line of a file where `#` starts a comment
+ * 
+ * @param   text     The characters of the line
+ * @param   n        The number of characters in `text`
+ * @param   state    The lexer state at the beginning of the line
+ * @param   classes  Output buffer for the class of each character, may be `NULL`
+ * @param   marks    Output buffer for the lexer state where lexing can be resumed, may be `NULL`
+ * @return           The lexer state at the end of the line
+ */
+static int_least16_t lex_plain(const char_t* text, pos_t n, int_least16_t state,
+			       int_least8_t* classes, int_least16_t* marks)
+{
+  pos_t i = 0;
+  
+  if (state != MODE_LINE_COMMENT)
+    for (; (i < n) && (*(text + i) != '#'); i++)
+      MARK(i, MODE_NORMAL);
+  CLASSIFY(0, i, HIGHLIGHT_NORMAL);
+  CLASSIFY(i, n, HIGHLIGHT_COMMENT);
+  for (; marks && (i < n); i++)
+    MARK(i, MODE_LINE_COMMENT);
+  return MODE_NORMAL;
+}
+
+
+/**
+ * Lex a line of C, or a language with the same comments and string literals
+ * 
+ * @param   text     The characters of the line
+ * @param   n        The number of characters in `text`
+ * @param   state    The lexer state at the beginning of the line
+ * @param   classes  Output buffer for the class of each character, may be `NULL`
+ * @param   marks    Output buffer for the lexer state where lexing can be resumed, may be `NULL`
+ * @return           The lexer state at the end of the line
+ */
+static int_least16_t lex_c(const char_t* text, pos_t n, int_least16_t state,
+			   int_least8_t* classes, int_least16_t* marks)
+{
+  pos_t i = 0, start;
+  char_t c;
+  
+  /* Every token is at most two characters, so that lexing can be resumed almost anywhere */
+  while (i < n)
+    {
+      MARK(i, state);
+      start = i;
+      c = *(text + i++);
+      if (state == MODE_LINE_COMMENT)
+	CLASSIFY(start, i, HIGHLIGHT_COMMENT);
+      else if (state == MODE_BLOCK_COMMENT)
+	{
+	  if ((c == '*') && (i < n) && (*(text + i) == '/'))
+	    {
+	      state = MODE_NORMAL;
+	      i++;
+	    }
+	  CLASSIFY(start, i, HIGHLIGHT_COMMENT);
+	}
+      else if ((state == MODE_DOUBLE_QUOTED) || (state == MODE_SINGLE_QUOTED))
+	{
+	  if (c == '\\')
+	    i += i < n;
+	  else if (c == (state == MODE_DOUBLE_QUOTED ? '"' : '\''))
+	    state = MODE_NORMAL;
+	  CLASSIFY(start, i, HIGHLIGHT_STRING);
+	}
+      else if ((c == '/') && (i < n) && ((*(text + i) == '/') || (*(text + i) == '*')))
+	{
+	  /* Do not let the * in the opening end the comment */
+	  state = *(text + i++) == '/' ? MODE_LINE_COMMENT : MODE_BLOCK_COMMENT;
+	  CLASSIFY(start, i, HIGHLIGHT_COMMENT);
+	}
+      else if ((c == '"') || (c == '\''))
+	{
+	  state = c == '"' ? MODE_DOUBLE_QUOTED : MODE_SINGLE_QUOTED;
+	  CLASSIFY(start, i, HIGHLIGHT_STRING);
+	}
+      else
+	CLASSIFY(start, i, HIGHLIGHT_NORMAL);
+    }
+  
+  /* String literals and line comments end at the end of the line */
+  return state == MODE_BLOCK_COMMENT ? state : MODE_NORMAL;
+}
+
+
+/**
+ * Lex a line of a shell script
+ * 
+ * @param   text     The characters of the line
+ * @param   n        The number of characters in `text`
+ * @param   state    The lexer state at the beginning of the line
+ * @param   classes  Output buffer for the class of each character, may be `NULL`
+ * @param   marks    Output buffer for the lexer state where lexing can be resumed, may be `NULL`
+ * @return           The lexer state at the end of the line
+ */
+static int_least16_t lex_shell(const char_t* text, pos_t n, int_least16_t state,
+			       int_least8_t* classes, int_least16_t* marks)
+{
+  int_least16_t heredoc = state & ~(MODE_MASK | MODE_AFTER_WORD);
+  int after_word = (state & MODE_AFTER_WORD) != 0;
+  pos_t i = 0, start;
+  char_t c;
+  
+  if ((state & MODE_MASK) == MODE_HEREDOC)
+    {
+      /* The body ends with a line that only contains the delimiter, possibly indented with tabs */
+      for (start = 0; (start < n) && (*(text + start) == '\t'); start++)
+	;
+      CLASSIFY(0, n, HIGHLIGHT_STRING);
+      return heredoc == delimiter_hash(text + start, n - start) ? MODE_NORMAL : state;
+    }
+  
+  state &= MODE_MASK;
+  while (i < n)
+    {
+      /* `#` only starts a comment at the beginning of a word */
+      start = i;
+      if (start > 0)
+	after_word = (*(text + start - 1) != ' ') && (*(text + start - 1) != '\t') && (*(text + start - 1) != ';');
+      MARK(start, state | heredoc | (after_word ? MODE_AFTER_WORD : 0));
+      c = *(text + i++);
+      if (state == MODE_LINE_COMMENT)
+	CLASSIFY(start, i, HIGHLIGHT_COMMENT);
+      else if ((state == MODE_SINGLE_QUOTED) || (state == MODE_DOUBLE_QUOTED))
+	{
+	  /* Only double-quoted strings have escapes, strings may span multiple lines */
+	  if ((c == '\\') && (state == MODE_DOUBLE_QUOTED))
+	    i += i < n;
+	  else if (c == (state == MODE_SINGLE_QUOTED ? '\'' : '"'))
+	    state = MODE_NORMAL;
+	  CLASSIFY(start, i, HIGHLIGHT_STRING);
+	}
+      else if ((c == '#') && !after_word)
+	{
+	  state = MODE_LINE_COMMENT;
+	  CLASSIFY(start, i, HIGHLIGHT_COMMENT);
+	}
+      else if (c == '\\')
+	{
+	  i += i < n;
+	  CLASSIFY(start, i, HIGHLIGHT_NORMAL);
+	}
+      else if ((c == '\'') || (c == '"'))
+	{
+	  CLASSIFY(start, i, HIGHLIGHT_STRING);
+	  state = c == '\'' ? MODE_SINGLE_QUOTED : MODE_DOUBLE_QUOTED;
+	}
+      else if ((c == '<') && (i + 1 < n) && (*(text + i) == '<') && (*(text + i + 1) != '<'))
+	{
+	  /* A here-document starts on the next line, the delimiter may be quoted */
+	  pos_t first;
+	  i++;
+	  i += *(text + i) == '-';
+	  while ((i < n) && ((*(text + i) == ' ') || (*(text + i) == '\t')))
+	    i++;
+	  i += (i < n) && ((*(text + i) == '\'') || (*(text + i) == '"'));
+	  for (first = i; i < n; i++)
+	    if (((c = *(text + i)) != '_') && !(('0' <= c) && (c <= '9')) &&
+		!(('a' <= (c | 32)) && ((c | 32) <= 'z')))
+	      break;
+	  if (i > first)
+	    heredoc = delimiter_hash(text + first, i - first);
+	  i += (i < n) && ((*(text + i) == '\'') || (*(text + i) == '"'));
+	  CLASSIFY(start, i, HIGHLIGHT_NORMAL);
+	}
+      else
+	CLASSIFY(start, i, HIGHLIGHT_NORMAL);
+    }
+  
+  /* Comments end at the end of the line */
+  state = state == MODE_LINE_COMMENT ? MODE_NORMAL : state;
+  if (heredoc && (state == MODE_NORMAL))
+    return heredoc | MODE_HEREDOC;
+  return state;
+}
+
+
+
+/**
+ * Filename extensions for C-like languages
+ */
+static const char* const c_extensions[] =
+  {
+    "c", "h", "cc", "hh", "cpp", "hpp", "cxx", "hxx", "java", "js", "ts", "go", "rs", "css", "cs", NULL
+  };
+
+/**
+ * Filename extensions for shell scripts
+ */
+static const char* const shell_extensions[] =
+  {
+    "sh", "bash", "zsh", "ksh", NULL
+  };
+
+/**
+ * No filename extensions
+ */
+static const char* const no_extensions[] = { NULL };
+
+/**
+ * The languages that can be highlighted, the last one is used for unrecognised files
+ */
+static const language_t languages[] =
+  {
+    { "C", c_extensions, lex_c },
+    { "Shell", shell_extensions, lex_shell },
+    { "Text", no_extensions, lex_plain }
+  };
+
+
+
+/**
+ * Find the language of a file
+ * 
+ * @param   filename  The name of the file, `NULL` for a buffer without a file
+ * @return            The language, a language that only highlights `#` comments if not recognised
+ */
+const language_t* find_language(const char* filename)
+{
+  const char* extension = NULL;
+  size_t i, j;
+  
+  for (i = 0; filename && *(filename + i); i++)
+    if (*(filename + i) == '.')
+      extension = filename + i + 1;
+    else if (*(filename + i) == '/')
+      extension = NULL;
+  
+  for (i = 0; extension && (i < sizeof(languages) / sizeof(*languages)); i++)
+    for (j = 0; *((languages + i)->extensions + j); j++)
+      if (!strcmp(extension, *((languages + i)->extensions + j)))
+	return languages + i;
+  return languages + sizeof(languages) / sizeof(*languages) - 1;
+}
+
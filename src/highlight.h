@@ -0,0 +1,114 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __HIGHLIGHT_H__
+#define __HIGHLIGHT_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+
+
+/**
+ * The lexer state of a line that has not been highlighted
+ */
+#define  HIGHLIGHT_UNKNOWN  (-1)
+
+/**
+ * Ordinary text
+ */
+#define  HIGHLIGHT_NORMAL  0
+
+/**
+ * A comment
+ */
+#define  HIGHLIGHT_COMMENT  1
+
+/**
+ * A string literal, or the body of a here-document
+ */
+#define  HIGHLIGHT_STRING  2
+
+
+
+/**
+ * The number of characters after a character that its class, and
+ * the lexer state at it if lexing can be resumed there, depend on
+ */
+#define  LEX_LOOKAHEAD  2
+
+
+
+/**
+ * Lex a line, or the rest of a line from a character where lexing can be resumed
+ * 
+ * The class of a character depends only on the lexer state at the beginning of the line,
+ * the characters before it, and the `LEX_LOOKAHEAD` characters after it, so the beginning
+ * of a line can be lexed without the rest of it
+ * 
+ * @param   text     The characters of the line, or of the rest of the line
+ * @param   n        The number of characters in `text`
+ * @param   state    The lexer state at the beginning of the line, 0 at the beginning of the
+ *                   file, or the lexer state marked at the first character of `text`
+ * @param   classes  Output buffer for the `HIGHLIGHT_*` class of each character, may be `NULL`
+ * @param   marks    Output buffer for the lexer state at each character where lexing can be
+ *                   resumed, the elements for the other characters are not changed, may be `NULL`
+ * @return           The lexer state at the end of the line, never negative
+ */
+typedef int_least16_t lexer_t(const char_t* text, pos_t n, int_least16_t state,
+			      int_least8_t* classes, int_least16_t* marks);
+
+
+/**
+ * A language that can be highlighted
+ */
+typedef struct language
+{
+  /**
+   * The name of the language
+   */
+  const char* name;
+  
+  /**
+   * The filename extensions of the language, without the dot, `NULL`-terminated
+   */
+  const char* const* extensions;
+  
+  /**
+   * The lexer of the language
+   */
+  lexer_t* lex;
+  
+} language_t;
+
+
+
+/**
+ * Find the language of a file
+ * 
+ * @param   filename  The name of the file, `NULL` for a buffer without a file
+ * @return            The language, a language that only highlights `#` comments if not recognised
+ */
+const language_t* find_language(const char* filename) __attribute__((pure));
+
+
+#endif
+
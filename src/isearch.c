@@ -0,0 +1,629 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "isearch.h"
+#include "edit.h"
+
+
+/**
+ * The currently active frame
+ */
+extern frame_t* cur_frame;
+
+/**
+ * The frame that is being searched, `NULL` if no search is in progress
+ */
+static frame_t* searching = NULL;
+
+/**
+ * The states of the search, the last one is the current state
+ */
+static isearch_state_t* states = NULL;
+
+/**
+ * The number of states in `states`
+ */
+static size_t depth = 0;
+
+/**
+ * The number of states that fit in `states`
+ */
+static size_t states_size = 0;
+
+/**
+ * The characters that have been typed, the current pattern is
+ * as many of them as the current state says
+ */
+static char_t* typed = NULL;
+
+/**
+ * The number of characters that fit in `typed`
+ */
+static pos_t typed_size = 0;
+
+/**
+ * The current pattern
+ */
+static search_pattern_t pattern;
+
+/**
+ * The pattern of the last search, searched for again if the search is repeated before anything is typed
+ */
+static char_t* last_pattern = NULL;
+
+/**
+ * The number of characters in `last_pattern`
+ */
+static pos_t last_length = 0;
+
+/**
+ * The count of the occurrences of the pattern in the frame
+ */
+static count_t counting;
+
+/**
+ * Whether counting the occurrences of the current pattern was stopped
+ */
+static int count_stopped = 0;
+
+/**
+ * The line of the point when the search started
+ */
+static pos_t origin_row;
+
+/**
+ * The column of the point when the search started
+ */
+static pos_t origin_column;
+
+
+
+/**
+ * Get the current state of the search
+ * 
+ * @return  The current state
+ */
+static isearch_state_t* current(void)
+{
+  return states + depth - 1;
+}
+
+
+/**
+ * Check whether `counting` is a count of the current pattern
+ * 
+ * @return  Whether the count is of the current pattern
+ */
+static int counts_pattern(void)
+{
+  return counting.parts && (counting.length == pattern.length) && (counting.regexp == (pattern.regexp != NULL)) &&
+    !memcmp(counting.chars, pattern.chars, (size_t)(pattern.length) * sizeof(char_t));
+}
+
+
+/**
+ * Check whether the occurrences of the current pattern should be counted some more
+ * 
+ * @return  Whether `count_step` should be called
+ */
+static int count_pending(void)
+{
+  if (!pattern.length || (current()->flags & ISEARCH_INCOMPLETE) || (searching->flags & FLAG_LOADING))
+    return 0;
+  if (!counts_pattern())
+    return 1;
+  return !count_stopped && !count_done(&counting);
+}
+
+
+/**
+ * Make a state the current state of the search
+ * 
+ * @param  state  The state, the point is recorded as it is now
+ */
+static void push_state(isearch_state_t state)
+{
+  if (depth == states_size)
+    states = realloc(states, (states_size = states_size * 2 + 8) * sizeof(isearch_state_t));
+  state.point_row = cur_frame->row;
+  state.point_column = cur_frame->column;
+  state.index = 0;
+  *(states + depth++) = state;
+}
+
+
+/**
+ * Prepare the pattern of the current state
+ */
+static void compile_pattern(void)
+{
+  isearch_state_t* state = current();
+  
+  search_free(&pattern);
+  state->flags &= (int_least8_t)~ISEARCH_INCOMPLETE;
+  if (!(state->flags & ISEARCH_REGEXP))
+    search_compile(&pattern, typed, state->length);
+  else if (search_compile_regexp(&pattern, typed, state->length))
+    state->flags |= ISEARCH_INCOMPLETE;
+}
+
+
+/**
+ * Move the point to the occurrence the current state has found
+ */
+static void goto_match(void)
+{
+  isearch_state_t* state = current();
+  pos_t column = state->column;
+  if (!(state->flags & ISEARCH_BACKWARD))
+    column += state->size;
+  set_point(state->row, column);
+  state->point_row = state->row;
+  state->point_column = column;
+}
+
+
+/**
+ * Return to the previous state of the search
+ */
+static void pop_state(void)
+{
+  depth--;
+  compile_pattern();
+  set_point(current()->point_row, current()->point_column);
+}
+
+
+/**
+ * Stop searching
+ * 
+ * @param  keep  Whether to leave the point where it is, rather than moving it back to where the search started
+ */
+static void end_search(int keep)
+{
+  isearch_state_t* state = current();
+  
+  if (state->length)
+    {
+      last_pattern = realloc(last_pattern, (size_t)(state->length) * sizeof(char_t));
+      memcpy(last_pattern, typed, (size_t)(state->length) * sizeof(char_t));
+      last_length = state->length;
+    }
+  
+  /* Like in Emacs, the mark is left where the search started */
+  if (!keep)
+    set_point(origin_row, origin_column);
+  else if ((cur_frame->row != origin_row) || (cur_frame->column != origin_column))
+    {
+      cur_frame->mark_row = origin_row;
+      cur_frame->mark_column = origin_column;
+      cur_frame->flags |= FLAG_MARK_SET;
+    }
+  
+  count_free(&counting);
+  search_free(&pattern);
+  searching = NULL;
+  depth = 0;
+}
+
+
+/**
+ * Start searching in the current frame
+ * 
+ * @param  flags  `ISEARCH_BACKWARD` and `ISEARCH_REGEXP`
+ */
+static void start_search(int_least8_t flags)
+{
+  line_buffer_t* lbuf = document_line(&(cur_frame->document), cur_frame->row);
+  isearch_state_t state;
+  
+  searching = cur_frame;
+  origin_row = cur_frame->row;
+  origin_column = cur_frame->column < lbuf->used ? cur_frame->column : lbuf->used;
+  if (typed == NULL)
+    typed = malloc((size_t)(typed_size = 16) * sizeof(char_t));
+  
+  state.length = 0;
+  state.row = origin_row;
+  state.column = origin_column;
+  state.size = 0;
+  state.flags = flags;
+  depth = 0;
+  push_state(state);
+  compile_pattern();
+}
+
+
+/**
+ * Add a character to the pattern
+ * 
+ * @param  c  The character
+ */
+static void extend_pattern(char_t c)
+{
+  isearch_state_t state = *current();
+  size_t i;
+  
+  if (state.length == typed_size)
+    typed = realloc(typed, (size_t)(typed_size <<= 1) * sizeof(char_t));
+  *(typed + state.length++) = c;
+  push_state(state);
+  compile_pattern();
+  
+  /* A longer regular expression can match where the shorter did not, so the search starts
+   * over where the last occurrence was found, nothing is searched for until it is complete */
+  if (state.flags & ISEARCH_REGEXP)
+    {
+      state.row = origin_row;
+      state.column = origin_column;
+      for (i = depth - 1; i-- > 0;)
+	if ((states + i)->flags & ISEARCH_FOUND)
+	  {
+	    state.row = (states + i)->row;
+	    state.column = (states + i)->column + ((state.flags & ISEARCH_BACKWARD) ? 1 : 0);
+	    break;
+	  }
+      current()->row = state.row;
+      current()->column = state.column;
+      current()->flags &= (int_least8_t)~(ISEARCH_FOUND | ISEARCH_FAILING);
+      return;
+    }
+  
+  /* The longer pattern can only occur where the shorter pattern occurs, so the search does not start over */
+  if (state.flags & ISEARCH_FOUND)
+    {
+      if (search_line(&pattern, document_line(&(cur_frame->document), state.row), state.column) == state.column)
+	{
+	  current()->size = pattern.length;
+	  goto_match();
+	}
+      else
+	{
+	  current()->flags &= (int_least8_t)~ISEARCH_FOUND;
+	  if (!(state.flags & ISEARCH_BACKWARD))
+	    current()->column++;
+	}
+    }
+}
+
+
+/**
+ * Search for the next occurrence
+ * 
+ * @param  direction  `ISEARCH_BACKWARD` or zero
+ */
+static void repeat_search(int_least8_t direction)
+{
+  isearch_state_t state = *current();
+  int_least8_t wrapped = state.flags & ISEARCH_WRAPPED;
+  
+  /* The search keeps searching for regular expressions if it was started to */
+  direction |= state.flags & ISEARCH_REGEXP;
+  
+  /* Searching before anything has been typed searches for the previous pattern */
+  if (state.length == 0)
+    {
+      current()->flags = direction;
+      if (last_length == 0)
+	return;
+      if (typed_size < last_length)
+	typed = realloc(typed, (size_t)(typed_size = last_length) * sizeof(char_t));
+      memcpy(typed, last_pattern, (size_t)last_length * sizeof(char_t));
+      state.length = last_length;
+      state.flags = direction;
+    }
+  else if (state.flags & ISEARCH_INCOMPLETE)
+    return;
+  else if ((state.flags & ISEARCH_FAILING) && ((state.flags & ISEARCH_BACKWARD) == (direction & ISEARCH_BACKWARD)))
+    {
+      /* Start over from the other edge of the frame */
+      state.row = (direction & ISEARCH_BACKWARD) ? document_lines(&(cur_frame->document)) : 0;
+      state.column = 0;
+      state.flags = direction | ISEARCH_WRAPPED;
+    }
+  else if (state.flags & ISEARCH_FAILING)
+    {
+      state.row = cur_frame->row;
+      state.column = cur_frame->column;
+      state.flags = direction | wrapped;
+    }
+  else
+    {
+      /* Forward, the next occurrence begins after this one, or after its first
+       * character if it is empty; backward, it begins before this one */
+      if ((state.flags & ISEARCH_FOUND) && !(direction & ISEARCH_BACKWARD))
+	state.column += state.size ? state.size : 1;
+      state.flags = direction | wrapped;
+    }
+  
+  push_state(state);
+  compile_pattern();
+}
+
+
+/**
+ * Stop counting the occurrences, otherwise cancel the search, or
+ * if the pattern has not been found, stop at the last place it was found
+ */
+static void quit_search(void)
+{
+  /* Counting the occurrences is stopped first, it can take a while in large frames */
+  if (count_pending() && counts_pattern())
+    {
+      count_stopped = 1;
+      return;
+    }
+  if (!(current()->flags & ISEARCH_FAILING))
+    {
+      end_search(0);
+      return;
+    }
+  while ((depth > 1) && (current()->flags & ISEARCH_FAILING))
+    pop_state();
+}
+
+
+
+/**
+ * Start searching forward in the current frame, as characters are typed
+ */
+void isearch_forward(void)
+{
+  start_search(0);
+}
+
+
+/**
+ * Start searching backward in the current frame, as characters are typed
+ */
+void isearch_backward(void)
+{
+  start_search(ISEARCH_BACKWARD);
+}
+
+
+/**
+ * Start searching forward in the current frame for a regular expression, as it is typed
+ */
+void isearch_forward_regexp(void)
+{
+  start_search(ISEARCH_REGEXP);
+}
+
+
+/**
+ * Start searching backward in the current frame for a regular expression, as it is typed
+ */
+void isearch_backward_regexp(void)
+{
+  start_search(ISEARCH_BACKWARD | ISEARCH_REGEXP);
+}
+
+
+/**
+ * Check whether an incremental search is in progress
+ * 
+ * @return  Whether an incremental search is in progress
+ */
+int isearch_active(void)
+{
+  return searching != NULL;
+}
+
+
+/**
+ * Check whether the incremental search has not yet found the pattern, nor failed
+ * to find it, or has not yet counted the occurrences of the pattern
+ * 
+ * @return  Whether `isearch_continue` should be called
+ */
+int isearch_pending(void)
+{
+  if ((searching == NULL) || !current()->length || (current()->flags & ISEARCH_INCOMPLETE))
+    return 0;
+  return !(current()->flags & (ISEARCH_FOUND | ISEARCH_FAILING)) || count_pending();
+}
+
+
+/**
+ * Search some more lines for the pattern of the incremental search,
+ * or when it has been found, count some more of its occurrences
+ * 
+ * @return  Whether the screen should be updated
+ */
+int isearch_continue(void)
+{
+  isearch_state_t* state = current();
+  document_t* doc = &(searching->document);
+  pos_t clean = clean_lines(searching);
+  int found, progress;
+  
+  if (!isearch_pending())
+    return 0;
+  
+  /* The occurrences are counted once the pattern has been found, or is known not to be found */
+  if (state->flags & (ISEARCH_FOUND | ISEARCH_FAILING))
+    {
+      if (!counts_pattern())
+	{
+	  count_free(&counting);
+	  count_start(&counting, &pattern, doc, clean);
+	  count_stopped = 0;
+	}
+      progress = count_progress(&counting);
+      return count_step(&counting, &pattern, doc) || (progress != count_progress(&counting));
+    }
+  
+  if (state->flags & ISEARCH_BACKWARD)
+    found = search_backward(&pattern, doc, clean, &(state->row), &(state->column), SEARCH_STEP);
+  else
+    found = search_forward(&pattern, doc, clean, &(state->row), &(state->column), SEARCH_STEP);
+  
+  if (found > 0)
+    {
+      state->flags |= ISEARCH_FOUND;
+      state->size = search_length(&pattern, document_line(doc, state->row), state->column);
+      goto_match();
+    }
+  else if (found < 0)
+    return 0;
+  else if (!(state->flags & ISEARCH_BACKWARD) && (searching->flags & FLAG_LOADING))
+    {
+      /* The rest of the file has not been read yet */
+      load_files(LOAD_STEP);
+      return 0;
+    }
+  else
+    state->flags |= ISEARCH_FAILING;
+  return 1;
+}
+
+
+/**
+ * Send a key to the incremental search
+ * 
+ * @param   key  The key
+ * @return       Whether the key was used, otherwise the search has
+ *               ended and the key should be handled as usual
+ */
+int isearch_key(keycode_t key)
+{
+  switch (key)
+    {
+    case KEY_CTRL('S'):
+      repeat_search(0);
+      return 1;
+      
+    case KEY_CTRL('R'):
+      repeat_search(ISEARCH_BACKWARD);
+      return 1;
+      
+    case KEY_CTRL('H'):
+    case KEY_CTRL('?'):
+      if (depth > 1)
+	pop_state();
+      return 1;
+      
+    case KEY_CTRL('G'):
+      quit_search();
+      return 1;
+      
+    case KEY_CTRL('M'):
+    case KEY_CTRL('J'):
+      /* Patterns cannot span lines, so line breaks end the search like in the minibuffer */
+      end_search(1);
+      return 1;
+      
+    default:
+      if ((key >= ' ') && (key < KEY_SPECIAL))
+	{
+	  extend_pattern((char_t)key);
+	  return 1;
+	}
+      end_search(1);
+      return 0;
+    }
+}
+
+
+/**
+ * Get how many occurrences of the pattern of the incremental search the current frame contains
+ * 
+ * @param   index  Output parameter for the number of the occurrence the search
+ *                 has found, counting from 1, zero if it has not found any
+ * @param   total  Output parameter for the number of occurrences, or if they
+ *                 are still being counted, the percentage that has been counted
+ * @return         1 if the occurrences have been counted, 0 if they are being counted, -1 otherwise
+ */
+int isearch_count(size_t* index, size_t* total)
+{
+  isearch_state_t* state;
+  
+  if ((searching != cur_frame) || (searching == NULL) || (current()->flags & ISEARCH_INCOMPLETE) || !counts_pattern())
+    return -1;
+  if (!count_done(&counting))
+    {
+      *total = (size_t)count_progress(&counting);
+      return count_stopped ? -1 : 0;
+    }
+  
+  state = current();
+  *total = counting.total;
+  *index = 0;
+  /* The number of the occurrence is counted once, the screen is redrawn many times while it is shown,
+   * occurrences that overlap the found one are not counted, so it can seem to be one too many */
+  if ((state->flags & ISEARCH_FOUND) && (state->index == 0))
+    state->index = count_before(&counting, &pattern, &(searching->document), state->row, state->column) + 1;
+  if (state->flags & ISEARCH_FOUND)
+    *index = state->index < *total ? state->index : *total;
+  return 1;
+}
+
+
+/**
+ * Get the part of a line of the current frame that the incremental search has found
+ * 
+ * @param   row    The line
+ * @param   start  Output parameter for the first column of the occurrence
+ * @param   end    Output parameter for the column after the occurrence
+ * @return         Whether the line contains the occurrence
+ */
+int isearch_match(pos_t row, pos_t* start, pos_t* end)
+{
+  isearch_state_t* state;
+  if ((searching != cur_frame) || (searching == NULL))
+    return 0;
+  state = current();
+  if (!(state->flags & ISEARCH_FOUND) || (state->row != row))
+    return 0;
+  *start = state->column;
+  *end = state->column + state->size;
+  return 1;
+}
+
+
+/**
+ * Draw the prompt of the incremental search
+ * 
+ * @param  row  The row on the screen to draw the prompt on
+ */
+void isearch_draw(pos_t row)
+{
+  isearch_state_t* state = current();
+  char prompt[48];
+  char* text;
+  pos_t col;
+  
+  snprintf(prompt, sizeof(prompt), "%s%s%sI-search%s: ",
+	   state->flags & ISEARCH_FAILING ? "failing " : "",
+	   state->flags & ISEARCH_WRAPPED ? "wrapped " : "",
+	   state->flags & ISEARCH_REGEXP ? "regexp " : "",
+	   state->flags & ISEARCH_BACKWARD ? " backward" : "");
+  /* Like in Emacs, the first word is capitalised */
+  if ((*prompt >= 'a') && (*prompt <= 'z'))
+    *prompt = (char)(*prompt - 'a' + 'A');
+  col = screen_print(row, 0, prompt, ATTR_BOLD);
+  
+  text = malloc((size_t)(state->length) * 6 + 1);
+  *(text + utf8_encode(typed, state->length, text)) = '\0';
+  col = screen_print(row, col, text, 0);
+  free(text);
+  
+  if (state->flags & ISEARCH_INCOMPLETE)
+    screen_print(row, col, " [incomplete input]", 0);
+}
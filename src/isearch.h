@@ -0,0 +1,200 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __ISEARCH_H__
+#define __ISEARCH_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "types.h"
+#include "frames.h"
+#include "search.h"
+#include "count.h"
+#include "keymap.h"
+#include "screen.h"
+
+
+
+/**
+ * The search goes towards the beginning of the frame
+ */
+#define  ISEARCH_BACKWARD  1
+
+/**
+ * The pattern has been found
+ */
+#define  ISEARCH_FOUND  2
+
+/**
+ * The pattern was not found before the edge of the frame was reached
+ */
+#define  ISEARCH_FAILING  4
+
+/**
+ * The search started over from the other edge of the frame
+ */
+#define  ISEARCH_WRAPPED  8
+
+/**
+ * The pattern is a regular expression
+ */
+#define  ISEARCH_REGEXP  16
+
+/**
+ * The pattern is a regular expression that has not been completely typed, or is malformed
+ */
+#define  ISEARCH_INCOMPLETE  32
+
+
+
+/**
+ * The state of an incremental search after a key, erasing
+ * the last typed character returns to the previous state
+ */
+typedef struct isearch_state
+{
+  /**
+   * The number of characters in the pattern
+   */
+  pos_t length;
+  
+  /**
+   * The line of the occurrence if found, otherwise the line the search continues at
+   */
+  pos_t row;
+  
+  /**
+   * The column of the occurrence if found, otherwise the column the search continues at
+   */
+  pos_t column;
+  
+  /**
+   * The number of characters in the occurrence, if found
+   */
+  pos_t size;
+  
+  /**
+   * The line of the point in this state
+   */
+  pos_t point_row;
+  
+  /**
+   * The column of the point in this state
+   */
+  pos_t point_column;
+  
+  /**
+   * The number of the occurrence among all occurrences of the pattern,
+   * counting from 1, zero until the occurrences have been counted
+   */
+  size_t index;
+  
+  /**
+   * `ISEARCH_*` flags
+   */
+  int_least8_t flags;
+  
+} isearch_state_t;
+
+
+
+/**
+ * Start searching forward in the current frame, as characters are typed
+ */
+void isearch_forward(void);
+
+/**
+ * Start searching backward in the current frame, as characters are typed
+ */
+void isearch_backward(void);
+
+/**
+ * Start searching forward in the current frame for a regular expression, as it is typed
+ */
+void isearch_forward_regexp(void);
+
+/**
+ * Start searching backward in the current frame for a regular expression, as it is typed
+ */
+void isearch_backward_regexp(void);
+
+/**
+ * Check whether an incremental search is in progress
+ * 
+ * @return  Whether an incremental search is in progress
+ */
+int isearch_active(void) __attribute__((pure));
+
+/**
+ * Check whether the incremental search has not yet found the pattern, nor failed
+ * to find it, or has not yet counted the occurrences of the pattern
+ * 
+ * @return  Whether `isearch_continue` should be called
+ */
+int isearch_pending(void) __attribute__((pure));
+
+/**
+ * Search some more lines for the pattern of the incremental search,
+ * or when it has been found, count some more of its occurrences
+ * 
+ * @return  Whether the screen should be updated
+ */
+int isearch_continue(void);
+
+/**
+ * Send a key to the incremental search
+ * 
+ * @param   key  The key
+ * @return       Whether the key was used, otherwise the search has
+ *               ended and the key should be handled as usual
+ */
+int isearch_key(keycode_t key);
+
+/**
+ * Get how many occurrences of the pattern of the incremental search the current frame contains
+ * 
+ * @param   index  Output parameter for the number of the occurrence the search
+ *                 has found, counting from 1, zero if it has not found any
+ * @param   total  Output parameter for the number of occurrences, or if they
+ *                 are still being counted, the percentage that has been counted
+ * @return         1 if the occurrences have been counted, 0 if they are being counted, -1 otherwise
+ */
+int isearch_count(size_t* index, size_t* total);
+
+/**
+ * Get the part of a line of the current frame that the incremental search has found
+ * 
+ * @param   row    The line
+ * @param   start  Output parameter for the first column of the occurrence
+ * @param   end    Output parameter for the column after the occurrence
+ * @return         Whether the line contains the occurrence
+ */
+int isearch_match(pos_t row, pos_t* start, pos_t* end);
+
+/**
+ * Draw the prompt of the incremental search
+ * 
+ * @param  row  The row on the screen to draw the prompt on
+ */
+void isearch_draw(pos_t row);
+
+
+#endif
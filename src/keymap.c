@@ -0,0 +1,307 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keymap.h"
+
+/* The commands in the keymap */
+#include "edit.h"
+#include "save.h"
+#include "isearch.h"
+
+
+/**
+ * The number of entries in an array of entries
+ */
+#define  KEYMAP(ENTRIES)  { sizeof(ENTRIES) / sizeof(*(ENTRIES)), ENTRIES }
+
+
+
+/**
+ * Keys after ESC ESC
+ */
+static const keymap_entry_t meta_escape_entries[] =
+  {
+    { KEY_ESCAPE, NULL, NULL }, /* help */
+  };
+static const keymap_t meta_escape_map = KEYMAP(meta_escape_entries);
+
+
+/**
+ * Keys after ESC, or typed with the meta key held down
+ */
+static const keymap_entry_t meta_entries[] =
+  {
+    { KEY_CTRL('R'), NULL, isearch_backward_regexp },
+    { KEY_CTRL('S'), NULL, isearch_forward_regexp },
+    { KEY_ESCAPE, &meta_escape_map, NULL },
+    { 'g', NULL, NULL }, /* jump */
+    { 'i', NULL, NULL }, /* tab */
+    { 'l', NULL, NULL }, /* lower case */
+    { 'u', NULL, NULL }, /* upper case */
+    { 'v', NULL, NULL }, /* page up */
+    { 'w', NULL, NULL }, /* copy */
+    { 'y', NULL, NULL }, /* cycle paste */
+  };
+static const keymap_t meta_map = KEYMAP(meta_entries);
+
+
+/**
+ * Keys after C-x
+ */
+static const keymap_entry_t ctrl_x_entries[] =
+  {
+    { KEY_CTRL('C'), NULL, quit_editor },
+    { KEY_CTRL('F'), NULL, NULL }, /* find file */
+    { KEY_CTRL('I'), NULL, NULL }, /* indent */
+    { KEY_CTRL('K'), NULL, NULL }, /* kill buffer */
+    { KEY_CTRL('Q'), NULL, NULL }, /* toggle read-only mode */
+    { KEY_CTRL('R'), NULL, NULL }, /* find file, read-only */
+    { KEY_CTRL('S'), NULL, save_buffer },
+    { KEY_CTRL('W'), NULL, write_file },
+    { KEY_CTRL('X'), NULL, NULL }, /* swap mark */
+    { KEY_CTRL('_'), NULL, switch_undo_direction },
+    { 'k', NULL, NULL },           /* kill buffer */
+    { 'o', NULL, NULL },           /* next buffer */
+    { 's', NULL, save_some_buffers },
+    { 'u', NULL, undo },
+  };
+static const keymap_t ctrl_x_map = KEYMAP(ctrl_x_entries);
+
+
+/**
+ * Keys at the beginning of a sequence, characters that are not in it insert themselves
+ */
+static const keymap_entry_t global_entries[] =
+  {
+    { KEY_CTRL('@'), NULL, NULL }, /* set mark */
+    { KEY_CTRL('A'), NULL, move_home },
+    { KEY_CTRL('B'), NULL, move_backward },
+    { KEY_CTRL('D'), NULL, delete_char },
+    { KEY_CTRL('E'), NULL, move_end },
+    { KEY_CTRL('F'), NULL, move_forward },
+    { KEY_CTRL('G'), NULL, NULL }, /* quit action */
+    { KEY_CTRL('H'), NULL, erase_char },
+    { KEY_CTRL('I'), NULL, insert_tab },
+    { KEY_CTRL('J'), NULL, new_line },
+    { KEY_CTRL('K'), NULL, NULL }, /* kill */
+    { KEY_CTRL('L'), NULL, NULL }, /* recenter */
+    { KEY_CTRL('M'), NULL, new_line },
+    { KEY_CTRL('N'), NULL, move_down },
+    { KEY_CTRL('O'), NULL, open_line },
+    { KEY_CTRL('P'), NULL, move_up },
+    { KEY_CTRL('Q'), NULL, NULL }, /* verbatim input */
+    { KEY_CTRL('R'), NULL, isearch_backward },
+    { KEY_CTRL('S'), NULL, isearch_forward },
+    { KEY_CTRL('T'), NULL, NULL }, /* transpose */
+    { KEY_CTRL('V'), NULL, NULL }, /* page down */
+    { KEY_CTRL('W'), NULL, NULL }, /* cut */
+    { KEY_CTRL('X'), &ctrl_x_map, NULL },
+    { KEY_CTRL('Y'), NULL, NULL }, /* paste */
+    { KEY_ESCAPE, &meta_map, NULL },
+    { KEY_CTRL('_'), NULL, undo },
+    { KEY_CTRL('?'), NULL, erase_char },
+    { KEY_UP, NULL, move_up },
+    { KEY_DOWN, NULL, move_down },
+    { KEY_RIGHT, NULL, move_forward },
+    { KEY_LEFT, NULL, move_backward },
+    { KEY_END, NULL, move_end },
+    { KEY_HOME, NULL, move_home },
+    { KEY_DELETE, NULL, delete_char },
+    { KEY_PAGE_UP, NULL, NULL },   /* page up */
+    { KEY_PAGE_DOWN, NULL, NULL }, /* page down */
+  };
+static const keymap_t global_map = KEYMAP(global_entries);
+
+
+/**
+ * Bindings made at runtime, the key of the root is not used
+ */
+static keymap_override_t overrides = { 0, NULL, 0, NULL };
+
+
+
+/**
+ * Find a key in a node of the built in keymap
+ * 
+ * @param   map  The node
+ * @param   key  The key
+ * @return       The entry for the key, `NULL` if not found
+ */
+__attribute__((pure))
+static const keymap_entry_t* find_entry(const keymap_t* map, keycode_t key)
+{
+  size_t low = 0, high = map->count, mid;
+  
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      if ((map->entries + mid)->key < key)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+  return ((low < map->count) && ((map->entries + low)->key == key)) ? map->entries + low : NULL;
+}
+
+
+/**
+ * Find a key among the children of a runtime binding
+ * 
+ * @param   node  The binding
+ * @param   key   The key
+ * @param   at    Output parameter for where the key is, or would be inserted
+ * @return        Whether the key was found
+ */
+static int find_override(const keymap_override_t* node, keycode_t key, size_t* at)
+{
+  size_t low = 0, high = node->count, mid;
+  
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      if ((node->children + mid)->key < key)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+  *at = low;
+  return (low < node->count) && ((node->children + low)->key == key);
+}
+
+
+/**
+ * Free the children of a runtime binding
+ * 
+ * @param  node  The binding
+ */
+static void free_override(keymap_override_t* node)
+{
+  size_t i;
+  for (i = 0; i < node->count; i++)
+    free_override(node->children + i);
+  free(node->children);
+  node->children = NULL;
+  node->count = 0;
+}
+
+
+
+/**
+ * Start over at the beginning of a key sequence
+ * 
+ * @param  state  The key sequence state
+ */
+void keymap_reset(keymap_state_t* state)
+{
+  state->builtin = &global_map;
+  state->override = &overrides;
+  state->length = 0;
+}
+
+
+/**
+ * Look up the next key in a key sequence
+ * 
+ * @param   state    The key sequence state, reset if the sequence is complete or not bound
+ * @param   key      The key
+ * @param   command  Output parameter for the command the sequence is bound to, `NULL` if none
+ * @return           1 if the sequence is complete, 0 if more keys are needed, -1 if it is not bound
+ */
+int keymap_lookup(keymap_state_t* state, keycode_t key, command_t** command)
+{
+  const keymap_entry_t* entry = state->builtin ? find_entry(state->builtin, key) : NULL;
+  const keymap_override_t* override = NULL;
+  size_t at;
+  
+  if (state->override && find_override(state->override, key, &at))
+    override = state->override->children + at;
+  
+  *command = NULL;
+  
+  /* A runtime binding hides everything in the built in keymap that starts the same way */
+  if (override && (override->count == 0))
+    {
+      *command = override->command;
+      keymap_reset(state);
+      return 1;
+    }
+  if ((override == NULL) && entry && (entry->next == NULL))
+    {
+      *command = entry->command;
+      keymap_reset(state);
+      return 1;
+    }
+  if ((override == NULL) && (entry == NULL))
+    {
+      keymap_reset(state);
+      return -1;
+    }
+  
+  state->builtin = entry ? entry->next : NULL;
+  state->override = override;
+  state->length++;
+  return 0;
+}
+
+
+/**
+ * Bind a key sequence to a command, overriding the built in keymap
+ * 
+ * @param   keys     The key sequence
+ * @param   n        The number of keys in `keys`
+ * @param   command  The command, `NULL` to make the sequence do nothing
+ * @return           Zero on success, -1 on error
+ */
+int keymap_bind(const keycode_t* keys, size_t n, command_t* command)
+{
+  keymap_override_t* node = &overrides;
+  keymap_override_t* new;
+  size_t at;
+  
+  for (; n--; keys++)
+    {
+      if (!find_override(node, *keys, &at))
+	{
+	  new = realloc(node->children, (node->count + 1) * sizeof(keymap_override_t));
+	  if (new == NULL)
+	    return -1;
+	  node->children = new;
+	  memmove(new + at + 1, new + at, (node->count++ - at) * sizeof(keymap_override_t));
+	  (new + at)->key = *keys;
+	  (new + at)->command = NULL;
+	  (new + at)->count = 0;
+	  (new + at)->children = NULL;
+	}
+      node = node->children + at;
+    }
+  
+  /* The sequence is now complete, anything that was bound to longer sequences is dropped */
+  free_override(node);
+  node->command = command;
+  return 0;
+}
+
+
+/**
+ * Free all runtime bindings
+ */
+void keymap_free(void)
+{
+  free_override(&overrides);
+}
+
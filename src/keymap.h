@@ -0,0 +1,250 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __KEYMAP_H__
+#define __KEYMAP_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+
+
+/**
+ * The first key that is not a character, keys below it are the characters they type
+ */
+#define  KEY_SPECIAL  0x110000
+
+/**
+ * A character typed with the control key held down
+ */
+#define  KEY_CTRL(KEY)  ((KEY) ^ 0x40)
+
+/**
+ * The escape key, and the prefix for keys typed with the meta key held down
+ */
+#define  KEY_ESCAPE  '\033'
+
+/**
+ * The key sent with `ESC [ FINAL` or `ESC O FINAL`
+ */
+#define  KEY_CSI(FINAL)  (KEY_SPECIAL + (FINAL))
+
+/**
+ * The key sent with `ESC [ NUMBER ~`
+ */
+#define  KEY_TILDE(NUMBER)  (KEY_SPECIAL + 128 + (NUMBER))
+
+/**
+ * The up arrow key
+ */
+#define  KEY_UP  KEY_CSI('A')
+
+/**
+ * The down arrow key
+ */
+#define  KEY_DOWN  KEY_CSI('B')
+
+/**
+ * The right arrow key
+ */
+#define  KEY_RIGHT  KEY_CSI('C')
+
+/**
+ * The left arrow key
+ */
+#define  KEY_LEFT  KEY_CSI('D')
+
+/**
+ * The end key
+ */
+#define  KEY_END  KEY_CSI('F')
+
+/**
+ * The home key
+ */
+#define  KEY_HOME  KEY_CSI('H')
+
+/**
+ * The insert key
+ */
+#define  KEY_INSERT  KEY_TILDE(2)
+
+/**
+ * The delete key
+ */
+#define  KEY_DELETE  KEY_TILDE(3)
+
+/**
+ * The page up key
+ */
+#define  KEY_PAGE_UP  KEY_TILDE(5)
+
+/**
+ * The page down key
+ */
+#define  KEY_PAGE_DOWN  KEY_TILDE(6)
+
+/**
+ * Not a key, the terminal sends it before pasted text
+ */
+#define  KEY_PASTE  KEY_TILDE(200)
+
+
+
+/**
+ * A key, a character or `KEY_SPECIAL` or above
+ */
+typedef uint_least32_t keycode_t;
+
+/**
+ * A function that a key sequence can be bound to
+ */
+typedef void command_t(void);
+
+
+/**
+ * A key in a keymap
+ */
+typedef struct keymap_entry
+{
+  /**
+   * The key
+   */
+  keycode_t key;
+  
+  /**
+   * The keys that may follow the key, `NULL` if the key completes a sequence
+   */
+  const struct keymap* next;
+  
+  /**
+   * The command the sequence is bound to, `NULL` if the sequence does nothing
+   */
+  command_t* command;
+  
+} keymap_entry_t;
+
+
+/**
+ * A node in a keymap, the keys that may follow a key sequence
+ */
+typedef struct keymap
+{
+  /**
+   * The number of keys
+   */
+  size_t count;
+  
+  /**
+   * The keys, sorted by key
+   */
+  const keymap_entry_t* entries;
+  
+} keymap_t;
+
+
+/**
+ * A binding made at runtime, it and its children take precedence over the built in keymap
+ */
+typedef struct keymap_override
+{
+  /**
+   * The key
+   */
+  keycode_t key;
+  
+  /**
+   * The command the sequence is bound to, only used if there are no children
+   */
+  command_t* command;
+  
+  /**
+   * The number of keys that may follow the key
+   */
+  size_t count;
+  
+  /**
+   * The keys that may follow the key, sorted by key
+   */
+  struct keymap_override* children;
+  
+} keymap_override_t;
+
+
+/**
+ * How far into a key sequence the user is
+ */
+typedef struct keymap_state
+{
+  /**
+   * The keys that may follow in the built in keymap, `NULL` if none
+   */
+  const keymap_t* builtin;
+  
+  /**
+   * The keys that may follow in the runtime bindings, `NULL` if none
+   */
+  const keymap_override_t* override;
+  
+  /**
+   * The number of keys in the incomplete sequence, zero if no sequence has been started
+   */
+  size_t length;
+  
+} keymap_state_t;
+
+
+
+/**
+ * Start over at the beginning of a key sequence
+ * 
+ * @param  state  The key sequence state
+ */
+void keymap_reset(keymap_state_t* state);
+
+/**
+ * Look up the next key in a key sequence
+ * 
+ * @param   state    The key sequence state, reset if the sequence is complete or not bound
+ * @param   key      The key
+ * @param   command  Output parameter for the command the sequence is bound to, `NULL` if none
+ * @return           1 if the sequence is complete, 0 if more keys are needed, -1 if it is not bound
+ */
+int keymap_lookup(keymap_state_t* state, keycode_t key, command_t** command);
+
+/**
+ * Bind a key sequence to a command, overriding the built in keymap
+ * 
+ * @param   keys     The key sequence
+ * @param   n        The number of keys in `keys`
+ * @param   command  The command, `NULL` to make the sequence do nothing
+ * @return           Zero on success, -1 on error
+ */
+int keymap_bind(const keycode_t* keys, size_t n, command_t* command);
+
+/**
+ * Free all runtime bindings
+ */
+void keymap_free(void);
+
+
+#endif
+
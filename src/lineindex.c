@@ -0,0 +1,331 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lineindex.h"
+
+
+
+/**
+ * Describe a file as it is now
+ * 
+ * @param  attr    The status of the file
+ * @param  header  Output parameter for the header of a line index of the file
+ */
+static void identify_file(const struct stat* attr, line_index_header_t* header)
+{
+  memset(header, 0, sizeof(line_index_header_t));
+  memcpy(header->magic, LINE_INDEX_MAGIC, sizeof(header->magic));
+  header->device = (uint_least64_t)(attr->st_dev);
+  header->inode = (uint_least64_t)(attr->st_ino);
+  header->size = (uint_least64_t)(attr->st_size);
+  header->mtime = (int_least64_t)(attr->st_mtim.tv_sec);
+  header->mtime_nsec = (int_least64_t)(attr->st_mtim.tv_nsec);
+  header->stride = LINE_INDEX_STRIDE;
+}
+
+
+/**
+ * Get the path of the line index of a file in the cache
+ * 
+ * @param   header  The header of the index
+ * @param   create  Whether to create the directory of the index
+ * @return          The path, `NULL` if there is no cache directory, free with `free`
+ */
+static char* index_path(const line_index_header_t* header, int create)
+{
+  const char* cache = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  char* path;
+  size_t n;
+  
+  /* Relative paths are not used, they would depend on the working directory */
+  if (cache && (*cache == '/'))
+    {
+      path = malloc(strlen(cache) + 64);
+      n = (size_t)sprintf(path, "%s", cache);
+    }
+  else if (home && (*home == '/'))
+    {
+      path = malloc(strlen(home) + 72);
+      n = (size_t)sprintf(path, "%s/.cache", home);
+    }
+  else
+    return NULL;
+  
+  if (create)
+    mkdir(path, 0700);
+  n += (size_t)sprintf(path + n, "/zecora");
+  if (create)
+    mkdir(path, 0700);
+  sprintf(path + n, "/%jx-%jx", (uintmax_t)(header->device), (uintmax_t)(header->inode));
+  return path;
+}
+
+
+/**
+ * Write a buffer completely to a file
+ * 
+ * @param   fd    The file descriptor of the file
+ * @param   data  The buffer
+ * @param   n     The number of bytes in `data`
+ * @return        Zero on success, -1 on error
+ */
+static int write_all(int fd, const void* data, size_t n)
+{
+  const char* buffer = data;
+  ssize_t wrote;
+  
+  while (n)
+    {
+      if ((wrote = write(fd, buffer, n)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      buffer += wrote;
+      n -= (size_t)wrote;
+    }
+  return 0;
+}
+
+
+/**
+ * Read a buffer completely from a file
+ * 
+ * @param   fd      The file descriptor of the file
+ * @param   data    Output buffer
+ * @param   n       The number of bytes to read
+ * @param   offset  The offset in the file to read from
+ * @return          Zero on success, -1 on error or if the file is too short
+ */
+static int read_all(int fd, void* data, size_t n, off_t offset)
+{
+  char* buffer = data;
+  ssize_t got;
+  
+  while (n)
+    {
+      if ((got = pread(fd, buffer, n, offset)) <= 0)
+	{
+	  if ((got < 0) && (errno == EINTR))
+	    continue;
+	  return -1;
+	}
+      buffer += got;
+      offset += (off_t)got;
+      n -= (size_t)got;
+    }
+  return 0;
+}
+
+
+/**
+ * Check that the entries of a line index describe a file that it could be the index of,
+ * so that a damaged index cannot make lines point outside the file
+ * 
+ * @param   index  The index
+ * @return         Whether the index is consistent
+ */
+__attribute__((pure))
+static int consistent(const line_index_t* index)
+{
+  const line_index_header_t* header = &(index->header);
+  const line_index_entry_t* entry = index->entries;
+  uint_least64_t i;
+  
+  if ((entry->offset != 0) || (entry->chars != 0))
+    return 0;
+  for (i = 0; i + 1 < header->entries; i++, entry++)
+    if (((entry + 1)->offset <= entry->offset) || ((entry + 1)->chars < entry->chars) ||
+	(entry->malformed >= (int_least64_t)LINE_INDEX_STRIDE) || (entry->malformed < -1))
+      return 0;
+  
+  /* The last entry is for a line that would follow the file */
+  return entry->offset == header->size + 1;
+}
+
+
+
+/**
+ * Start building the line index of a file as it is read, nothing is built if the file is small
+ * 
+ * @param  index  The index
+ * @param  attr   The status of the file
+ */
+void line_index_start(line_index_t* index, const struct stat* attr)
+{
+  identify_file(attr, &(index->header));
+  index->entries = NULL;
+  index->allocated = 0;
+  index->chars = 0;
+  if (attr->st_size >= LINE_INDEX_MIN_SIZE)
+    index->entries = malloc((index->allocated = 64) * sizeof(line_index_entry_t));
+}
+
+
+/**
+ * Add the next line of a file to its line index
+ * 
+ * @param  index      The index, nothing is done if it is not being built
+ * @param  offset     The offset in the file of the beginning of the line
+ * @param  chars      The number of characters in the line
+ * @param  malformed  Whether the line is not well-formed UTF-8
+ */
+void line_index_add(line_index_t* index, size_t offset, pos_t chars, int malformed)
+{
+  line_index_header_t* header = &(index->header);
+  line_index_entry_t* entry;
+  
+  if (index->entries == NULL)
+    return;
+  
+  if (header->lines % LINE_INDEX_STRIDE == 0)
+    {
+      if (header->entries == index->allocated)
+	index->entries = realloc(index->entries, (index->allocated <<= 1) * sizeof(line_index_entry_t));
+      entry = index->entries + header->entries++;
+      entry->offset = offset;
+      entry->chars = index->chars;
+      entry->malformed = -1;
+    }
+  
+  entry = index->entries + header->entries - 1;
+  if (malformed && (entry->malformed < 0))
+    entry->malformed = (int_least64_t)(header->lines % LINE_INDEX_STRIDE);
+  header->lines++;
+  index->chars += (uint_least64_t)chars;
+}
+
+
+/**
+ * Store the line index of a file that has been read completely in the cache, and release it
+ * 
+ * @param  index  The index, nothing is stored if it is not being built
+ * @param  size   The size of the file
+ */
+void line_index_finish(line_index_t* index, size_t size)
+{
+  line_index_header_t* header = &(index->header);
+  line_index_entry_t* entry;
+  char* path;
+  char* temporary;
+  int fd, error;
+  
+  if (index->entries == NULL)
+    return;
+  if ((size != header->size) || ((path = index_path(header, 1)) == NULL))
+    {
+      line_index_free(index);
+      return;
+    }
+  
+  /* The end of the file is where the line after the last line would begin */
+  if (header->entries == index->allocated)
+    index->entries = realloc(index->entries, ++(index->allocated) * sizeof(line_index_entry_t));
+  entry = index->entries + header->entries++;
+  entry->offset = size + 1;
+  entry->chars = index->chars;
+  entry->malformed = -1;
+  
+  /* Write the index beside where it belongs and then replace the old index with it,
+   * so that an editor that opens the file meanwhile does not see half of it */
+  temporary = malloc(strlen(path) + 3 * sizeof(pid_t) + 2);
+  sprintf(temporary, "%s.%ji", path, (intmax_t)getpid());
+  if ((fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600)) >= 0)
+    {
+      error = write_all(fd, header, sizeof(line_index_header_t)) ||
+	      write_all(fd, index->entries, (size_t)(header->entries) * sizeof(line_index_entry_t));
+      error = close(fd) || error;
+      if (error || rename(temporary, path))
+	unlink(temporary);
+    }
+  free(temporary);
+  free(path);
+  line_index_free(index);
+}
+
+
+/**
+ * Load the line index of a file from the cache
+ * 
+ * @param   index  Output parameter for the index
+ * @param   attr   The status of the file
+ * @return         Whether the cache had an index for the file as it is now
+ */
+int line_index_load(line_index_t* index, const struct stat* attr)
+{
+  line_index_header_t* header = &(index->header);
+  line_index_header_t expected;
+  struct stat index_attr;
+  size_t n;
+  char* path;
+  int fd;
+  
+  index->entries = NULL;
+  index->allocated = 0;
+  index->chars = 0;
+  if (attr->st_size < LINE_INDEX_MIN_SIZE)
+    return 0;
+  identify_file(attr, &expected);
+  if ((path = index_path(&expected, 0)) == NULL)
+    return 0;
+  if ((fd = open(path, O_RDONLY | O_NOFOLLOW)) < 0)
+    {
+      free(path);
+      return 0;
+    }
+  
+  /* The index is only used if it was made of the file as it is now, otherwise the
+   * file has been modified, or another file has been given its inode, since then */
+  if (read_all(fd, header, sizeof(line_index_header_t), 0) ||
+      memcmp(header, &expected, offsetof(line_index_header_t, lines)) ||
+      (header->lines == 0) || (header->entries != (header->lines - 1) / LINE_INDEX_STRIDE + 2) ||
+      fstat(fd, &index_attr) ||
+      ((uint_least64_t)(index_attr.st_size) !=
+       sizeof(line_index_header_t) + header->entries * sizeof(line_index_entry_t)))
+    {
+      unlink(path);
+      free(path);
+      close(fd);
+      return 0;
+    }
+  free(path);
+  
+  n = (size_t)(header->entries) * sizeof(line_index_entry_t);
+  index->entries = malloc(n);
+  index->allocated = (size_t)(header->entries);
+  if (read_all(fd, index->entries, n, (off_t)sizeof(line_index_header_t)) || !consistent(index))
+    line_index_free(index);
+  close(fd);
+  return index->entries != NULL;
+}
+
+
+/**
+ * Release the resources of a line index
+ * 
+ * @param  index  The index
+ */
+void line_index_free(line_index_t* index)
+{
+  free(index->entries);
+  index->entries = NULL;
+  index->allocated = 0;
+}
+
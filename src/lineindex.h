@@ -0,0 +1,209 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __LINEINDEX_H__
+#define __LINEINDEX_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "types.h"
+
+
+
+/**
+ * The bytes that the line index of a file begins with
+ */
+#define  LINE_INDEX_MAGIC  "ZECORAL1"
+
+
+/**
+ * The number of lines between the lines whose places are kept in the line index of a file
+ */
+#ifndef LINE_INDEX_STRIDE
+#define LINE_INDEX_STRIDE  1024
+#endif
+
+/**
+ * The number of bytes a file must have to be given a line index, smaller files are read quickly enough
+ */
+#ifndef LINE_INDEX_MIN_SIZE
+#define LINE_INDEX_MIN_SIZE  (16 << 20)
+#endif
+
+
+
+/**
+ * The beginning of the line index of a file, it is followed by the entries of the index
+ */
+typedef struct line_index_header
+{
+  /**
+   * `LINE_INDEX_MAGIC`
+   */
+  char magic[8];
+  
+  /**
+   * The device the file is stored on
+   */
+  uint_least64_t device;
+  
+  /**
+   * The inode of the file
+   */
+  uint_least64_t inode;
+  
+  /**
+   * The size of the file
+   */
+  uint_least64_t size;
+  
+  /**
+   * The seconds of the last modification time of the file
+   */
+  int_least64_t mtime;
+  
+  /**
+   * The nanoseconds of the last modification time of the file
+   */
+  int_least64_t mtime_nsec;
+  
+  /**
+   * `LINE_INDEX_STRIDE` when the index was made
+   */
+  uint_least64_t stride;
+  
+  /**
+   * The number of lines in the file
+   */
+  uint_least64_t lines;
+  
+  /**
+   * The number of entries in the index, one per `stride` lines, and one for the end of the file
+   */
+  uint_least64_t entries;
+  
+} line_index_header_t;
+
+
+/**
+ * The place of every `stride`:th line of a file, starting with the first line
+ */
+typedef struct line_index_entry
+{
+  /**
+   * The offset in the file of the beginning of the line
+   */
+  uint_least64_t offset;
+  
+  /**
+   * The number of characters, excluding line breaks, before the line
+   */
+  uint_least64_t chars;
+  
+  /**
+   * The number of lines after the line, within the following `stride` lines,
+   * before the first of them that is not well-formed UTF-8, -1 if none
+   */
+  int_least64_t malformed;
+  
+} line_index_entry_t;
+
+
+/**
+ * The line index of a file, that is either being built
+ * while the file is read, or has been loaded from the cache
+ */
+typedef struct line_index
+{
+  /**
+   * The header of the index, `lines` is the number of lines indexed so far while it is built
+   */
+  line_index_header_t header;
+  
+  /**
+   * The entries of the index, `NULL` if the file is not indexed
+   */
+  line_index_entry_t* entries;
+  
+  /**
+   * The number of entries that fit in `entries`
+   */
+  size_t allocated;
+  
+  /**
+   * The number of characters, excluding line breaks, in the lines indexed so far
+   */
+  uint_least64_t chars;
+  
+} line_index_t;
+
+
+
+/**
+ * Start building the line index of a file as it is read, nothing is built if the file is small
+ * 
+ * @param  index  The index
+ * @param  attr   The status of the file
+ */
+void line_index_start(line_index_t* index, const struct stat* attr);
+
+/**
+ * Add the next line of a file to its line index
+ * 
+ * @param  index      The index, nothing is done if it is not being built
+ * @param  offset     The offset in the file of the beginning of the line
+ * @param  chars      The number of characters in the line
+ * @param  malformed  Whether the line is not well-formed UTF-8
+ */
+void line_index_add(line_index_t* index, size_t offset, pos_t chars, int malformed);
+
+/**
+ * Store the line index of a file that has been read completely in the cache, and release it
+ * 
+ * @param  index  The index, nothing is stored if it is not being built
+ * @param  size   The size of the file
+ */
+void line_index_finish(line_index_t* index, size_t size);
+
+/**
+ * Load the line index of a file from the cache
+ * 
+ * @param   index  Output parameter for the index
+ * @param   attr   The status of the file
+ * @return         Whether the cache had an index for the file as it is now
+ */
+int line_index_load(line_index_t* index, const struct stat* attr);
+
+/**
+ * Release the resources of a line index
+ * 
+ * @param  index  The index
+ */
+void line_index_free(line_index_t* index);
+
+
+#endif
+
@@ -0,0 +1,602 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lines.h"
+
+
+
+/**
+ * Get the address of a character in the storage of a materialised line
+ * 
+ * @param   LBUF   The line
+ * @param   INDEX  The index of the character in the storage, counting the gap
+ * @return         The address of the character
+ */
+#define AT(LBUF, INDEX)  ((char*)((LBUF)->line) + (size_t)(INDEX) * (size_t)((LBUF)->width))
+
+
+
+/**
+ * Get the narrowest storage width that can hold some characters
+ * 
+ * @param   text  The characters
+ * @param   n     The number of characters
+ * @return        The number of bytes needed per character
+ */
+static int_least8_t width_of(const char_t* text, pos_t n)
+{
+  uint_least32_t max = 0;
+  for (pos_t i = 0; i < n; i++)
+    max |= (uint_least32_t)*(text + i);
+  return max <= 0xFF ? 1 : max <= 0xFFFF ? 2 : 4;
+}
+
+
+/**
+ * Store characters with a specific width
+ * 
+ * @param  output  The storage
+ * @param  width   The number of bytes per character in `output`
+ * @param  text    The characters
+ * @param  n       The number of characters
+ */
+static void narrow(void* output, int_least8_t width, const char_t* text, pos_t n)
+{
+  if (width == 1)
+    for (pos_t i = 0; i < n; i++)
+      *((uint8_t*)output + i) = (uint8_t)*(text + i);
+  else if (width == 2)
+    for (pos_t i = 0; i < n; i++)
+      *((uint16_t*)output + i) = (uint16_t)*(text + i);
+  else
+    memcpy(output, text, (size_t)n * sizeof(char_t));
+}
+
+
+/**
+ * Load characters stored with a specific width
+ * 
+ * @param  input   The storage
+ * @param  width   The number of bytes per character in `input`
+ * @param  output  Output buffer for the characters
+ * @param  n       The number of characters
+ */
+static void widen(const void* input, int_least8_t width, char_t* output, pos_t n)
+{
+  if (width == 1)
+    for (pos_t i = 0; i < n; i++)
+      *(output + i) = *((const uint8_t*)input + i);
+  else if (width == 2)
+    for (pos_t i = 0; i < n; i++)
+      *(output + i) = *((const uint16_t*)input + i);
+  else
+    memcpy(output, input, (size_t)n * sizeof(char_t));
+}
+
+
+/**
+ * Copy characters between storages of possibly different widths
+ * 
+ * @param  output        The storage to copy to
+ * @param  output_width  The number of bytes per character in `output`
+ * @param  input         The storage to copy from
+ * @param  input_width   The number of bytes per character in `input`
+ * @param  n             The number of characters
+ */
+static void convert(void* output, int_least8_t output_width, const void* input, int_least8_t input_width, pos_t n)
+{
+  if (output_width == input_width)
+    memcpy(output, input, (size_t)n * (size_t)input_width);
+  else
+    for (pos_t i = 0; i < n; i++)
+      {
+	char_t c;
+	widen((const char*)input + i * input_width, input_width, &c, 1);
+	narrow((char*)output + i * output_width, output_width, &c, 1);
+      }
+}
+
+
+/**
+ * Allocate storage for a line in an arena and fill it
+ * 
+ * @param  lbuf   The line
+ * @param  arena  The arena
+ * @param  text   The content of the line
+ * @param  n      The number of characters in the line
+ */
+static void allocate_line(line_buffer_t* lbuf, arena_t* arena, const char_t* text, pos_t n)
+{
+  lbuf->width = width_of(text, n);
+  lbuf->allocated = n + LINE_SLACK;
+  lbuf->line = arena_alloc(arena, (size_t)(lbuf->allocated) * (size_t)(lbuf->width));
+  lbuf->flags |= LINE_ARENA;
+  lbuf->used = lbuf->gap = n;
+  narrow(lbuf->line, lbuf->width, text, n);
+}
+
+
+/**
+ * Move the storage of a line to the heap, with a new size or width
+ * 
+ * @param  lbuf       The line
+ * @param  allocated  The number of characters to allocate room for, at least `lbuf->used`
+ * @param  width      The number of bytes per character, at least `lbuf->width`
+ */
+static void relocate_line(line_buffer_t* lbuf, pos_t allocated, int_least8_t width)
+{
+  pos_t tail = lbuf->used - lbuf->gap;
+  
+  if (!(lbuf->flags & LINE_ARENA) && (width == lbuf->width))
+    {
+      /* Heap storage of the right width can simply be resized */
+      lbuf->line = realloc(lbuf->line, (size_t)allocated * (size_t)width);
+      memmove(AT(lbuf, allocated - tail), AT(lbuf, lbuf->allocated - tail), (size_t)tail * (size_t)width);
+    }
+  else
+    {
+      /* Lines that outgrow their space in the arena move to the heap */
+      void* line = malloc((size_t)allocated * (size_t)width);
+      convert(line, width, lbuf->line, lbuf->width, lbuf->gap);
+      convert((char*)line + (size_t)(allocated - tail) * (size_t)width, width,
+	      AT(lbuf, lbuf->allocated - tail), lbuf->width, tail);
+      if (!(lbuf->flags & LINE_ARENA))
+	free(lbuf->line);
+      lbuf->line = line;
+      lbuf->flags &= (int_least8_t)~LINE_ARENA;
+    }
+  
+  lbuf->allocated = allocated;
+  lbuf->width = width;
+}
+
+
+
+/**
+ * Get the display column after a character
+ * 
+ * @param   column  The display column the character starts at
+ * @param   c       The character
+ * @return          The display column after the character
+ */
+static pos_t advance(pos_t column, char_t c)
+{
+  if (c == '\t')
+    return (column | 7) + 1;
+  return column + glyph_get(c)->width;
+}
+
+
+/**
+ * Forget the sampled display columns and the lexer checkpoints from a character and onwards
+ * 
+ * @param  lbuf      The line
+ * @param  position  The index of the first changed character
+ */
+static void invalidate_samples(line_buffer_t* lbuf, pos_t position)
+{
+  line_checkpoints_t* checkpoints = lbuf->checkpoints;
+  if (lbuf->columns && (lbuf->columns->valid > position / COLUMN_SAMPLE + 1))
+    lbuf->columns->valid = position / COLUMN_SAMPLE + 1;
+  
+  /* The lexer state at a character depends on the characters just after it */
+  if (checkpoints)
+    while ((checkpoints->valid > 1) &&
+	   ((checkpoints->checkpoint + checkpoints->valid - 1)->index + LEX_LOOKAHEAD > position))
+      checkpoints->valid--;
+}
+
+
+/**
+ * Make sure that the display columns of a line are sampled up to a character
+ * 
+ * @param   lbuf   The line
+ * @param   index  The index of the character
+ * @return         The samples
+ */
+static line_columns_t* sample_columns(line_buffer_t* lbuf, pos_t index)
+{
+  char_t text[COLUMN_SAMPLE * 16];
+  line_columns_t* samples = lbuf->columns;
+  pos_t last = index / COLUMN_SAMPLE, k, i, n, column;
+  
+  if ((samples == NULL) || (samples->allocated <= last))
+    {
+      pos_t allocated = lbuf->used / COLUMN_SAMPLE + 1;
+      allocated = allocated > last ? allocated : last + 1;
+      samples = realloc(samples, sizeof(line_columns_t) + (size_t)allocated * sizeof(pos_t));
+      if (lbuf->columns == NULL)
+	{
+	  samples->valid = 1;
+	  *(samples->column) = 0;
+	}
+      samples->allocated = allocated;
+      lbuf->columns = samples;
+    }
+  
+  /* Measure the characters after the last valid sample, reading many at a time */
+  k = samples->valid - 1;
+  column = *(samples->column + k);
+  for (i = k * COLUMN_SAMPLE; k < last;)
+    {
+      if ((n = read_line(lbuf, i, (pos_t)(sizeof(text) / sizeof(char_t)), text)) == 0)
+	break;
+      for (pos_t j = 0; (j < n) && (k < last); j++)
+	{
+	  column = advance(column, *(text + j));
+	  if (++i % COLUMN_SAMPLE == 0)
+	    *(samples->column + ++k) = column;
+	}
+    }
+  if (samples->valid < k + 1)
+    samples->valid = k + 1;
+  return samples;
+}
+
+
+/**
+ * Read characters from a line
+ * 
+ * @param   lbuf    The line
+ * @param   start   The index of the first character to read
+ * @param   n       The maximum number of characters to read
+ * @param   output  Output buffer for the characters
+ * @return          The number of characters stored in `output`
+ */
+pos_t read_line(const line_buffer_t* lbuf, pos_t start, pos_t n, char_t* output)
+{
+  if (start >= lbuf->used)
+    return 0;
+  if (n > lbuf->used - start)
+    n = lbuf->used - start;
+  
+  if (lbuf->line)
+    {
+      /* The line has been materialised, copy its characters from both sides of the gap */
+      pos_t before = lbuf->gap - start;
+      before = before < 0 ? 0 : before > n ? n : before;
+      widen(AT(lbuf, start), lbuf->width, output, before);
+      widen(AT(lbuf, start + before + lbuf->allocated - lbuf->used), lbuf->width, output + before, n - before);
+      return n;
+    }
+  
+  /* The line is still a view into the file, decode it */
+  return utf8_decode(lbuf->raw, lbuf->raw_size, start, n, output);
+}
+
+
+/**
+ * Read a character from a line
+ * 
+ * @param   lbuf   The line
+ * @param   index  The index of the character, must be in the line
+ * @return         The character
+ */
+char_t line_char(const line_buffer_t* lbuf, pos_t index)
+{
+  char_t c;
+  read_line(lbuf, index, 1, &c);
+  return c;
+}
+
+
+/**
+ * Get the display column a character starts at
+ * 
+ * @param   lbuf   The line
+ * @param   index  The index of the character, `lbuf->used` for the end of the line
+ * @return         The display column
+ */
+pos_t line_column(line_buffer_t* lbuf, pos_t index)
+{
+  char_t text[COLUMN_SAMPLE];
+  pos_t column = 0, i = 0, n;
+  
+  index = index < lbuf->used ? index : lbuf->used;
+  
+  /* Start at the nearest sample before the character in long lines */
+  if (index >= COLUMN_SAMPLE)
+    {
+      i = index - index % COLUMN_SAMPLE;
+      column = *(sample_columns(lbuf, index)->column + i / COLUMN_SAMPLE);
+    }
+  
+  n = read_line(lbuf, i, index - i, text);
+  for (pos_t j = 0; j < n; j++)
+    column = advance(column, *(text + j));
+  return column;
+}
+
+
+/**
+ * Find the character displayed at a display column
+ * 
+ * @param   lbuf    The line
+ * @param   column  The display column
+ * @param   start   Output parameter for the display column the character starts at
+ * @return          The index of the character, `lbuf->used` if the line ends before the column
+ */
+pos_t line_index(line_buffer_t* lbuf, pos_t column, pos_t* start)
+{
+  pos_t at = 0, i = 0;
+  
+  /* Find the last sample at or before the column in long lines */
+  if (lbuf->used >= COLUMN_SAMPLE)
+    {
+      line_columns_t* samples = sample_columns(lbuf, lbuf->used);
+      pos_t low = 0, high = lbuf->used / COLUMN_SAMPLE + 1;
+      while (high - low > 1)
+	{
+	  pos_t mid = (low + high) / 2;
+	  if (*(samples->column + mid) <= column)
+	    low = mid;
+	  else
+	    high = mid;
+	}
+      i = low * COLUMN_SAMPLE;
+      at = *(samples->column + low);
+    }
+  
+  return line_index_from(lbuf, i, at, column, start);
+}
+
+
+/**
+ * Find the character displayed at a display column, after a character whose display column is known
+ * 
+ * @param   lbuf    The line
+ * @param   index   The index of a character that starts at or before the column
+ * @param   at      The display column the character at `index` starts at
+ * @param   column  The display column
+ * @param   start   Output parameter for the display column the character starts at
+ * @return          The index of the character, `lbuf->used` if the line ends before the column
+ */
+pos_t line_index_from(const line_buffer_t* lbuf, pos_t index, pos_t at, pos_t column, pos_t* start)
+{
+  char_t text[COLUMN_SAMPLE];
+  pos_t n, j, next;
+  
+  /* The character is the first whose end is past the column */
+  for (; index < lbuf->used; index += n)
+    {
+      n = read_line(lbuf, index, COLUMN_SAMPLE, text);
+      for (j = 0; j < n; j++, at = next)
+	if ((next = advance(at, *(text + j))) > column)
+	  {
+	    *start = at;
+	    return index + j;
+	  }
+    }
+  *start = at;
+  return lbuf->used;
+}
+
+
+/**
+ * Make a line a view into the content of a file
+ * 
+ * @param   lbuf   Output parameter for the line
+ * @param   start  The beginning of the line in the content, may be `NULL` if `end` is too
+ * @param   end    The end of the content
+ * @return         The number of bytes in the line, excluding the line break
+ */
+size_t view_line(line_buffer_t* lbuf, const char* start, const char* end)
+{
+  int ascii;
+  lbuf->allocated = 0;
+  lbuf->line = NULL;
+  lbuf->gap = 0;
+  lbuf->width = 0;
+  lbuf->raw = start;
+  lbuf->columns = NULL;
+  lbuf->checkpoints = NULL;
+  lbuf->highlight = HIGHLIGHT_UNKNOWN;
+  lbuf->raw_size = utf8_line(start, (size_t)(end - start), &(lbuf->used), &ascii);
+  lbuf->flags = ascii || utf8_valid(start, lbuf->raw_size) ? 0 : LINE_MALFORMED;
+  return lbuf->raw_size;
+}
+
+
+/**
+ * Give a line its own character buffer so that it can be edited
+ * 
+ * @param  lbuf   The line
+ * @param  arena  The arena to allocate the buffer in
+ */
+void materialise_line(line_buffer_t* lbuf, arena_t* arena)
+{
+  char_t small[256];
+  char_t* text;
+  pos_t n = lbuf->used;
+  
+  if (lbuf->line)
+    return;
+  
+  /* Decode the line so that its widest character is known, a line without bytes has no size and decodes as empty */
+  text = n <= 256 ? small : malloc((size_t)n * sizeof(char_t));
+  n = utf8_decode(lbuf->raw, lbuf->raw_size, 0, n, text);
+  allocate_line(lbuf, arena, text, n);
+  if (text != small)
+    free(text);
+}
+
+
+/**
+ * Move the gap of a materialised line
+ * 
+ * @param  lbuf      The line
+ * @param  position  The number of characters that shall precede the gap
+ */
+void move_gap(line_buffer_t* lbuf, pos_t position)
+{
+  pos_t gap_size = lbuf->allocated - lbuf->used;
+  if (position < lbuf->gap)
+    memmove(AT(lbuf, position + gap_size), AT(lbuf, position),
+	    (size_t)(lbuf->gap - position) * (size_t)(lbuf->width));
+  else if (position > lbuf->gap)
+    memmove(AT(lbuf, lbuf->gap), AT(lbuf, lbuf->gap + gap_size),
+	    (size_t)(position - lbuf->gap) * (size_t)(lbuf->width));
+  lbuf->gap = position;
+}
+
+
+/**
+ * Move the gap of a line to its end, turning it into a plain array,
+ * this should be done when the point leaves the line
+ * 
+ * @param  lbuf  The line
+ */
+void compact_line(line_buffer_t* lbuf)
+{
+  if (lbuf->line)
+    move_gap(lbuf, lbuf->used);
+}
+
+
+/**
+ * Insert characters into a line
+ * 
+ * @param  lbuf      The line
+ * @param  arena     The arena to allocate the buffer in if the line has not been materialised
+ * @param  position  The index of the first inserted character
+ * @param  text      The characters to insert
+ * @param  n         The number of characters to insert
+ */
+void line_insert(line_buffer_t* lbuf, arena_t* arena, pos_t position, const char_t* text, pos_t n)
+{
+  int_least8_t width = width_of(text, n);
+  
+  materialise_line(lbuf, arena);
+  
+  /* Grow the gap if it is too small, by at least doubling the allocation,
+   * and widen the line if the text does not fit in its current width */
+  width = width > lbuf->width ? width : lbuf->width;
+  if ((lbuf->allocated - lbuf->used < n) || (width != lbuf->width))
+    {
+      pos_t allocated = lbuf->allocated;
+      if (allocated - lbuf->used < n)
+	{
+	  allocated <<= 1;
+	  if (allocated < lbuf->used + n)
+	    allocated = lbuf->used + n;
+	}
+      relocate_line(lbuf, allocated, width);
+    }
+  
+  /* Fill the beginning of the gap */
+  invalidate_samples(lbuf, position);
+  move_gap(lbuf, position);
+  narrow(AT(lbuf, lbuf->gap), lbuf->width, text, n);
+  lbuf->gap += n;
+  lbuf->used += n;
+}
+
+
+/**
+ * Remove characters from a line
+ * 
+ * @param  lbuf      The line
+ * @param  arena     The arena to allocate the buffer in if the line has not been materialised
+ * @param  position  The index of the first character to remove
+ * @param  n         The number of characters to remove
+ */
+void line_delete(line_buffer_t* lbuf, arena_t* arena, pos_t position, pos_t n)
+{
+  materialise_line(lbuf, arena);
+  
+  /* Let the gap swallow the characters */
+  invalidate_samples(lbuf, position);
+  move_gap(lbuf, position);
+  lbuf->used -= n;
+}
+
+
+/**
+ * Split a line in two
+ * 
+ * @param  lbuf      The line, will be truncated
+ * @param  arena     The arena to allocate the new line in
+ * @param  position  The number of characters to keep in `lbuf`
+ * @param  tail      Output parameter for a new line with the rest of the characters
+ */
+void split_line(line_buffer_t* lbuf, arena_t* arena, pos_t position, line_buffer_t* tail)
+{
+  char_t* text;
+  pos_t n = lbuf->used - position;
+  
+  if (lbuf->line == NULL)
+    {
+      /* Both halves of a view are views */
+      size_t offset = 0;
+      for (pos_t skip = position; offset < lbuf->raw_size; offset++)
+	if ((*(lbuf->raw + offset) & 0xC0) != 0x80)
+	  if (skip-- == 0)
+	    break;
+      tail->used = n;
+      tail->allocated = 0;
+      tail->line = NULL;
+      tail->gap = 0;
+      tail->width = 0;
+      tail->raw = lbuf->raw ? lbuf->raw + offset : NULL;
+      tail->raw_size = lbuf->raw_size - offset;
+      tail->columns = NULL;
+      tail->checkpoints = NULL;
+      tail->highlight = HIGHLIGHT_UNKNOWN;
+      tail->flags = lbuf->flags;
+      invalidate_samples(lbuf, position);
+      lbuf->raw_size = offset;
+      lbuf->used = position;
+      return;
+    }
+  
+  /* The new line gets the narrowest width its own characters allow */
+  text = malloc((size_t)(n ? n : 1) * sizeof(char_t));
+  read_line(lbuf, position, n, text);
+  tail->raw = NULL;
+  tail->raw_size = 0;
+  tail->columns = NULL;
+  tail->checkpoints = NULL;
+  tail->highlight = HIGHLIGHT_UNKNOWN;
+  tail->flags = 0;
+  allocate_line(tail, arena, text, n);
+  free(text);
+  line_delete(lbuf, arena, position, n);
+}
+
+
+/**
+ * Release the resources of a line
+ * 
+ * @param  lbuf  The line
+ */
+void free_line(line_buffer_t* lbuf)
+{
+  /* Storage in the arena is released with the arena */
+  if (lbuf->line && !(lbuf->flags & LINE_ARENA))
+    free(lbuf->line);
+  free(lbuf->columns);
+  free(lbuf->checkpoints);
+  lbuf->columns = NULL;
+  lbuf->checkpoints = NULL;
+  lbuf->flags &= (int_least8_t)~LINE_ARENA;
+  lbuf->line = NULL;
+  lbuf->allocated = 0;
+  lbuf->gap = 0;
+  lbuf->width = 0;
+}
+
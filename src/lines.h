@@ -0,0 +1,368 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __LINES_H__
+#define __LINES_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "utf8.h"
+#include "arena.h"
+#include "glyph.h"
+#include "highlight.h"
+
+
+/**
+ * The number of characters a line is given room to grow
+ * with when it is allocated, before it has to be moved
+ */
+#ifndef LINE_SLACK
+#define LINE_SLACK  16
+#endif
+
+/**
+ * The number of characters between the sampled display columns of a line,
+ * shorter lines are measured without keeping any samples
+ */
+#ifndef COLUMN_SAMPLE
+#define COLUMN_SAMPLE  64
+#endif
+
+/**
+ * The number of characters between the lexer checkpoints of a line,
+ * shorter lines are lexed without keeping any checkpoints
+ */
+#ifndef LEXER_SAMPLE
+#define LEXER_SAMPLE  1024
+#endif
+
+/**
+ * The number of characters that are lexed at a time while the checkpoints
+ * of a long line are found, at least twice `LEXER_SAMPLE`
+ */
+#ifndef LEXER_WINDOW
+#define LEXER_WINDOW  (16 * LEXER_SAMPLE)
+#endif
+
+
+
+/**
+ * The original content of the line is not well-formed UTF-8
+ */
+#define  LINE_MALFORMED  1
+
+/**
+ * The storage of the line is allocated in its document's arena
+ */
+#define  LINE_ARENA  2
+
+
+
+/**
+ * The display columns of every `COLUMN_SAMPLE`:th character of a line
+ */
+typedef struct line_columns
+{
+  /**
+   * The number of samples that are up to date, edits invalidate the samples after them
+   */
+  pos_t valid;
+  
+  /**
+   * The number of samples that fit in `column`
+   */
+  pos_t allocated;
+  
+  /**
+   * The display column of the character `i * COLUMN_SAMPLE` at index `i`
+   */
+  pos_t column[];
+  
+} line_columns_t;
+
+
+/**
+ * A character of a line where lexing can be resumed
+ */
+typedef struct line_checkpoint
+{
+  /**
+   * The index of the character
+   */
+  pos_t index;
+  
+  /**
+   * The number of bytes in the content of the line before the character,
+   * if the line is still a view into its file, so that it can be decoded from there
+   */
+  size_t offset;
+  
+  /**
+   * The lexer state at the character
+   */
+  int_least16_t state;
+  
+} line_checkpoint_t;
+
+
+/**
+ * The first character where lexing can be resumed after every `LEXER_SAMPLE`:th character of a line
+ */
+typedef struct line_checkpoints
+{
+  /**
+   * The lexer that the checkpoints are for
+   */
+  lexer_t* lexer;
+  
+  /**
+   * The lexer state at the beginning of the line that the checkpoints are for
+   */
+  int_least16_t start;
+  
+  /**
+   * The number of checkpoints that are up to date, edits invalidate the checkpoints after them
+   */
+  pos_t valid;
+  
+  /**
+   * The number of checkpoints that fit in `checkpoint`
+   */
+  pos_t allocated;
+  
+  /**
+   * The checkpoints, by index, the first is the beginning of the line
+   */
+  line_checkpoint_t checkpoint[];
+  
+} line_checkpoints_t;
+
+
+/**
+ * Frame line buffer information structure
+ * 
+ * A line that has not been edited is a view into the
+ * UTF-8 encoded content of the file, `raw`, and is
+ * decoded on demand. It is only decoded into `line`
+ * once it is edited.
+ * 
+ * A materialised line is a gap buffer: the unused
+ * characters in `line` are located at `gap`, so that
+ * consecutive edits at the same position do not have
+ * to move the rest of the line. A line whose gap is
+ * at its end is a plain array of characters.
+ * 
+ * The characters of a materialised line are stored
+ * with the narrowest of 8, 16 and 32 bits that can
+ * hold its widest character. Use `read_line` rather
+ * than accessing `line` directly.
+ */
+typedef struct line_buffer
+{
+  /**
+   * The number of used characters in the line
+   */
+  pos_t used;
+  
+  /**
+   * The number of allocated characters for the line, zero if the line has not been materialised
+   */
+  pos_t allocated;
+  
+  /**
+   * The content of the line, `NULL` if the line has not been materialised
+   */
+  void* line;
+  
+  /**
+   * The index in `line` of the gap, that is, the number of characters before the
+   * gap, the gap consists of the `allocated - used` unused characters
+   */
+  pos_t gap;
+  
+  /**
+   * The original content of the line in the file, UTF-8 encoded and without
+   * the line break, `NULL` if the line did not come from the file
+   */
+  const char* raw;
+  
+  /**
+   * The number of bytes in `raw`
+   */
+  size_t raw_size;
+  
+  /**
+   * Sampled display columns, `NULL` until columns are looked up in a long line
+   */
+  line_columns_t* columns;
+  
+  /**
+   * Lexer checkpoints, `NULL` until a long line is highlighted
+   */
+  line_checkpoints_t* checkpoints;
+  
+  /**
+   * The lexer state at the end of the line when it was last highlighted,
+   * `HIGHLIGHT_UNKNOWN` if it has never been highlighted, the frame
+   * keeps track of which lines have been highlighted since they changed
+   */
+  int_least16_t highlight;
+  
+  /**
+   * The flags for the line
+   */
+  int_least8_t flags;
+  
+  /**
+   * The number of bytes per character in `line`: 1 (Latin-1), 2 (UCS-2) or 4 (UCS-4)
+   */
+  int_least8_t width;
+  
+} line_buffer_t;
+
+
+
+/**
+ * Read characters from a line
+ * 
+ * @param   lbuf    The line
+ * @param   start   The index of the first character to read
+ * @param   n       The maximum number of characters to read
+ * @param   output  Output buffer for the characters
+ * @return          The number of characters stored in `output`
+ */
+pos_t read_line(const line_buffer_t* lbuf, pos_t start, pos_t n, char_t* output);
+
+/**
+ * Read a character from a line
+ * 
+ * @param   lbuf   The line
+ * @param   index  The index of the character, must be in the line
+ * @return         The character
+ */
+char_t line_char(const line_buffer_t* lbuf, pos_t index);
+
+/**
+ * Get the display column a character starts at
+ * 
+ * @param   lbuf   The line
+ * @param   index  The index of the character, `lbuf->used` for the end of the line
+ * @return         The display column
+ */
+pos_t line_column(line_buffer_t* lbuf, pos_t index);
+
+/**
+ * Find the character displayed at a display column
+ * 
+ * @param   lbuf    The line
+ * @param   column  The display column
+ * @param   start   Output parameter for the display column the character starts at
+ * @return          The index of the character, `lbuf->used` if the line ends before the column
+ */
+pos_t line_index(line_buffer_t* lbuf, pos_t column, pos_t* start);
+
+/**
+ * Find the character displayed at a display column, after a character whose display column is known
+ * 
+ * @param   lbuf    The line
+ * @param   index   The index of a character that starts at or before the column
+ * @param   at      The display column the character at `index` starts at
+ * @param   column  The display column
+ * @param   start   Output parameter for the display column the character starts at
+ * @return          The index of the character, `lbuf->used` if the line ends before the column
+ */
+pos_t line_index_from(const line_buffer_t* lbuf, pos_t index, pos_t at, pos_t column, pos_t* start);
+
+/**
+ * Make a line a view into the content of a file
+ * 
+ * @param   lbuf   Output parameter for the line
+ * @param   start  The beginning of the line in the content, may be `NULL` if `end` is too
+ * @param   end    The end of the content
+ * @return         The number of bytes in the line, excluding the line break
+ */
+size_t view_line(line_buffer_t* lbuf, const char* start, const char* end);
+
+/**
+ * Give a line its own character buffer so that it can be edited
+ * 
+ * @param  lbuf   The line
+ * @param  arena  The arena to allocate the buffer in
+ */
+void materialise_line(line_buffer_t* lbuf, arena_t* arena);
+
+/**
+ * Move the gap of a materialised line
+ * 
+ * @param  lbuf      The line
+ * @param  position  The number of characters that shall precede the gap
+ */
+void move_gap(line_buffer_t* lbuf, pos_t position);
+
+/**
+ * Move the gap of a line to its end, turning it into a plain array,
+ * this should be done when the point leaves the line
+ * 
+ * @param  lbuf  The line
+ */
+void compact_line(line_buffer_t* lbuf);
+
+/**
+ * Insert characters into a line
+ * 
+ * @param  lbuf      The line
+ * @param  arena     The arena to allocate the buffer in if the line has not been materialised
+ * @param  position  The index of the first inserted character
+ * @param  text      The characters to insert
+ * @param  n         The number of characters to insert
+ */
+void line_insert(line_buffer_t* lbuf, arena_t* arena, pos_t position, const char_t* text, pos_t n);
+
+/**
+ * Remove characters from a line
+ * 
+ * @param  lbuf      The line
+ * @param  arena     The arena to allocate the buffer in if the line has not been materialised
+ * @param  position  The index of the first character to remove
+ * @param  n         The number of characters to remove
+ */
+void line_delete(line_buffer_t* lbuf, arena_t* arena, pos_t position, pos_t n);
+
+/**
+ * Split a line in two
+ * 
+ * @param  lbuf      The line, will be truncated
+ * @param  arena     The arena to allocate the new line in
+ * @param  position  The number of characters to keep in `lbuf`
+ * @param  tail      Output parameter for a new line with the rest of the characters
+ */
+void split_line(line_buffer_t* lbuf, arena_t* arena, pos_t position, line_buffer_t* tail);
+
+/**
+ * Release the resources of a line
+ * 
+ * @param  lbuf  The line
+ */
+void free_line(line_buffer_t* lbuf);
+
+
+#endif
+
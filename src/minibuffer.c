@@ -0,0 +1,157 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "minibuffer.h"
+
+
+/**
+ * The prompt of the open minibuffer, `NULL` if the minibuffer is closed
+ */
+static const char* minibuffer_prompt = NULL;
+
+/**
+ * The function to call when the user is done
+ */
+static minibuffer_callback_t* minibuffer_callback = NULL;
+
+/**
+ * The text the user has entered, UTF-8 encoded
+ */
+static char* minibuffer_text = NULL;
+
+/**
+ * The number of bytes in `minibuffer_text`
+ */
+static size_t minibuffer_used = 0;
+
+/**
+ * The number of bytes that fit in `minibuffer_text`
+ */
+static size_t minibuffer_size = 0;
+
+
+
+/**
+ * Ask the user for a line of text, keys are sent to the minibuffer until it is closed
+ * 
+ * @param  prompt    The prompt to display before the text
+ * @param  callback  The function to call with the text when the user is done
+ */
+void minibuffer_open(const char* prompt, minibuffer_callback_t* callback)
+{
+  minibuffer_prompt = prompt;
+  minibuffer_callback = callback;
+  minibuffer_used = 0;
+}
+
+
+/**
+ * Check whether the minibuffer is open
+ * 
+ * @return  Whether the minibuffer is open
+ */
+int minibuffer_active(void)
+{
+  return minibuffer_prompt != NULL;
+}
+
+
+/**
+ * Send a key to the open minibuffer
+ * 
+ * @param  key  The key
+ */
+void minibuffer_key(keycode_t key)
+{
+  minibuffer_callback_t* callback = minibuffer_callback;
+  char_t c = (char_t)key;
+  char* text;
+  
+  switch (key)
+    {
+    case KEY_CTRL('M'):
+    case KEY_CTRL('J'):
+      /* Done, the text is terminated so it can be used as a string */
+      if (minibuffer_size == minibuffer_used)
+	minibuffer_text = realloc(minibuffer_text, minibuffer_size = minibuffer_size * 2 + 1);
+      *(minibuffer_text + minibuffer_used) = '\0';
+      text = minibuffer_text;
+      minibuffer_text = NULL;
+      minibuffer_close();
+      callback(text);
+      free(text);
+      break;
+      
+    case KEY_CTRL('G'):
+      /* Cancel */
+      minibuffer_close();
+      callback(NULL);
+      break;
+      
+    case KEY_CTRL('H'):
+    case KEY_CTRL('?'):
+      /* Erase the last character */
+      while (minibuffer_used && ((*(minibuffer_text + --minibuffer_used) & 0xC0) == 0x80))
+	;
+      break;
+      
+    default:
+      if ((key < ' ') || (key >= KEY_SPECIAL))
+	break;
+      if (minibuffer_size < minibuffer_used + 6)
+	minibuffer_text = realloc(minibuffer_text, minibuffer_size = minibuffer_size * 2 + 6);
+      minibuffer_used += utf8_encode(&c, 1, minibuffer_text + minibuffer_used);
+      break;
+    }
+}
+
+
+/**
+ * Close the minibuffer without calling its callback
+ */
+void minibuffer_close(void)
+{
+  free(minibuffer_text);
+  minibuffer_text = NULL;
+  minibuffer_used = minibuffer_size = 0;
+  minibuffer_prompt = NULL;
+  minibuffer_callback = NULL;
+}
+
+
+/**
+ * Draw the minibuffer
+ * 
+ * @param   row  The row on the screen to draw the minibuffer on
+ * @return       The column of the cursor
+ */
+pos_t minibuffer_draw(pos_t row)
+{
+  pos_t col = screen_print(row, 0, minibuffer_prompt, ATTR_BOLD);
+  char* text;
+  
+  if (minibuffer_used == 0)
+    return col;
+  text = malloc(minibuffer_used + 1);
+  memcpy(text, minibuffer_text, minibuffer_used);
+  *(text + minibuffer_used) = '\0';
+  col = screen_print(row, col, text, 0);
+  free(text);
+  return col;
+}
+
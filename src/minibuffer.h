@@ -0,0 +1,79 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __MINIBUFFER_H__
+#define __MINIBUFFER_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "utf8.h"
+#include "keymap.h"
+#include "screen.h"
+
+
+
+/**
+ * A function that is called with the text the user entered into the minibuffer
+ * 
+ * @param  text  The text, UTF-8 encoded, `NULL` if the user cancelled
+ */
+typedef void minibuffer_callback_t(const char* text);
+
+
+
+/**
+ * Ask the user for a line of text, keys are sent to the minibuffer until it is closed
+ * 
+ * @param  prompt    The prompt to display before the text
+ * @param  callback  The function to call with the text when the user is done
+ */
+void minibuffer_open(const char* prompt, minibuffer_callback_t* callback);
+
+/**
+ * Check whether the minibuffer is open
+ * 
+ * @return  Whether the minibuffer is open
+ */
+int minibuffer_active(void) __attribute__((pure));
+
+/**
+ * Send a key to the open minibuffer
+ * 
+ * @param  key  The key
+ */
+void minibuffer_key(keycode_t key);
+
+/**
+ * Close the minibuffer without calling its callback
+ */
+void minibuffer_close(void);
+
+/**
+ * Draw the minibuffer
+ * 
+ * @param   row  The row on the screen to draw the minibuffer on
+ * @return       The column of the cursor
+ */
+pos_t minibuffer_draw(pos_t row);
+
+
+#endif
+
@@ -0,0 +1,333 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "recover.h"
+#include "edit.h"
+#include "minibuffer.h"
+
+
+/**
+ * The currently active frame
+ */
+extern frame_t* cur_frame;
+
+/**
+ * The frame the user is asked whether to recover the edits of, `NULL` if none
+ */
+static frame_t* recovering = NULL;
+
+/**
+ * The question the user is asked
+ */
+static char* recovery_prompt = NULL;
+
+
+
+/**
+ * Get the journal of the unsaved edits of a file
+ * 
+ * @param   filename  The file
+ * @return            The path of the journal, free with `free`
+ */
+static char* journal_path(const char* filename)
+{
+  const char* base = strrchr(filename, '/');
+  size_t dir = base ? (size_t)(base - filename) : 0;
+  char* path = malloc(strlen(filename) + 24);
+  
+  if (base == NULL)
+    sprintf(path, ".%s.zecora-edits", filename);
+  else
+    sprintf(path, "%.*s/.%s.zecora-edits", (int)dir, filename, base + 1);
+  return path;
+}
+
+
+/**
+ * Get the name the journal of the unsaved edits of a file is kept under
+ * while the user has not decided whether to recover them
+ * 
+ * @param   filename  The file
+ * @return            The path of the journal, free with `free`
+ */
+static char* aside_path(const char* filename)
+{
+  char* path = journal_path(filename);
+  strcat(path, "~");
+  return path;
+}
+
+
+/**
+ * Describe a file as it is now
+ * 
+ * @param  filename  The file
+ * @param  header    Output parameter for the header of a journal of edits made to the file
+ */
+static void identify_file(const char* filename, edits_header_t* header)
+{
+  struct stat attr;
+  
+  memset(header, 0, sizeof(edits_header_t));
+  memcpy(header->magic, EDITS_MAGIC, sizeof(header->magic));
+  if (stat(filename, &attr) == 0)
+    {
+      header->inode = (uint_least64_t)(attr.st_ino);
+      header->size = (uint_least64_t)(attr.st_size);
+      header->mtime = (int_least64_t)(attr.st_mtim.tv_sec);
+      header->mtime_nsec = (int_least64_t)(attr.st_mtim.tv_nsec);
+    }
+}
+
+
+/**
+ * Start a journal for the edits of a frame
+ * 
+ * @param  frame  The frame
+ */
+static void start_journal(frame_t* frame)
+{
+  char* path = journal_path(frame->file);
+  edits_header_t header;
+  int fd;
+  
+  identify_file(frame->file, &header);
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600)) >= 0)
+    {
+      if (write(fd, &header, sizeof(edits_header_t)) == (ssize_t)sizeof(edits_header_t))
+	undo_journal_open(&(frame->undo), fd, (off_t)sizeof(edits_header_t));
+      else
+	close(fd);
+    }
+  free(path);
+}
+
+
+/**
+ * Read the journal of a frame
+ * 
+ * @param   frame  The frame
+ * @param   size   Output parameter for the number of bytes in the journal
+ * @return         The journal, `NULL` on error
+ */
+static char* read_journal(frame_t* frame, size_t* size)
+{
+  char* path = journal_path(frame->file);
+  struct stat attr;
+  char* journal = NULL;
+  ssize_t got;
+  int fd;
+  
+  *size = 0;
+  if ((fd = open(path, O_RDONLY | O_NOFOLLOW)) >= 0)
+    {
+      if ((fstat(fd, &attr) == 0) && ((size_t)(attr.st_size) >= sizeof(edits_header_t)))
+	{
+	  journal = malloc((size_t)(attr.st_size));
+	  while (*size < (size_t)(attr.st_size))
+	    {
+	      if ((got = pread(fd, journal + *size, (size_t)(attr.st_size) - *size, (off_t)*size)) <= 0)
+		{
+		  if ((got < 0) && (errno == EINTR))
+		    continue;
+		  break;
+		}
+	      *size += (size_t)got;
+	    }
+	}
+      close(fd);
+    }
+  free(path);
+  return journal;
+}
+
+
+/**
+ * Apply the edits in the journal of the current frame
+ */
+static void recover_edits(void)
+{
+  frame_t* frame = cur_frame;
+  document_t* doc = &(frame->document);
+  edits_header_t now;
+  undo_edit_t edit;
+  size_t size, offset = 0;
+  long count = 0;
+  char* journal;
+  char* message;
+  
+  if ((journal = read_journal(frame, &size)) == NULL)
+    return;
+  
+  /* The edits can only be made to the file they were made to, as it was */
+  identify_file(frame->file, &now);
+  if ((size < sizeof(edits_header_t)) || memcmp(journal, &now, sizeof(edits_header_t)))
+    {
+      alert(strdup("\033[31mThe file has changed since the edits were made, they were not recovered\033[m"));
+      free(journal);
+      return;
+    }
+  
+  /* The edits can be anywhere in the file */
+  while (frame->flags & FLAG_LOADING)
+    load_files(LOAD_STEP);
+  
+  size -= sizeof(edits_header_t);
+  while (undo_journal_read(journal + sizeof(edits_header_t), size, &offset, &edit))
+    {
+      if ((edit.row >= document_lines(doc)) || (edit.column > document_line(doc, edit.row)->used))
+	{
+	  free(edit.text);
+	  break;
+	}
+      set_point(edit.row, edit.column);
+      if (edit.type == UNDO_INSERT)
+	insert_region(edit.text, edit.length);
+      else
+	delete_region(edit.length);
+      undo_boundary(&(frame->undo));
+      free(edit.text);
+      count++;
+    }
+  free(journal);
+  
+  message = malloc(64 * sizeof(char));
+  snprintf(message, 64, "Recovered %li edit%s", count, count == 1 ? "" : "s");
+  alert(message);
+}
+
+
+/**
+ * Recover or discard the edits in the journal of the current frame, as the user answered
+ * 
+ * @param  text  The answer, `NULL` if the user cancelled
+ */
+static void recovery_answered(const char* text)
+{
+  char* path = journal_path(recovering->file);
+  char* aside;
+  
+  /* Without an answer the journal is moved aside, rather than replaced by the journal
+   * of the new edits, and offered again when the file is opened; if it cannot be
+   * moved, the frame stays recoverable and the user is asked again */
+  if (text == NULL)
+    {
+      aside = aside_path(recovering->file);
+      if (rename(path, aside) == 0)
+	recovering->flags &= (int_least8_t)~FLAG_RECOVERABLE;
+      free(aside);
+    }
+  else
+    {
+      recovering->flags &= (int_least8_t)~FLAG_RECOVERABLE;
+      if (!strcmp(text, "yes") || !strcmp(text, "y"))
+	recover_edits();
+      else
+	unlink(path);
+    }
+  free(path);
+  
+  recovering = NULL;
+  free(recovery_prompt);
+  recovery_prompt = NULL;
+}
+
+
+
+/**
+ * Check whether a file has a journal of unsaved edits, a journal that was
+ * moved aside because the user did not answer whether to recover it is
+ * put back, unless the file has a newer journal
+ * 
+ * @param   filename  The file
+ * @return            Whether the file has a journal
+ */
+int has_journal(const char* filename)
+{
+  char* path = journal_path(filename);
+  char* aside = aside_path(filename);
+  struct stat attr;
+  int found = lstat(path, &attr) == 0;
+  if (!found)
+    found = (lstat(aside, &attr) == 0) && (rename(aside, path) == 0);
+  free(aside);
+  free(path);
+  return found;
+}
+
+
+/**
+ * Write the new edits in the frames to their journals
+ * 
+ * @param  sync  Whether to wait for the journals to be synchronised to disk
+ */
+void flush_journals(int sync)
+{
+  frame_t* frame;
+  pos_t i;
+  
+  /* The journal of a frame is not replaced while the user is deciding whether to recover it */
+  for (i = 0; (frame = get_frame(i)); i++)
+    if (frame->file && !(frame->flags & FLAG_RECOVERABLE))
+      {
+	if ((frame->undo.journal < 0) && undo_journal_pending(&(frame->undo)))
+	  start_journal(frame);
+	undo_journal_flush(&(frame->undo), sync);
+      }
+}
+
+
+/**
+ * Remove the journal of a frame, once the frame has been saved
+ * 
+ * @param  frame  The frame
+ */
+void journal_saved(frame_t* frame)
+{
+  char* path;
+  
+  undo_journal_close(&(frame->undo));
+  undo_journal_skip(&(frame->undo));
+  if (frame->file && !(frame->flags & FLAG_RECOVERABLE))
+    {
+      path = journal_path(frame->file);
+      unlink(path);
+      free(path);
+    }
+}
+
+
+/**
+ * Ask the user whether to recover the edits in the journal of the current frame, if it has one
+ * 
+ * @return  Whether the user was asked
+ */
+int offer_recovery(void)
+{
+  size_t n;
+  
+  if (!(cur_frame->flags & FLAG_RECOVERABLE) || recovering || minibuffer_active())
+    return 0;
+  
+  recovering = cur_frame;
+  n = strlen(cur_frame->file) + 64;
+  recovery_prompt = malloc(n * sizeof(char));
+  snprintf(recovery_prompt, n, "Recover unsaved edits to %s? (yes or no) ", cur_frame->file);
+  minibuffer_open(recovery_prompt, recovery_answered);
+  return 1;
+}
@@ -0,0 +1,111 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __RECOVER_H__
+#define __RECOVER_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "types.h"
+#include "frames.h"
+#include "undo.h"
+
+
+
+/**
+ * The bytes that the journal of the unsaved edits of a file begins with
+ */
+#define  EDITS_MAGIC  "ZECORAE1"
+
+
+
+/**
+ * The beginning of the journal of the unsaved edits of a file, it is followed by the
+ * records of the edits, as they are in the undo log of the frame of the file
+ */
+typedef struct edits_header
+{
+  /**
+   * `EDITS_MAGIC`
+   */
+  char magic[8];
+  
+  /**
+   * The inode of the file the edits were made to, zero if it did not exist
+   */
+  uint_least64_t inode;
+  
+  /**
+   * The size of the file the edits were made to
+   */
+  uint_least64_t size;
+  
+  /**
+   * The seconds of the last modification time of the file the edits were made to
+   */
+  int_least64_t mtime;
+  
+  /**
+   * The nanoseconds of the last modification time of the file the edits were made to
+   */
+  int_least64_t mtime_nsec;
+  
+} edits_header_t;
+
+
+
+/**
+ * Check whether a file has a journal of unsaved edits, a journal that was
+ * moved aside because the user did not answer whether to recover it is
+ * put back, unless the file has a newer journal
+ * 
+ * @param   filename  The file
+ * @return            Whether the file has a journal
+ */
+int has_journal(const char* filename);
+
+/**
+ * Write the new edits in the frames to their journals
+ * 
+ * @param  sync  Whether to wait for the journals to be synchronised to disk
+ */
+void flush_journals(int sync);
+
+/**
+ * Remove the journal of a frame, once the frame has been saved
+ * 
+ * @param  frame  The frame
+ */
+void journal_saved(frame_t* frame);
+
+/**
+ * Ask the user whether to recover the edits in the journal of the current frame, if it has one
+ * 
+ * @return  Whether the user was asked
+ */
+int offer_recovery(void);
+
+
+#endif
@@ -0,0 +1,1488 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "regexp.h"
+
+
+
+/**
+ * A node that does not exist
+ */
+#define NO_NODE  SIZE_MAX
+
+
+
+/**
+ * A part of a program that is being compiled, it is entered at one node and
+ * left at another, a `REGEXP_EMPTY` node whose next node has not been set yet
+ */
+typedef struct fragment
+{
+  /**
+   * The first node
+   */
+  size_t start;
+  
+  /**
+   * The last node
+   */
+  size_t end;
+  
+} fragment_t;
+
+
+/**
+ * The state of the compilation of an expression into a program
+ */
+typedef struct parser
+{
+  /**
+   * The expression the program belongs to
+   */
+  regexp_t* re;
+  
+  /**
+   * The program
+   */
+  regexp_program_t* program;
+  
+  /**
+   * The source of the expression
+   */
+  const char_t* pattern;
+  
+  /**
+   * The number of characters in `pattern`
+   */
+  pos_t n;
+  
+  /**
+   * The index of the next character to parse
+   */
+  pos_t i;
+  
+  /**
+   * Whether the program matches the expression backwards
+   */
+  int reverse;
+  
+} parser_t;
+
+
+/**
+ * A match in progress, it follows the states of an automaton until
+ * the automaton is full, and then follows the nodes of the program
+ */
+typedef struct run
+{
+  /**
+   * The expression
+   */
+  regexp_t* re;
+  
+  /**
+   * The automaton
+   */
+  regexp_dfa_t* dfa;
+  
+  /**
+   * The current state, `NULL` once the automaton was full
+   */
+  regexp_state_t* state;
+  
+  /**
+   * The current nodes once the automaton was full, `NULL` until then
+   */
+  size_t* set;
+  
+  /**
+   * Room for the next nodes once the automaton was full
+   */
+  size_t* next_set;
+  
+  /**
+   * The number of elements in `set`
+   */
+  size_t count;
+  
+  /**
+   * The flags of the current nodes once the automaton was full
+   */
+  int_least8_t flags;
+  
+  /**
+   * Working memory once the automaton was full
+   */
+  regexp_scratch_t scratch;
+  
+} run_t;
+
+
+/**
+ * The states at columns of a line from which matching has been seen not to accept
+ */
+typedef struct failures
+{
+  /**
+   * The states, `NULL` in unused slots
+   */
+  const regexp_state_t** states;
+  
+  /**
+   * The column of each state
+   */
+  pos_t* columns;
+  
+  /**
+   * The number of elements in `states` and `columns`, a power of two
+   */
+  size_t size;
+  
+  /**
+   * The number of used slots
+   */
+  size_t used;
+  
+} failures_t;
+
+
+
+/**
+ * Add a node to the program that is being compiled
+ * 
+ * @param   p     The parser
+ * @param   type  The type of the node
+ * @return        The index of the node
+ */
+static size_t add_node(parser_t* p, int_least8_t type)
+{
+  regexp_program_t* program = p->program;
+  regexp_node_t* node;
+  
+  if (program->count == program->allocated)
+    program->nodes = realloc(program->nodes, (program->allocated = program->allocated * 2 + 16) * sizeof(regexp_node_t));
+  node = program->nodes + program->count;
+  node->type = type;
+  node->negated = 0;
+  node->out = node->alt = NO_NODE;
+  node->ranges = node->count = 0;
+  return program->count++;
+}
+
+
+/**
+ * Add a range of characters to the expression that is being compiled
+ * 
+ * @param  p      The parser
+ * @param  first  The first character in the range
+ * @param  last   The last character in the range
+ */
+static void add_range(parser_t* p, char_t first, char_t last)
+{
+  regexp_t* re = p->re;
+  if (re->range_count == re->ranges_allocated)
+    re->ranges = realloc(re->ranges, (re->ranges_allocated = re->ranges_allocated * 2 + 16) * sizeof(regexp_range_t));
+  (re->ranges + re->range_count)->first = first;
+  (re->ranges + re->range_count++)->last = last;
+}
+
+
+/**
+ * Make a fragment of a node followed by a `REGEXP_EMPTY` node
+ * 
+ * @param  p     The parser
+ * @param  type  The type of the first node
+ * @param  frag  Output parameter for the fragment
+ */
+static void single(parser_t* p, int_least8_t type, fragment_t* frag)
+{
+  frag->start = add_node(p, type);
+  frag->end = add_node(p, REGEXP_EMPTY);
+  (p->program->nodes + frag->start)->out = frag->end;
+}
+
+
+/**
+ * Make a fragment that matches a character in a class
+ * 
+ * @param  p        The parser
+ * @param  first    The index of the first range of the class, the class is the ranges added since
+ * @param  negated  Whether the class is every character that is not in the ranges
+ * @param  frag     Output parameter for the fragment
+ */
+static void class_fragment(parser_t* p, size_t first, int negated, fragment_t* frag)
+{
+  regexp_node_t* node;
+  single(p, REGEXP_CLASS, frag);
+  node = p->program->nodes + frag->start;
+  node->negated = (int_least8_t)negated;
+  node->ranges = first;
+  node->count = p->re->range_count - first;
+}
+
+
+static int parse_alternation(parser_t* p, fragment_t* frag);
+
+
+/**
+ * Parse a bracket expression, after its `[`
+ * 
+ * @param   p     The parser
+ * @param   frag  Output parameter for the fragment
+ * @return        Zero on success, -1 if the expression is incomplete or malformed
+ */
+static int parse_bracket(parser_t* p, fragment_t* frag)
+{
+  size_t first = p->re->range_count;
+  int negated = 0, leading = 1;
+  char_t low, high;
+  
+  if ((p->i < p->n) && (*(p->pattern + p->i) == '^'))
+    {
+      negated = 1;
+      p->i++;
+    }
+  
+  /* A `]` at the beginning is a literal, as is a `-` at the beginning or the end */
+  for (;; leading = 0)
+    {
+      if (p->i >= p->n)
+	return -1;
+      low = high = *(p->pattern + p->i++);
+      if ((low == ']') && !leading)
+	break;
+      if ((p->i + 1 < p->n) && (*(p->pattern + p->i) == '-') && (*(p->pattern + p->i + 1) != ']'))
+	{
+	  high = *(p->pattern + p->i + 1);
+	  p->i += 2;
+	  if (high < low)
+	    return -1;
+	}
+      add_range(p, low, high);
+    }
+  
+  class_fragment(p, first, negated, frag);
+  return 0;
+}
+
+
+/**
+ * Parse an escaped character
+ * 
+ * @param  p     The parser
+ * @param  c     The character after the `\`
+ * @param  frag  Output parameter for the fragment
+ */
+static void parse_escape(parser_t* p, char_t c, fragment_t* frag)
+{
+  size_t first = p->re->range_count;
+  
+  switch (c)
+    {
+    case 'd':
+    case 'D':
+      add_range(p, '0', '9');
+      break;
+      
+    case 'w':
+    case 'W':
+      add_range(p, '0', '9');
+      add_range(p, 'A', 'Z');
+      add_range(p, '_', '_');
+      add_range(p, 'a', 'z');
+      break;
+      
+    case 's':
+    case 'S':
+      add_range(p, '\t', '\r');
+      add_range(p, ' ', ' ');
+      break;
+      
+    default:
+      add_range(p, c, c);
+      class_fragment(p, first, 0, frag);
+      return;
+    }
+  
+  /* The upper case classes are the complements of the lower case classes */
+  class_fragment(p, first, (c >= 'A') && (c <= 'Z'), frag);
+}
+
+
+/**
+ * Parse an atom: a character, a class, an anchor or a group
+ * 
+ * @param   p     The parser
+ * @param   frag  Output parameter for the fragment
+ * @return        Zero on success, -1 if the expression is incomplete or malformed
+ */
+static int parse_atom(parser_t* p, fragment_t* frag)
+{
+  char_t c = *(p->pattern + p->i++);
+  
+  switch (c)
+    {
+    case '(':
+      if (parse_alternation(p, frag))
+	return -1;
+      if ((p->i >= p->n) || (*(p->pattern + p->i) != ')'))
+	return -1;
+      p->i++;
+      return 0;
+      
+    case '[':
+      return parse_bracket(p, frag);
+      
+    case '.':
+      class_fragment(p, p->re->range_count, 1, frag);
+      return 0;
+      
+      /* Backwards, the anchors swap places */
+    case '^':
+      single(p, p->reverse ? REGEXP_END : REGEXP_BEGIN, frag);
+      return 0;
+      
+    case '$':
+      single(p, p->reverse ? REGEXP_BEGIN : REGEXP_END, frag);
+      return 0;
+      
+    case '\\':
+      if (p->i >= p->n)
+	return -1;
+      parse_escape(p, *(p->pattern + p->i++), frag);
+      return 0;
+      
+    default:
+      /* Repetition operators without anything to repeat are literals */
+      add_range(p, c, c);
+      class_fragment(p, p->re->range_count - 1, 0, frag);
+      return 0;
+    }
+}
+
+
+/**
+ * Parse an atom and the repetition operators after it
+ * 
+ * @param   p     The parser
+ * @param   frag  Output parameter for the fragment
+ * @return        Zero on success, -1 if the expression is incomplete or malformed
+ */
+static int parse_repetition(parser_t* p, fragment_t* frag)
+{
+  size_t split, end;
+  char_t c;
+  
+  if (parse_atom(p, frag))
+    return -1;
+  
+  while ((p->i < p->n) && (((c = *(p->pattern + p->i)) == '*') || (c == '+') || (c == '?')))
+    {
+      p->i++;
+      split = add_node(p, REGEXP_SPLIT);
+      end = add_node(p, REGEXP_EMPTY);
+      (p->program->nodes + split)->out = frag->start;
+      (p->program->nodes + split)->alt = end;
+      (p->program->nodes + frag->end)->out = c == '?' ? end : split;
+      frag->start = c == '+' ? frag->start : split;
+      frag->end = end;
+    }
+  
+  return 0;
+}
+
+
+/**
+ * Parse a sequence of atoms
+ * 
+ * @param   p     The parser
+ * @param   frag  Output parameter for the fragment
+ * @return        Zero on success, -1 if the expression is incomplete or malformed
+ */
+static int parse_concatenation(parser_t* p, fragment_t* frag)
+{
+  fragment_t next;
+  
+  frag->start = frag->end = add_node(p, REGEXP_EMPTY);
+  while ((p->i < p->n) && (*(p->pattern + p->i) != '|') && (*(p->pattern + p->i) != ')'))
+    {
+      if (parse_repetition(p, &next))
+	return -1;
+      /* Backwards, the atoms are matched last to first */
+      if (p->reverse)
+	{
+	  (p->program->nodes + next.end)->out = frag->start;
+	  frag->start = next.start;
+	}
+      else
+	{
+	  (p->program->nodes + frag->end)->out = next.start;
+	  frag->end = next.end;
+	}
+    }
+  
+  return 0;
+}
+
+
+/**
+ * Parse alternatives
+ * 
+ * @param   p     The parser
+ * @param   frag  Output parameter for the fragment
+ * @return        Zero on success, -1 if the expression is incomplete or malformed
+ */
+static int parse_alternation(parser_t* p, fragment_t* frag)
+{
+  fragment_t next;
+  size_t split, end;
+  
+  if (parse_concatenation(p, frag))
+    return -1;
+  
+  while ((p->i < p->n) && (*(p->pattern + p->i) == '|'))
+    {
+      p->i++;
+      if (parse_concatenation(p, &next))
+	return -1;
+      split = add_node(p, REGEXP_SPLIT);
+      end = add_node(p, REGEXP_EMPTY);
+      (p->program->nodes + split)->out = frag->start;
+      (p->program->nodes + split)->alt = next.start;
+      (p->program->nodes + frag->end)->out = end;
+      (p->program->nodes + next.end)->out = end;
+      frag->start = split;
+      frag->end = end;
+    }
+  
+  return 0;
+}
+
+
+/**
+ * Compile an expression into a program
+ * 
+ * @param   re       The expression
+ * @param   program  Output parameter for the program
+ * @param   pattern  The source of the expression
+ * @param   n        The number of characters in `pattern`
+ * @param   reverse  Whether the program shall match the expression backwards
+ * @return           Zero on success, -1 if the expression is incomplete or malformed
+ */
+static int compile_program(regexp_t* re, regexp_program_t* program, const char_t* pattern, pos_t n, int reverse)
+{
+  parser_t p;
+  fragment_t frag;
+  size_t match;
+  
+  p.re = re;
+  p.program = program;
+  p.pattern = pattern;
+  p.n = n;
+  p.i = 0;
+  p.reverse = reverse;
+  
+  /* A `)` that is left over has no `(` */
+  if (parse_alternation(&p, &frag) || (p.i < n))
+    return -1;
+  match = add_node(&p, REGEXP_MATCH);
+  (program->nodes + frag.end)->out = match;
+  program->start = frag.start;
+  return 0;
+}
+
+
+
+/**
+ * Compare two characters
+ * 
+ * @param   a  The first character
+ * @param   b  The second character
+ * @return     Negative if `a` is less, positive if `a` is greater, zero if they are equal
+ */
+static int compare_chars(const void* a, const void* b)
+{
+  char_t x = *(const char_t*)a, y = *(const char_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Get the class of a character by its place among the bounds of the classes
+ * 
+ * @param   re  The expression
+ * @param   c   The character
+ * @return      The class
+ */
+__attribute__((pure))
+static size_t bound_class(const regexp_t* re, char_t c)
+{
+  size_t low = 0, high = re->bound_count, mid;
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      if (*(re->bounds + mid) <= c)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+  return low;
+}
+
+
+/**
+ * Get the class of a character
+ * 
+ * @param   re  The expression
+ * @param   c   The character
+ * @return      The class
+ */
+__attribute__((pure))
+static size_t class_of(const regexp_t* re, char_t c)
+{
+  return (c >= 0) && (c < 128) ? *(re->ascii + c) : bound_class(re, c);
+}
+
+
+/**
+ * Get a character of a class
+ * 
+ * @param   re     The expression
+ * @param   class  The class
+ * @return         A character in the class, every character in the class is in the same ranges
+ */
+static char_t member_of(const regexp_t* re, size_t class)
+{
+  if (class > 0)
+    return *(re->bounds + class - 1);
+  return re->bound_count ? *(re->bounds) - 1 : 0;
+}
+
+
+/**
+ * Divide the characters into classes that the expression cannot tell apart
+ * 
+ * @param  re  The expression
+ */
+static void build_alphabet(regexp_t* re)
+{
+  size_t i, n = 0;
+  char_t c;
+  
+  re->bounds = malloc((re->range_count * 2 + 1) * sizeof(char_t));
+  for (i = 0; i < re->range_count; i++)
+    {
+      *(re->bounds + n++) = (re->ranges + i)->first;
+      if ((re->ranges + i)->last < INT_LEAST32_MAX)
+	*(re->bounds + n++) = (re->ranges + i)->last + 1;
+    }
+  qsort(re->bounds, n, sizeof(char_t), compare_chars);
+  
+  re->bound_count = 0;
+  for (i = 0; i < n; i++)
+    if ((i == 0) || (*(re->bounds + i) != *(re->bounds + i - 1)))
+      *(re->bounds + re->bound_count++) = *(re->bounds + i);
+  
+  for (c = 0; c < 128; c++)
+    *(re->ascii + c) = bound_class(re, c);
+}
+
+
+
+/**
+ * Check whether a character is in the class of a node
+ * 
+ * @param   re    The expression
+ * @param   node  The node
+ * @param   c     The character
+ * @return        Whether the character is in the class
+ */
+__attribute__((pure))
+static int in_class(const regexp_t* re, const regexp_node_t* node, char_t c)
+{
+  const regexp_range_t* range = re->ranges + node->ranges;
+  size_t i;
+  for (i = 0; i < node->count; i++, range++)
+    if ((range->first <= c) && (c <= range->last))
+      return !node->negated;
+  return node->negated;
+}
+
+
+
+/**
+ * Allocate working memory for computing states
+ * 
+ * @param  scratch  Output parameter for the working memory
+ * @param  nodes    The number of nodes in the program
+ */
+static void scratch_init(regexp_scratch_t* scratch, size_t nodes)
+{
+  scratch->set = malloc(nodes * sizeof(size_t));
+  scratch->reached = malloc(nodes * sizeof(size_t));
+  scratch->stack = malloc((nodes * 2 + 1) * sizeof(size_t));
+  scratch->mark = calloc(nodes, sizeof(unsigned));
+  scratch->generation = 0;
+}
+
+
+/**
+ * Release working memory for computing states
+ * 
+ * @param  scratch  The working memory
+ */
+static void scratch_free(regexp_scratch_t* scratch)
+{
+  free(scratch->set);
+  free(scratch->reached);
+  free(scratch->stack);
+  free(scratch->mark);
+}
+
+
+/**
+ * Start a new visit of the nodes
+ * 
+ * @param  scratch  The working memory
+ * @param  nodes    The number of nodes in the program
+ */
+static void next_visit(regexp_scratch_t* scratch, size_t nodes)
+{
+  if (++(scratch->generation) == 0)
+    {
+      memset(scratch->mark, 0, nodes * sizeof(unsigned));
+      scratch->generation = 1;
+    }
+}
+
+
+/**
+ * Add the nodes that can be reached from a node without consuming
+ * a character to a set, unless already visited in this visit
+ * 
+ * @param  program  The program
+ * @param  scratch  The working memory
+ * @param  node     The node
+ * @param  begin    Whether `REGEXP_BEGIN` nodes may be passed
+ * @param  end      Whether `REGEXP_END` nodes may be passed
+ * @param  set      The set
+ * @param  count    The number of elements in `set`, will be updated
+ */
+static void follow(const regexp_program_t* program, regexp_scratch_t* scratch, size_t node,
+		   int begin, int end, size_t* set, size_t* count)
+{
+  const regexp_node_t* at;
+  size_t top = 0;
+  
+  *(scratch->stack + top++) = node;
+  while (top)
+    {
+      node = *(scratch->stack + --top);
+      if (*(scratch->mark + node) == scratch->generation)
+	continue;
+      *(scratch->mark + node) = scratch->generation;
+      at = program->nodes + node;
+      
+      /* Nodes that consume characters, and the anchors at the end, are the states of the automaton */
+      switch (at->type)
+	{
+	case REGEXP_CLASS:
+	case REGEXP_MATCH:
+	  *(set + (*count)++) = node;
+	  break;
+	case REGEXP_END:
+	  *(set + (*count)++) = node;
+	  if (end)
+	    *(scratch->stack + top++) = at->out;
+	  break;
+	case REGEXP_BEGIN:
+	  if (begin)
+	    *(scratch->stack + top++) = at->out;
+	  break;
+	case REGEXP_SPLIT:
+	  *(scratch->stack + top++) = at->alt;
+	  *(scratch->stack + top++) = at->out;
+	  break;
+	default:
+	  *(scratch->stack + top++) = at->out;
+	  break;
+	}
+    }
+}
+
+
+/**
+ * Get the flags of a set of nodes
+ * 
+ * @param   program     The program
+ * @param   scratch     The working memory, `set` is not used
+ * @param   set         The set
+ * @param   count       The number of elements in `set`
+ * @param   begin       Whether the set is where matching starts at the edge of the text
+ * @param   unanchored  Whether the program can start matching anywhere
+ * @return              The `REGEXP_ACCEPT`, `REGEXP_ACCEPT_AT_END` and `REGEXP_DEAD` flags of the set
+ */
+static int_least8_t flags_of(const regexp_program_t* program, regexp_scratch_t* scratch,
+			     const size_t* set, size_t count, int begin, int unanchored)
+{
+  int_least8_t flags = 0, type;
+  int consumes = 0, matched = 0;
+  size_t i, reached = 0;
+  
+  /* A program that can start anywhere adds its first nodes after every
+     character, so its sets can only be stuck if they are empty */
+  for (i = 0; i < count; i++)
+    {
+      type = (program->nodes + *(set + i))->type;
+      matched |= type == REGEXP_MATCH;
+      consumes |= (type == REGEXP_CLASS) || unanchored;
+    }
+  if (!consumes)
+    flags |= REGEXP_DEAD;
+  if (matched)
+    return flags | REGEXP_ACCEPT | REGEXP_ACCEPT_AT_END;
+  
+  /* Anchors at the end are passed if the text ends here */
+  next_visit(scratch, program->count);
+  for (i = 0; i < count; i++)
+    if ((program->nodes + *(set + i))->type == REGEXP_END)
+      follow(program, scratch, (program->nodes + *(set + i))->out, begin, 1, scratch->reached, &reached);
+  for (i = 0; i < reached; i++)
+    if ((program->nodes + *(scratch->reached + i))->type == REGEXP_MATCH)
+      return flags | REGEXP_ACCEPT_AT_END;
+  return flags;
+}
+
+
+/**
+ * Compute the set of nodes that follows a set of nodes when a character is consumed
+ * 
+ * @param   re          The expression
+ * @param   program     The program
+ * @param   unanchored  Whether the program can start matching anywhere
+ * @param   scratch     The working memory, `set` is not used
+ * @param   set         The set
+ * @param   count       The number of elements in `set`
+ * @param   c           The character
+ * @param   next        Output parameter for the next set
+ * @return              The number of elements in `next`
+ */
+static size_t step_set(const regexp_t* re, const regexp_program_t* program, int unanchored, regexp_scratch_t* scratch,
+		       const size_t* set, size_t count, char_t c, size_t* next)
+{
+  const regexp_node_t* node;
+  size_t i, n = 0;
+  
+  next_visit(scratch, program->count);
+  for (i = 0; i < count; i++)
+    {
+      node = program->nodes + *(set + i);
+      if ((node->type == REGEXP_CLASS) && in_class(re, node, c))
+	follow(program, scratch, node->out, 0, 0, next, &n);
+    }
+  if (unanchored)
+    follow(program, scratch, program->start, 0, 0, next, &n);
+  return n;
+}
+
+
+/**
+ * Compare two nodes
+ * 
+ * @param   a  The first node
+ * @param   b  The second node
+ * @return     Negative if `a` is less, positive if `a` is greater, zero if they are equal
+ */
+static int compare_nodes(const void* a, const void* b)
+{
+  size_t x = *(const size_t*)a, y = *(const size_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Get the state of an automaton for a set of nodes, the caller must hold the lock of the automaton
+ * 
+ * @param   re     The expression
+ * @param   dfa    The automaton
+ * @param   set    The set, will be sorted
+ * @param   count  The number of elements in `set`
+ * @param   begin  Whether the set is where matching starts at the edge of the text
+ * @param   force  Whether to add the state even if the automaton is full
+ * @return         The state, `NULL` if it is new and the automaton is full
+ */
+static regexp_state_t* intern(const regexp_t* re, regexp_dfa_t* dfa, size_t* set, size_t count, int begin, int force)
+{
+  regexp_state_t** buckets;
+  regexp_state_t* state;
+  regexp_state_t* chain;
+  regexp_state_t* following;
+  size_t hash = begin ? 0x9E3779B9UL : 0, classes = re->bound_count + 1, i;
+  
+  qsort(set, count, sizeof(size_t), compare_nodes);
+  for (i = 0; i < count; i++)
+    hash = (hash ^ *(set + i)) * 1099511628211UL;
+  
+  for (state = *(dfa->buckets + (hash & (dfa->bucket_count - 1))); state; state = state->chain)
+    if ((state->hash == hash) && (state->count == count) && (!(state->flags & REGEXP_AT_BEGIN) == !begin) &&
+	!memcmp(state->nodes, set, count * sizeof(size_t)))
+      return state;
+  if (!force && (dfa->states >= REGEXP_STATES))
+    return NULL;
+  
+  state = calloc(1, sizeof(regexp_state_t) + classes * sizeof(regexp_state_t*) + count * sizeof(size_t));
+  state->nodes = (size_t*)(state->next + classes);
+  memcpy(state->nodes, set, count * sizeof(size_t));
+  state->count = count;
+  state->hash = hash;
+  state->flags = flags_of(dfa->program, &(dfa->scratch), set, count, begin, dfa->unanchored);
+  state->flags |= begin ? REGEXP_AT_BEGIN : 0;
+  
+  /* Keep the buckets at most half full */
+  if (++(dfa->states) > dfa->bucket_count / 2)
+    {
+      buckets = calloc(dfa->bucket_count * 2, sizeof(regexp_state_t*));
+      for (i = 0; i < dfa->bucket_count; i++)
+	for (chain = *(dfa->buckets + i); chain; chain = following)
+	  {
+	    following = chain->chain;
+	    chain->chain = *(buckets + (chain->hash & (dfa->bucket_count * 2 - 1)));
+	    *(buckets + (chain->hash & (dfa->bucket_count * 2 - 1))) = chain;
+	  }
+      free(dfa->buckets);
+      dfa->buckets = buckets;
+      dfa->bucket_count *= 2;
+    }
+  
+  state->chain = *(dfa->buckets + (hash & (dfa->bucket_count - 1)));
+  *(dfa->buckets + (hash & (dfa->bucket_count - 1))) = state;
+  return state;
+}
+
+
+
+/**
+ * Get the state an automaton starts in
+ * 
+ * @param   re     The expression
+ * @param   dfa    The automaton
+ * @param   begin  Whether matching starts at the edge of the text
+ * @return         The state
+ */
+static regexp_state_t* initial_state(const regexp_t* re, regexp_dfa_t* dfa, int begin)
+{
+  regexp_state_t* state = __atomic_load_n(dfa->initial + begin, __ATOMIC_ACQUIRE);
+  size_t count = 0;
+  
+  if (state != NULL)
+    return state;
+  
+  pthread_mutex_lock(&(dfa->mutex));
+  state = __atomic_load_n(dfa->initial + begin, __ATOMIC_RELAXED);
+  if (state == NULL)
+    {
+      /* The initial states are added even if the automaton is full, so that there always are some */
+      next_visit(&(dfa->scratch), dfa->program->count);
+      follow(dfa->program, &(dfa->scratch), dfa->program->start, begin, 0, dfa->scratch.set, &count);
+      state = intern(re, dfa, dfa->scratch.set, count, begin, 1);
+      __atomic_store_n(dfa->initial + begin, state, __ATOMIC_RELEASE);
+    }
+  pthread_mutex_unlock(&(dfa->mutex));
+  return state;
+}
+
+
+/**
+ * Compute the state that follows a state when a character is consumed
+ * 
+ * @param   re     The expression
+ * @param   dfa    The automaton
+ * @param   state  The state
+ * @param   class  The class of the character
+ * @return         The next state, `NULL` if it is new and the automaton is full
+ */
+static regexp_state_t* transition(const regexp_t* re, regexp_dfa_t* dfa, regexp_state_t* state, size_t class)
+{
+  regexp_state_t* next;
+  size_t count;
+  
+  pthread_mutex_lock(&(dfa->mutex));
+  next = __atomic_load_n(state->next + class, __ATOMIC_RELAXED);
+  if (next == NULL)
+    {
+      count = step_set(re, dfa->program, dfa->unanchored, &(dfa->scratch), state->nodes,
+		       state->count, member_of(re, class), dfa->scratch.set);
+      next = intern(re, dfa, dfa->scratch.set, count, 0, 0);
+      if (next != NULL)
+	__atomic_store_n(state->next + class, next, __ATOMIC_RELEASE);
+    }
+  pthread_mutex_unlock(&(dfa->mutex));
+  return next;
+}
+
+
+
+/**
+ * Start a match
+ * 
+ * @param  run    Output parameter for the match
+ * @param  re     The expression
+ * @param  dfa    The automaton
+ * @param  begin  Whether matching starts at the edge of the text
+ */
+static void run_start(run_t* run, regexp_t* re, regexp_dfa_t* dfa, int begin)
+{
+  run->re = re;
+  run->dfa = dfa;
+  run->set = run->next_set = NULL;
+  run->state = initial_state(re, dfa, begin);
+}
+
+
+/**
+ * Release the resources of a match
+ * 
+ * @param  run  The match
+ */
+static void run_end(run_t* run)
+{
+  if (run->set == NULL)
+    return;
+  free(run->set);
+  free(run->next_set);
+  scratch_free(&(run->scratch));
+  run->set = run->next_set = NULL;
+}
+
+
+/**
+ * Start a match over, with the same expression and automaton
+ * 
+ * @param  run    The match
+ * @param  begin  Whether matching starts at the edge of the text
+ */
+static void run_restart(run_t* run, int begin)
+{
+  run_end(run);
+  run->state = initial_state(run->re, run->dfa, begin);
+}
+
+
+/**
+ * Get the flags of the current state of a match
+ * 
+ * @param   run  The match
+ * @return       `REGEXP_ACCEPT`, `REGEXP_ACCEPT_AT_END` and `REGEXP_DEAD`
+ */
+static int_least8_t run_flags(const run_t* run)
+{
+  return run->state != NULL ? run->state->flags : run->flags;
+}
+
+
+/**
+ * Continue a match on the nodes of the program, because the automaton is full
+ * 
+ * @param  run  The match
+ */
+static void run_overflow(run_t* run)
+{
+  size_t nodes = run->dfa->program->count;
+  run->set = malloc(nodes * sizeof(size_t));
+  run->next_set = malloc(nodes * sizeof(size_t));
+  scratch_init(&(run->scratch), nodes);
+  memcpy(run->set, run->state->nodes, run->state->count * sizeof(size_t));
+  run->count = run->state->count;
+  run->state = NULL;
+}
+
+
+/**
+ * Consume a character by following the nodes of the program
+ * 
+ * @param  run  The match
+ * @param  c    The character
+ */
+static void run_nfa_step(run_t* run, char_t c)
+{
+  const regexp_program_t* program = run->dfa->program;
+  size_t* set = run->next_set;
+  
+  run->count = step_set(run->re, program, run->dfa->unanchored, &(run->scratch),
+			run->set, run->count, c, set);
+  run->next_set = run->set;
+  run->set = set;
+  run->flags = flags_of(program, &(run->scratch), set, run->count, 0, run->dfa->unanchored);
+}
+
+
+/**
+ * Consume a character
+ * 
+ * @param  run  The match
+ * @param  c    The character
+ */
+static void run_step(run_t* run, char_t c)
+{
+  regexp_state_t* next;
+  size_t class;
+  
+  if (run->state != NULL)
+    {
+      class = class_of(run->re, c);
+      next = __atomic_load_n(run->state->next + class, __ATOMIC_ACQUIRE);
+      if ((next == NULL) && ((next = transition(run->re, run->dfa, run->state, class)) == NULL))
+	run_overflow(run);
+      else
+	{
+	  run->state = next;
+	  return;
+	}
+    }
+  run_nfa_step(run, c);
+}
+
+
+
+/**
+ * Prepare an automaton
+ * 
+ * @param  dfa         Output parameter for the automaton
+ * @param  program     The program the automaton runs
+ * @param  unanchored  Whether the program can start matching anywhere
+ */
+static void init_dfa(regexp_dfa_t* dfa, const regexp_program_t* program, int unanchored)
+{
+  dfa->program = program;
+  dfa->unanchored = unanchored;
+  dfa->bucket_count = 64;
+  dfa->buckets = calloc(dfa->bucket_count, sizeof(regexp_state_t*));
+  dfa->states = 0;
+  dfa->initial[0] = dfa->initial[1] = NULL;
+  scratch_init(&(dfa->scratch), program->count);
+  pthread_mutex_init(&(dfa->mutex), NULL);
+}
+
+
+/**
+ * Release the resources of an automaton
+ * 
+ * @param  dfa  The automaton
+ */
+static void free_dfa(regexp_dfa_t* dfa)
+{
+  regexp_state_t* state;
+  regexp_state_t* following;
+  size_t i;
+  
+  if (dfa->buckets == NULL)
+    return;
+  for (i = 0; i < dfa->bucket_count; i++)
+    for (state = *(dfa->buckets + i); state; state = following)
+      {
+	following = state->chain;
+	free(state);
+      }
+  free(dfa->buckets);
+  dfa->buckets = NULL;
+  scratch_free(&(dfa->scratch));
+  pthread_mutex_destroy(&(dfa->mutex));
+}
+
+
+
+/**
+ * Compile a regular expression
+ * 
+ * The syntax is that of POSIX extended regular expressions: `.`, `[...]` and `[^...]`,
+ * `*`, `+`, `?`, `|`, `(...)`, `^` and `$`, and `\d`, `\w` and `\s` and their complements
+ * `\D`, `\W` and `\S`, `\` before any other character makes it literal
+ * 
+ * @param   re       Output parameter for the expression
+ * @param   pattern  The expression
+ * @param   n        The number of characters in `pattern`
+ * @return           Zero on success, -1 if the expression is incomplete or malformed
+ */
+int regexp_compile(regexp_t* re, const char_t* pattern, pos_t n)
+{
+  memset(re, 0, sizeof(regexp_t));
+  if (compile_program(re, &(re->forward), pattern, n, 0) || compile_program(re, &(re->reverse), pattern, n, 1))
+    {
+      regexp_free(re);
+      return -1;
+    }
+  build_alphabet(re);
+  init_dfa(&(re->search), &(re->forward), 1);
+  init_dfa(&(re->match), &(re->forward), 0);
+  init_dfa(&(re->starts), &(re->reverse), 1);
+  return 0;
+}
+
+
+/**
+ * Release the resources of a regular expression
+ * 
+ * @param  re  The expression
+ */
+void regexp_free(regexp_t* re)
+{
+  free_dfa(&(re->search));
+  free_dfa(&(re->match));
+  free_dfa(&(re->starts));
+  free(re->forward.nodes);
+  free(re->reverse.nodes);
+  free(re->ranges);
+  free(re->bounds);
+  memset(re, 0, sizeof(regexp_t));
+}
+
+
+/**
+ * Find where the leftmost occurrence of a regular expression in a line starts
+ * 
+ * @param   re    The expression
+ * @param   text  The line
+ * @param   n     The number of characters in `text`
+ * @param   from  The first column the occurrence may start at
+ * @return        The column the occurrence starts at, -1 if not found
+ */
+pos_t regexp_first(regexp_t* re, const char_t* text, pos_t n, pos_t from)
+{
+  run_t run;
+  pos_t p = n, found = -1;
+  int_least8_t flags;
+  
+  if (from > n)
+    return -1;
+  
+  /* The reversed expression is matched from the end of the line, it accepts where occurrences start */
+  run_start(&run, re, &(re->starts), 1);
+  for (;;)
+    {
+      flags = run_flags(&run);
+      if ((flags & REGEXP_ACCEPT) || ((p == 0) && (flags & REGEXP_ACCEPT_AT_END)))
+	found = p;
+      if ((p == from) || (flags & REGEXP_DEAD))
+	break;
+      run_step(&run, *(text + --p));
+    }
+  run_end(&run);
+  return found;
+}
+
+
+/**
+ * Find where the rightmost occurrence of a regular expression
+ * in a line that starts before a column starts
+ * 
+ * @param   re      The expression
+ * @param   text    The line
+ * @param   n       The number of characters in `text`
+ * @param   before  The occurrence must start before this column
+ * @return          The column the occurrence starts at, -1 if not found
+ */
+pos_t regexp_last(regexp_t* re, const char_t* text, pos_t n, pos_t before)
+{
+  run_t run;
+  pos_t p = n, found = -1;
+  int_least8_t flags;
+  
+  run_start(&run, re, &(re->starts), 1);
+  for (;;)
+    {
+      flags = run_flags(&run);
+      if ((p < before) && ((flags & REGEXP_ACCEPT) || ((p == 0) && (flags & REGEXP_ACCEPT_AT_END))))
+	{
+	  found = p;
+	  break;
+	}
+      if ((p == 0) || (flags & REGEXP_DEAD))
+	break;
+      run_step(&run, *(text + --p));
+    }
+  run_end(&run);
+  return found;
+}
+
+
+/**
+ * Find every column in a line where an occurrence of a regular expression starts
+ * 
+ * @param  re      The expression
+ * @param  text    The line
+ * @param  n       The number of characters in `text`
+ * @param  starts  Output parameter for whether an occurrence starts
+ *                 at each column, `n + 1` elements
+ */
+void regexp_starts(regexp_t* re, const char_t* text, pos_t n, char* starts)
+{
+  run_t run;
+  pos_t p = n;
+  int_least8_t flags;
+  
+  memset(starts, 0, (size_t)n + 1);
+  run_start(&run, re, &(re->starts), 1);
+  for (;;)
+    {
+      flags = run_flags(&run);
+      *(starts + p) = (flags & REGEXP_ACCEPT) || ((p == 0) && (flags & REGEXP_ACCEPT_AT_END));
+      if ((p == 0) || (flags & REGEXP_DEAD))
+	break;
+      run_step(&run, *(text + --p));
+    }
+  run_end(&run);
+}
+
+
+/**
+ * Find the length of the longest occurrence of a regular expression that starts at a column
+ * 
+ * @param   re     The expression
+ * @param   text   The line
+ * @param   n      The number of characters in `text`
+ * @param   start  The column
+ * @return         The number of characters in the occurrence, -1 if none starts there
+ */
+pos_t regexp_longest(regexp_t* re, const char_t* text, pos_t n, pos_t start)
+{
+  run_t run;
+  pos_t p = start, found = -1;
+  int_least8_t flags;
+  
+  run_start(&run, re, &(re->match), start == 0);
+  for (;;)
+    {
+      flags = run_flags(&run);
+      if ((flags & REGEXP_ACCEPT) || ((p == n) && (flags & REGEXP_ACCEPT_AT_END)))
+	found = p - start;
+      if ((p == n) || (flags & REGEXP_DEAD))
+	break;
+      run_step(&run, *(text + p++));
+    }
+  run_end(&run);
+  return found;
+}
+
+
+/**
+ * Get the slot of a state at a column in the places where matching cannot accept
+ * 
+ * @param   failures  The places
+ * @param   state     The state
+ * @param   column    The column
+ * @return            The slot of the state at the column, or the unused slot where it would be
+ */
+__attribute__((pure))
+static size_t failure_slot(const failures_t* failures, const regexp_state_t* state, pos_t column)
+{
+  size_t i = (((uintptr_t)state >> 4) ^ ((size_t)column * 1099511628211UL)) & (failures->size - 1);
+  while (*(failures->states + i) && ((*(failures->states + i) != state) || (*(failures->columns + i) != column)))
+    i = (i + 1) & (failures->size - 1);
+  return i;
+}
+
+
+/**
+ * Remember that matching cannot accept from a state at a column
+ * 
+ * @param  failures  The places where matching cannot accept
+ * @param  state     The state
+ * @param  column    The column
+ */
+static void add_failure(failures_t* failures, const regexp_state_t* state, pos_t column)
+{
+  const regexp_state_t** states = failures->states;
+  pos_t* columns = failures->columns;
+  size_t i = failure_slot(failures, state, column), size = failures->size, j;
+  
+  if (*(states + i))
+    return;
+  *(states + i) = state;
+  *(columns + i) = column;
+  
+  /* Keep the slots at most half full */
+  if (++(failures->used) <= size / 2)
+    return;
+  failures->states = calloc(size * 2, sizeof(regexp_state_t*));
+  failures->columns = malloc(size * 2 * sizeof(pos_t));
+  failures->size = size * 2;
+  for (i = 0; i < size; i++)
+    if (*(states + i))
+      {
+	j = failure_slot(failures, *(states + i), *(columns + i));
+	*(failures->states + j) = *(states + i);
+	*(failures->columns + j) = *(columns + i);
+      }
+  free(states);
+  free(columns);
+}
+
+
+/**
+ * Count the occurrences of a regular expression in a line, occurrences do not overlap
+ * 
+ * Each occurrence is the longest one that starts where the previous one ends, or
+ * as soon as possible after that, and empty occurrences are skipped past. Finding
+ * how long an occurrence is can read far past its end, so the states that matching
+ * was in there are remembered, and matching from another occurrence stops when it
+ * reaches one of them, this keeps the count linear in the length of the line.
+ * 
+ * @param   re      The expression
+ * @param   text    The line
+ * @param   n       The number of characters in `text`
+ * @param   before  Only occurrences that start before this column are counted
+ * @return          The number of occurrences
+ */
+size_t regexp_count(regexp_t* re, const char_t* text, pos_t n, pos_t before)
+{
+  regexp_state_t** trail = malloc(((size_t)n + 1) * sizeof(regexp_state_t*));
+  char* starts = malloc((size_t)n + 1);
+  failures_t failures;
+  size_t count = 0;
+  pos_t at, p, found;
+  int_least8_t flags;
+  run_t run;
+  
+  failures.size = 64;
+  failures.used = 0;
+  failures.states = calloc(failures.size, sizeof(regexp_state_t*));
+  failures.columns = malloc(failures.size * sizeof(pos_t));
+  
+  regexp_starts(re, text, n, starts);
+  for (at = 0; (at <= n) && (at < before); at++)
+    {
+      if (*(starts + at) == 0)
+	continue;
+      count++;
+  
+      run_start(&run, re, &(re->match), at == 0);
+      for (p = at, found = at;; run_step(&run, *(text + p++)))
+	{
+	  flags = run_flags(&run);
+	  *(trail + p) = run.state;
+	  if ((flags & REGEXP_ACCEPT) || ((p == n) && (flags & REGEXP_ACCEPT_AT_END)))
+	    found = p;
+	  else if (run.state && *(failures.states + failure_slot(&failures, run.state, p)))
+	    break;
+	  if ((p == n) || (flags & REGEXP_DEAD))
+	    break;
+	}
+      run_end(&run);
+  
+      /* Nothing is accepted after the end of the occurrence from where matching went on */
+      for (; p > found; p--)
+	if (*(trail + p))
+	  add_failure(&failures, *(trail + p), p);
+      at = found > at ? found - 1 : at;
+    }
+  
+  free(failures.states);
+  free(failures.columns);
+  free(starts);
+  free(trail);
+  return count;
+}
+
+
+/**
+ * Find the first line that contains an occurrence of a regular expression in
+ * consecutive well-formed UTF-8 encoded lines that are each followed by a line feed
+ * 
+ * @param   re   The expression
+ * @param   run  The content of the first line
+ * @param   end  The end of the content of the last line
+ * @return       The content of the line, `NULL` if none
+ */
+const char* regexp_scan(regexp_t* re, const char* run, const char* end)
+{
+  const char* line = run;
+  regexp_state_t* at;
+  regexp_state_t* next;
+  run_t state;
+  int_least8_t flags;
+  char_t c;
+  
+  run_start(&state, re, &(re->search), 1);
+  for (;;)
+    {
+      flags = run_flags(&state);
+      if (flags & REGEXP_ACCEPT)
+	break;
+      if ((run == end) || (*run == '\n'))
+	{
+	  if ((flags & REGEXP_ACCEPT_AT_END) || (run == end))
+	    break;
+	  run_restart(&state, 1);
+	  line = ++run;
+	  continue;
+	}
+      
+      /* Nothing in the rest of the line can be matched, not even its end */
+      if (flags & REGEXP_DEAD)
+	{
+	  if ((run = memchr(run, '\n', (size_t)(end - run))) == NULL)
+	    {
+	      run_end(&state);
+	      return NULL;
+	    }
+	  run_restart(&state, 1);
+	  line = ++run;
+	  continue;
+	}
+      
+      /* Most characters are ASCII, and most transitions have already been computed */
+      if (state.state != NULL)
+	{
+	  at = state.state;
+	  while ((run != end) && ((c = (unsigned char)*run) < 0x80) && (c != '\n'))
+	    {
+	      next = __atomic_load_n(at->next + *(re->ascii + c), __ATOMIC_ACQUIRE);
+	      if (next == NULL)
+		break;
+	      at = next;
+	      run++;
+	      if (at->flags & (REGEXP_ACCEPT | REGEXP_DEAD))
+		break;
+	    }
+	  state.state = at;
+	  if ((run == end) || (*run == '\n') || (at->flags & (REGEXP_ACCEPT | REGEXP_DEAD)))
+	    continue;
+	}
+      
+      c = (unsigned char)*run++;
+      if (c >= 0xF0)
+	{
+	  c = ((c & 0x07) << 18) | ((*run & 0x3F) << 12) | ((*(run + 1) & 0x3F) << 6) | (*(run + 2) & 0x3F);
+	  run += 3;
+	}
+      else if (c >= 0xE0)
+	{
+	  c = ((c & 0x0F) << 12) | ((*run & 0x3F) << 6) | (*(run + 1) & 0x3F);
+	  run += 2;
+	}
+      else if (c >= 0x80)
+	c = ((c & 0x1F) << 6) | (*run++ & 0x3F);
+      run_step(&state, c);
+    }
+  
+  flags = run_flags(&state);
+  run_end(&state);
+  if ((flags & REGEXP_ACCEPT) || ((flags & REGEXP_ACCEPT_AT_END) && ((run == end) || (*run == '\n'))))
+    return line;
+  return NULL;
+}
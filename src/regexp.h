@@ -0,0 +1,455 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __REGEXP_H__
+#define __REGEXP_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "types.h"
+
+
+
+/**
+ * The maximum number of states kept in each automaton of a regular expression,
+ * once there are this many, matching continues without new states, just slower
+ */
+#ifndef REGEXP_STATES
+#define REGEXP_STATES  (1 << 12)
+#endif
+
+
+
+/**
+ * The node consumes a character in its class
+ */
+#define  REGEXP_CLASS  0
+
+/**
+ * The node continues to its next node without consuming anything
+ */
+#define  REGEXP_EMPTY  1
+
+/**
+ * The node continues to both of its next nodes without consuming anything
+ */
+#define  REGEXP_SPLIT  2
+
+/**
+ * The node continues only at the edge of the text where matching started
+ */
+#define  REGEXP_BEGIN  3
+
+/**
+ * The node continues only at the edge of the text where matching ends
+ */
+#define  REGEXP_END  4
+
+/**
+ * The node is reached when the expression has been matched
+ */
+#define  REGEXP_MATCH  5
+
+
+/**
+ * The state has matched the expression
+ */
+#define  REGEXP_ACCEPT  1
+
+/**
+ * The state has matched the expression if the text ends here
+ */
+#define  REGEXP_ACCEPT_AT_END  2
+
+/**
+ * The state is where matching starts at the edge of the text
+ */
+#define  REGEXP_AT_BEGIN  4
+
+/**
+ * The state cannot match the expression however the text continues
+ */
+#define  REGEXP_DEAD  8
+
+
+
+/**
+ * An inclusive range of characters
+ */
+typedef struct regexp_range
+{
+  /**
+   * The first character in the range
+   */
+  char_t first;
+  
+  /**
+   * The last character in the range
+   */
+  char_t last;
+  
+} regexp_range_t;
+
+
+/**
+ * An instruction of a compiled regular expression, a node in its Thompson automaton
+ */
+typedef struct regexp_node
+{
+  /**
+   * `REGEXP_CLASS`, `REGEXP_EMPTY`, `REGEXP_SPLIT`,
+   * `REGEXP_BEGIN`, `REGEXP_END` or `REGEXP_MATCH`
+   */
+  int_least8_t type;
+  
+  /**
+   * Whether the class is every character that is not in the ranges
+   */
+  int_least8_t negated;
+  
+  /**
+   * The next node
+   */
+  size_t out;
+  
+  /**
+   * The other next node of a `REGEXP_SPLIT`
+   */
+  size_t alt;
+  
+  /**
+   * The index of the first range of the class of a `REGEXP_CLASS`
+   */
+  size_t ranges;
+  
+  /**
+   * The number of ranges in the class of a `REGEXP_CLASS`
+   */
+  size_t count;
+  
+} regexp_node_t;
+
+
+/**
+ * A regular expression compiled to be matched in one direction
+ */
+typedef struct regexp_program
+{
+  /**
+   * The instructions
+   */
+  regexp_node_t* nodes;
+  
+  /**
+   * The number of elements in `nodes`
+   */
+  size_t count;
+  
+  /**
+   * The number of elements that fit in `nodes`
+   */
+  size_t allocated;
+  
+  /**
+   * The first instruction
+   */
+  size_t start;
+  
+} regexp_program_t;
+
+
+/**
+ * A state of a deterministic automaton, a set of nodes of a program
+ */
+typedef struct regexp_state
+{
+  /**
+   * The nodes, sorted
+   */
+  size_t* nodes;
+  
+  /**
+   * The number of elements in `nodes`
+   */
+  size_t count;
+  
+  /**
+   * `REGEXP_ACCEPT`, `REGEXP_ACCEPT_AT_END`, `REGEXP_AT_BEGIN` and `REGEXP_DEAD`
+   */
+  int_least8_t flags;
+  
+  /**
+   * The hash of the nodes and `REGEXP_AT_BEGIN`
+   */
+  size_t hash;
+  
+  /**
+   * The next state in the same bucket of the automaton
+   */
+  struct regexp_state* chain;
+  
+  /**
+   * The next state for each class of characters, `NULL` until it has been needed,
+   * these are written by one thread at a time but can be read at any time
+   */
+  struct regexp_state* next[];
+  
+} regexp_state_t;
+
+
+/**
+ * Working memory for computing the states of an automaton
+ */
+typedef struct regexp_scratch
+{
+  /**
+   * The nodes of the state being computed
+   */
+  size_t* set;
+  
+  /**
+   * The nodes that remain to be visited
+   */
+  size_t* stack;
+  
+  /**
+   * The nodes that have been reached when checking whether the text may end
+   */
+  size_t* reached;
+  
+  /**
+   * When each node was last visited
+   */
+  unsigned* mark;
+  
+  /**
+   * The current visit
+   */
+  unsigned generation;
+  
+} regexp_scratch_t;
+
+
+/**
+ * A deterministic automaton that is built as it is used
+ */
+typedef struct regexp_dfa
+{
+  /**
+   * The program the automaton runs
+   */
+  const regexp_program_t* program;
+  
+  /**
+   * Whether the program can start matching anywhere, rather than only where matching starts
+   */
+  int unanchored;
+  
+  /**
+   * The states, by hash
+   */
+  regexp_state_t** buckets;
+  
+  /**
+   * The number of elements in `buckets`, a power of two
+   */
+  size_t bucket_count;
+  
+  /**
+   * The number of states
+   */
+  size_t states;
+  
+  /**
+   * The state at the edge of the text, and the state elsewhere, `NULL` until needed
+   */
+  regexp_state_t* initial[2];
+  
+  /**
+   * Working memory for computing new states
+   */
+  regexp_scratch_t scratch;
+  
+  /**
+   * Protects everything but the transitions that have already been computed
+   */
+  pthread_mutex_t mutex;
+  
+} regexp_dfa_t;
+
+
+/**
+ * A compiled regular expression
+ */
+typedef struct regexp
+{
+  /**
+   * The ranges of the classes of characters
+   */
+  regexp_range_t* ranges;
+  
+  /**
+   * The number of elements in `ranges`
+   */
+  size_t range_count;
+  
+  /**
+   * The number of elements that fit in `ranges`
+   */
+  size_t ranges_allocated;
+  
+  /**
+   * The characters where a new class of characters begins, sorted,
+   * characters that no class can tell apart belong to the same class
+   */
+  char_t* bounds;
+  
+  /**
+   * The number of elements in `bounds`, there is one more class than this
+   */
+  size_t bound_count;
+  
+  /**
+   * The class of each ASCII character
+   */
+  size_t ascii[128];
+  
+  /**
+   * The expression as it is matched forwards
+   */
+  regexp_program_t forward;
+  
+  /**
+   * The expression reversed, as it is matched backwards
+   */
+  regexp_program_t reverse;
+  
+  /**
+   * Finds where occurrences end
+   */
+  regexp_dfa_t search;
+  
+  /**
+   * Finds how long an occurrence that starts at a given position is
+   */
+  regexp_dfa_t match;
+  
+  /**
+   * Finds where occurrences start, from the end of the text
+   */
+  regexp_dfa_t starts;
+  
+} regexp_t;
+
+
+
+/**
+ * Compile a regular expression
+ * 
+ * The syntax is that of POSIX extended regular expressions: `.`, `[...]` and `[^...]`,
+ * `*`, `+`, `?`, `|`, `(...)`, `^` and `$`, and `\d`, `\w` and `\s` and their complements
+ * `\D`, `\W` and `\S`, `\` before any other character makes it literal
+ * 
+ * @param   re       Output parameter for the expression
+ * @param   pattern  The expression
+ * @param   n        The number of characters in `pattern`
+ * @return           Zero on success, -1 if the expression is incomplete or malformed
+ */
+int regexp_compile(regexp_t* re, const char_t* pattern, pos_t n);
+
+/**
+ * Release the resources of a regular expression
+ * 
+ * @param  re  The expression
+ */
+void regexp_free(regexp_t* re);
+
+/**
+ * Find where the leftmost occurrence of a regular expression in a line starts
+ * 
+ * @param   re    The expression
+ * @param   text  The line
+ * @param   n     The number of characters in `text`
+ * @param   from  The first column the occurrence may start at
+ * @return        The column the occurrence starts at, -1 if not found
+ */
+pos_t regexp_first(regexp_t* re, const char_t* text, pos_t n, pos_t from);
+
+/**
+ * Find where the rightmost occurrence of a regular expression
+ * in a line that starts before a column starts
+ * 
+ * @param   re      The expression
+ * @param   text    The line
+ * @param   n       The number of characters in `text`
+ * @param   before  The occurrence must start before this column
+ * @return          The column the occurrence starts at, -1 if not found
+ */
+pos_t regexp_last(regexp_t* re, const char_t* text, pos_t n, pos_t before);
+
+/**
+ * Find every column in a line where an occurrence of a regular expression starts
+ * 
+ * @param  re      The expression
+ * @param  text    The line
+ * @param  n       The number of characters in `text`
+ * @param  starts  Output parameter for whether an occurrence starts
+ *                 at each column, `n + 1` elements
+ */
+void regexp_starts(regexp_t* re, const char_t* text, pos_t n, char* starts);
+
+/**
+ * Find the length of the longest occurrence of a regular expression that starts at a column
+ * 
+ * @param   re     The expression
+ * @param   text   The line
+ * @param   n      The number of characters in `text`
+ * @param   start  The column
+ * @return         The number of characters in the occurrence, -1 if none starts there
+ */
+pos_t regexp_longest(regexp_t* re, const char_t* text, pos_t n, pos_t start);
+
+/**
+ * Count the occurrences of a regular expression in a line, occurrences do not overlap
+ * 
+ * @param   re      The expression
+ * @param   text    The line
+ * @param   n       The number of characters in `text`
+ * @param   before  Only occurrences that start before this column are counted
+ * @return          The number of occurrences
+ */
+size_t regexp_count(regexp_t* re, const char_t* text, pos_t n, pos_t before);
+
+/**
+ * Find the first line that contains an occurrence of a regular expression in
+ * consecutive well-formed UTF-8 encoded lines that are each followed by a line feed
+ * 
+ * @param   re   The expression
+ * @param   run  The content of the first line
+ * @param   end  The end of the content of the last line
+ * @return       The content of the line, `NULL` if none
+ */
+const char* regexp_scan(regexp_t* re, const char* run, const char* end);
+
+
+#endif
+
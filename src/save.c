@@ -0,0 +1,965 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include "save.h"
+
+
+/**
+ * The currently active frame
+ */
+extern frame_t* cur_frame;
+
+
+
+/**
+ * Write bytes to a file, retrying until everything has been written
+ * 
+ * @param   fd    The file
+ * @param   data  The bytes
+ * @param   n     The number of bytes
+ * @return        Zero on success, otherwise an error code
+ */
+static int write_fully(int fd, const char* data, size_t n)
+{
+  ssize_t wrote;
+  while (n)
+    {
+      if ((wrote = write(fd, data, n)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return errno;
+	}
+      data += wrote;
+      n -= (size_t)wrote;
+    }
+  return 0;
+}
+
+
+/**
+ * Write bytes to a position in a file, retrying until everything has been written
+ * 
+ * @param   fd      The file
+ * @param   data    The bytes
+ * @param   n       The number of bytes
+ * @param   offset  The position in the file to write the bytes to
+ * @return          Zero on success, otherwise an error code
+ */
+static int pwrite_fully(int fd, const char* data, size_t n, off_t offset)
+{
+  ssize_t wrote;
+  while (n)
+    {
+      if ((wrote = pwrite(fd, data, n, offset)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return errno;
+	}
+      data += wrote;
+      offset += wrote;
+      n -= (size_t)wrote;
+    }
+  return 0;
+}
+
+
+/**
+ * Write the buffered bytes of a file being saved
+ * 
+ * @param  out  The output
+ */
+static void flush_output(save_output_t* out)
+{
+  if (out->used && !out->error)
+    out->error = write_fully(out->fd, out->buffer, out->used);
+  out->used = 0;
+}
+
+
+/**
+ * Write bytes to a file being saved
+ * 
+ * @param  out   The output
+ * @param  data  The bytes
+ * @param  n     The number of bytes
+ */
+static void output_bytes(save_output_t* out, const char* data, size_t n)
+{
+  if (out->used + n > SAVE_BUFFER)
+    flush_output(out);
+  if (n >= SAVE_BUFFER)
+    {
+      /* Do not copy large blocks into the buffer just to write them */
+      if (!out->error)
+	out->error = write_fully(out->fd, data, n);
+      return;
+    }
+  memcpy(out->buffer + out->used, data, n);
+  out->used += n;
+}
+
+
+/**
+ * Write unedited content to a file being saved
+ * 
+ * @param  out   The output
+ * @param  data  The content
+ * @param  n     The number of bytes
+ */
+static void output_content(save_output_t* out, const char* data, size_t n)
+{
+  loff_t offset = (loff_t)(data - out->content);
+  ssize_t copied;
+  
+  if ((out->source < 0) || (n < SAVE_COPY_MIN))
+    {
+      output_bytes(out, data, n);
+      return;
+    }
+  
+  /* Let the kernel copy the bytes from the original file, without passing them through
+   * the process, and sharing the blocks if the file system supports it */
+  flush_output(out);
+  while (n && !out->error)
+    {
+      if ((copied = copy_file_range(out->source, &offset, out->fd, NULL, n, 0)) <= 0)
+	{
+	  if ((copied < 0) && (errno == EINTR))
+	    continue;
+	  /* Not supported, or the file has changed, write the rest from memory */
+	  out->source = -1;
+	  output_bytes(out, out->content + offset, n);
+	  return;
+	}
+      n -= (size_t)copied;
+    }
+}
+
+
+/**
+ * Write an edited line to a file being saved
+ * 
+ * @param  out   The output
+ * @param  lbuf  The line
+ */
+static void output_line(save_output_t* out, const line_buffer_t* lbuf)
+{
+  char_t text[SAVE_BUFFER / 64];
+  pos_t i, n;
+  
+  for (i = 0; i < lbuf->used; i += n)
+    {
+      n = read_line(lbuf, i, (pos_t)(sizeof(text) / sizeof(char_t)), text);
+      if (out->used + (size_t)n * 6 > SAVE_BUFFER)
+	flush_output(out);
+      out->used += utf8_encode(text, n, out->buffer + out->used);
+    }
+}
+
+
+/**
+ * Write unedited lines to a file being saved, joined with the unedited lines before them
+ * 
+ * @param  out      The output
+ * @param  run      The unedited content that has not been written yet, `NULL` if none, will be updated
+ * @param  run_end  The end of `*run`, will be updated
+ * @param  raw      The content of the lines
+ * @param  size     The number of bytes in `raw`
+ * @param  newline  Whether the lines are preceded by a line break
+ */
+static void output_raw(save_output_t* out, const char** run, const char** run_end,
+		       const char* raw, size_t size, int newline)
+{
+  /* Consecutive unedited lines are written as one block of the original content */
+  if (*run && (raw == *run_end + 1) && (**run_end == '\n'))
+    {
+      *run_end = raw + size;
+      return;
+    }
+  if (*run)
+    output_content(out, *run, (size_t)(*run_end - *run));
+  if (newline)
+    output_bytes(out, "\n", 1);
+  *run = raw;
+  *run_end = raw + size;
+}
+
+
+/**
+ * Write the lines of a frame to a file
+ * 
+ * @param  out    The output
+ * @param  frame  The frame
+ * @param  first  The first line to write
+ */
+static void write_frame(save_output_t* out, frame_t* frame, pos_t first)
+{
+  document_t* doc = &(frame->document);
+  pos_t row = first, rows = document_lines(doc), count;
+  const char* run = NULL;
+  const char* run_end = NULL;
+  document_node_t* node;
+  line_buffer_t* lbuf;
+  
+  while (row < rows)
+    {
+      /* Blocks whose lines have not been looked up are unedited, they are not indexed to be written */
+      node = document_chunk(doc, row, &count);
+      if ((node->line_buffers == NULL) && (count == 0))
+	{
+	  output_raw(out, &run, &run_end, node->raw, node->raw_size, row > first);
+	  row += node->count;
+	  continue;
+	}
+      
+      for (lbuf = document_span(doc, row, &count); count--; lbuf++, row++)
+	if ((lbuf->line == NULL) && lbuf->raw)
+	  output_raw(out, &run, &run_end, lbuf->raw, lbuf->raw_size, row > first);
+	else
+	  {
+	    if (run)
+	      output_content(out, run, (size_t)(run_end - run));
+	    run = NULL;
+	    if (row > first)
+	      output_bytes(out, "\n", 1);
+	    output_line(out, lbuf);
+	  }
+    }
+  
+  /* The part of the content that has not been indexed yet follows the last line */
+  if (frame->flags & FLAG_LOADING)
+    {
+      const char* rest = frame->content + frame->loaded;
+      if (run && (rest == run_end + 1))
+	run_end = frame->content + frame->content_size;
+      else
+	{
+	  if (run)
+	    output_content(out, run, (size_t)(run_end - run));
+	  output_bytes(out, "\n", 1);
+	  run = rest;
+	  run_end = frame->content + frame->content_size;
+	}
+    }
+  if (run)
+    output_content(out, run, (size_t)(run_end - run));
+  flush_output(out);
+}
+
+
+/**
+ * Get the directory of a file
+ * 
+ * @param   filename  The file
+ * @return            The directory, free with `free`
+ */
+static char* directory_of(const char* filename)
+{
+  const char* slash = strrchr(filename, '/');
+  size_t n = slash ? (size_t)(slash - filename) : 0;
+  char* dir = malloc(n + 2);
+  if (slash == NULL)
+    return strcpy(dir, ".");
+  memcpy(dir, filename, n ? n : 1);
+  *(dir + (n ? n : 1)) = '\0';
+  return dir;
+}
+
+
+/**
+ * Get the journal that is used when a file is saved in place
+ * 
+ * @param   filename  The file
+ * @return            The path of the journal, free with `free`
+ */
+static char* journal_of(const char* filename)
+{
+  const char* base = strrchr(filename, '/');
+  char* dir = directory_of(filename);
+  char* path = malloc(strlen(dir) + strlen(base ? base + 1 : filename) + 24);
+  sprintf(path, "%s/.%s.zecora-journal", dir, base ? base + 1 : filename);
+  free(dir);
+  return path;
+}
+
+
+/**
+ * Copy the bytes in a journal to the file it belongs to
+ * 
+ * @param   journal  The journal
+ * @param   fd       The file
+ * @param   offset   The position in the file to write the bytes to
+ * @param   length   The number of bytes after the header of the journal
+ * @return           Zero on success, otherwise an error code
+ */
+static int copy_journal(int journal, int fd, size_t offset, size_t length)
+{
+  loff_t in = (loff_t)sizeof(save_journal_t), out = (loff_t)offset;
+  char* buffer;
+  ssize_t n;
+  int error = 0;
+  
+  while (length)
+    {
+      if ((n = copy_file_range(journal, &in, fd, &out, length, 0)) > 0)
+	length -= (size_t)n;
+      else if ((n == 0) || (errno != EINTR))
+	break;
+    }
+  if (length == 0)
+    return 0;
+  
+  /* Copy the rest through the process if the kernel cannot copy it */
+  if ((buffer = malloc(SAVE_BUFFER)) == NULL)
+    return ENOMEM;
+  while (length && !error)
+    {
+      if ((n = pread(journal, buffer, length < SAVE_BUFFER ? length : SAVE_BUFFER, (off_t)in)) <= 0)
+	{
+	  if ((n < 0) && (errno == EINTR))
+	    continue;
+	  error = n ? errno : EIO;
+	  break;
+	}
+      error = pwrite_fully(fd, buffer, (size_t)n, (off_t)out);
+      in += n;
+      out += n;
+      length -= (size_t)n;
+    }
+  free(buffer);
+  return error;
+}
+
+
+/**
+ * Make the lines of a frame that has been saved in place views into its file again
+ * 
+ * @param  frame  The frame
+ * @param  size   The new size of the file
+ */
+static void settle_lines(frame_t* frame, size_t size)
+{
+  document_t* doc = &(frame->document);
+  pos_t row = frame->modified_row, rows = document_lines(doc), count, chars;
+  const char* raw = frame->content + frame->modified_offset;
+  const char* end = frame->content + size;
+  document_node_t* node;
+  line_buffer_t* lbuf;
+  int ascii;
+  
+  /* The lines from the first edited line may have moved */
+  if (frame->malformed_row >= row)
+    frame->malformed_row = -1;
+  
+  while (row < rows)
+    {
+      /* Blocks whose lines have not been looked up have only moved */
+      node = document_chunk(doc, row, &count);
+      if ((node->line_buffers == NULL) && (count == 0))
+	{
+	  if ((node->malformed >= 0) && (frame->malformed_row < 0))
+	    frame->malformed_row = row + node->malformed;
+	  node->raw = raw;
+	  raw += node->raw_size + 1;
+	  row += node->count;
+	  continue;
+	}
+      
+      for (lbuf = document_span(doc, row, &count); count--; lbuf++, row++)
+	{
+	  /* Unedited lines keep their bytes, they have only moved */
+	  if (lbuf->line || (lbuf->raw == NULL))
+	    {
+	      free_line(lbuf);
+	      lbuf->raw_size = utf8_line(raw, (size_t)(end - raw), &chars, &ascii);
+	      lbuf->flags = ascii || utf8_valid(raw, lbuf->raw_size) ? 0 : LINE_MALFORMED;
+	      if (chars != lbuf->used)
+		{
+		  document_resize(doc, row, chars - lbuf->used);
+		  lbuf->used = chars;
+		}
+	    }
+	  if ((lbuf->flags & LINE_MALFORMED) && (frame->malformed_row < 0))
+	    frame->malformed_row = row;
+	  lbuf->raw = raw;
+	  raw += lbuf->raw_size + 1;
+	}
+    }
+  
+  frame->content_size = frame->loaded = size;
+  frame->modified_row = -1;
+  frame->modified_offset = 0;
+  frame->flags &= (int_least8_t)~FLAG_MODIFIED;
+}
+
+
+/**
+ * Make the lines of a frame, from its first modified line, views into a private copy
+ * of the end of its file as the journal has it, when saving in place failed half way
+ * and the journal could not be replayed, so that no line shows the half written file
+ * 
+ * @param   frame    The frame
+ * @param   journal  The journal of the save
+ * @param   length   The number of bytes after the header of the journal
+ * @return           Zero on success, otherwise an error code
+ */
+static int strand_lines(frame_t* frame, int journal, size_t length)
+{
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t start = frame->modified_offset / page * page;
+  size_t head = frame->modified_offset - start, got = 0;
+  char* copy;
+  ssize_t n;
+  
+  /* The copy is filled before it replaces the mapping, so the frame is left as it was if it cannot be */
+  copy = mmap(NULL, head + length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (copy == MAP_FAILED)
+    return errno;
+  memcpy(copy, frame->content + start, head);
+  while (got < length)
+    {
+      n = pread(journal, copy + head + got, length - got, (off_t)(sizeof(save_journal_t) + got));
+      if (n > 0)
+	got += (size_t)n;
+      else if ((n == 0) || (errno != EINTR))
+	break;
+    }
+  if ((got < length) || mprotect(copy, head + length, PROT_READ) ||
+      (mremap(copy, head + length, head + length, MREMAP_MAYMOVE | MREMAP_FIXED, frame->content + start) == MAP_FAILED))
+    {
+      munmap(copy, head + length);
+      return got < length ? EIO : errno;
+    }
+  
+  /* The file still has to be saved, and not in place, since its content is not in the file */
+  settle_lines(frame, frame->modified_offset + length);
+  frame->flags |= FLAG_MODIFIED | FLAG_REPLACED;
+  frame->modified_row = 0;
+  return 0;
+}
+
+
+/**
+ * Write the end of a frame, from its first modified line, to a journal next to its
+ * file, so that the file can be rewritten from there rather than replaced
+ * 
+ * @param   save  The save, its `frame` and `filename` must be set
+ * @return        Whether the file is saved in place, otherwise nothing has been done
+ */
+static int begin_save_in_place(pending_save_t* save)
+{
+  frame_t* frame = save->frame;
+  save_journal_t header;
+  save_output_t out;
+  struct stat attr;
+  void* buffer;
+  off_t end;
+  
+  /* The end of the file is written twice, to the journal and to the file, so it is
+   * only worth it if that is at most half of the file; and the lines before the
+   * first modified line must still be views into the file at their places */
+  if ((frame->modified_row < 0) || !(frame->flags & FLAG_MAPPED) || (frame->flags & (FLAG_LOADING | FLAG_REPLACED)) ||
+      (frame->file == NULL) || strcmp(save->filename, frame->file) ||
+      (frame->content_size - frame->modified_offset > frame->content_size / 2))
+    return 0;
+  if ((out.source = open(frame->file, O_RDONLY)) < 0)
+    return 0;
+  if (fstat(out.source, &attr) || (attr.st_dev != frame->device) || (attr.st_ino != frame->inode) ||
+      ((size_t)(attr.st_size) != frame->content_size))
+    {
+      close(out.source);
+      return 0;
+    }
+  
+  /* The header is written last, a journal without it was never completed */
+  save->temporary = journal_of(save->filename);
+  memset(&header, 0, sizeof(save_journal_t));
+  if ((save->fd = open(save->temporary, O_RDWR | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600)) < 0)
+    out.error = errno;
+  else if ((out.error = write_fully(save->fd, (const char*)&header, sizeof(save_journal_t))) == 0)
+    out.error = posix_memalign(&buffer, 4096, SAVE_BUFFER);
+  if (out.error == 0)
+    {
+      out.fd = save->fd;
+      out.content = frame->content;
+      out.buffer = buffer;
+      out.used = 0;
+      write_frame(&out, frame, frame->modified_row);
+      free(buffer);
+    }
+  close(out.source);
+  if (out.error == 0)
+    {
+      if ((end = lseek(save->fd, 0, SEEK_CUR)) < 0)
+	out.error = errno;
+      else
+	save->length = (size_t)end - sizeof(save_journal_t);
+    }
+  
+  /* The file must fit where it is mapped, so that the lines can be views into it afterwards */
+  if (out.error || (frame->modified_offset + save->length > frame->content_reserved))
+    {
+      if (save->fd >= 0)
+	{
+	  close(save->fd);
+	  unlink(save->temporary);
+	}
+      free(save->temporary);
+      save->temporary = NULL;
+      save->fd = -1;
+      return 0;
+    }
+  
+  save->in_place = 1;
+  save->device = frame->device;
+  save->inode = frame->inode;
+  sync_file_range(save->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+  return 1;
+}
+
+
+/**
+ * Wait for the journal of a file that is saved in place to become durable, and rewrite the file
+ * 
+ * @param  save  The save, that has been started with `begin_save_in_place`
+ */
+static void commit_in_place(pending_save_t* save)
+{
+  frame_t* frame = save->frame;
+  size_t size = frame->modified_offset + save->length;
+  save_journal_t header;
+  char* dir;
+  int fd = -1;
+  
+  /* The journal must be durable, and then be marked as complete, before the file is touched */
+  memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+  header.inode = (uint_least64_t)(frame->inode);
+  header.offset = (uint_least64_t)(frame->modified_offset);
+  header.length = (uint_least64_t)(save->length);
+  if (fsync(save->fd) || (save->error = pwrite_fully(save->fd, (const char*)&header, sizeof(save_journal_t), 0)) ||
+      fsync(save->fd))
+    save->error = save->error ? save->error : errno;
+  else
+    {
+      /* So must the name of the journal */
+      dir = directory_of(save->filename);
+      if ((fd = open(dir, O_RDONLY | O_DIRECTORY)) >= 0)
+	{
+	  fsync(fd);
+	  close(fd);
+	  fd = -1;
+	}
+      free(dir);
+    }
+  
+  /* Nothing has been changed if the new end of the file cannot be mapped or given room */
+  if ((save->error == 0) && ((fd = open(save->filename, O_RDWR)) < 0))
+    save->error = errno;
+  if ((save->error == 0) && (size > frame->content_size))
+    {
+      if (mmap(frame->content, size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+	save->error = errno;
+      else if (fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)(frame->content_size), (off_t)(size - frame->content_size)))
+	if ((errno != EOPNOTSUPP) && (errno != ENOSYS))
+	  save->error = errno;
+    }
+  if (save->error)
+    {
+      if (fd >= 0)
+	close(fd);
+      close(save->fd);
+      save->fd = -1;
+      unlink(save->temporary);
+      return;
+    }
+  
+  if ((save->error = copy_journal(save->fd, fd, frame->modified_offset, save->length)) == 0)
+    if (ftruncate(fd, (off_t)size) || fsync(fd))
+      save->error = errno;
+  close(fd);
+  
+  /* If the file was left half written, try once more; otherwise the journal is kept so that
+   * the save is finished when the file is opened, and it must not be overwritten by saving
+   * the file in place again, nor may the lines still be views into the half written file */
+  if (save->error && recover_save(save->filename))
+    {
+      strand_lines(frame, save->fd, save->length);
+      close(save->fd);
+      save->fd = -1;
+      frame->flags |= FLAG_REPLACED;
+      return;
+    }
+  close(save->fd);
+  save->fd = -1;
+  save->error = 0;
+  unlink(save->temporary);
+  settle_lines(frame, size);
+  journal_saved(frame);
+}
+
+
+/**
+ * Write a frame to a temporary file next to the file it is saved to,
+ * and start writing it to disk, without waiting for it to be durable
+ * 
+ * @param  save  The save, its `frame` and `filename` must be set
+ */
+static void begin_save(pending_save_t* save)
+{
+  frame_t* frame = save->frame;
+  const char* base = strrchr(save->filename, '/');
+  save_output_t out;
+  struct stat attr;
+  mode_t mode, mask;
+  void* buffer;
+  char* dir;
+  
+  /* Only rewrite the end of the file if it is all that has changed */
+  if (begin_save_in_place(save))
+    return;
+  
+  dir = directory_of(save->filename);
+  save->fd = -1;
+  save->temporary = malloc(strlen(dir) + strlen(base ? base + 1 : save->filename) + 16);
+  sprintf(save->temporary, "%s/.%s.XXXXXX", dir, base ? base + 1 : save->filename);
+  free(dir);
+  if ((save->fd = mkstemp(save->temporary)) < 0)
+    {
+      save->error = errno;
+      return;
+    }
+  
+  /* Keep the permissions and owner of the file, new files get the default permissions */
+  if (stat(save->filename, &attr) == 0)
+    {
+      mode = attr.st_mode & 07777;
+      /* The owner can only be kept if the user is privileged, that is not an error */
+      if (fchown(save->fd, attr.st_uid, attr.st_gid) < 0)
+	errno = 0;
+    }
+  else
+    {
+      umask(mask = umask(0));
+      mode = 0666 & ~mask;
+    }
+  
+  /* The original file can only be copied from if it is still the file the content was read from */
+  out.source = -1;
+  if (frame->content && frame->inode && !(frame->flags & FLAG_REPLACED))
+    if ((out.source = open(frame->file, O_RDONLY)) >= 0)
+      if (fstat(out.source, &attr) || (attr.st_dev != frame->device) || (attr.st_ino != frame->inode) ||
+	  ((size_t)(attr.st_size) != frame->content_size))
+	{
+	  close(out.source);
+	  out.source = -1;
+	}
+  
+  out.fd = save->fd;
+  out.content = frame->content;
+  out.used = 0;
+  out.error = posix_memalign(&buffer, 4096, SAVE_BUFFER);
+  if (out.error == 0)
+    {
+      out.buffer = buffer;
+      write_frame(&out, frame, 0);
+      free(buffer);
+    }
+  if (out.source >= 0)
+    close(out.source);
+  
+  if ((save->error = out.error))
+    return;
+  if (fchmod(save->fd, mode) || fstat(save->fd, &attr))
+    {
+      save->error = errno;
+      return;
+    }
+  save->device = attr.st_dev;
+  save->inode = attr.st_ino;
+  
+  /* Start writing the file to disk, so that the writes of multiple files overlap */
+  sync_file_range(save->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+}
+
+
+/**
+ * Wait for saves to become durable and replace the files with them
+ * 
+ * @param  saves  The saves, that have been started with `begin_save`
+ * @param  count  The number of elements in `saves`
+ */
+static void commit_saves(pending_save_t* saves, size_t count)
+{
+  pending_save_t* save;
+  size_t i, j;
+  char* dir;
+  char* real;
+  int fd;
+  
+  /* The files must be on disk before they replace the old files */
+  for (i = 0; i < count; i++)
+    if (((save = saves + i)->error == 0) && !save->in_place && fsync(save->fd))
+      save->error = errno;
+  
+  /* Files saved in place are rewritten once their journals are durable, they are then done */
+  for (i = 0; i < count; i++)
+    if (((save = saves + i)->error == 0) && save->in_place)
+      commit_in_place(save);
+  
+  for (i = 0; i < count; i++)
+    {
+      save = saves + i;
+      if (save->in_place)
+	continue;
+      if (save->fd >= 0)
+	close(save->fd);
+      if ((save->error == 0) && rename(save->temporary, save->filename))
+	save->error = errno;
+      if (save->error && (save->fd >= 0))
+	unlink(save->temporary);
+    }
+  
+  /* Make the renames durable, once per directory */
+  for (i = 0; i < count; i++)
+    {
+      if ((save = saves + i)->error || save->in_place)
+	continue;
+      dir = directory_of(save->filename);
+      for (j = 0; j < i; j++)
+	if (((saves + j)->error == 0) && !(saves + j)->in_place && !strcmp((saves + j)->temporary, dir))
+	  break;
+      if ((j == i) && ((fd = open(dir, O_RDONLY | O_DIRECTORY)) >= 0))
+	{
+	  fsync(fd);
+	  close(fd);
+	}
+      /* The temporary filename is not needed anymore, keep the directory in its place */
+      free(save->temporary);
+      save->temporary = dir;
+    }
+  
+  /* The frames now belong to the files */
+  for (i = 0; i < count; i++)
+    {
+      save = saves + i;
+      if ((save->error == 0) && !save->in_place)
+	{
+	  real = realpath(save->filename, NULL);
+	  if (real == NULL)
+	    real = strdup(save->filename);
+	  if (save->frame->file && !strcmp(save->frame->file, real))
+	    {
+	      free(real);
+	      real = save->frame->file;
+	    }
+	  journal_saved(save->frame);
+	  set_frame_file(save->frame, real, save->device, save->inode);
+	  save->frame->flags &= (int_least8_t)~FLAG_MODIFIED;
+	  save->frame->flags |= FLAG_REPLACED;
+	}
+      free(save->temporary);
+    }
+}
+
+
+/**
+ * Choose the file to save to
+ * 
+ * @param  save      The save to set up
+ * @param  frame     The frame
+ * @param  filename  The file to save to, `NULL` for the file of the frame
+ */
+static void prepare_save(pending_save_t* save, frame_t* frame, const char* filename)
+{
+  save->frame = frame;
+  save->error = 0;
+  save->temporary = NULL;
+  save->fd = -1;
+  save->in_place = 0;
+  save->length = 0;
+  /* Save to the file a symbolic link points to, rather than replacing the link */
+  if ((save->filename = realpath(filename ? filename : frame->file, NULL)) == NULL)
+    save->filename = strdup(filename ? filename : frame->file);
+}
+
+
+/**
+ * Tell the user how a save went
+ * 
+ * @param  filename  The file that was saved to
+ * @param  error     Zero on success, otherwise an error code
+ */
+static void report_save(const char* filename, int error)
+{
+  const char* reason = error ? strerror(error) : NULL;
+  size_t n = strlen(filename) + (reason ? strlen(reason) : 0) + 64;
+  char* message = malloc(n * sizeof(char));
+  if (reason)
+    snprintf(message, n, "\033[31mCould not save %s: %s\033[m", filename, reason);
+  else
+    snprintf(message, n, "Wrote %s", filename);
+  alert(message);
+}
+
+
+/**
+ * Save the current frame to the file the user entered
+ * 
+ * @param  text  The filename, `NULL` if the user cancelled
+ */
+static void write_file_done(const char* text)
+{
+  if (text && *text)
+    report_save(text, save_frame(cur_frame, text));
+}
+
+
+
+/**
+ * Save a frame
+ * 
+ * @param   frame     The frame
+ * @param   filename  The file to save to, `NULL` for the file of the frame
+ * @return            Zero on success, otherwise an error code
+ */
+int save_frame(frame_t* frame, const char* filename)
+{
+  pending_save_t save;
+  prepare_save(&save, frame, filename);
+  if (save.error == 0)
+    begin_save(&save);
+  commit_saves(&save, 1);
+  free(save.filename);
+  return save.error;
+}
+
+
+/**
+ * Save the current frame, asking for a filename if it has no file
+ */
+void save_buffer(void)
+{
+  if (cur_frame->file == NULL)
+    write_file();
+  else if (cur_frame->flags & FLAG_MODIFIED)
+    report_save(cur_frame->file, save_frame(cur_frame, NULL));
+  else
+    alert(strdup("(No changes need to be saved)"));
+}
+
+
+/**
+ * Ask for a filename and save the current frame to it
+ */
+void write_file(void)
+{
+  minibuffer_open("Write file: ", write_file_done);
+}
+
+
+/**
+ * Save all frames that have been modified
+ */
+void save_some_buffers(void)
+{
+  pending_save_t* saves = NULL;
+  size_t i, count = 0, failed = 0;
+  frame_t* frame;
+  pos_t index;
+  char* message;
+  
+  for (index = 0; (frame = get_frame(index)); index++)
+    if ((frame->flags & FLAG_MODIFIED) && frame->file)
+      {
+	saves = realloc(saves, (count + 1) * sizeof(pending_save_t));
+	prepare_save(saves + count++, frame, NULL);
+      }
+  
+  /* Write every file before waiting for any of them, so the disk can work on all of them at once */
+  for (i = 0; i < count; i++)
+    begin_save(saves + i);
+  commit_saves(saves, count);
+  
+  for (i = 0; i < count; i++)
+    {
+      if ((saves + i)->error)
+	{
+	  if (failed++ == 0)
+	    report_save((saves + i)->filename, (saves + i)->error);
+	}
+      free((saves + i)->filename);
+    }
+  free(saves);
+  
+  if (failed)
+    return;
+  message = malloc(64 * sizeof(char));
+  if (count)
+    snprintf(message, 64, "Saved %zu file%s", count, count == 1 ? "" : "s");
+  else
+    snprintf(message, 64, "(No files need saving)");
+  alert(message);
+}
+
+
+/**
+ * Finish saving a file in place if it was interrupted, using its journal
+ * 
+ * @param   filename  The file
+ * @return            Zero if the file has no journal left, otherwise an error code
+ */
+int recover_save(const char* filename)
+{
+  char* path = journal_of(filename);
+  save_journal_t header;
+  struct stat attr;
+  int journal, fd, error = 0;
+  
+  if ((journal = open(path, O_RDONLY | O_NOFOLLOW)) < 0)
+    {
+      free(path);
+      return 0;
+    }
+  
+  /* A journal that was not completed was abandoned before the file was touched,
+   * and a journal for another file with the same name is stale */
+  if ((pread(journal, &header, sizeof(save_journal_t), 0) == (ssize_t)sizeof(save_journal_t)) &&
+      !memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) && !fstat(journal, &attr) &&
+      ((uint_least64_t)(attr.st_size) == sizeof(save_journal_t) + header.length))
+    {
+      if ((fd = open(filename, O_RDWR)) < 0)
+	error = errno;
+      else
+	{
+	  if (!fstat(fd, &attr) && ((uint_least64_t)(attr.st_ino) == header.inode))
+	    if ((error = copy_journal(journal, fd, (size_t)(header.offset), (size_t)(header.length))) == 0)
+	      if (ftruncate(fd, (off_t)(header.offset + header.length)) || fsync(fd))
+		error = errno;
+	  close(fd);
+	}
+    }
+  
+  close(journal);
+  if (error == 0)
+    unlink(path);
+  free(path);
+  return error;
+}
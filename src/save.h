@@ -0,0 +1,219 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SAVE_H__
+#define __SAVE_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <errno.h>
+
+#include "types.h"
+#include "frames.h"
+#include "utf8.h"
+#include "minibuffer.h"
+#include "recover.h"
+
+
+
+/**
+ * The number of bytes that are collected before they are written to a file
+ */
+#ifndef SAVE_BUFFER
+#define SAVE_BUFFER  (1 << 20)
+#endif
+
+/**
+ * The minimum number of unedited bytes to let the kernel copy from the original
+ * file, rather than writing them from memory, when a file is saved
+ */
+#ifndef SAVE_COPY_MIN
+#define SAVE_COPY_MIN  (1 << 16)
+#endif
+
+/**
+ * The bytes that the journal of a file that is saved in place begins with
+ */
+#define  JOURNAL_MAGIC  "ZECORAJ1"
+
+
+
+/**
+ * A file that a frame is being written to
+ */
+typedef struct save_output
+{
+  /**
+   * The file
+   */
+  int fd;
+  
+  /**
+   * The file the content of the frame was read from, -1 if unavailable
+   */
+  int source;
+  
+  /**
+   * The content of the frame, that unedited lines are views into
+   */
+  const char* content;
+  
+  /**
+   * Bytes waiting to be written
+   */
+  char* buffer;
+  
+  /**
+   * The number of bytes in `buffer`
+   */
+  size_t used;
+  
+  /**
+   * Zero on success, otherwise an error code
+   */
+  int error;
+  
+} save_output_t;
+
+
+/**
+ * The beginning of the journal of a file that is saved in place, it
+ * is followed by the bytes that replace the end of the file
+ */
+typedef struct save_journal
+{
+  /**
+   * `JOURNAL_MAGIC` once the journal is complete, zeroes until then
+   */
+  char magic[8];
+  
+  /**
+   * The inode of the file
+   */
+  uint_least64_t inode;
+  
+  /**
+   * The offset in the file of the first replaced byte
+   */
+  uint_least64_t offset;
+  
+  /**
+   * The number of bytes that follow the header, the file is truncated after them
+   */
+  uint_least64_t length;
+  
+} save_journal_t;
+
+
+/**
+ * A save that has been written but not committed
+ */
+typedef struct pending_save
+{
+  /**
+   * The frame being saved
+   */
+  frame_t* frame;
+  
+  /**
+   * The real path of the file to save to
+   */
+  char* filename;
+  
+  /**
+   * The path of the temporary file, that replaces the file once it is durable,
+   * or the path of the journal if the file is saved in place
+   */
+  char* temporary;
+  
+  /**
+   * The temporary file or journal, -1 if closed
+   */
+  int fd;
+  
+  /**
+   * Whether only the end of the file is rewritten, from the first modified byte
+   */
+  int in_place;
+  
+  /**
+   * The number of bytes written from the first modified byte, if the file is saved in place
+   */
+  size_t length;
+  
+  /**
+   * The device the temporary file is stored on
+   */
+  dev_t device;
+  
+  /**
+   * The inode of the temporary file, and of the file once it has replaced it
+   */
+  ino_t inode;
+  
+  /**
+   * Zero on success, otherwise an error code
+   */
+  int error;
+  
+} pending_save_t;
+
+
+
+/**
+ * Save a frame
+ * 
+ * @param   frame     The frame
+ * @param   filename  The file to save to, `NULL` for the file of the frame
+ * @return            Zero on success, otherwise an error code
+ */
+int save_frame(frame_t* frame, const char* filename);
+
+/**
+ * Save the current frame, asking for a filename if it has no file
+ */
+void save_buffer(void);
+
+/**
+ * Ask for a filename and save the current frame to it
+ */
+void write_file(void);
+
+/**
+ * Save all frames that have been modified
+ */
+void save_some_buffers(void);
+
+/**
+ * Finish saving a file in place if it was interrupted, using its journal
+ * 
+ * @param   filename  The file
+ * @return            Zero if the file has no journal left, otherwise an error code
+ */
+int recover_save(const char* filename);
+
+
+#endif
+
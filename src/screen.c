@@ -0,0 +1,511 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "screen.h"
+
+
+/**
+ * The number of rows on the terminal
+ */
+static pos_t screen_rows = 0;
+
+/**
+ * The number of columns on the terminal
+ */
+static pos_t screen_cols = 0;
+
+/**
+ * The cells as they are displayed on the terminal
+ */
+static screen_cell_t* front = NULL;
+
+/**
+ * The cells of the frame that is being drawn
+ */
+static screen_cell_t* back = NULL;
+
+/**
+ * The row the terminal's cursor is on, -1 if unknown
+ */
+static pos_t cursor_row = -1;
+
+/**
+ * The column the terminal's cursor is on, -1 if unknown
+ */
+static pos_t cursor_col = -1;
+
+/**
+ * The attributes the terminal is drawing with, -1 if unknown
+ */
+static int cursor_attr = -1;
+
+/**
+ * Output that has not been sent to the terminal yet
+ */
+static char* output = NULL;
+
+/**
+ * The number of bytes in `output`
+ */
+static size_t output_used = 0;
+
+/**
+ * The number of bytes that fits in `output`
+ */
+static size_t output_size = 0;
+
+
+
+/**
+ * Set every cell in a region to a blank space
+ * 
+ * @param  cells  The first cell
+ * @param  n      The number of cells
+ */
+static void blank(screen_cell_t* cells, pos_t n)
+{
+  while (n--)
+    {
+      cells->c = ' ';
+      cells->mark = 0;
+      cells->attr = 0;
+      cells++;
+    }
+}
+
+
+/**
+ * Check whether a cell is a blank space that can be erased
+ * 
+ * @param   cell  The cell
+ * @return        Whether the cell is blank
+ */
+__attribute__((pure))
+static int is_blank(const screen_cell_t* cell)
+{
+  return (cell->c == ' ') && (cell->mark == 0) && (cell->attr == 0);
+}
+
+
+/**
+ * Append bytes to the output
+ * 
+ * @param  bytes  The bytes
+ * @param  n      The number of bytes
+ */
+static void emit(const char* bytes, size_t n)
+{
+  if (output_used + n > output_size)
+    {
+      output_size = (output_used + n) << 1;
+      output = realloc(output, output_size * sizeof(char));
+    }
+  memcpy(output + output_used, bytes, n);
+  output_used += n;
+}
+
+
+/**
+ * Append a non-negative number in decimal to the output
+ * 
+ * @param  value  The number
+ */
+static void emit_number(pos_t value)
+{
+  char buf[3 * sizeof(pos_t)];
+  size_t i = sizeof(buf);
+  do
+    *(buf + --i) = (char)('0' + value % 10);
+  while (value /= 10);
+  emit(buf + i, sizeof(buf) - i);
+}
+
+
+/**
+ * Move the cursor of the terminal
+ * 
+ * @param  row  The row, 0-based
+ * @param  col  The column, 0-based
+ */
+static void move_cursor(pos_t row, pos_t col)
+{
+  if ((row == cursor_row) && (col == cursor_col))
+    return;
+  emit("\033[", 2);
+  emit_number(row + 1);
+  emit(";", 1);
+  emit_number(col + 1);
+  emit("H", 1);
+  cursor_row = row;
+  cursor_col = col;
+}
+
+
+/**
+ * Change the attributes the terminal draws with
+ * 
+ * @param  attr  The attributes
+ */
+static void set_attr(int attr)
+{
+  if (attr == cursor_attr)
+    return;
+  char buf[16];
+  size_t n = 0;
+  *(buf + n++) = '\033';
+  *(buf + n++) = '[';
+  *(buf + n++) = '0';
+  if (attr & ATTR_BOLD)
+    *(buf + n++) = ';', *(buf + n++) = '1';
+  if (attr & ATTR_REVERSE)
+    *(buf + n++) = ';', *(buf + n++) = '7';
+  if (attr & ATTR_FG_MASK)
+    *(buf + n++) = ';', *(buf + n++) = '3', *(buf + n++) = (char)('0' + ((attr & ATTR_FG_MASK) >> 2) - 1);
+  if (attr & ATTR_BG_MASK)
+    *(buf + n++) = ';', *(buf + n++) = '4', *(buf + n++) = (char)('0' + ((attr & ATTR_BG_MASK) >> 6) - 1);
+  *(buf + n++) = 'm';
+  emit(buf, n);
+  cursor_attr = attr;
+}
+
+
+/**
+ * Write a character to the terminal
+ * 
+ * @param  c  The character
+ */
+static void put_char(char_t c)
+{
+  if ((c < 0x80) && (output_used < output_size))
+    *(output + output_used++) = (char)c;
+  else
+    {
+      const glyph_t* glyph = glyph_get(c);
+      emit(glyph->utf8, (size_t)(glyph->length));
+    }
+}
+
+
+
+/**
+ * Create the screen, the terminal must be cleared
+ * 
+ * @param  rows  The number of rows on the terminal
+ * @param  cols  The number of columns on the terminal
+ */
+void screen_create(pos_t rows, pos_t cols)
+{
+  screen_rows = rows;
+  screen_cols = cols;
+  front = malloc((size_t)(rows * cols) * sizeof(screen_cell_t));
+  back = malloc((size_t)(rows * cols) * sizeof(screen_cell_t));
+  blank(front, rows * cols);
+  blank(back, rows * cols);
+  cursor_row = cursor_col = -1;
+  cursor_attr = -1;
+}
+
+
+/**
+ * Start drawing a new frame, every cell is blanked
+ */
+void screen_clear(void)
+{
+  blank(back, screen_rows * screen_cols);
+}
+
+
+/**
+ * Draw a character, a combining character is drawn over the character to the left
+ * 
+ * @param   row   The row of the cell, 0-based
+ * @param   col   The column of the cell, 0-based
+ * @param   c     The character, must be printable
+ * @param   attr  The attributes of the cell
+ * @return        The number of columns the character occupies
+ */
+pos_t screen_put(pos_t row, pos_t col, char_t c, int attr)
+{
+  pos_t width = glyph_get(c)->width;
+  screen_cell_t* cell;
+  
+  if ((row < 0) || (row >= screen_rows) || (col < 0) || (col > screen_cols))
+    return width;
+  cell = back + row * screen_cols + col;
+  
+  if (width == 0)
+    {
+      /* Combine with the character to the left, only one combining character is kept */
+      if ((col > 0) && ((cell - 1)->c == 0))
+	cell--;
+      if ((col > 0) && ((cell - 1)->mark == 0))
+	(cell - 1)->mark = c;
+      return 0;
+    }
+  if (col == screen_cols)
+    return width;
+  
+  /* A double-width character that does not fit is replaced by a space */
+  if (col + width > screen_cols)
+    c = ' ', width = 1;
+  
+  /* Do not leave half of a double-width character */
+  if ((cell->c == 0) && (col > 0))
+    (cell - 1)->c = ' ', (cell - 1)->mark = 0;
+  if ((col + width < screen_cols) && ((cell + width)->c == 0))
+    (cell + width)->c = ' ', (cell + width)->mark = 0;
+  
+  cell->c = c;
+  cell->mark = 0;
+  cell->attr = (int_least16_t)attr;
+  if (width == 2)
+    *(cell + 1) = *cell, (cell + 1)->c = 0;
+  return width;
+}
+
+
+/**
+ * Fill cells with blank spaces
+ * 
+ * @param  row   The row of the cells, 0-based
+ * @param  col   The column of the first cell, 0-based
+ * @param  n     The number of cells
+ * @param  attr  The attributes of the cells
+ */
+void screen_fill(pos_t row, pos_t col, pos_t n, int attr)
+{
+  for (; n > 0; n--)
+    screen_put(row, col++, ' ', attr);
+}
+
+
+/**
+ * Draw UTF-8 encoded text that may contain SGR escape sequences,
+ * the text is clipped at the end of the row
+ * 
+ * @param   row   The row of the text, 0-based
+ * @param   col   The column of the first character, 0-based
+ * @param   text  The text, NUL-terminated
+ * @param   attr  The attributes of the text, also restored by `ESC [ 0 m`
+ * @return        The column after the text
+ */
+pos_t screen_print(pos_t row, pos_t col, const char* text, int attr)
+{
+  int cur = attr;
+  
+  while (*text)
+    {
+      unsigned char b = (unsigned char)*text++;
+      if ((b == '\033') && (*text == '['))
+	{
+	  /* Apply SGR parameters, and skip any other control sequence */
+	  int param = 0;
+	  for (text++; *text; text++)
+	    if (('0' <= *text) && (*text <= '9'))
+	      param = param * 10 + (*text & 15);
+	    else
+	      {
+		if ((*text == ';') || (*text == 'm'))
+		  {
+		    if (param == 0)
+		      cur = attr;
+		    else if (param == 1)
+		      cur |= ATTR_BOLD;
+		    else if ((param == 21) || (param == 22))
+		      cur &= ~ATTR_BOLD;
+		    else if (param == 7)
+		      cur |= ATTR_REVERSE;
+		    else if (param == 27)
+		      cur &= ~ATTR_REVERSE;
+		    else if ((30 <= param) && (param <= 37))
+		      cur = (cur & ~ATTR_FG_MASK) | ATTR_FG(param - 30);
+		    else if (param == 39)
+		      cur &= ~ATTR_FG_MASK;
+		    else if ((40 <= param) && (param <= 47))
+		      cur = (cur & ~ATTR_BG_MASK) | ATTR_BG(param - 40);
+		    else if (param == 49)
+		      cur &= ~ATTR_BG_MASK;
+		    param = 0;
+		  }
+		if (*text != ';')
+		  {
+		    text += *text != 0;
+		    break;
+		  }
+	      }
+	  continue;
+	}
+      if (b < ' ')
+	continue;
+      
+      /* Decode UTF-8, continuation bytes belong to the previous character */
+      char_t c = b;
+      if (b >= 0xC0)
+	{
+	  int n = b >= 0xF0 ? 3 : b >= 0xE0 ? 2 : 1;
+	  c = b & (0x3F >> n);
+	  for (; n && ((*text & 0xC0) == 0x80); n--)
+	    c = (c << 6) | (*text++ & 0x3F);
+	}
+      else if (b >= 0x80)
+	continue;
+      col += screen_put(row, col, c, cur);
+    }
+  return col;
+}
+
+
+/**
+ * Scroll rows on the terminal, so that they do not need to be redrawn
+ * 
+ * @param  top     The first row of the scrolled area, 0-based
+ * @param  bottom  The row after the last row of the scrolled area
+ * @param  lines   The number of lines to scroll the content upwards, negative for downwards
+ */
+void screen_scroll(pos_t top, pos_t bottom, pos_t lines)
+{
+  pos_t n = lines < 0 ? -lines : lines;
+  pos_t kept = bottom - top - n;
+  screen_cell_t* first = front + top * screen_cols;
+  
+  if ((lines == 0) || (kept <= 0))
+    return;
+  
+  /* The new lines are filled with the current background colour */
+  set_attr(0);
+  emit("\033[", 2);
+  emit_number(top + 1);
+  emit(";", 1);
+  emit_number(bottom);
+  emit("r\033[", 3);
+  emit_number(n);
+  emit(lines > 0 ? "S\033[r" : "T\033[r", 4);
+  cursor_row = cursor_col = -1;
+  
+  /* The terminal now shows this, update what we know about it */
+  if (lines > 0)
+    {
+      memmove(first, first + n * screen_cols, (size_t)(kept * screen_cols) * sizeof(screen_cell_t));
+      blank(first + kept * screen_cols, n * screen_cols);
+    }
+  else
+    {
+      memmove(first + n * screen_cols, first, (size_t)(kept * screen_cols) * sizeof(screen_cell_t));
+      blank(first, n * screen_cols);
+    }
+}
+
+
+/**
+ * Update the terminal with the cells that have changed since the last flush
+ * 
+ * @param  row  The row to place the cursor on, 0-based
+ * @param  col  The column to place the cursor on, 0-based
+ */
+void screen_flush(pos_t row, pos_t col)
+{
+  for (pos_t r = 0; r < screen_rows; r++)
+    {
+      screen_cell_t* old = front + r * screen_cols;
+      screen_cell_t* new = back + r * screen_cols;
+      pos_t end = screen_cols, old_end = screen_cols, c;
+      
+      /* Do not draw in the last cell of the screen, the terminal could scroll */
+      if (r == screen_rows - 1)
+	end = old_end = screen_cols - 1;
+      
+      /* Trailing blanks can be erased all at once */
+      while (end && is_blank(new + end - 1))
+	end--;
+      while (old_end && is_blank(old + old_end - 1))
+	old_end--;
+      
+      for (c = 0; c < end; c++)
+	if (((old + c)->c != (new + c)->c) || ((old + c)->mark != (new + c)->mark) ||
+	    ((old + c)->attr != (new + c)->attr))
+	  {
+	    /* The right half of a double-width character is drawn with its left half */
+	    if ((new + c)->c == 0)
+	      {
+		*(old + c) = *(new + c);
+		continue;
+	      }
+	    
+	    /* Rewriting a few unchanged cells is shorter than moving the cursor over them */
+	    if ((cursor_row == r) && (0 <= cursor_col) && (cursor_col < c) && (c - cursor_col <= SCREEN_REWRITE))
+	      {
+		pos_t g;
+		for (g = cursor_col; g < c; g++)
+		  if (((new + g)->attr != cursor_attr) || ((new + g)->c < ' ') ||
+		      ((new + g)->c >= 0x80) || (new + g)->mark)
+		    break;
+		for (; (g == c) && (cursor_col < c); cursor_col++)
+		  put_char((new + cursor_col)->c);
+	      }
+	    move_cursor(r, c);
+	    set_attr((new + c)->attr);
+	    put_char((new + c)->c);
+	    if ((new + c)->mark)
+	      put_char((new + c)->mark);
+	    *(old + c) = *(new + c);
+	    if ((c + 1 < screen_cols) && ((new + c + 1)->c == 0))
+	      {
+		c++;
+		*(old + c) = *(new + c);
+	      }
+	    /* At the last column the cursor is not moved, but the next character is printed on the next row */
+	    cursor_col = c + 1 < screen_cols ? c + 1 : -1;
+	  }
+      
+      if (old_end > end)
+	{
+	  move_cursor(r, end);
+	  set_attr(0);
+	  emit("\033[K", 3);
+	  blank(old + end, old_end - end);
+	}
+    }
+  
+  move_cursor(row, col);
+  
+  /* Send everything at once */
+  for (size_t off = 0; off < output_used;)
+    {
+      ssize_t wrote = write(STDOUT_FILENO, output + off, output_used - off);
+      if (wrote > 0)
+	off += (size_t)wrote;
+      else if ((wrote == 0) || (errno != EINTR))
+	break;
+    }
+  output_used = 0;
+}
+
+
+/**
+ * Free the resources of the screen
+ */
+void screen_free(void)
+{
+  free(front);
+  free(back);
+  free(output);
+  front = back = NULL;
+  output = NULL;
+  output_used = output_size = 0;
+}
+
@@ -0,0 +1,169 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SCREEN_H__
+#define __SCREEN_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "types.h"
+#include "glyph.h"
+
+
+
+/**
+ * The maximum number of unchanged cells to send again rather than moving the cursor over them
+ */
+#ifndef SCREEN_REWRITE
+#define SCREEN_REWRITE  4
+#endif
+
+
+
+/**
+ * The text is bold
+ */
+#define  ATTR_BOLD  1
+
+/**
+ * The foreground and background colours are swapped
+ */
+#define  ATTR_REVERSE  2
+
+/**
+ * The text is drawn in one of the eight basic colours
+ */
+#define  ATTR_FG(COLOUR)  (((COLOUR) + 1) << 2)
+
+/**
+ * The cell is filled with one of the eight basic colours
+ */
+#define  ATTR_BG(COLOUR)  (((COLOUR) + 1) << 6)
+
+/**
+ * The bits used by `ATTR_FG`
+ */
+#define  ATTR_FG_MASK  (15 << 2)
+
+/**
+ * The bits used by `ATTR_BG`
+ */
+#define  ATTR_BG_MASK  (15 << 6)
+
+
+
+/**
+ * A character cell on the screen
+ */
+typedef struct screen_cell
+{
+  /**
+   * The character in the cell, 0 if the cell is covered by a
+   * double-width character in the cell to the left of it
+   */
+  char_t c;
+  
+  /**
+   * A combining character drawn over the character, 0 if none
+   */
+  char_t mark;
+  
+  /**
+   * The attributes of the cell, a combination of the `ATTR_*` values
+   */
+  int_least16_t attr;
+  
+} screen_cell_t;
+
+
+
+/**
+ * Create the screen, the terminal must be cleared
+ * 
+ * @param  rows  The number of rows on the terminal
+ * @param  cols  The number of columns on the terminal
+ */
+void screen_create(pos_t rows, pos_t cols);
+
+/**
+ * Start drawing a new frame, every cell is blanked
+ */
+void screen_clear(void);
+
+/**
+ * Draw a character, a combining character is drawn over the character to the left
+ * 
+ * @param   row   The row of the cell, 0-based
+ * @param   col   The column of the cell, 0-based
+ * @param   c     The character, must be printable
+ * @param   attr  The attributes of the cell
+ * @return        The number of columns the character occupies
+ */
+pos_t screen_put(pos_t row, pos_t col, char_t c, int attr);
+
+/**
+ * Fill cells with blank spaces
+ * 
+ * @param  row   The row of the cells, 0-based
+ * @param  col   The column of the first cell, 0-based
+ * @param  n     The number of cells
+ * @param  attr  The attributes of the cells
+ */
+void screen_fill(pos_t row, pos_t col, pos_t n, int attr);
+
+/**
+ * Draw UTF-8 encoded text that may contain SGR escape sequences,
+ * the text is clipped at the end of the row
+ * 
+ * @param   row   The row of the text, 0-based
+ * @param   col   The column of the first character, 0-based
+ * @param   text  The text, NUL-terminated
+ * @param   attr  The attributes of the text, also restored by `ESC [ 0 m`
+ * @return        The column after the text
+ */
+pos_t screen_print(pos_t row, pos_t col, const char* text, int attr);
+
+/**
+ * Scroll rows on the terminal, so that they do not need to be redrawn
+ * 
+ * @param  top     The first row of the scrolled area, 0-based
+ * @param  bottom  The row after the last row of the scrolled area
+ * @param  lines   The number of lines to scroll the content upwards, negative for downwards
+ */
+void screen_scroll(pos_t top, pos_t bottom, pos_t lines);
+
+/**
+ * Update the terminal with the cells that have changed since the last flush
+ * 
+ * @param  row  The row to place the cursor on, 0-based
+ * @param  col  The column to place the cursor on, 0-based
+ */
+void screen_flush(pos_t row, pos_t col);
+
+/**
+ * Free the resources of the screen
+ */
+void screen_free(void);
+
+
+#endif
+
@@ -0,0 +1,1026 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define HAVE_X86_KERNELS
+#endif
+
+
+
+/**
+ * Returned by `find` when the pattern does not occur in the text
+ */
+#define NOT_FOUND  SIZE_MAX
+
+
+
+/**
+ * Vectorisable primitives for searching, each kernel
+ * only handles whole blocks and leaves the rest to the caller
+ */
+typedef struct search_kernels
+{
+  /**
+   * Find a position in text where a unit is followed by another unit at a fixed distance
+   * 
+   * @param   text   The text
+   * @param   n      The number of units in `text`
+   * @param   width  The number of bytes per unit: 1, 2 or 4
+   * @param   first  The unit at the position
+   * @param   last   The unit `gap` units after the position
+   * @param   gap    The distance between the units
+   * @return         The first such position, or the first position that was not examined
+   */
+  size_t (*candidate)(const char* text, size_t n, int_least8_t width,
+		      uint_least32_t first, uint_least32_t last, size_t gap);
+  
+} search_kernels_t;
+
+
+/**
+ * Where the last search in a line that is still a view into its file ended,
+ * so that successive searches in the line do not start over from its beginning
+ */
+typedef struct line_cursor
+{
+  /**
+   * The line decoded, if it is malformed, `NULL` until it has been searched
+   */
+  char_t* text;
+  
+  /**
+   * The number of bytes in the content of the line before `column`
+   */
+  size_t offset;
+  
+  /**
+   * The column the last search ended at
+   */
+  pos_t column;
+  
+} line_cursor_t;
+
+
+
+static size_t candidate_scalar(const char* text, size_t n, int_least8_t width,
+			       uint_least32_t first, uint_least32_t last, size_t gap)
+{
+  (void) text, (void) n, (void) width, (void) first, (void) last, (void) gap;
+  return 0;
+}
+
+/**
+ * Kernels for machines without vector instructions, the callers' scalar loops do all the work
+ */
+static const search_kernels_t scalar_kernels = { candidate_scalar };
+
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+static __m128i splat_sse2(uint_least32_t unit, int_least8_t width)
+{
+  if (width == 1)
+    return _mm_set1_epi8((char)unit);
+  if (width == 2)
+    return _mm_set1_epi16((short)unit);
+  return _mm_set1_epi32((int)unit);
+}
+
+__attribute__((target("sse2")))
+static __m128i equal_sse2(__m128i a, __m128i b, int_least8_t width)
+{
+  if (width == 1)
+    return _mm_cmpeq_epi8(a, b);
+  if (width == 2)
+    return _mm_cmpeq_epi16(a, b);
+  return _mm_cmpeq_epi32(a, b);
+}
+
+__attribute__((target("sse2"), pure))
+static size_t candidate_sse2(const char* text, size_t n, int_least8_t width,
+			     uint_least32_t first, uint_least32_t last, size_t gap)
+{
+  const __m128i head = splat_sse2(first, width);
+  const __m128i tail = splat_sse2(last, width);
+  size_t block = 16 / (size_t)width, i = 0;
+  
+  for (; i + block + gap <= n; i += block)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i*)(const void*)(text + i * (size_t)width));
+      __m128i b = _mm_loadu_si128((const __m128i*)(const void*)(text + (i + gap) * (size_t)width));
+      unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(equal_sse2(a, head, width),
+								equal_sse2(b, tail, width)));
+      /* Each unit sets one bit per byte in the mask */
+      if (mask)
+	return i + (size_t)__builtin_ctz(mask) / (size_t)width;
+    }
+  
+  return i;
+}
+
+/**
+ * Kernels for machines with SSE2
+ */
+static const search_kernels_t sse2_kernels = { candidate_sse2 };
+
+
+__attribute__((target("avx2")))
+static __m256i splat_avx2(uint_least32_t unit, int_least8_t width)
+{
+  if (width == 1)
+    return _mm256_set1_epi8((char)unit);
+  if (width == 2)
+    return _mm256_set1_epi16((short)unit);
+  return _mm256_set1_epi32((int)unit);
+}
+
+__attribute__((target("avx2")))
+static __m256i equal_avx2(__m256i a, __m256i b, int_least8_t width)
+{
+  if (width == 1)
+    return _mm256_cmpeq_epi8(a, b);
+  if (width == 2)
+    return _mm256_cmpeq_epi16(a, b);
+  return _mm256_cmpeq_epi32(a, b);
+}
+
+__attribute__((target("avx2"), pure))
+static size_t candidate_avx2(const char* text, size_t n, int_least8_t width,
+			     uint_least32_t first, uint_least32_t last, size_t gap)
+{
+  const __m256i head = splat_avx2(first, width);
+  const __m256i tail = splat_avx2(last, width);
+  size_t block = 32 / (size_t)width, i = 0;
+  
+  for (; i + block + gap <= n; i += block)
+    {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(const void*)(text + i * (size_t)width));
+      __m256i b = _mm256_loadu_si256((const __m256i*)(const void*)(text + (i + gap) * (size_t)width));
+      unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(equal_avx2(a, head, width),
+								      equal_avx2(b, tail, width)));
+      /* Each unit sets one bit per byte in the mask */
+      if (mask)
+	return i + (size_t)__builtin_ctz(mask) / (size_t)width;
+    }
+  
+  return i;
+}
+
+/**
+ * Kernels for machines with AVX2
+ */
+static const search_kernels_t avx2_kernels = { candidate_avx2 };
+
+#endif
+
+
+/**
+ * Select the best kernels the machine supports
+ * 
+ * @return  The kernels to use
+ */
+static const search_kernels_t* select_kernels(void)
+{
+  static const search_kernels_t* selected = NULL;
+  const search_kernels_t* kernels = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+  if (kernels)
+    return kernels;
+  
+  kernels = &scalar_kernels;
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    kernels = &avx2_kernels;
+  else if (__builtin_cpu_supports("sse2"))
+    kernels = &sse2_kernels;
+#endif
+  __atomic_store_n(&selected, kernels, __ATOMIC_RELAXED);
+  return kernels;
+}
+
+
+
+/**
+ * Read a unit from text
+ * 
+ * @param   text   The text
+ * @param   width  The number of bytes per unit
+ * @param   index  The index of the unit
+ * @return         The unit
+ */
+static uint_least32_t unit_at(const void* text, int_least8_t width, size_t index)
+{
+  if (width == 1)
+    return *((const uint8_t*)text + index);
+  if (width == 2)
+    return *((const uint16_t*)text + index);
+  return *((const uint32_t*)text + index);
+}
+
+
+/**
+ * Find the first occurrence of a pattern in text
+ * 
+ * @param   needle  The pattern, prepared for the way the text is stored
+ * @param   text    The text
+ * @param   n       The number of units in `text`
+ * @return          The index of the occurrence, `NOT_FOUND` if none
+ */
+static size_t find(const search_needle_t* needle, const char* text, size_t n)
+{
+  const search_kernels_t* kernels = select_kernels();
+  int_least8_t width = needle->width;
+  size_t m = needle->length, bytes = m * (size_t)width, gap, i = 0;
+  uint_least32_t first, last, c;
+  
+  if (m == 0)
+    return 0;
+  if ((needle->units == NULL) || (m > n))
+    return NOT_FOUND;
+  gap = m - 1;
+  first = unit_at(needle->units, width, 0);
+  last = unit_at(needle->units, width, gap);
+  
+  if (needle->shift && (kernels == &scalar_kernels))
+    {
+      /* Without vector instructions, long patterns are better off skipping ahead by almost their length */
+      while (i + gap < n)
+	{
+	  c = unit_at(text, width, i + gap);
+	  if ((c == last) && !memcmp(text + i * (size_t)width, needle->units, bytes))
+	    return i;
+	  i += *(needle->shift + (c & 0xFF));
+	}
+      return NOT_FOUND;
+    }
+  
+  /* Short patterns are compared where the first and the last unit match */
+  while (i + gap < n)
+    {
+      i += kernels->candidate(text + i * (size_t)width, n - i, width, first, last, gap);
+      for (; i + gap < n; i++)
+	if ((unit_at(text, width, i) == first) && (unit_at(text, width, i + gap) == last))
+	  break;
+      if (i + gap == n)
+	break;
+      if (!memcmp(text + i * (size_t)width, needle->units, bytes))
+	return i;
+      i++;
+    }
+  return NOT_FOUND;
+}
+
+
+/**
+ * Prepare a pattern for searching in text stored in a specific way
+ * 
+ * @param  needle  Output parameter for the prepared pattern
+ * @param  units   The units of the pattern, the needle takes over the allocation, `NULL` if
+ *                 the pattern cannot occur in the text
+ * @param  n       The number of units in `units`
+ * @param  width   The number of bytes per unit
+ */
+static void prepare(search_needle_t* needle, void* units, size_t n, int_least8_t width)
+{
+  size_t i;
+  
+  needle->units = units;
+  needle->length = n;
+  needle->width = width;
+  needle->shift = NULL;
+  if ((units == NULL) || (n < SEARCH_HORSPOOL))
+    return;
+  
+  /* Units that share their lowest byte share their entry, so the shortest distance is used */
+  needle->shift = malloc(256 * sizeof(size_t));
+  for (i = 0; i < 256; i++)
+    *(needle->shift + i) = n;
+  for (i = 0; i + 1 < n; i++)
+    *(needle->shift + (unit_at(units, width, i) & 0xFF)) = n - 1 - i;
+}
+
+
+/**
+ * Release the resources of a prepared pattern
+ * 
+ * @param  needle  The prepared pattern
+ */
+static void release(search_needle_t* needle)
+{
+  free(needle->units);
+  free(needle->shift);
+  needle->units = NULL;
+  needle->shift = NULL;
+}
+
+
+/**
+ * Decode a line
+ * 
+ * @param   lbuf  The line
+ * @return        The characters of the line
+ */
+static char_t* line_text(const line_buffer_t* lbuf)
+{
+  char_t* text = malloc((size_t)(lbuf->used ? lbuf->used : 1) * sizeof(char_t));
+  read_line(lbuf, 0, lbuf->used, text);
+  return text;
+}
+
+
+/**
+ * Find the first occurrence of a pattern in a materialised line
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line
+ * @param   from     The first column the occurrence may start at
+ * @return           The column the occurrence starts at, -1 if not found
+ */
+static pos_t search_materialised(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t from)
+{
+  const search_needle_t* needle = pattern->units + (lbuf->width >> 1);
+  size_t width = (size_t)(lbuf->width), hit;
+  pos_t m = pattern->length, gap = lbuf->gap, used = lbuf->used, start, stop;
+  const char* before = lbuf->line;
+  const char* after = before + (size_t)(lbuf->allocated - used + gap) * width;
+  char_t* window;
+  
+  /* Occurrences before the gap */
+  if (from + m <= gap)
+    if ((hit = find(needle, before + (size_t)from * width, (size_t)(gap - from))) != NOT_FOUND)
+      return from + (pos_t)hit;
+  
+  /* Occurrences that the gap splits, the pattern may not fit the width of the line but the window */
+  start = from > gap - m + 1 ? from : gap - m + 1;
+  stop = used < gap + m - 1 ? used : gap + m - 1;
+  if ((start < gap) && (stop - start >= m))
+    {
+      window = malloc((size_t)(stop - start) * sizeof(char_t));
+      read_line(lbuf, start, stop - start, window);
+      hit = find(pattern->units + 2, (const char*)window, (size_t)(stop - start));
+      free(window);
+      if ((hit != NOT_FOUND) && (start + (pos_t)hit < gap))
+	return start + (pos_t)hit;
+    }
+  
+  /* Occurrences after the gap */
+  start = from > gap ? from : gap;
+  if (start + m <= used)
+    if ((hit = find(needle, after + (size_t)(start - gap) * width, (size_t)(used - start))) != NOT_FOUND)
+      return start + (pos_t)hit;
+  
+  return -1;
+}
+
+
+/**
+ * Find an occurrence of a pattern in consecutive lines that are still views into their file
+ * 
+ * @param   pattern  The pattern
+ * @param   doc      The document
+ * @param   run      The content of the first line
+ * @param   end      The end of the content of the last line
+ * @param   first    The index of the first line
+ * @param   last     Whether to find the last occurrence rather than the first
+ * @param   row      Output parameter for the line of the occurrence
+ * @param   column   Output parameter for the column of the occurrence
+ * @return           Whether the pattern was found
+ */
+static int search_run(const search_pattern_t* pattern, const document_t* doc, const char* run, const char* end,
+		      pos_t first, int last, pos_t* row, pos_t* column)
+{
+  size_t size = (size_t)(end - run), hit, next;
+  const char* line = run;
+  const char* found;
+  const char* at;
+  line_buffer_t* lbuf;
+  
+  /* Regular expressions find the line, which is then searched by its characters */
+  if (pattern->regexp)
+    {
+      if ((found = regexp_scan(pattern->regexp, run, end)) == NULL)
+	return 0;
+      if (last)
+	while ((at = memchr(found, '\n', (size_t)(end - found))) && (at = regexp_scan(pattern->regexp, at + 1, end)))
+	  found = at;
+      hit = (size_t)(found - run);
+    }
+  else
+    {
+      if ((hit = find(&(pattern->bytes), run, size)) == NOT_FOUND)
+	return 0;
+      if (last)
+	while ((hit + 1 < size) && ((next = find(&(pattern->bytes), run + hit + 1, size - hit - 1)) != NOT_FOUND))
+	  hit += next + 1;
+    }
+  
+  /* Each line is followed by exactly one line feed */
+  while ((at = memchr(line, '\n', (size_t)(run + hit - line))))
+    {
+      line = at + 1;
+      first++;
+    }
+  
+  lbuf = document_line(doc, first);
+  *row = first;
+  if (pattern->regexp)
+    *column = last ? search_line_backward(pattern, lbuf, lbuf->used + 1) : search_line(pattern, lbuf, 0);
+  else if ((size_t)(lbuf->used) == lbuf->raw_size)
+    *column = (pos_t)(run + hit - line);
+  else
+    *column = utf8_length(line, (size_t)(run + hit - line));
+  return 1;
+}
+
+
+/**
+ * Get the block of a document that begins at a line, if it can be searched without being indexed
+ * 
+ * @param   doc   The document
+ * @param   row   The line
+ * @param   stop  The line after the last line to search
+ * @return        The block, `NULL` if the line does not begin a block that has not been indexed,
+ *                that ends before `stop`, and whose lines are well-formed UTF-8
+ */
+static const document_node_t* whole_block(const document_t* doc, pos_t row, pos_t stop)
+{
+  pos_t local;
+  const document_node_t* node = document_chunk(doc, row, &local);
+  if ((node->line_buffers == NULL) && (local == 0) && (node->malformed < 0) && (row + node->count <= stop))
+    return node;
+  return NULL;
+}
+
+
+/**
+ * Find an occurrence of a pattern in whole lines
+ * 
+ * @param   pattern  The pattern
+ * @param   doc      The document
+ * @param   clean    The number of lines at the beginning of the document that are well-formed views
+ *                   into the file, back to back
+ * @param   first    The first line to search
+ * @param   stop     The line after the last line to search
+ * @param   last     Whether to find the last occurrence rather than the first
+ * @param   row      Output parameter for the line of the occurrence
+ * @param   column   Output parameter for the column of the occurrence
+ * @return           Whether the pattern was found
+ */
+static int search_rows(const search_pattern_t* pattern, const document_t* doc, pos_t clean, pos_t first, pos_t stop,
+		       int last, pos_t* row, pos_t* column)
+{
+  const char* run = NULL;
+  const char* end = NULL;
+  pos_t r = first, run_row = 0, count, c;
+  const document_node_t* block;
+  line_buffer_t* lbuf;
+  int found = 0, viewed;
+  
+  /* Lines that have not been edited are still back to back in the file, so they do not need to be looked at */
+  if ((r < clean) && (r < stop))
+    {
+      lbuf = document_line(doc, (clean < stop ? clean : stop) - 1);
+      end = lbuf->raw ? lbuf->raw + lbuf->raw_size : NULL;
+      run = document_line(doc, r)->raw;
+      if (run && end)
+	{
+	  run_row = r;
+	  r = clean < stop ? clean : stop;
+	}
+      else
+	run = NULL;
+    }
+  
+  while (r < stop)
+    {
+      /* Blocks whose lines are not in memory are searched like lines that are views into the file */
+      if ((block = whole_block(doc, r, stop)))
+	{
+	  if (run && (block->raw == end + 1))
+	    end = block->raw + block->raw_size;
+	  else
+	    {
+	      if (run && search_run(pattern, doc, run, end, run_row, last, row, column))
+		{
+		  if (!last)
+		    return 1;
+		  found = 1;
+		}
+	      run = block->raw;
+	      end = run + block->raw_size;
+	      run_row = r;
+	    }
+	  r += block->count;
+	  continue;
+	}
+      
+      for (lbuf = document_span(doc, r, &count); count-- && (r < stop); lbuf++, r++)
+	{
+	  /* Consecutive lines that are still views into the file lie back to back, separated
+	   * by line feeds, which the pattern cannot match, so they are searched as one */
+	  viewed = (lbuf->line == NULL) && lbuf->raw && !(lbuf->flags & LINE_MALFORMED);
+	  if (run && viewed && (lbuf->raw == end + 1))
+	    {
+	      end = lbuf->raw + lbuf->raw_size;
+	      continue;
+	    }
+	  
+	  if (run && search_run(pattern, doc, run, end, run_row, last, row, column))
+	    {
+	      if (!last)
+		return 1;
+	      found = 1;
+	    }
+	  run = NULL;
+	  
+	  if (viewed)
+	    {
+	      run = lbuf->raw;
+	      end = run + lbuf->raw_size;
+	      run_row = r;
+	    }
+	  else if ((c = last ? search_line_backward(pattern, lbuf, lbuf->used + 1) : search_line(pattern, lbuf, 0)) >= 0)
+	    {
+	      *row = r;
+	      *column = c;
+	      if (!last)
+		return 1;
+	      found = 1;
+	    }
+	}
+    }
+  
+  if (run && search_run(pattern, doc, run, end, run_row, last, row, column))
+    found = 1;
+  return found;
+}
+
+
+
+/**
+ * Prepare a pattern for searching
+ * 
+ * @param  pattern  Output parameter for the pattern
+ * @param  text     The characters to search for, must not contain line breaks
+ * @param  n        The number of characters in `text`
+ */
+void search_compile(search_pattern_t* pattern, const char_t* text, pos_t n)
+{
+  char_t max = 0;
+  uint8_t* latin1 = NULL;
+  uint16_t* ucs2 = NULL;
+  char* utf8;
+  pos_t i;
+  
+  pattern->length = n;
+  pattern->chars = malloc((size_t)(n ? n : 1) * sizeof(char_t));
+  memcpy(pattern->chars, text, (size_t)n * sizeof(char_t));
+  for (i = 0; i < n; i++)
+    max = *(text + i) > max ? *(text + i) : max;
+  
+  /* Lines that are stored narrower than the pattern cannot contain it */
+  if (max <= 0xFF)
+    {
+      latin1 = malloc((size_t)(n ? n : 1));
+      for (i = 0; i < n; i++)
+	*(latin1 + i) = (uint8_t)*(text + i);
+    }
+  if (max <= 0xFFFF)
+    {
+      ucs2 = malloc((size_t)(n ? n : 1) * sizeof(uint16_t));
+      for (i = 0; i < n; i++)
+	*(ucs2 + i) = (uint16_t)*(text + i);
+    }
+  prepare(pattern->units + 0, latin1, (size_t)n, 1);
+  prepare(pattern->units + 1, ucs2, (size_t)n, 2);
+  prepare(pattern->units + 2, memcpy(malloc((size_t)(n ? n : 1) * sizeof(char_t)), text, (size_t)n * sizeof(char_t)),
+	  (size_t)n, 4);
+  
+  utf8 = malloc((size_t)n * 6 + 1);
+  prepare(&(pattern->bytes), utf8, utf8_encode(text, n, utf8), 1);
+  pattern->regexp = NULL;
+}
+
+
+/**
+ * Prepare a regular expression for searching, see `regexp_compile` for the syntax
+ * 
+ * @param   pattern  Output parameter for the pattern, it is prepared
+ *                   for searching literally if the expression is invalid
+ * @param   text     The expression, must not contain line breaks
+ * @param   n        The number of characters in `text`
+ * @return           Zero on success, -1 if the expression is incomplete or malformed
+ */
+int search_compile_regexp(search_pattern_t* pattern, const char_t* text, pos_t n)
+{
+  regexp_t* regexp = malloc(sizeof(regexp_t));
+  
+  if (regexp_compile(regexp, text, n))
+    {
+      free(regexp);
+      search_compile(pattern, text, n);
+      return -1;
+    }
+  
+  pattern->length = n;
+  pattern->chars = malloc((size_t)(n ? n : 1) * sizeof(char_t));
+  memcpy(pattern->chars, text, (size_t)n * sizeof(char_t));
+  memset(&(pattern->bytes), 0, sizeof(search_needle_t));
+  memset(pattern->units, 0, sizeof(pattern->units));
+  pattern->regexp = regexp;
+  return 0;
+}
+
+
+/**
+ * Release the resources of a pattern
+ * 
+ * @param  pattern  The pattern
+ */
+void search_free(search_pattern_t* pattern)
+{
+  int i;
+  
+  free(pattern->chars);
+  pattern->chars = NULL;
+  release(&(pattern->bytes));
+  for (i = 0; i < 3; i++)
+    release(pattern->units + i);
+  if (pattern->regexp)
+    {
+      regexp_free(pattern->regexp);
+      free(pattern->regexp);
+      pattern->regexp = NULL;
+    }
+}
+
+
+/**
+ * Find the first occurrence of a pattern, that is not a regular expression, in a line
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line
+ * @param   from     The first column the occurrence may start at
+ * @param   cursor   Where the last search in the line ended, `text` must be
+ *                   freed by the caller, initialise it to zeroes for the first search
+ * @return           The column the occurrence starts at, -1 if not found
+ */
+static pos_t search_line_from(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t from,
+			      line_cursor_t* cursor)
+{
+  size_t hit;
+  
+  from = from < 0 ? 0 : from;
+  if (from > lbuf->used - pattern->length)
+    return -1;
+  if (pattern->length == 0)
+    return from;
+  
+  if (lbuf->line)
+    return search_materialised(pattern, lbuf, from);
+  
+  /* Malformed UTF-8 does not decode byte for byte, so such lines are decoded before they are searched */
+  if (lbuf->flags & LINE_MALFORMED)
+    {
+      if (cursor->text == NULL)
+	cursor->text = line_text(lbuf);
+      hit = find(pattern->units + 2, (const char*)(cursor->text + from), (size_t)(lbuf->used - from));
+      return hit == NOT_FOUND ? -1 : from + (pos_t)hit;
+    }
+  
+  /* Lines that only contain ASCII have one byte per character */
+  if ((size_t)(lbuf->used) == lbuf->raw_size)
+    {
+      hit = find(&(pattern->bytes), lbuf->raw + from, lbuf->raw_size - (size_t)from);
+      return hit == NOT_FOUND ? -1 : from + (pos_t)hit;
+    }
+  
+  /* Otherwise the byte offset of the column is found from where the last search ended */
+  if (from < cursor->column)
+    cursor->offset = 0, cursor->column = 0;
+  cursor->offset += utf8_offset(lbuf->raw + cursor->offset, lbuf->raw_size - cursor->offset, from - cursor->column);
+  cursor->column = from;
+  hit = find(&(pattern->bytes), lbuf->raw + cursor->offset, lbuf->raw_size - cursor->offset);
+  if (hit == NOT_FOUND)
+    return -1;
+  cursor->column += utf8_length(lbuf->raw + cursor->offset, hit);
+  cursor->offset += hit;
+  return cursor->column;
+}
+
+
+/**
+ * Find the first occurrence of a pattern in a line
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line
+ * @param   from     The first column the occurrence may start at
+ * @return           The column the occurrence starts at, -1 if not found
+ */
+pos_t search_line(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t from)
+{
+  line_cursor_t cursor;
+  char_t* text;
+  pos_t column;
+  
+  if (pattern->regexp)
+    {
+      from = from < 0 ? 0 : from;
+      if (from > lbuf->used)
+	return -1;
+      text = line_text(lbuf);
+      column = regexp_first(pattern->regexp, text, lbuf->used, from);
+      free(text);
+      return column;
+    }
+  
+  memset(&cursor, 0, sizeof(line_cursor_t));
+  column = search_line_from(pattern, lbuf, from, &cursor);
+  free(cursor.text);
+  return column;
+}
+
+
+/**
+ * Find the last occurrence of a pattern in a line
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line
+ * @param   before   The occurrence must start before this column
+ * @return           The column the occurrence starts at, -1 if not found
+ */
+pos_t search_line_backward(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t before)
+{
+  pos_t last = -1, at = 0;
+  line_cursor_t cursor;
+  char_t* text;
+  
+  if (pattern->regexp)
+    {
+      text = line_text(lbuf);
+      last = regexp_last(pattern->regexp, text, lbuf->used, before);
+      free(text);
+      return last;
+    }
+  
+  /* The occurrences are found from the start of the line, each search continues where the last ended */
+  memset(&cursor, 0, sizeof(line_cursor_t));
+  while (((at = search_line_from(pattern, lbuf, at, &cursor)) >= 0) && (at < before))
+    last = at++;
+  free(cursor.text);
+  return last;
+}
+
+
+/**
+ * Get the length of an occurrence of a pattern
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line of the occurrence
+ * @param   column   The column the occurrence starts at
+ * @return           The number of characters in the occurrence
+ */
+pos_t search_length(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t column)
+{
+  char_t* text;
+  pos_t length;
+  
+  if (pattern->regexp == NULL)
+    return pattern->length;
+  text = line_text(lbuf);
+  length = regexp_longest(pattern->regexp, text, lbuf->used, column);
+  free(text);
+  return length < 0 ? 0 : length;
+}
+
+
+/**
+ * Count the occurrences of a pattern in a line, occurrences do not overlap
+ * 
+ * @param   pattern  The pattern, must not be empty
+ * @param   lbuf     The line
+ * @param   before   Only occurrences that start before this column are counted
+ * @return           The number of occurrences
+ */
+size_t search_count_line(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t before)
+{
+  size_t count = 0;
+  line_cursor_t cursor;
+  pos_t at = 0;
+  char_t* text;
+  
+  if (pattern->regexp)
+    {
+      text = line_text(lbuf);
+      count = regexp_count(pattern->regexp, text, lbuf->used, before);
+      free(text);
+      return count;
+    }
+  
+  memset(&cursor, 0, sizeof(line_cursor_t));
+  while (((at = search_line_from(pattern, lbuf, at, &cursor)) >= 0) && (at < before))
+    {
+      count++;
+      at += pattern->length;
+    }
+  free(cursor.text);
+  return count;
+}
+
+
+/**
+ * Count the occurrences of a pattern in consecutive well-formed lines that are still views
+ * into their file, occurrences do not overlap, and cannot span lines
+ * 
+ * @param   pattern  The pattern, must not be empty
+ * @param   run      The content of the first line
+ * @param   end      The end of the content of the last line
+ * @return           The number of occurrences
+ */
+size_t search_count_run(const search_pattern_t* pattern, const char* run, const char* end)
+{
+  size_t count = 0, hit;
+  line_buffer_t view;
+  const char* line;
+  const char* next;
+  
+  /* Regular expressions find the lines with occurrences, which are then counted by their characters */
+  if (pattern->regexp)
+    {
+      memset(&view, 0, sizeof(line_buffer_t));
+      for (; (line = regexp_scan(pattern->regexp, run, end)); run = next + 1)
+	{
+	  next = memchr(line, '\n', (size_t)(end - line));
+	  view.raw = line;
+	  view.raw_size = (size_t)((next ? next : end) - line);
+	  view.used = utf8_length(line, view.raw_size);
+	  count += search_count_line(pattern, &view, view.used + 1);
+	  if (next == NULL)
+	    break;
+	}
+      return count;
+    }
+  
+  while ((hit = find(&(pattern->bytes), run, (size_t)(end - run))) != NOT_FOUND)
+    {
+      count++;
+      run += hit + pattern->bytes.length;
+    }
+  return count;
+}
+
+
+/**
+ * Count the occurrences of a pattern in whole lines, occurrences do not overlap
+ * 
+ * @param   pattern  The pattern, must not be empty
+ * @param   doc      The document
+ * @param   first    The first line to search
+ * @param   stop     The line after the last line to search
+ * @return           The number of occurrences
+ */
+size_t search_count_rows(const search_pattern_t* pattern, const document_t* doc, pos_t first, pos_t stop)
+{
+  const char* run = NULL;
+  const char* end = NULL;
+  const document_node_t* block;
+  line_buffer_t* lbuf;
+  size_t total = 0;
+  pos_t r = first, count;
+  int viewed;
+  
+  while (r < stop)
+    {
+      /* Lines and blocks are grouped like in `search_rows` */
+      if ((block = whole_block(doc, r, stop)))
+	{
+	  if (run && (block->raw == end + 1))
+	    end = block->raw + block->raw_size;
+	  else
+	    {
+	      if (run)
+		total += search_count_run(pattern, run, end);
+	      run = block->raw;
+	      end = run + block->raw_size;
+	    }
+	  r += block->count;
+	  continue;
+	}
+      
+      for (lbuf = document_span(doc, r, &count); count-- && (r < stop); lbuf++, r++)
+	{
+	  viewed = (lbuf->line == NULL) && lbuf->raw && !(lbuf->flags & LINE_MALFORMED);
+	  if (run && viewed && (lbuf->raw == end + 1))
+	    {
+	      end = lbuf->raw + lbuf->raw_size;
+	      continue;
+	    }
+	  if (run)
+	    total += search_count_run(pattern, run, end);
+	  run = NULL;
+	  if (viewed)
+	    {
+	      run = lbuf->raw;
+	      end = run + lbuf->raw_size;
+	    }
+	  else
+	    total += search_count_line(pattern, lbuf, lbuf->used + 1);
+	}
+    }
+  
+  if (run)
+    total += search_count_run(pattern, run, end);
+  return total;
+}
+
+
+/**
+ * Find the first occurrence of a pattern in a document at or after a position
+ * 
+ * @param   pattern  The pattern
+ * @param   doc      The document
+ * @param   clean    The number of lines at the beginning of the document that are well-formed views
+ *                   into the file, back to back, they are searched without being looked at, see `clean_lines`
+ * @param   row      The line to start at, set to the line of the occurrence, or the line to continue at
+ * @param   column   The column to start at, set to the column of the occurrence, or zero
+ * @param   lines    The number of whole lines to search before giving up
+ * @return           1 if found, 0 if the end of the document was reached, -1 if the search gave up
+ */
+int search_forward(const search_pattern_t* pattern, const document_t* doc, pos_t clean,
+		   pos_t* row, pos_t* column, pos_t lines)
+{
+  pos_t rows = document_lines(doc), r = *row, c, stop;
+  
+  /* The rest of the line the position is in */
+  if ((r < rows) && (*column > 0))
+    {
+      if ((c = search_line(pattern, document_line(doc, r), *column)) >= 0)
+	{
+	  *column = c;
+	  return 1;
+	}
+      r++;
+    }
+  
+  stop = rows - r < lines ? rows : r + lines;
+  if (search_rows(pattern, doc, clean, r, stop, 0, row, column))
+    return 1;
+  *row = stop;
+  *column = 0;
+  return stop < rows ? -1 : 0;
+}
+
+
+/**
+ * Find the last occurrence of a pattern in a document that starts before a position
+ * 
+ * @param   pattern  The pattern
+ * @param   doc      The document
+ * @param   clean    The number of lines at the beginning of the document that are well-formed views
+ *                   into the file, back to back, they are searched without being looked at, see `clean_lines`
+ * @param   row      The line of the position, may be the number of lines in the document,
+ *                   set to the line of the occurrence, or the line to continue before
+ * @param   column   The column of the position, set to the column of the occurrence, or zero
+ * @param   lines    The number of whole lines to search before giving up
+ * @return           1 if found, 0 if the beginning of the document was reached, -1 if the search gave up
+ */
+int search_backward(const search_pattern_t* pattern, const document_t* doc, pos_t clean,
+		    pos_t* row, pos_t* column, pos_t lines)
+{
+  pos_t rows = document_lines(doc), r = *row < rows ? *row : rows, c, start;
+  
+  /* The part of the line the position is in that is before it */
+  if ((r < rows) && (*column > 0))
+    if ((c = search_line_backward(pattern, document_line(doc, r), *column)) >= 0)
+      {
+	*row = r;
+	*column = c;
+	return 1;
+      }
+  
+  start = r < lines ? 0 : r - lines;
+  if (search_rows(pattern, doc, clean, start, r, 1, row, column))
+    return 1;
+  *row = start;
+  *column = 0;
+  return start > 0 ? -1 : 0;
+}
@@ -0,0 +1,239 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "types.h"
+#include "utf8.h"
+#include "lines.h"
+#include "document.h"
+#include "regexp.h"
+
+
+
+/**
+ * The length, in characters or bytes, from which patterns are searched for by skipping ahead
+ * Boyer–Moore–Horspool style on machines without vector instructions, where filtering
+ * candidates by their first and last character one at a time is slower
+ */
+#ifndef SEARCH_HORSPOOL
+#define SEARCH_HORSPOOL  8
+#endif
+
+/**
+ * The number of lines searched by `search_forward` and `search_backward`
+ * before they give up, so that the search can continue later
+ */
+#ifndef SEARCH_STEP
+#define SEARCH_STEP  (1 << 14)
+#endif
+
+
+
+/**
+ * A pattern prepared for being searched for in text stored in a specific way
+ */
+typedef struct search_needle
+{
+  /**
+   * The units of the pattern, `NULL` if the pattern cannot occur in text stored this way
+   */
+  void* units;
+  
+  /**
+   * The number of units in `units`
+   */
+  size_t length;
+  
+  /**
+   * The number of bytes per unit
+   */
+  int_least8_t width;
+  
+  /**
+   * How far to skip when a unit whose lowest byte is the index is at the end of
+   * the examined text, `NULL` unless the pattern is at least `SEARCH_HORSPOOL` units
+   */
+  size_t* shift;
+  
+} search_needle_t;
+
+
+/**
+ * A pattern to search for
+ */
+typedef struct search_pattern
+{
+  /**
+   * The characters in the pattern
+   */
+  char_t* chars;
+  
+  /**
+   * The number of characters in the pattern
+   */
+  pos_t length;
+  
+  /**
+   * The pattern, UTF-8 encoded, for lines that are still views into their file
+   */
+  search_needle_t bytes;
+  
+  /**
+   * The pattern for materialised lines, with 1, 2 and 4 bytes per character
+   */
+  search_needle_t units[3];
+  
+  /**
+   * The pattern as a regular expression, `NULL` if it is searched for literally,
+   * the needles are not used for regular expressions
+   */
+  regexp_t* regexp;
+  
+} search_pattern_t;
+
+
+
+/**
+ * Prepare a pattern for searching
+ * 
+ * @param  pattern  Output parameter for the pattern
+ * @param  text     The characters to search for, must not contain line breaks
+ * @param  n        The number of characters in `text`
+ */
+void search_compile(search_pattern_t* pattern, const char_t* text, pos_t n);
+
+/**
+ * Prepare a regular expression for searching, see `regexp_compile` for the syntax
+ * 
+ * @param   pattern  Output parameter for the pattern, it is prepared
+ *                   for searching literally if the expression is invalid
+ * @param   text     The expression, must not contain line breaks
+ * @param   n        The number of characters in `text`
+ * @return           Zero on success, -1 if the expression is incomplete or malformed
+ */
+int search_compile_regexp(search_pattern_t* pattern, const char_t* text, pos_t n);
+
+/**
+ * Release the resources of a pattern
+ * 
+ * @param  pattern  The pattern
+ */
+void search_free(search_pattern_t* pattern);
+
+/**
+ * Find the first occurrence of a pattern in a line
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line
+ * @param   from     The first column the occurrence may start at
+ * @return           The column the occurrence starts at, -1 if not found
+ */
+pos_t search_line(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t from);
+
+/**
+ * Find the last occurrence of a pattern in a line
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line
+ * @param   before   The occurrence must start before this column
+ * @return           The column the occurrence starts at, -1 if not found
+ */
+pos_t search_line_backward(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t before);
+
+/**
+ * Get the length of an occurrence of a pattern
+ * 
+ * @param   pattern  The pattern
+ * @param   lbuf     The line of the occurrence
+ * @param   column   The column the occurrence starts at
+ * @return           The number of characters in the occurrence
+ */
+pos_t search_length(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t column);
+
+/**
+ * Count the occurrences of a pattern in a line, occurrences do not overlap
+ * 
+ * @param   pattern  The pattern, must not be empty
+ * @param   lbuf     The line
+ * @param   before   Only occurrences that start before this column are counted
+ * @return           The number of occurrences
+ */
+size_t search_count_line(const search_pattern_t* pattern, const line_buffer_t* lbuf, pos_t before);
+
+/**
+ * Count the occurrences of a pattern in consecutive well-formed lines that are still views
+ * into their file, occurrences do not overlap, and cannot span lines
+ * 
+ * @param   pattern  The pattern, must not be empty
+ * @param   run      The content of the first line
+ * @param   end      The end of the content of the last line
+ * @return           The number of occurrences
+ */
+size_t search_count_run(const search_pattern_t* pattern, const char* run, const char* end);
+
+/**
+ * Count the occurrences of a pattern in whole lines, occurrences do not overlap
+ * 
+ * @param   pattern  The pattern, must not be empty
+ * @param   doc      The document
+ * @param   first    The first line to search
+ * @param   stop     The line after the last line to search
+ * @return           The number of occurrences
+ */
+size_t search_count_rows(const search_pattern_t* pattern, const document_t* doc, pos_t first, pos_t stop);
+
+/**
+ * Find the first occurrence of a pattern in a document at or after a position
+ * 
+ * @param   pattern  The pattern
+ * @param   doc      The document
+ * @param   clean    The number of lines at the beginning of the document that are well-formed views
+ *                   into the file, back to back, they are searched without being looked at, see `clean_lines`
+ * @param   row      The line to start at, set to the line of the occurrence, or the line to continue at
+ * @param   column   The column to start at, set to the column of the occurrence, or zero
+ * @param   lines    The number of whole lines to search before giving up
+ * @return           1 if found, 0 if the end of the document was reached, -1 if the search gave up
+ */
+int search_forward(const search_pattern_t* pattern, const document_t* doc, pos_t clean,
+		   pos_t* row, pos_t* column, pos_t lines);
+
+/**
+ * Find the last occurrence of a pattern in a document that starts before a position
+ * 
+ * @param   pattern  The pattern
+ * @param   doc      The document
+ * @param   clean    The number of lines at the beginning of the document that are well-formed views
+ *                   into the file, back to back, they are searched without being looked at, see `clean_lines`
+ * @param   row      The line of the position, may be the number of lines in the document,
+ *                   set to the line of the occurrence, or the line to continue before
+ * @param   column   The column of the position, set to the column of the occurrence, or zero
+ * @param   lines    The number of whole lines to search before giving up
+ * @return           1 if found, 0 if the beginning of the document was reached, -1 if the search gave up
+ */
+int search_backward(const search_pattern_t* pattern, const document_t* doc, pos_t clean,
+		    pos_t* row, pos_t* column, pos_t lines);
+
+
+#endif
@@ -0,0 +1,599 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "undo.h"
+
+
+
+/**
+ * Round an offset in an undo log up to the alignment of records
+ * 
+ * @param   N  The offset
+ * @return     The aligned offset
+ */
+#define ALIGN_RECORD(N)  (((N) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+
+
+
+/**
+ * Protects the queue of journals that wait to be synchronised
+ */
+static pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signals that journals have been queued to be synchronised
+ */
+static pthread_cond_t sync_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * The journals that wait to be synchronised
+ */
+static undo_sync_t* sync_queue = NULL;
+
+/**
+ * The number of elements in `sync_queue`
+ */
+static size_t sync_queued = 0;
+
+/**
+ * The number of elements that fit in `sync_queue`
+ */
+static size_t sync_allocated = 0;
+
+/**
+ * Whether the thread that synchronises the journals has been started
+ */
+static int syncer_started = 0;
+
+
+
+/**
+ * Get a record in an undo log
+ * 
+ * @param   log     The log
+ * @param   offset  The offset of the record
+ * @return          The record, valid until something is added to the log
+ */
+__attribute__((pure))
+static undo_record_t* record_at(const undo_log_t* log, size_t offset)
+{
+  return (undo_record_t*)(void*)(log->records + offset);
+}
+
+
+/**
+ * Make room for more bytes at the end of an undo log
+ * 
+ * @param  log  The log
+ * @param  n    The number of bytes
+ */
+static void reserve(undo_log_t* log, size_t n)
+{
+  if (log->used + n <= log->allocated)
+    return;
+  log->allocated = log->allocated ? log->allocated << 1 : 4096;
+  while (log->used + n > log->allocated)
+    log->allocated <<= 1;
+  log->records = realloc(log->records, log->allocated);
+}
+
+
+/**
+ * Begin a new record at the end of an undo log
+ * 
+ * @param   log     The log
+ * @param   type    The type of the edit
+ * @param   row     The line the edited text begins on
+ * @param   column  The column the edited text begins at
+ * @return          The record
+ */
+static undo_record_t* begin_record(undo_log_t* log, int_least8_t type, pos_t row, pos_t column)
+{
+  size_t offset = ALIGN_RECORD(log->used);
+  undo_record_t* record;
+  
+  reserve(log, offset - log->used + sizeof(undo_record_t));
+  record = record_at(log, offset);
+  record->previous = log->last;
+  record->size = 0;
+  record->row = record->end_row = row;
+  record->column = record->end_column = column;
+  record->length = 0;
+  record->type = type;
+  log->last = offset;
+  log->used = offset + sizeof(undo_record_t);
+  return record;
+}
+
+
+/**
+ * Add text to the last record in an undo log
+ * 
+ * @param   log       The log
+ * @param   text      The text
+ * @param   n         The number of characters in `text`
+ * @param   backward  Whether to add the characters in reverse order
+ * @return            The record, it may have moved
+ */
+static undo_record_t* extend_record(undo_log_t* log, const char_t* text, pos_t n, int backward)
+{
+  size_t size;
+  pos_t i;
+  
+  reserve(log, (size_t)n * 6);
+  if (backward)
+    for (size = 0, i = n; i--;)
+      size += utf8_encode(text + i, 1, log->records + log->used + size);
+  else
+    size = utf8_encode(text, n, log->records + log->used);
+  
+  log->used += size;
+  record_at(log, log->last)->size += size;
+  record_at(log, log->last)->length += n;
+  return record_at(log, log->last);
+}
+
+
+/**
+ * Decode a record
+ * 
+ * @param  record  The record
+ * @param  edit    Output parameter for the edit
+ */
+static void decode_record(const undo_record_t* record, undo_edit_t* edit)
+{
+  char_t c;
+  pos_t i;
+  
+  edit->type = record->type;
+  edit->row = record->row;
+  edit->column = record->column;
+  edit->length = record->length;
+  edit->text = malloc((size_t)(record->length) * sizeof(char_t));
+  utf8_decode((const char*)(record + 1), record->size, 0, record->length, edit->text);
+  if (record->type == UNDO_DELETE_BACKWARD)
+    for (i = 0; i < edit->length / 2; i++)
+      {
+	c = *(edit->text + i);
+	*(edit->text + i) = *(edit->text + edit->length - 1 - i);
+	*(edit->text + edit->length - 1 - i) = c;
+      }
+}
+
+
+/**
+ * Synchronise the queued journals to disk, forever
+ * 
+ * @param   arg  Not used
+ * @return       Never returns
+ */
+static void* sync_journals(void* arg)
+{
+  struct timespec delay;
+  undo_sync_t* batch;
+  size_t i, n;
+  
+  (void) arg;
+  delay.tv_sec = UNDO_SYNC_DELAY / 1000;
+  delay.tv_nsec = (UNDO_SYNC_DELAY % 1000) * 1000000L;
+  
+  pthread_mutex_lock(&sync_mutex);
+  for (;;)
+    {
+      while (sync_queued == 0)
+	pthread_cond_wait(&sync_cond, &sync_mutex);
+      
+      /* Let the writes that follow shortly be made durable by the same synchronisation */
+      pthread_mutex_unlock(&sync_mutex);
+      nanosleep(&delay, NULL);
+      pthread_mutex_lock(&sync_mutex);
+      
+      batch = sync_queue;
+      n = sync_queued;
+      sync_queue = NULL;
+      sync_queued = sync_allocated = 0;
+      pthread_mutex_unlock(&sync_mutex);
+      for (i = 0; i < n; i++)
+	{
+	  fdatasync((batch + i)->fd);
+	  close((batch + i)->fd);
+	}
+      free(batch);
+      pthread_mutex_lock(&sync_mutex);
+    }
+  
+  return NULL;
+}
+
+
+/**
+ * Queue the journal of an undo log to be synchronised to disk
+ * 
+ * @param  log  The log
+ */
+static void queue_sync(const undo_log_t* log)
+{
+  pthread_t thread;
+  size_t i;
+  int fd;
+  
+  pthread_mutex_lock(&sync_mutex);
+  for (i = 0; i < sync_queued; i++)
+    if ((sync_queue + i)->log == log)
+      {
+	pthread_mutex_unlock(&sync_mutex);
+	return;
+      }
+  
+  if (!syncer_started)
+    {
+      if (pthread_create(&thread, NULL, sync_journals, NULL))
+	{
+	  /* Without the thread, the journal is synchronised right away */
+	  pthread_mutex_unlock(&sync_mutex);
+	  fdatasync(log->journal);
+	  return;
+	}
+      pthread_detach(thread);
+      syncer_started = 1;
+    }
+  
+  /* The journal may be closed before it is synchronised, so the thread gets its own descriptor */
+  if ((fd = dup(log->journal)) >= 0)
+    {
+      if (sync_queued == sync_allocated)
+	sync_queue = realloc(sync_queue, (sync_allocated = sync_allocated ? sync_allocated << 1 : 8) * sizeof(undo_sync_t));
+      (sync_queue + sync_queued)->log = log;
+      (sync_queue + sync_queued++)->fd = fd;
+      pthread_cond_signal(&sync_cond);
+    }
+  pthread_mutex_unlock(&sync_mutex);
+}
+
+
+/**
+ * Write bytes to a journal
+ * 
+ * @param   log     The log the journal belongs to
+ * @param   offset  The offset in the log of the bytes
+ * @param   n       The number of bytes
+ * @return          Zero on success, otherwise an error code
+ */
+static int write_journal(const undo_log_t* log, size_t offset, size_t n)
+{
+  const char* data = log->records + offset;
+  off_t position = log->journal_offset + (off_t)(offset - log->journal_start);
+  ssize_t wrote;
+  
+  while (n)
+    {
+      if ((wrote = pwrite(log->journal, data, n, position)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return errno;
+	}
+      data += wrote;
+      position += wrote;
+      n -= (size_t)wrote;
+    }
+  return 0;
+}
+
+
+/**
+ * Get the last record in an undo log, if the next edit may be merged into it
+ * 
+ * @param   log  The log
+ * @return       The record, `NULL` if none or if the log is sealed
+ */
+static undo_record_t* open_record(undo_log_t* log)
+{
+  /* An edit that is not part of an undo ends the sequence of undos */
+  if (!(log->flags & UNDO_REVERTING))
+    log->flags &= (int_least8_t)~UNDO_CHAIN;
+  if ((log->flags & UNDO_SEALED) || (log->last == UNDO_NONE))
+    return NULL;
+  return record_at(log, log->last);
+}
+
+
+
+/**
+ * Create an empty undo log
+ * 
+ * @param  log  The log
+ */
+void undo_create(undo_log_t* log)
+{
+  log->records = NULL;
+  log->used = log->allocated = 0;
+  log->last = log->pending = UNDO_NONE;
+  log->journal = -1;
+  log->journal_start = log->journal_written = 0;
+  log->journal_offset = 0;
+  log->journal_last = UNDO_NONE;
+  log->flags = UNDO_SEALED;
+}
+
+
+/**
+ * Release the resources of an undo log
+ * 
+ * @param  log  The log
+ */
+void undo_free(undo_log_t* log)
+{
+  undo_journal_close(log);
+  free(log->records);
+  log->records = NULL;
+}
+
+
+/**
+ * Record that text has been inserted
+ * 
+ * @param  log     The log
+ * @param  row     The line the text was inserted on
+ * @param  column  The column the text was inserted at
+ * @param  text    The inserted text, either without line breaks or a single `\n`
+ * @param  n       The number of characters in `text`
+ */
+void undo_insert(undo_log_t* log, pos_t row, pos_t column, const char_t* text, pos_t n)
+{
+  undo_record_t* record;
+  
+  if (n == 0)
+    return;
+  
+  /* Text that is inserted where the last insertion ended continues it */
+  record = open_record(log);
+  if ((record == NULL) || (record->type != UNDO_INSERT) ||
+      (record->end_row != row) || (record->end_column != column))
+    record = begin_record(log, UNDO_INSERT, row, column);
+  
+  record = extend_record(log, text, n, 0);
+  if (*text == '\n')
+    {
+      record->end_row = row + 1;
+      record->end_column = 0;
+    }
+  else
+    record->end_column = column + n;
+  log->flags &= (int_least8_t)~UNDO_SEALED;
+}
+
+
+/**
+ * Record that text has been deleted
+ * 
+ * @param  log       The log
+ * @param  row       The line the deleted text began on
+ * @param  column    The column the deleted text began at
+ * @param  text      The deleted text, in order, with `\n` for line breaks
+ * @param  n         The number of characters in `text`
+ * @param  backward  Whether the text was deleted from before the point
+ */
+void undo_delete(undo_log_t* log, pos_t row, pos_t column, const char_t* text, pos_t n, int backward)
+{
+  undo_record_t* record;
+  int merge = 0;
+  
+  if (n == 0)
+    return;
+  
+  /* Text deleted where the last deletion began either followed it,
+   * or preceded it, which a single deleted character can be turned into */
+  if ((record = open_record(log)))
+    {
+      if (backward && (n == 1) && ((record->type == UNDO_DELETE_BACKWARD) ||
+				   ((record->type == UNDO_DELETE) && (record->length == 1))))
+	merge = (*text == '\n') ? ((record->row == row + 1) && (record->column == 0))
+				: ((record->row == row) && (record->column == column + 1));
+      else if (!backward)
+	merge = (record->type == UNDO_DELETE) && (record->row == row) && (record->column == column);
+    }
+  
+  if (merge && backward)
+    {
+      record->type = UNDO_DELETE_BACKWARD;
+      record->row = record->end_row = row;
+      record->column = record->end_column = column;
+    }
+  else if (!merge)
+    begin_record(log, backward ? UNDO_DELETE_BACKWARD : UNDO_DELETE, row, column);
+  
+  extend_record(log, text, n, backward);
+  log->flags &= (int_least8_t)~UNDO_SEALED;
+}
+
+
+/**
+ * Take the next edit to revert, starting a sequence of undos from the last
+ * record if none is in progress, the edits that are recorded until
+ * `undo_boundary` is called are assumed to revert it
+ * 
+ * @param   log   The log
+ * @param   edit  Output parameter for the edit
+ * @return        Whether there was an edit to revert
+ */
+int undo_pop(undo_log_t* log, undo_edit_t* edit)
+{
+  undo_record_t* record;
+  
+  if (!(log->flags & UNDO_CHAIN))
+    {
+      log->pending = log->last;
+      log->flags |= UNDO_CHAIN;
+    }
+  if (log->pending == UNDO_NONE)
+    return 0;
+  
+  record = record_at(log, log->pending);
+  decode_record(record, edit);
+  
+  log->pending = record->previous;
+  log->flags |= UNDO_REVERTING | UNDO_SEALED;
+  return 1;
+}
+
+
+/**
+ * End the edits of a command, so that later edits are not merged with them
+ * 
+ * @param  log  The log
+ */
+void undo_boundary(undo_log_t* log)
+{
+  log->flags &= (int_least8_t)~UNDO_REVERTING;
+  log->flags |= UNDO_SEALED;
+}
+
+
+/**
+ * End the current sequence of undos, so that the next undo reverts the undos, that is, redoes
+ * 
+ * @param  log  The log
+ */
+void undo_switch(undo_log_t* log)
+{
+  log->flags &= (int_least8_t)~UNDO_CHAIN;
+  log->flags |= UNDO_SEALED;
+}
+
+
+/**
+ * Start writing the records that are added to an undo log to a journal
+ * 
+ * @param  log     The log
+ * @param  fd      The journal, the log takes over the file descriptor
+ * @param  offset  The position in the journal to write the first record to
+ */
+void undo_journal_open(undo_log_t* log, int fd, off_t offset)
+{
+  undo_journal_close(log);
+  log->journal = fd;
+  log->journal_offset = offset;
+  log->journal_written = log->journal_start;
+  log->journal_last = UNDO_NONE;
+}
+
+
+/**
+ * Stop writing an undo log to its journal, if it has one
+ * 
+ * @param  log  The log
+ */
+void undo_journal_close(undo_log_t* log)
+{
+  if (log->journal >= 0)
+    close(log->journal);
+  log->journal = -1;
+}
+
+
+/**
+ * Check whether an undo log has records that have not been written to a journal
+ * 
+ * @param   log  The log
+ * @return       Whether there are records to write
+ */
+int undo_journal_pending(const undo_log_t* log)
+{
+  return log->used > (log->journal >= 0 ? log->journal_written : log->journal_start);
+}
+
+
+/**
+ * Write the new records in an undo log to its journal, they are synchronised to disk
+ * in the background, together with the other writes made shortly after them
+ * 
+ * @param   log   The log
+ * @param   sync  Whether to synchronise the journal to disk before returning
+ * @return        Zero on success, otherwise an error code
+ */
+int undo_journal_flush(undo_log_t* log, int sync)
+{
+  int error = 0;
+  
+  if (log->journal < 0)
+    return 0;
+  
+  if (log->used > log->journal_written)
+    {
+      /* The last record that was written may have grown since then */
+      if (log->journal_last != UNDO_NONE)
+	error = write_journal(log, log->journal_last, sizeof(undo_record_t));
+      if (error == 0)
+	error = write_journal(log, log->journal_written, log->used - log->journal_written);
+      if (error)
+	return error;
+      log->journal_written = log->used;
+      log->journal_last = log->last;
+      if (!sync)
+	queue_sync(log);
+    }
+  
+  if (sync && fdatasync(log->journal))
+    return errno;
+  return 0;
+}
+
+
+/**
+ * Forget the records in an undo log, as far as its journal is concerned,
+ * so that only the records that are added after them are written to it
+ * 
+ * @param  log  The log
+ */
+void undo_journal_skip(undo_log_t* log)
+{
+  log->flags |= UNDO_SEALED;
+  log->journal_start = log->journal_written = ALIGN_RECORD(log->used);
+  log->journal_last = UNDO_NONE;
+}
+
+
+/**
+ * Read a record from a journal
+ * 
+ * @param   records  The records in the journal, aligned to `size_t`
+ * @param   size     The number of bytes in `records`
+ * @param   offset   The offset of the record, will be updated to the offset after it
+ * @param   edit     Output parameter for the edit
+ * @return           Whether there was a complete record
+ */
+int undo_journal_read(const char* records, size_t size, size_t* offset, undo_edit_t* edit)
+{
+  size_t at = ALIGN_RECORD(*offset);
+  const undo_record_t* record;
+  
+  if ((at > size) || (size - at < sizeof(undo_record_t)))
+    return 0;
+  record = (const undo_record_t*)(const void*)(records + at);
+  
+  /* The end of the journal may have been torn by a crash */
+  if ((record->type < UNDO_INSERT) || (record->type > UNDO_DELETE_BACKWARD) || (record->length <= 0) ||
+      (record->row < 0) || (record->column < 0) || (record->size < (size_t)(record->length)) ||
+      (record->size > (size_t)(record->length) * 6) || (record->size > size - at - sizeof(undo_record_t)))
+    return 0;
+  
+  decode_record(record, edit);
+  *offset = at + sizeof(undo_record_t) + record->size;
+  return 1;
+}
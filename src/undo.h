@@ -0,0 +1,368 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __UNDO_H__
+#define __UNDO_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "utf8.h"
+
+
+
+/**
+ * The number of milliseconds to wait after writes to journals before they are synchronised
+ * to disk, so that the writes made during that time are made durable together
+ */
+#ifndef UNDO_SYNC_DELAY
+#define UNDO_SYNC_DELAY  500
+#endif
+
+
+
+/**
+ * Text was inserted at the position
+ */
+#define  UNDO_INSERT  0
+
+/**
+ * Text was deleted after the position
+ */
+#define  UNDO_DELETE  1
+
+/**
+ * Text was deleted before the point, ending where the previous deletion began,
+ * the text is stored backwards so that the record can grow at its end
+ */
+#define  UNDO_DELETE_BACKWARD  2
+
+
+/**
+ * The undo log is in a sequence of undos
+ */
+#define  UNDO_CHAIN  1
+
+/**
+ * The edits that are being recorded revert an earlier edit
+ */
+#define  UNDO_REVERTING  2
+
+/**
+ * The next edit shall not be merged into the last record
+ */
+#define  UNDO_SEALED  4
+
+
+/**
+ * Marks the absence of a record
+ */
+#define  UNDO_NONE  SIZE_MAX
+
+
+
+/**
+ * The header of a record in an undo log, followed by the
+ * UTF-8 encoded text of the edit, line breaks included
+ */
+typedef struct undo_record
+{
+  /**
+   * The offset of the previous record in the log, `UNDO_NONE` if none
+   */
+  size_t previous;
+  
+  /**
+   * The number of bytes of text after the header
+   */
+  size_t size;
+  
+  /**
+   * The line the edited text begins on
+   */
+  pos_t row;
+  
+  /**
+   * The column the edited text begins at
+   */
+  pos_t column;
+  
+  /**
+   * The line where the next edit has to be made to be merged into the record
+   */
+  pos_t end_row;
+  
+  /**
+   * The column where the next edit has to be made to be merged into the record
+   */
+  pos_t end_column;
+  
+  /**
+   * The number of characters in the text, line breaks included
+   */
+  pos_t length;
+  
+  /**
+   * `UNDO_INSERT`, `UNDO_DELETE` or `UNDO_DELETE_BACKWARD`
+   */
+  int_least8_t type;
+  
+} undo_record_t;
+
+
+/**
+ * The edits that have been made in a frame, records are only ever
+ * appended, reverting an edit is recorded as another edit
+ */
+typedef struct undo_log
+{
+  /**
+   * The records, each aligned to `size_t`
+   */
+  char* records;
+  
+  /**
+   * The number of used bytes in `records`
+   */
+  size_t used;
+  
+  /**
+   * The number of allocated bytes in `records`
+   */
+  size_t allocated;
+  
+  /**
+   * The offset of the last record, `UNDO_NONE` if none
+   */
+  size_t last;
+  
+  /**
+   * The offset of the record that is reverted next in a sequence of undos, `UNDO_NONE` if none is left
+   */
+  size_t pending;
+  
+  /**
+   * The file the records are written to, -1 if none
+   */
+  int journal;
+  
+  /**
+   * The offset of the first record that is written to the journal
+   */
+  size_t journal_start;
+  
+  /**
+   * The position in the journal of the first record that is written to it
+   */
+  off_t journal_offset;
+  
+  /**
+   * The number of bytes of the log that have been written to the journal
+   */
+  size_t journal_written;
+  
+  /**
+   * The offset of the last record when the journal was written, `UNDO_NONE`
+   * if none, its header is written again because the record may have grown
+   */
+  size_t journal_last;
+  
+  /**
+   * The state of the log
+   */
+  int_least8_t flags;
+  
+} undo_log_t;
+
+
+/**
+ * A journal that waits to be synchronised to disk
+ */
+typedef struct undo_sync
+{
+  /**
+   * The undo log the journal belongs to
+   */
+  const undo_log_t* log;
+  
+  /**
+   * A duplicate of the file descriptor of the journal, that is closed once it has been synchronised
+   */
+  int fd;
+  
+} undo_sync_t;
+
+
+/**
+ * An edit that has been taken from an undo log
+ */
+typedef struct undo_edit
+{
+  /**
+   * `UNDO_INSERT`, `UNDO_DELETE` or `UNDO_DELETE_BACKWARD`
+   */
+  int_least8_t type;
+  
+  /**
+   * The line the edited text begins on
+   */
+  pos_t row;
+  
+  /**
+   * The column the edited text begins at
+   */
+  pos_t column;
+  
+  /**
+   * The edited text, in order, with `\n` for line breaks, free with `free`
+   */
+  char_t* text;
+  
+  /**
+   * The number of characters in `text`
+   */
+  pos_t length;
+  
+} undo_edit_t;
+
+
+
+/**
+ * Create an empty undo log
+ * 
+ * @param  log  The log
+ */
+void undo_create(undo_log_t* log);
+
+/**
+ * Release the resources of an undo log
+ * 
+ * @param  log  The log
+ */
+void undo_free(undo_log_t* log);
+
+/**
+ * Record that text has been inserted
+ * 
+ * @param  log     The log
+ * @param  row     The line the text was inserted on
+ * @param  column  The column the text was inserted at
+ * @param  text    The inserted text, either without line breaks or a single `\n`
+ * @param  n       The number of characters in `text`
+ */
+void undo_insert(undo_log_t* log, pos_t row, pos_t column, const char_t* text, pos_t n);
+
+/**
+ * Record that text has been deleted
+ * 
+ * @param  log       The log
+ * @param  row       The line the deleted text began on
+ * @param  column    The column the deleted text began at
+ * @param  text      The deleted text, in order, with `\n` for line breaks
+ * @param  n         The number of characters in `text`
+ * @param  backward  Whether the text was deleted from before the point
+ */
+void undo_delete(undo_log_t* log, pos_t row, pos_t column, const char_t* text, pos_t n, int backward);
+
+/**
+ * Take the next edit to revert, starting a sequence of undos from the last
+ * record if none is in progress, the edits that are recorded until
+ * `undo_boundary` is called are assumed to revert it
+ * 
+ * @param   log   The log
+ * @param   edit  Output parameter for the edit
+ * @return        Whether there was an edit to revert
+ */
+int undo_pop(undo_log_t* log, undo_edit_t* edit);
+
+/**
+ * End the edits of a command, so that later edits are not merged with them
+ * 
+ * @param  log  The log
+ */
+void undo_boundary(undo_log_t* log);
+
+/**
+ * End the current sequence of undos, so that the next undo reverts the undos, that is, redoes
+ * 
+ * @param  log  The log
+ */
+void undo_switch(undo_log_t* log);
+
+/**
+ * Start writing the records that are added to an undo log to a journal
+ * 
+ * @param  log     The log
+ * @param  fd      The journal, the log takes over the file descriptor
+ * @param  offset  The position in the journal to write the first record to
+ */
+void undo_journal_open(undo_log_t* log, int fd, off_t offset);
+
+/**
+ * Stop writing an undo log to its journal, if it has one
+ * 
+ * @param  log  The log
+ */
+void undo_journal_close(undo_log_t* log);
+
+/**
+ * Check whether an undo log has records that have not been written to a journal
+ * 
+ * @param   log  The log
+ * @return       Whether there are records to write
+ */
+int undo_journal_pending(const undo_log_t* log) __attribute__((pure));
+
+/**
+ * Write the new records in an undo log to its journal, they are synchronised to disk
+ * in the background, together with the other writes made shortly after them
+ * 
+ * @param   log   The log
+ * @param   sync  Whether to synchronise the journal to disk before returning
+ * @return        Zero on success, otherwise an error code
+ */
+int undo_journal_flush(undo_log_t* log, int sync);
+
+/**
+ * Forget the records in an undo log, as far as its journal is concerned,
+ * so that only the records that are added after them are written to it
+ * 
+ * @param  log  The log
+ */
+void undo_journal_skip(undo_log_t* log);
+
+/**
+ * Read a record from a journal
+ * 
+ * @param   records  The records in the journal, aligned to `size_t`
+ * @param   size     The number of bytes in `records`
+ * @param   offset   The offset of the record, will be updated to the offset after it
+ * @param   edit     Output parameter for the edit
+ * @return           Whether there was a complete record
+ */
+int undo_journal_read(const char* records, size_t size, size_t* offset, undo_edit_t* edit);
+
+
+#endif
@@ -0,0 +1,493 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define HAVE_X86_KERNELS
+#endif
+
+
+
+/**
+ * Vectorisable primitives for UTF-8 scanning, each kernel
+ * only handles whole blocks and leaves the rest to the caller
+ */
+typedef struct utf8_kernels
+{
+  /**
+   * Scan text for a line break
+   * 
+   * @param   buffer  The text
+   * @param   size    The number of bytes in `buffer`
+   * @param   chars   Incremented by the number of characters in the scanned bytes
+   * @param   high    Bitwise OR:ed with non-zero if any scanned byte is not ASCII
+   * @return          The number of scanned bytes, the index of the line break if one was found
+   */
+  size_t (*line)(const char* buffer, size_t size, pos_t* chars, unsigned* high);
+  
+  /**
+   * Skip over characters
+   * 
+   * @param   buffer  The text
+   * @param   size    The number of bytes in `buffer`
+   * @param   skip    The number of characters to skip, decremented by the number of skipped characters
+   * @return          The number of skipped bytes, it will not go past the first byte of the last character to skip
+   */
+  size_t (*skip)(const char* buffer, size_t size, pos_t* skip);
+  
+  /**
+   * Widen ASCII text
+   * 
+   * @param   buffer  The text
+   * @param   size    The maximum number of bytes to widen
+   * @param   output  Output buffer for the characters
+   * @return          The number of widened bytes, stops before the first block with a non-ASCII byte
+   */
+  size_t (*widen)(const char* buffer, size_t size, char_t* output);
+  
+} utf8_kernels_t;
+
+
+/**
+ * Whether a byte is the first byte of a character
+ */
+#define IS_LEAD(BYTE)  ((*(BYTE) & 0xC0) != 0x80)
+
+
+
+static size_t line_scalar(const char* buffer, size_t size, pos_t* chars, unsigned* high)
+{
+  (void) buffer, (void) size, (void) chars, (void) high;
+  return 0;
+}
+
+static size_t skip_scalar(const char* buffer, size_t size, pos_t* skip)
+{
+  (void) buffer, (void) size, (void) skip;
+  return 0;
+}
+
+static size_t widen_scalar(const char* buffer, size_t size, char_t* output)
+{
+  (void) buffer, (void) size, (void) output;
+  return 0;
+}
+
+/**
+ * Kernels for machines without vector instructions, the callers' scalar loops do all the work
+ */
+static const utf8_kernels_t scalar_kernels = { line_scalar, skip_scalar, widen_scalar };
+
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+static size_t line_sse2(const char* buffer, size_t size, pos_t* chars, unsigned* high)
+{
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i last_continuation = _mm_set1_epi8((char)0xBF);
+  size_t i = 0;
+  
+  for (; i + 16 <= size; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(buffer + i));
+      unsigned nl = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+      unsigned lead = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, last_continuation));
+      unsigned hi = (unsigned)_mm_movemask_epi8(v);
+      if (nl)
+	{
+	  /* Only count the bytes before the line break */
+	  unsigned before = (nl & -nl) - 1;
+	  *chars += __builtin_popcount(lead & before);
+	  *high |= hi & before;
+	  return i + (size_t)__builtin_ctz(nl);
+	}
+      *chars += __builtin_popcount(lead);
+      *high |= hi;
+    }
+  
+  return i;
+}
+
+__attribute__((target("sse2")))
+static size_t skip_sse2(const char* buffer, size_t size, pos_t* skip)
+{
+  const __m128i last_continuation = _mm_set1_epi8((char)0xBF);
+  size_t i = 0;
+  
+  for (; i + 16 <= size; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(buffer + i));
+      pos_t leads = __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, last_continuation)));
+      if (leads > *skip)
+	break;
+      *skip -= leads;
+    }
+  
+  return i;
+}
+
+__attribute__((target("sse2")))
+static size_t widen_sse2(const char* buffer, size_t size, char_t* output)
+{
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  
+  for (; i + 16 <= size; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(buffer + i));
+      if (_mm_movemask_epi8(v))
+	break;
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+      __m128i* out = (__m128i*)(void*)(output + i);
+      _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo, zero));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+      _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+      _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+  
+  return i;
+}
+
+/**
+ * Kernels for machines with SSE2
+ */
+static const utf8_kernels_t sse2_kernels = { line_sse2, skip_sse2, widen_sse2 };
+
+
+__attribute__((target("avx2,popcnt")))
+static size_t line_avx2(const char* buffer, size_t size, pos_t* chars, unsigned* high)
+{
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i last_continuation = _mm256_set1_epi8((char)0xBF);
+  size_t i = 0;
+  
+  for (; i + 32 <= size; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(buffer + i));
+      unsigned nl = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline));
+      unsigned lead = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, last_continuation));
+      unsigned hi = (unsigned)_mm256_movemask_epi8(v);
+      if (nl)
+	{
+	  /* Only count the bytes before the line break */
+	  unsigned before = (nl & -nl) - 1;
+	  *chars += __builtin_popcount(lead & before);
+	  *high |= hi & before;
+	  return i + (size_t)__builtin_ctz(nl);
+	}
+      *chars += __builtin_popcount(lead);
+      *high |= hi;
+    }
+  
+  return i;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t skip_avx2(const char* buffer, size_t size, pos_t* skip)
+{
+  const __m256i last_continuation = _mm256_set1_epi8((char)0xBF);
+  size_t i = 0;
+  
+  for (; i + 32 <= size; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(buffer + i));
+      pos_t leads = __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, last_continuation)));
+      if (leads > *skip)
+	break;
+      *skip -= leads;
+    }
+  
+  return i;
+}
+
+__attribute__((target("avx2")))
+static size_t widen_avx2(const char* buffer, size_t size, char_t* output)
+{
+  size_t i = 0;
+  
+  for (; i + 32 <= size; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(buffer + i));
+      if (_mm256_movemask_epi8(v))
+	break;
+      __m256i* out = (__m256i*)(void*)(output + i);
+      __m128i lo = _mm256_castsi256_si128(v);
+      __m128i hi = _mm256_extracti128_si256(v, 1);
+      _mm256_storeu_si256(out + 0, _mm256_cvtepu8_epi32(lo));
+      _mm256_storeu_si256(out + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+      _mm256_storeu_si256(out + 2, _mm256_cvtepu8_epi32(hi));
+      _mm256_storeu_si256(out + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+    }
+  
+  return i;
+}
+
+/**
+ * Kernels for machines with AVX2
+ */
+static const utf8_kernels_t avx2_kernels = { line_avx2, skip_avx2, widen_avx2 };
+
+#endif
+
+
+/**
+ * Select the best kernels the machine supports
+ * 
+ * @return  The kernels to use
+ */
+static const utf8_kernels_t* select_kernels(void)
+{
+  static const utf8_kernels_t* selected = NULL;
+  const utf8_kernels_t* kernels = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+  if (kernels)
+    return kernels;
+  
+  /* Files can be read on multiple threads, they will all select the same kernels */
+  kernels = &scalar_kernels;
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    kernels = &avx2_kernels;
+  else if (__builtin_cpu_supports("sse2"))
+    kernels = &sse2_kernels;
+#endif
+  __atomic_store_n(&selected, kernels, __ATOMIC_RELAXED);
+  return kernels;
+}
+
+
+
+/**
+ * Count the number of characters in UTF-8 encoded text
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @return          The number of characters `buffer` decodes into
+ */
+pos_t utf8_length(const char* buffer, size_t size)
+{
+  /* Skipping as many characters as there are bytes counts the characters of every whole block */
+  pos_t skip = (pos_t)size;
+  size_t i = select_kernels()->skip(buffer, size, &skip);
+  pos_t chars = (pos_t)size - skip;
+  for (; i < size; i++)
+    if (IS_LEAD(buffer + i))
+      chars++;
+  return chars;
+}
+
+
+/**
+ * Find where a character begins in UTF-8 encoded text
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @param   index   The index of the character
+ * @return          The number of bytes before the character, `size` if the text is shorter
+ */
+size_t utf8_offset(const char* buffer, size_t size, pos_t index)
+{
+  size_t i = select_kernels()->skip(buffer, size, &index);
+  for (; i < size; i++)
+    if (IS_LEAD(buffer + i))
+      {
+	if (index == 0)
+	  break;
+	index--;
+      }
+  return i;
+}
+
+
+/**
+ * Find the end of the first line in UTF-8 encoded text
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @param   chars   Output parameter for the number of characters in the line
+ * @param   ascii   Output parameter for whether the line only contains ASCII characters
+ * @return          The number of bytes in the line, excluding the line break,
+ *                  `size` if the text does not contain a line break
+ */
+size_t utf8_line(const char* buffer, size_t size, pos_t* chars, int* ascii)
+{
+  unsigned high = 0;
+  size_t i;
+  
+  *chars = 0;
+  i = select_kernels()->line(buffer, size, chars, &high);
+  for (; (i < size) && (*(buffer + i) != '\n'); i++)
+    {
+      if (IS_LEAD(buffer + i))
+	++*chars;
+      high |= (unsigned)*(buffer + i) & 0x80;
+    }
+  
+  *ascii = high == 0;
+  return i;
+}
+
+
+/**
+ * Check whether UTF-8 encoded text is well-formed
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @return          Whether the text is well-formed
+ */
+int utf8_valid(const char* buffer, size_t size)
+{
+  const unsigned char* text = (const unsigned char*)buffer;
+  size_t i = 0;
+  
+  while (i < size)
+    {
+      unsigned c = *(text + i++);
+      unsigned n, value, min;
+      if (c < 0x80)
+	continue;
+      else if ((c & 0xE0) == 0xC0)
+	n = 1, value = c & 0x1F, min = 0x80;
+      else if ((c & 0xF0) == 0xE0)
+	n = 2, value = c & 0x0F, min = 0x800;
+      else if ((c & 0xF8) == 0xF0)
+	n = 3, value = c & 0x07, min = 0x10000;
+      else
+	return 0;
+      if (n > size - i)
+	return 0;
+      for (; n; n--)
+	{
+	  if ((*(text + i) & 0xC0) != 0x80)
+	    return 0;
+	  value = (value << 6) | (*(text + i++) & 0x3F);
+	}
+      /* Reject overlong encodings, surrogates and values beyond Unicode */
+      if ((value < min) || ((0xD800 <= value) && (value <= 0xDFFF)) || (value > 0x10FFFF))
+	return 0;
+    }
+  
+  return 1;
+}
+
+
+/**
+ * Decode UTF-8 encoded text
+ * 
+ * Continuation bytes are merged into the preceding character,
+ * continuation bytes without a preceding character are discarded
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @param   skip    The number of characters to skip in the beginning of `buffer`
+ * @param   n       The maximum number of characters to decode
+ * @param   output  Output buffer for the decoded characters
+ * @return          The number of characters stored in `output`
+ */
+pos_t utf8_decode(const char* buffer, size_t size, pos_t skip, pos_t n, char_t* output)
+{
+  const utf8_kernels_t* kernels = select_kernels();
+  size_t i, scalar_until = 0;
+  pos_t k = -1;
+  
+  /* Find the first byte of the first character to decode */
+  i = kernels->skip(buffer, size, &skip);
+  for (; i < size; i++)
+    if (IS_LEAD(buffer + i))
+      {
+	if (skip == 0)
+	  break;
+	skip--;
+      }
+  
+  /* Decode characters until `n` characters have been decoded and the next character begins */
+  while (i < size)
+    {
+      uint8_t c = (uint8_t)*(buffer + i);
+      if ((c < 0x80) && (i >= scalar_until))
+	{
+	  /* Widen runs of ASCII characters in bulk, but do not retry
+	   * until the block that contained non-ASCII has been passed */
+	  size_t limit = size - i, widened;
+	  if ((size_t)(n - (k + 1)) < limit)
+	    limit = (size_t)(n - (k + 1));
+	  widened = kernels->widen(buffer + i, limit, output + k + 1);
+	  i += widened;
+	  k += (pos_t)widened;
+	  scalar_until = i + 32;
+	  if (widened)
+	    continue;
+	}
+      if ((c & 0xC0) != 0x80)
+	{
+	  int8_t m = 0;
+	  if (k + 1 == n)
+	    break;
+	  while (c & 0x80)
+	    {
+	      m++;
+	      c = (uint8_t)(c << 1);
+	    }
+	  *(output + ++k) = c >> m;
+	}
+      else if (k >= 0)
+	{
+	  *(output + k) <<= 6;
+	  *(output + k) |= c & 0x3F;
+	}
+      i++;
+    }
+  
+  return k + 1;
+}
+
+
+/**
+ * Encode characters as UTF-8
+ * 
+ * @param   text    The characters
+ * @param   n       The number of characters in `text`
+ * @param   output  Output buffer for the encoded text, must have room for 6 bytes per character
+ * @return          The number of bytes stored in `output`
+ */
+size_t utf8_encode(const char_t* text, pos_t n, char* output)
+{
+  char* start = output;
+  char_t c;
+  int i, m;
+  
+  while (n--)
+    {
+      if ((c = *text++) < 0x80)
+	{
+	  *output++ = (char)c;
+	  continue;
+	}
+      m = c < 0x800 ? 1 : c < 0x10000 ? 2 : c < 0x200000 ? 3 : c < 0x4000000 ? 4 : 5;
+      for (i = m; i > 0; i--, c >>= 6)
+	*(output + i) = (char)((c & 0x3F) | 0x80);
+      *output = (char)((0xFF00 >> (m + 1)) | c);
+      output += m + 1;
+    }
+  return (size_t)(output - start);
+}
+
@@ -0,0 +1,97 @@
+/**
+ * Zecora – An minimal Emacs-clone intended for use in emergencies
+ * 
+ * Copyright © 2013, 2014  Mattias Andrée (maandree@member.fsf.org)
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __UTF8_H__
+#define __UTF8_H__
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+
+
+
+/**
+ * Count the number of characters in UTF-8 encoded text
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @return          The number of characters `buffer` decodes into
+ */
+pos_t utf8_length(const char* buffer, size_t size);
+
+/**
+ * Find where a character begins in UTF-8 encoded text
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @param   index   The index of the character
+ * @return          The number of bytes before the character, `size` if the text is shorter
+ */
+size_t utf8_offset(const char* buffer, size_t size, pos_t index);
+
+/**
+ * Find the end of the first line in UTF-8 encoded text
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @param   chars   Output parameter for the number of characters in the line
+ * @param   ascii   Output parameter for whether the line only contains ASCII characters
+ * @return          The number of bytes in the line, excluding the line break,
+ *                  `size` if the text does not contain a line break
+ */
+size_t utf8_line(const char* buffer, size_t size, pos_t* chars, int* ascii);
+
+/**
+ * Check whether UTF-8 encoded text is well-formed
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @return          Whether the text is well-formed
+ */
+int utf8_valid(const char* buffer, size_t size) __attribute__((pure));
+
+/**
+ * Decode UTF-8 encoded text
+ * 
+ * Continuation bytes are merged into the preceding character,
+ * continuation bytes without a preceding character are discarded
+ * 
+ * @param   buffer  The text
+ * @param   size    The number of bytes in `buffer`
+ * @param   skip    The number of characters to skip in the beginning of `buffer`
+ * @param   n       The maximum number of characters to decode
+ * @param   output  Output buffer for the decoded characters
+ * @return          The number of characters stored in `output`
+ */
+pos_t utf8_decode(const char* buffer, size_t size, pos_t skip, pos_t n, char_t* output);
+
+/**
+ * Encode characters as UTF-8
+ * 
+ * @param   text    The characters
+ * @param   n       The number of characters in `text`
+ * @param   output  Output buffer for the encoded text, must have room for 6 bytes per character
+ * @return          The number of bytes stored in `output`
+ */
+size_t utf8_encode(const char_t* text, pos_t n, char* output);
+
+
+#endif
+
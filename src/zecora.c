@@ -24,6 +24,11 @@
  */
 extern frame_t* cur_frame;
 
+/**
+ * Whether the user has asked for the editor to exit
+ */
+extern bool_t quit_requested;
+
 
 
 /**
@@ -40,6 +45,9 @@ int main(int argc, char** argv)
   struct termios saved_stty;
   struct termios stty;
   bool_t file_loaded;
+  char** filenames;
+  file_batch_t* files;
+  size_t n;
   pid_t pid;
   int i;
   int status;
@@ -70,11 +78,14 @@ int main(int argc, char** argv)
   tcgetattr(STDIN_FILENO, &saved_stty);
   tcgetattr(STDIN_FILENO, &stty);
   stty.c_lflag &= (tcflag_t)~(ICANON | ECHO | ISIG);
+  /* Let C-s and C-q through rather than using them for flow control */
+  stty.c_iflag &= (tcflag_t)~IXON;
   tcsetattr(STDIN_FILENO, TCSAFLUSH, &stty);
   
   printf("\033[?1049h"   /* Initialise subterminal, if using an xterm */
 	 "\033[H\033[2J" /* Clear the terminal, subterminal, if initialised is already clean */
-	 "\033[?8c");    /* Switch to block cursor, if using TTY */
+	 "\033[?8c"      /* Switch to block cursor, if using TTY */
+	 "\033[?2004h"); /* Let the terminal mark pasted text, if supported */
   /* Apply the previous instruction */
   fflush(stdout);
   
@@ -89,13 +100,20 @@ int main(int argc, char** argv)
       /* Create an empty buffer not yet associeted with a file */
       create_scratch();
       
-      /* Load files and apply jumps from the command line */
+      /* Read the files from the command line in parallel */
+      filenames = malloc((size_t)argc * sizeof(char*));
+      for (n = 0, i = 1; i < argc; i++)
+	if (**(argv + i) != ':')
+	  *(filenames + n++) = *(argv + i);
+      files = open_files(filenames, n);
+      
+      /* Open the files in order and apply jumps from the command line */
       file_loaded = 0;
-      for (i = 1; i < argc; i++)
+      for (n = 0, i = 1; i < argc; i++)
 	if (**(argv + i) != ':')
 	  {
 	    /* Load file */
-	    file_loaded = open_file(*(argv + i)) == 0;
+	    file_loaded = (files ? add_file(files, n++) : open_file(*(argv + i))) == 0;
 	  }
 	else if (file_loaded)
 	  {
@@ -104,12 +122,21 @@ int main(int argc, char** argv)
 	    file_loaded = 0;
 	  }
       
+      free(files);
+      free(filenames);
+      
       /* Create the screen and start display the files */
+      screen_create(rows, cols);
       create_screen(rows, cols);
       /* Start interaction */
-      read_input(cols);
+      read_input(rows, cols);
+      flush_journals(1);
       
       /* Release resources */
+      screen_free();
+      glyph_free();
+      keymap_free();
+      minibuffer_close();
       free_frames();
       
       /* Do not continue beyond this point if we managed to fork */
@@ -117,7 +144,8 @@ int main(int argc, char** argv)
 	return 0;
     }
   
-  printf("\033[?0c"      /* Restore cursor to default, if using TTY */
+  printf("\033[?2004l"   /* Stop marking pasted text */
+	 "\033[?0c"      /* Restore cursor to default, if using TTY */
 	 "\033[H\033[2J" /* Clear the terminal, useless if in subterminal and not TTY */
 	 "\033[?1049l"); /* Terminate subterminal, if using an xterm */
   /* Apply the previous instruction */
@@ -195,43 +223,65 @@ static void jump(const char* command)
 
 static void create_screen(pos_t rows, pos_t cols)
 {
-  char* spaces;
-  pos_t i;
+  static frame_t* drawn_frame = NULL;
+  static pos_t drawn_first_row = 0;
+  pos_t i, col;
   char* filename;
-  
-  /* Create a line of spaces as large as the screen */
-  spaces = malloc((size_t)(cols + 1) * sizeof(char));
-  for (i = 0; i < cols; i++)
-    *(spaces + i) = ' ';
-  *(spaces + cols) = 0;
+  char buf[64];
+  int attr, counted;
+  size_t match = 0, matches = 0;
+  pos_t prompt_col = -1;
   
   /* Ensure that the point is visible */
   pos_t point_row = cur_frame->row;
   pos_t point_col = cur_frame->column;
-  pos_t point_cols = cur_frame->line_buffers[point_row].used;
-  if (point_col > (pos_t)point_cols)
-    point_col = (pos_t)point_cols;
+  line_buffer_t* point_line = document_line(&(cur_frame->document), point_row);
+  if (point_col > point_line->used)
+    point_col = point_line->used;
+  pos_t point_x = line_column(point_line, point_col);
   if (point_row < cur_frame->first_row)
     cur_frame->first_row = point_row;
   else if (point_row >= cur_frame->first_row + rows - 3)
     cur_frame->first_row = point_row;
-  if (point_col < cur_frame->first_column)
-    cur_frame->first_column = point_col;
-  else if (point_col >= cur_frame->first_column + cols)
-    cur_frame->first_column = point_col;
+  if (point_x < cur_frame->first_column)
+    cur_frame->first_column = point_x;
+  else if (point_x >= cur_frame->first_column + cols)
+    cur_frame->first_column = point_x;
+  
+  /* Let the terminal move the lines that are still visible */
+  if (drawn_frame == cur_frame)
+    screen_scroll(1, rows - 2, cur_frame->first_row - drawn_first_row);
+  drawn_frame = cur_frame;
+  drawn_first_row = cur_frame->first_row;
   
-  /* Create the screen with the current frame, but do not fill it */
-  printf("\033[07m"
-	 "%s"
-	 "\033[1;1H\033[01mZecora  \033[21mPress ESC three times for help"
-	 "\033[27m"
-	 "\033[%li;1H\033[07m"
-	 "%s"
-	 "\033[%li;3H(%li,%li)  ",
-	 spaces, rows - 1, spaces, rows - 1, cur_frame->row + 1, point_col + 1);
+  /* Draw the title bar */
+  screen_clear();
+  screen_fill(0, 0, cols, ATTR_REVERSE);
+  screen_print(0, 0, "Zecora", ATTR_REVERSE | ATTR_BOLD);
+  screen_print(0, 8, "Press ESC three times for help", ATTR_REVERSE);
   
+  /* Draw the mode line */
+  screen_fill(rows - 2, 0, cols, ATTR_REVERSE);
+  snprintf(buf, sizeof(buf), "(%li,%li)  ", cur_frame->row + 1, point_col + 1);
+  col = screen_print(rows - 2, 2, buf, ATTR_REVERSE);
+  if (cur_frame->flags & FLAG_LOADING)
+    {
+      snprintf(buf, sizeof(buf), "Loading %i%%  ", (int)(cur_frame->loaded * 100 / cur_frame->content_size));
+      col = screen_print(rows - 2, col, buf, ATTR_REVERSE);
+    }
+  if ((counted = isearch_count(&match, &matches)) >= 0)
+    {
+      if (counted == 0)
+	snprintf(buf, sizeof(buf), "Counting %zu%%  ", matches);
+      else if (match)
+	snprintf(buf, sizeof(buf), "Match %zu of %zu  ", match, matches);
+      else
+	snprintf(buf, sizeof(buf), "%zu match%s  ", matches, matches == 1 ? "" : "es");
+      col = screen_print(rows - 2, col, buf, ATTR_REVERSE);
+    }
+  attr = ATTR_REVERSE;
   if (cur_frame->flags & FLAG_MODIFIED)
-    printf("\033[41m");
+    attr |= ATTR_BG(1);
   filename = cur_frame->file;
   if (filename)
     {
@@ -240,404 +290,365 @@ static void create_screen(pos_t rows, pos_t cols)
 	if (*(filename + j) == '/')
 	  sep = j;
       *(filename + sep) = 0;
-      printf("%s/\033[01m%s\033[21;27m\n", filename, filename + sep + 1);
+      col = screen_print(rows - 2, col, filename, attr);
       *(filename + sep) = '/';
+      col = screen_print(rows - 2, col, "/", attr);
+      screen_print(rows - 2, col, filename + sep + 1, attr | ATTR_BOLD);
     }
   else
-    printf("\033[01m*scratch*\033[21;27m\n");
-  if (cur_frame->alert)
-    printf("%s", cur_frame->alert);
-  printf("\033[00m\033[2;1H");
+    screen_print(rows - 2, col, "*scratch*", attr | ATTR_BOLD);
+  if (isearch_active())
+    isearch_draw(rows - 1);
+  else if (minibuffer_active())
+    prompt_col = minibuffer_draw(rows - 1);
+  else if (cur_frame->alert)
+    screen_print(rows - 1, 0, cur_frame->alert, 0);
   
   /* Fill the screen */
   pos_t r = cur_frame->row;
-  pos_t n = cur_frame->line_count, m = cur_frame->first_row + rows - 3;
-  line_buffer_t* lines = cur_frame->line_buffers;
+  pos_t n = document_lines(&(cur_frame->document)), m = cur_frame->first_row + rows - 3;
   n = n < m ? n : m;
   cols--;
-  static char ucs_decode_buffer[8];
-  *(ucs_decode_buffer + 7) = 0;
+  static const int class_attrs[] = { 0, ATTR_FG(1), ATTR_FG(2) };
+  const char_t* line;
+  const int_least8_t* classes;
   for (i = cur_frame->first_row; i < n; i++)
     {
-      m = (lines + i)->used;
-      pos_t j = i == r ? cur_frame->first_column : 0;
-      m = m < (cols + j) ? m : (cols + j);
-      char_t* line = (lines + i)->line;
-      /* TODO add support for combining diacriticals */
-      pos_t col = 0;
-      int is_comment = 0;
-      for (; (j < m) && (col < cols); j++)
+      line_buffer_t* lbuf = document_line(&(cur_frame->document), i);
+      pos_t left = i == r ? cur_frame->first_column : 0;
+      pos_t y = i - cur_frame->first_row + 1;
+      pos_t x = 0, end, end_x;
+      pos_t j = left ? line_index(lbuf, left, &x) : 0;
+      pos_t match_start = -1, match_end = -1;
+      isearch_match(i, &match_start, &match_end);
+      
+      /* Only the characters that are shown are highlighted, from the lexer checkpoint before them */
+      end = line_index_from(lbuf, j, x, left + cols, &end_x) + 1;
+      end = j + highlight_line(cur_frame, i, j, end, &line, &classes);
+      
+      /* x is the display column in the line, the character is drawn in the column x - left on the screen */
+      for (; (j < end) && (x - left < cols); j++, line++, classes++)
 	{
-	  char_t c = *(line + j);
-	  if (c == (char_t)'\t')
+	  const glyph_t* glyph = glyph_get(*line);
+	  int text = class_attrs[*classes];
+	  if ((match_start <= j) && (j < match_end))
+	    text = ATTR_BG(5);
+	  col = x - left;
+	  x = glyph->class == GLYPH_TAB ? (x | 7) + 1 : x + glyph->width;
+	  if ((glyph->class == GLYPH_TAB) || (col < 0) || (x - left > cols))
 	    {
-	      printf(" ");
-	      col++;
-	      while ((col < cols) && (col & 7))
-		{
-		  printf(" ");
-		  col++;
-		}
+	      /* Tabs, and characters that are only partially visible, are drawn as spaces */
+	      col = col < 0 ? 0 : col;
+	      screen_fill(y, col, (x - left < cols ? x - left : cols) - col, glyph->class == GLYPH_TAB ? text : 0);
 	      continue;
 	    }
-	  col++;
-	  if ((c & 0x7FFFFFFF) != c) /* should never happend: invalid ucs value */
-	    printf(is_comment ? "\033[41m.\033[00;31m" : "\033[41m.\033[00m");
-	  else if ((0 <= c) && (c < (char_t)' '))
-	    printf(is_comment ? "\033[01m%c\033[21m" : "\033[31m%c\033[00m", '@' + c);
-	  else if (c == 0x2011) /* non-breaking hyphen */
-	    printf(is_comment ? "\033[35m-\033[00m" : "\033[35m-\033[00m");
-	  else if (c == 0x2010) /* hyphen */
-	    printf(is_comment ? "\033[34m-\033[00m" : "\033[34m-\033[00m");
-	  else if (c == 0x00A0) /* no-breaking space */
-	    printf(is_comment ? "\033[45m \033[00;31m" : "\033[45m \033[00m");
-	  else if (c == 0x00AD) /* soft hyphen */
-	    printf(is_comment ? "\033[01m-\033[21m" : "\033[31m-\033[00m");
-	  else if (c < 0x80)
+	  switch (glyph->class)
 	    {
-	      if (c == '#')
-		{
-		  is_comment = 1;
-		  printf("\033[31m");
-		}
-	      printf("%c", c);
-	    }
-	  else
-	    {
-	      long off = 7;
-	      *ucs_decode_buffer = (int8_t)0x80;
-	      if (c < 0)
-		abort();
-	      while (c)
-		{
-		  *(ucs_decode_buffer + --off) = (char)((c & 0x3F) | 0x80);
-		  *ucs_decode_buffer |= (*ucs_decode_buffer) >> 1;
-		  c >>= 6;
-		}
-	      if ((*ucs_decode_buffer) & (*(ucs_decode_buffer + off) & 0x3F))
-		*(ucs_decode_buffer + --off) = (char)((*ucs_decode_buffer) << 1);
-	      else
-		*(ucs_decode_buffer + off) |= (char)((*ucs_decode_buffer) << 1);
-	      printf("%s", ucs_decode_buffer + off);
+	    case GLYPH_INVALID:
+	      attr = ATTR_BG(1);
+	      break;
+	    case GLYPH_CONTROL:
+	    case GLYPH_SOFT_HYPHEN:
+	      attr = text ? text | ATTR_BOLD : ATTR_FG(1);
+	      break;
+	    case GLYPH_NB_HYPHEN:
+	      attr = ATTR_FG(5);
+	      break;
+	    case GLYPH_HYPHEN:
+	      attr = ATTR_FG(4);
+	      break;
+	    case GLYPH_NBSP:
+	      attr = ATTR_BG(5);
+	      break;
+	    default:
+	      attr = text;
+	      break;
 	    }
+	  screen_put(y, col, glyph->shown, attr);
 	}
-      printf("\033[00m\n");
     }
   cols++;
   
-  /* Move the cursor to the position of the point */
-  printf("\033[%li;%liH", point_row - cur_frame->first_row + 2, point_col - cur_frame->first_column + 1);
-  
-  /* Flush the screen */
-  fflush(stdout);
-  
-  free(spaces);
+  /* Send the changes to the terminal and move the cursor to the position of the point, or the minibuffer */
+  if (prompt_col >= 0)
+    screen_flush(rows - 1, prompt_col < cols ? prompt_col : cols - 1);
+  else
+    screen_flush(point_row - cur_frame->first_row + 1, point_x - cur_frame->first_column);
 }
 
 
-static void read_input(pos_t cols)
+static void read_input(pos_t rows, pos_t cols)
 {
-#define CRTL(KEY)  (KEY - '@')
-  
-  int ctrl_x = 0;
-  int meta = 0;
+  keymap_state_t keys;
+  command_t* command;
+  keycode_t key;
+  size_t length;
   ssize_t escape = -1;
   char escape_buffer[16];
+  int after_escape = 0;
+  int was_escape;
+  int number;
+  int utf8_pending = 0;
+  char_t utf8_char = 0;
+  int redraw = 0;
+  int loading = 1;
+  int pasting = 0;
+  int paste_end = 0;
+  int paste_cr = 0;
+  char_t* paste = NULL;
+  pos_t pasted = 0;
+  pos_t paste_size = 0;
+  char buffer[INPUT_BUFFER_SIZE];
+  ssize_t got = 0;
+  ssize_t ptr = 0;
+  ssize_t i;
+  struct pollfd input;
+  
+  input.fd = STDIN_FILENO;
+  input.events = POLLIN;
+  keymap_reset(&keys);
   
-  for (;;)
+  while (!quit_requested)
     {
-      int c = getchar();
-      if (escape >= 0)
+      if (ptr == got)
 	{
-	  if (escape == sizeof(escape_buffer) / sizeof(char))
-	    /* Too long, stop. */
-	    escape = -1;
-	  else
+	  /* Insert what has been pasted so far, the rest of it has not arrived yet */
+	  if (pasted)
+	    insert_pasted(paste, pasted);
+	  pasted = 0;
+	  
+	  /* Update the screen when a command has been completed and there is no more input to process,
+	   * and write the new edits to the journals, without waiting for them to reach the disk */
+	  if ((escape == -1) && (keys.length == 0) && (utf8_pending == 0) && (poll(&input, 1, 0) == 0))
 	    {
-	      if ((('0' <= c) && (c <= '9')) || (c == ';'))
-		escape_buffer[escape++] = c;
-	      else
+	      flush_journals(0);
+	      if (notice_truncated())
+		redraw = 1;
+	      if (!isearch_active() && offer_recovery())
+		redraw = 1;
+	      if (redraw)
+		create_screen(rows, cols);
+	      redraw = 0;
+	      /* Keep the lines of large files that have not been used recently out of memory */
+	      trim_frames();
+	    }
+	  
+	  /* Continue searching and counting until there is input to process, and show how it went */
+	  while (isearch_pending() && (poll(&input, 1, 0) == 0))
+	    if (isearch_continue() && (escape == -1) && (keys.length == 0) && (utf8_pending == 0))
+	      create_screen(rows, cols);
+	  
+	  /* Continue loading files until there is input to process */
+	  while (loading && (poll(&input, 1, 0) == 0))
+	    {
+	      size_t progress = cur_frame->loaded * 100 / (cur_frame->content_size ? cur_frame->content_size : 1);
+	      loading = load_files(LOAD_STEP);
+	      if ((progress != cur_frame->loaded * 100 / (cur_frame->content_size ? cur_frame->content_size : 1))
+		  && (escape == -1) && (keys.length == 0) && (utf8_pending == 0))
+		create_screen(rows, cols);
+	    }
+	  
+	  /* Read all input that is available, the keys are applied before the screen is updated */
+	  ptr = 0;
+	  got = read(STDIN_FILENO, buffer, sizeof(buffer));
+	  if ((got < 0) && (errno == EINTR))
+	    {
+	      got = 0;
+	      continue;
+	    }
+	  if (got <= 0)
+	    break;
+	}
+      
+      int c = (unsigned char)*(buffer + ptr++);
+      redraw = 1;
+      if (pasting)
+	{
+	  /* Pasted text is inserted as is, until the terminal reports the end of the paste */
+	  if (c == *(PASTE_END + paste_end))
+	    {
+	      if (*(PASTE_END + ++paste_end) == '\0')
 		{
-		  switch (c)
-		    {
-		    case 'A':
-		      /* up */
-		      break;
-		      
-		    case 'B':
-		      /* down */
-		      break;
-		      
-		    case 'C':
-		      /* right */
-		      break;
-		      
-		    case 'D':
-		      /* left */
-		      break;
-		      
-		    case '~':
-		      /* ... */
-		      break;
-		      
-		    default:
-		      /* not recognised */
-		      break;
-		    }
-		  escape = -1;
+		  if (pasted)
+		    insert_pasted(paste, pasted);
+		  pasted = 0;
+		  pasting = paste_end = utf8_pending = 0;
 		}
 	      continue;
 	    }
+	  if (paste_size < pasted + paste_end + 1)
+	    {
+	      paste_size = (pasted + paste_end + 1) << 1;
+	      paste = realloc(paste, (size_t)paste_size * sizeof(char_t));
+	    }
+	  /* It was not the end of the paste after all */
+	  for (i = 0; i < paste_end; i++)
+	    *(paste + pasted++) = (char_t)*(PASTE_END + i);
+	  if ((paste_end = (c == *PASTE_END)))
+	    continue;
+	  if ((c & 0xC0) == 0x80)
+	    {
+	      if (utf8_pending == 0)
+		continue;
+	      utf8_char = (utf8_char << 6) | (c & 0x3F);
+	      if (--utf8_pending)
+		continue;
+	    }
+	  else if (c & 0x80)
+	    {
+	      for (utf8_pending = 0; c & (0x40 >> utf8_pending);)
+		utf8_pending++;
+	      utf8_char = c & (0x3F >> utf8_pending);
+	      continue;
+	    }
+	  else
+	    utf8_char = (char_t)c;
+	  /* Terminals send line breaks as carriage returns, but text may have both */
+	  if ((utf8_char != '\n') || !paste_cr)
+	    *(paste + pasted++) = utf8_char == '\r' ? '\n' : utf8_char;
+	  paste_cr = utf8_char == '\r';
+	  continue;
 	}
-      if (escape == -2) /* ESC O */
+      was_escape = after_escape;
+      after_escape = c == KEY_ESCAPE;
+      
+      /* Turn the input into keys */
+      if (escape >= 0) /* ESC [ */
 	{
-	  switch (c)
+	  if ((('0' <= c) && (c <= '9')) || (c == ';'))
 	    {
-	    case 'H':
-	      /* home */
-	      break;
-	      
-	    case 'F':
-	      /* end */
-	      break;
-	      
-	    default:
-	      /* not recognised */
-	      break;
+	      if (escape == sizeof(escape_buffer) / sizeof(char))
+		/* Too long, stop. */
+		escape = -1;
+	      else
+		escape_buffer[escape++] = (char)c;
+	      continue;
 	    }
+	  if (c == '~')
+	    {
+	      for (number = 0, i = 0; (i < escape) && (escape_buffer[i] != ';'); i++)
+		number = number * 10 + (escape_buffer[i] & 15);
+	      if ((number == 1) || (number == 7))
+		key = KEY_HOME;
+	      else if ((number == 4) || (number == 8))
+		key = KEY_END;
+	      else
+		key = KEY_TILDE((keycode_t)number);
+	    }
+	  else
+	    key = KEY_CSI((keycode_t)c);
 	  escape = -1;
-	}
-      else if (c == '\033')
-	{
-	  meta += 1;
-	  if (meta == 3)
+	  if (key == KEY_PASTE)
 	    {
-	      meta = 0;
-	      /* help */
+	      /* Beginning of bracketed paste */
+	      pasting = 1;
+	      paste_cr = 0;
+	      continue;
 	    }
 	}
-      else if (meta)
+      else if (escape == -2) /* ESC O */
 	{
-	  if (ctrl_x == 0)
-	    switch (c)
-	      {
-	      case 'O':
-		escape = -2;
-		break;
-		
-	      case 'g':
-		/* jump */
-		break;
-		
-	      case 'i':
-		/* tab */
-		break;
-		
-	      case 'l':
-		/* lower case */
-		break;
-		
-	      case 'u':
-		/* upper case */
-		break;
-		
-	      case 'v':
-		/* page up */
-		break;
-		
-	      case 'w':
-		/* copy */
-		break;
-		
-	      case 'y':
-		/* cycle paste */
-		break;
-		
-	      case '[':
-		escape = 0;
-		break;
-		
-	      default:
-		/* not recognised */
-		break;
-	      }
-	  ctrl_x = 0;
-	  meta = 0;
+	  key = KEY_CSI((keycode_t)c);
+	  escape = -1;
 	}
-      else if (ctrl_x == 0)
+      else if (was_escape && ((c == '[') || (c == 'O')))
 	{
-	  switch (c)
-	    {
-	    case CTRL('@'):
-	      /* set mark */
-	      break;
-	      
-	    case CTRL('A'):
-	      /* home */
-	      break;
-	      
-	    case CTRL('B'):
-	      /* backwards */
-	      break;
-	      
-	    case CTRL('D'):
-	      /* delete */
-	      break;
-	      
-	    case CTRL('E'):
-	      /* end */
-	      break;
-	      
-	    case CTRL('F'):
-	      /* forward */
-	      break;
-	      
-	    case CTRL('G'):
-	      /* quit action */
-	      break;
-	    
-	    case CTRL('K'):
-	      /* kill */
-	      break;
-	      
-	    case CTRL('L'):
-	      /* recenter */
-	      break;
-	      
-	    case CTRL('M'):
-	      /* new line */
-	      break;
-	      
-	    case CTRL('N'):
-	      /* next line */
-	      break;
-	      
-	    case CTRL('O'):
-	      /* insert new line */
-	      break;
-	      
-	    case CTRL('P'):
-	      /* previous line */
-	      break;
-	      
-	    case CTRL('Q'):
-	      /* verbatim input */
-	      break;
-	    
-	    case CTRL('R'):
-	      /* search backwards */
-	      break;
-	      
-	    case CTRL('S'):
-	      /* search */
-	      break;
-	      
-	    case CTRL('T'):
-	      /* transpose */
-	      break;
-	      
-	    case CTRL('V'):
-	      /* page down */
-	      break;
-	      
-	    case CTRL('W'):
-	      /* cut */
-	      break;
-	      
-	    case CTRL('X'):
-	      ctrl_x = 1;
-	      break;
-	      
-	    case CTRL('Y'):
-	      /* paste */
-	      break;
-	      
-	    case CTRL('_'):
-	      /* undo */
-	      break;
-	      
-	    case '\t':
-	      /* tab */
-	      break;
-	      
-	    case '\n':
-	      /* new line */
-	      break;
-	      
-	    case 127:
-	    case CTRL('H'):
-	      /* erase */
-	      break;
-	      
-	    default:
-	      /* charcter? */
-	      break;
-	    }
+	  /* The ESC did not start a meta sequence, it is part of a key that is not a character */
+	  keymap_reset(&keys);
+	  escape = c == '[' ? 0 : -2;
+	  continue;
+	}
+      else if ((c & 0xC0) == 0x80)
+	{
+	  /* Continuation of a multibyte character */
+	  if (utf8_pending == 0)
+	    continue;
+	  utf8_char = (utf8_char << 6) | (c & 0x3F);
+	  if (--utf8_pending)
+	    continue;
+	  key = (keycode_t)utf8_char;
+	}
+      else if (c & 0x80)
+	{
+	  /* Beginning of a multibyte character */
+	  for (utf8_pending = 0; c & (0x40 >> utf8_pending);)
+	    utf8_pending++;
+	  utf8_char = c & (0x3F >> utf8_pending);
+	  continue;
 	}
       else
 	{
-	  switch (c)
+	  utf8_pending = 0;
+	  key = (keycode_t)c;
+	}
+      
+      /* Keys are used by the incremental search while it is active, until a key ends it */
+      if (isearch_active() && isearch_key(key))
+	continue;
+      
+      /* Keys are typed into the minibuffer while it is open */
+      if (minibuffer_active())
+	{
+	  minibuffer_key(key);
+	  continue;
+	}
+      
+      /* Run the command the key sequence is bound to, characters that are not bound insert themselves */
+      length = keys.length;
+      switch (keymap_lookup(&keys, key, &command))
+	{
+	case 1:
+	  /* Edits made by different commands are undone separately, characters typed in a row are undone together */
+	  undo_boundary(&(cur_frame->undo));
+	  if (command)
+	    command();
+	  undo_boundary(&(cur_frame->undo));
+	  break;
+	  
+	case -1:
+	  if ((length == 0) && (key >= ' ') && (key != KEY_CTRL('?')) && (key < KEY_SPECIAL))
 	    {
-	    case CTRL('C'):
-	      /* exit */
-	      return;
-	      
-	    case CTRL('F'):
-	      /* find file */
-	      break;
-	      
-	    case CTRL('I'):
-	      /* indent */
-	      break;
-	      
-	    case CTRL('K'):
-	      /* kill buffer */
-	      break;
-	      
-	    case CTRL('Q'):
-	      /* toggle read-only mode */
-	      break;
-	      
-	    case CTRL('R'):
-	      /* find file, read-only */
-	      break;
-	      
-	    case CTRL('S'):
-	      /* save */
-	      break;
-	      
-	    case CTRL('W'):
-	      /* save as */
-	      break;
-	      
-	    case CTRL('X'):
-	      /* swap mark */
-	      break;
-	      
-	    case CTRL('_'):
-	      /* switch undo direction */
-	      break;
-	      
-	    case 'k':
-	      /* kill buffer */
-	      break;
-	      
-	    case 'o':
-	      /* next buffer */
-	      break;
-	      
-	    case 's':
-	      /* save all, ask */
-	      break;
-	      
-	    default:
-	      /* not recognised */
-	      break;
+	      utf8_char = (char_t)key;
+	      insert_text(&utf8_char, 1);
 	    }
-	  ctrl_x = 0;
+	  break;
+	  
+	default:
+	  break;
 	}
     }
   
-#undef CRTL
+  free(paste);
+}
+
+
+/**
+ * Insert pasted text at the point
+ * 
+ * @param  text  The pasted characters, lines are separated by line feeds
+ * @param  n     The number of characters in `text`
+ */
+static void insert_pasted(const char_t* text, pos_t n)
+{
+  pos_t i;
+  
+  /* Only the first line can be searched for, and control characters would end the search */
+  if (isearch_active())
+    {
+      for (i = 0; (i < n) && (*(text + i) != '\n'); i++)
+	if (*(text + i) >= ' ')
+	  isearch_key((keycode_t)*(text + i));
+      return;
+    }
+  
+  /* Only the first line can be pasted into the minibuffer */
+  if (minibuffer_active())
+    {
+      for (i = 0; (i < n) && (*(text + i) != '\n'); i++)
+	minibuffer_key((keycode_t)*(text + i));
+      return;
+    }
+  
+  insert_region(text, n);
 }
 
@@ -28,8 +28,17 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
 
 #include "frames.h"
+#include "edit.h"
+#include "keymap.h"
+#include "minibuffer.h"
+#include "isearch.h"
+#include "recover.h"
+#include "screen.h"
 #include "types.h"
 
 
@@ -48,6 +57,20 @@
 #endif
 
 
+/**
+ * The number of bytes to read from the terminal at a time
+ */
+#ifndef INPUT_BUFFER_SIZE
+#define INPUT_BUFFER_SIZE  4096
+#endif
+
+
+/**
+ * The sequence the terminal sends at the end of a bracketed paste
+ */
+#define PASTE_END  "\033[201~"
+
+
 #ifdef DEBUG
 #  define xfork()  ((pid_t)-1)
 #else
@@ -65,7 +88,15 @@ static void jump(const char* command);
 
 static void create_screen(pos_t rows, pos_t cols);
 
-static void read_input(pos_t cols);
+static void read_input(pos_t rows, pos_t cols);
+
+/**
+ * Insert pasted text at the point
+ * 
+ * @param  text  The pasted characters, lines are separated by line feeds
+ * @param  n     The number of characters in `text`
+ */
+static void insert_pasted(const char_t* text, pos_t n);
 
 
 #endif